@@ -0,0 +1,162 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Time Windowed Signal Aggregation
+
+Both the per-frame update and the flush are written as straight loops over
+restrict qualified arrays without branches, so the compiler is free to
+vectorize them. fmin() and fmax() already ignore NAN operands, which is how
+absent signals drop out of the extremes.
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aggregate.h"
+
+static void reset(struct aggregate *a)
+{
+    uint32_t i;
+
+    for (i = 0; i < a->nsignals; i++) {
+        a->min[i] = INFINITY;
+        a->max[i] = -INFINITY;
+        a->sum[i] = 0;
+        a->last[i] = NAN;
+        a->count[i] = 0;
+    }
+}
+
+int aggregate_init(struct aggregate *a, const struct dbc *db, uint64_t window)
+{
+    const size_t n = db->nsignals ? db->nsignals : 1;
+
+    memset(a, 0, sizeof(*a));
+    a->nsignals = db->nsignals;
+    a->window = window;
+
+    a->min = malloc(n * sizeof(double));
+    a->max = malloc(n * sizeof(double));
+    a->sum = malloc(n * sizeof(double));
+    a->last = malloc(n * sizeof(double));
+    a->count = malloc(n * sizeof(uint32_t));
+    a->result_min = calloc(n, sizeof(double));
+    a->result_max = calloc(n, sizeof(double));
+    a->result_mean = calloc(n, sizeof(double));
+    a->result_last = calloc(n, sizeof(double));
+    a->result_count = calloc(n, sizeof(uint32_t));
+
+    if (NULL == a->min || NULL == a->max || NULL == a->sum ||
+        NULL == a->last || NULL == a->count ||
+        NULL == a->result_min || NULL == a->result_max ||
+        NULL == a->result_mean || NULL == a->result_last ||
+        NULL == a->result_count) {
+        aggregate_free(a);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    reset(a);
+    return 0;
+}
+
+void aggregate_free(struct aggregate *a)
+{
+    free(a->min);
+    free(a->max);
+    free(a->sum);
+    free(a->last);
+    free(a->count);
+    free(a->result_min);
+    free(a->result_max);
+    free(a->result_mean);
+    free(a->result_last);
+    free(a->result_count);
+    memset(a, 0, sizeof(*a));
+}
+
+void aggregate_add(
+    struct aggregate *a,
+    uint64_t now,
+    const struct dbc_message *msg,
+    const double *values)
+{
+    double *restrict min = &a->min[msg->first];
+    double *restrict max = &a->max[msg->first];
+    double *restrict sum = &a->sum[msg->first];
+    double *restrict last = &a->last[msg->first];
+    uint32_t *restrict count = &a->count[msg->first];
+    const double *restrict v = values;
+    uint16_t i;
+
+    if (!a->started) {
+        a->start = now - now % a->window;
+        a->started = 1;
+    }
+
+    for (i = 0; i < msg->count; i++) {
+        const int present = (v[i] == v[i]);
+
+        min[i] = fmin(min[i], v[i]);
+        max[i] = fmax(max[i], v[i]);
+        sum[i] += present ? v[i] : 0.0;
+        last[i] = present ? v[i] : last[i];
+        count[i] += present;
+    }
+}
+
+void aggregate_flush(struct aggregate *a, uint64_t now)
+{
+    double *restrict min = a->min;
+    double *restrict max = a->max;
+    double *restrict sum = a->sum;
+    double *restrict last = a->last;
+    uint32_t *restrict count = a->count;
+    double *restrict result_min = a->result_min;
+    double *restrict result_max = a->result_max;
+    double *restrict result_mean = a->result_mean;
+    double *restrict result_last = a->result_last;
+    uint32_t *restrict result_count = a->result_count;
+    uint32_t i;
+
+    for (i = 0; i < a->nsignals; i++) {
+        result_min[i] = min[i];
+        result_max[i] = max[i];
+        result_mean[i] = sum[i] / count[i];
+        result_last[i] = last[i];
+        result_count[i] = count[i];
+
+        min[i] = INFINITY;
+        max[i] = -INFINITY;
+        sum[i] = 0;
+        last[i] = NAN;
+        count[i] = 0;
+    }
+
+    a->result_start = a->start;
+    a->start = now - now % a->window;
+}
@@ -0,0 +1,96 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Time Windowed Signal Aggregation
+
+Accumulates the minimum, maximum, sum, count and last value of every signal of
+a DBC database over fixed time windows aligned to multiples of the window
+length. Accumulators are flat arrays indexed like the extraction plans, so
+memory depends only on the size of the database and not on the frame rate.
+
+Closing a window is one pass over the arrays which moves the accumulators into
+the result arrays, computes the means and resets the accumulators.
+*/
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdint.h>
+
+#include "dbc.h"
+
+struct aggregate
+{
+    /* Running accumulators of the open window */
+    double *min;
+    double *max;
+    double *sum;
+    double *last;
+    uint32_t *count;
+
+    /* Results of the most recently closed window */
+    double *result_min;
+    double *result_max;
+    double *result_mean;
+    double *result_last;
+    uint32_t *result_count;
+
+    uint32_t nsignals;
+    uint64_t window;    /* Window length in nanoseconds */
+    uint64_t start;     /* Start of the open window */
+    uint64_t result_start;
+    int started;        /* Whether a window has been opened yet */
+};
+
+/* Allocate accumulators for every signal of db. Returns 0 on success and -1
+ * with errno set on failure.
+ */
+int aggregate_init(struct aggregate *a, const struct dbc *db, uint64_t window);
+
+void aggregate_free(struct aggregate *a);
+
+/* Whether a frame at time now (in nanoseconds) falls outside the open window,
+ * meaning aggregate_flush() has to be called before adding it.
+ */
+static inline int aggregate_due(const struct aggregate *a, uint64_t now)
+{
+    return a->started && now >= a->start + a->window;
+}
+
+/* Fold the decoded values of msg into the open window. NAN values, signals not
+ * present in the frame, are skipped.
+ */
+void aggregate_add(
+    struct aggregate *a,
+    uint64_t now,
+    const struct dbc_message *msg,
+    const double *values);
+
+/* Close the open window into the result arrays and open the window which
+ * contains now. Signals without samples have a result count of 0.
+ */
+void aggregate_flush(struct aggregate *a, uint64_t now);
+
+#endif /* AGGREGATE_H */
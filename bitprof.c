@@ -0,0 +1,225 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Payload Bit Activity Profiler
+
+Bit n of the payload word is bit n % 8 of byte n / 8, so the word is the
+payload loaded little-endian. Bytes beyond the frame length are masked to
+zero, which makes a change of length show up as activity in the bytes that
+appeared or disappeared.
+*/
+
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitprof.h"
+
+/* Heatmap shades, by the share of frames in which a bit toggled */
+static const struct
+{
+    double below;
+    char shade;
+} shades[] = {
+    {0.01, '.'},
+    {0.05, ':'},
+    {0.10, '-'},
+    {0.25, '='},
+    {0.50, '+'},
+    {0.75, '*'},
+    {2.00, '#'},
+};
+
+int bitprof_init(struct bitprof *bp, uint32_t capacity)
+{
+    memset(bp, 0, sizeof(*bp));
+
+    bp->entries = idtable_init_entries(&bp->index, capacity, sizeof(*bp->entries));
+    if (NULL == bp->entries) {
+        return -1;
+    }
+
+    bp->capacity = capacity;
+    return 0;
+}
+
+void bitprof_free(struct bitprof *bp)
+{
+    idtable_free(&bp->index);
+    free(bp->entries);
+    memset(bp, 0, sizeof(*bp));
+}
+
+static uint64_t payload_word(const struct can_frame *frame)
+{
+    const uint8_t len = (frame->len > CAN_MAX_DLEN) ? CAN_MAX_DLEN : frame->len;
+    const uint64_t mask = (len == CAN_MAX_DLEN) ? UINT64_MAX : (UINT64_C(1) << (len * 8)) - 1;
+    uint64_t w;
+
+    memcpy(&w, frame->data, sizeof(w));
+    return le64toh(w) & mask;
+}
+
+void bitprof_add(struct bitprof *bp, uint64_t stamp, const struct can_frame *frame)
+{
+    const uint32_t key = idtable_key(frame->can_id);
+    const uint64_t w = payload_word(frame);
+    struct bitprof_entry *e;
+    uint32_t i;
+    uint64_t x;
+
+    i = idtable_find(&bp->index, key);
+    if (IDTABLE_EMPTY == i) {
+        i = bp->index.count;
+        if (1 != idtable_insert(&bp->index, key, i)) {
+            bp->dropped++;
+            return;
+        }
+
+        /* The first payload is the reference, nothing has changed yet */
+        e = &bp->entries[i];
+        e->can_id = key;
+        e->previous = w;
+        e->len = frame->len;
+        e->frames = 1;
+        return;
+    }
+
+    e = &bp->entries[i];
+    x = w ^ e->previous;
+    e->previous = w;
+    e->len = frame->len;
+    e->frames++;
+
+    if (0 == x) {
+        return;
+    }
+
+    e->changed |= x;
+    e->last = stamp;
+    if (0 == e->first) {
+        e->first = stamp;
+    }
+
+    /* Visit only the bits that toggled */
+    do {
+        e->toggles[__builtin_ctzll(x)]++;
+        x &= x - 1;
+    } while (0 != x);
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    const struct bitprof_entry *x = *(const struct bitprof_entry *const *)a;
+    const struct bitprof_entry *y = *(const struct bitprof_entry *const *)b;
+    return (x->can_id > y->can_id) - (x->can_id < y->can_id);
+}
+
+static char shade(const struct bitprof_entry *e, unsigned int bit)
+{
+    double rate;
+    size_t i;
+
+    if (0 == (e->changed & (UINT64_C(1) << bit))) {
+        return ' ';
+    }
+
+    rate = (double)e->toggles[bit] / e->frames;
+    for (i = 0; i < sizeof(shades) / sizeof(shades[0]) - 1; i++) {
+        if (rate < shades[i].below) {
+            break;
+        }
+    }
+    return shades[i].shade;
+}
+
+static void print_time(FILE *fp, uint64_t stamp)
+{
+    if (0 == stamp) {
+        fprintf(fp, " %20s", "-");
+    } else {
+        fprintf(fp, " %10llu.%09llu",
+                (unsigned long long)(stamp / 1000000000),
+                (unsigned long long)(stamp % 1000000000));
+    }
+}
+
+void bitprof_report(const struct bitprof *bp, FILE *fp)
+{
+    const struct bitprof_entry **sorted;
+    uint32_t i;
+
+    sorted = malloc((bp->index.count ? bp->index.count : 1) * sizeof(*sorted));
+    if (NULL == sorted) {
+        return;
+    }
+
+    for (i = 0; i < bp->index.count; i++) {
+        sorted[i] = &bp->entries[i];
+    }
+    qsort(sorted, bp->index.count, sizeof(*sorted), compare_ids);
+
+    fprintf(fp,
+        "Bit activity per ID, each byte printed from bit 7 down to bit 0\n"
+        "(share of frames a bit toggled in: ' ' never, '.' <1%%, ':' <5%%, "
+        "'-' <10%%, '=' <25%%, '+' <50%%, '*' <75%%, '#' more)\n"
+        "%-8s %10s %5s  %-71s %20s %20s\n",
+        "ID", "Frames", "Bits", "Payload", "First change", "Last change");
+
+    for (i = 0; i < bp->index.count; i++) {
+        const struct bitprof_entry *e = sorted[i];
+        int byte;
+        int bit;
+
+        if (e->can_id & CAN_EFF_FLAG) {
+            fprintf(fp, "%08X", e->can_id & CAN_EFF_MASK);
+        } else {
+            fprintf(fp, "%03X     ", e->can_id);
+        }
+
+        fprintf(fp, " %10llu %2d/%-2d ",
+                (unsigned long long)e->frames,
+                __builtin_popcountll(e->changed),
+                e->len * 8);
+
+        for (byte = 0; byte < CAN_MAX_DLEN; byte++) {
+            fputc(' ', fp);
+            for (bit = 7; bit >= 0; bit--) {
+                fputc(shade(e, byte * 8 + bit), fp);
+            }
+        }
+
+        print_time(fp, e->first);
+        print_time(fp, e->last);
+        fputc('\n', fp);
+    }
+
+    if (bp->dropped) {
+        fprintf(fp, "%llu frames of IDs beyond the first %u were not profiled\n",
+                (unsigned long long)bp->dropped, bp->capacity);
+    }
+
+    free(sorted);
+}
@@ -0,0 +1,81 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Payload Bit Activity Profiler
+
+Tracks, for every CAN ID seen on the bus, which payload bits have ever
+changed, how often each bit toggled and when the payload first and last
+changed. The whole classic CAN payload is handled as one 64-bit word: the
+changed bits of a frame are the XOR against the previous payload, they are
+ORed into the activity mask and only the set bits are visited to count
+toggles.
+*/
+
+#ifndef BITPROF_H
+#define BITPROF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <linux/can.h>
+
+#include "idtable.h"
+
+#define BITPROF_BITS (CAN_MAX_DLEN * 8)
+
+struct bitprof_entry
+{
+    uint64_t previous;  /* Payload of the last frame */
+    uint64_t changed;   /* Every bit which has ever changed */
+    uint64_t frames;
+    uint64_t first;     /* Time of the first change in nanoseconds, 0 if none */
+    uint64_t last;      /* Time of the last change in nanoseconds */
+    uint32_t toggles[BITPROF_BITS];
+    canid_t can_id;
+    uint8_t len;
+};
+
+struct bitprof
+{
+    struct idtable index;   /* Maps CAN IDs to entries */
+    struct bitprof_entry *entries;
+    uint32_t capacity;
+    uint64_t dropped;       /* Frames of IDs which did not fit the table */
+};
+
+/* Allocate a profiler for up to capacity distinct IDs. Returns 0 on success
+ * and -1 with errno set on failure.
+ */
+int bitprof_init(struct bitprof *bp, uint32_t capacity);
+
+void bitprof_free(struct bitprof *bp);
+
+/* Account for a received frame, stamped in nanoseconds */
+void bitprof_add(struct bitprof *bp, uint64_t stamp, const struct can_frame *frame);
+
+/* Print one heatmap row per ID, sorted by ID */
+void bitprof_report(const struct bitprof *bp, FILE *fp);
+
+#endif /* BITPROF_H */
@@ -0,0 +1,431 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Network Bridge Benchmark
+
+This program measures the latency and overhead of carrying CAN frames over a
+TCP connection the way the bridge demo does. A sender feeds frames at a fixed
+rate through a stream writer (see canstream.h) into a connection over the
+loopback interface, and a receiving thread decodes them. Every frame carries
+the time it was handed to the writer in its payload, so the receiver measures
+the latency of each frame from end to end.
+
+Each rate is run with every frame sent at once, then with batches bounded by
+the flush timeout, and the fastest rate also with zero-copy sends. The bytes
+per frame on the stream, and on the wire counting a 52 byte IPv4 and TCP
+header with timestamps per segment, show what the batching saves.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <linux/can.h>
+#include <linux/tcp.h>
+
+#include "cannelloni.h"
+#include "canstream.h"
+
+#define VERSION "2.0.0"
+
+#define NIDS (200)
+#define DEFAULT_SECONDS (1)
+#define DEFAULT_TIMEOUT_US (1000)
+
+/* Frames sent as fast as possible */
+#define FLAT_OUT_FRAMES (1 << 21)
+
+/* Frames handed over at once when sending as fast as possible, as many as the
+ * bridge reads from its CAN socket in one call
+ */
+#define BATCH (64)
+
+/* IPv4 and TCP headers, with the timestamp option, of one segment */
+#define SEGMENT_OVERHEAD (52)
+
+struct args
+{
+    unsigned long seconds;
+    unsigned long timeout;
+};
+
+struct run
+{
+    unsigned long rate;     /* Frames per second, 0 for as fast as possible */
+    uint64_t timeout;       /* Flush timeout in nanoseconds */
+    int zerocopy;
+};
+
+struct receiver
+{
+    int fd;
+    uint64_t *latency;
+    uint64_t expected;
+    uint64_t received;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS]\n"
+        "\n"
+        "Options:\n"
+        "  --seconds, -s N  Send at each rate for N seconds (default: %d)\n"
+        "  --timeout, -t US Flush timeout of the batching runs in microseconds\n"
+        "                   (default: %d)\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, DEFAULT_SECONDS, DEFAULT_TIMEOUT_US
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"seconds", required_argument, NULL, 's'},
+        {"timeout", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    args->seconds = DEFAULT_SECONDS;
+    args->timeout = DEFAULT_TIMEOUT_US;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "s:t:Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 's':
+            args->seconds = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->seconds) {
+                error(EXIT_FAILURE, 0, "invalid duration: %s", optarg);
+            }
+            break;
+        case 't':
+            args->timeout = strtoul(optarg, &end, 0);
+            if ('\0' != *end || end == optarg) {
+                error(EXIT_FAILURE, 0, "invalid timeout: %s", optarg);
+            }
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc != optind) {
+        error(0, 0, "no arguments expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts;
+
+    ts.tv_sec = t / 1000000000;
+    ts.tv_nsec = t % 1000000000;
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+    }
+}
+
+/* A connected pair of TCP sockets over the loopback interface */
+static void connect_pair(int *tx, int *rx)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    int listener;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (-1 == listener ||
+        -1 == bind(listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+        -1 == listen(listener, 1) ||
+        -1 == getsockname(listener, (struct sockaddr *)&addr, &len)) {
+        error(EXIT_FAILURE, errno, "listen");
+    }
+
+    *tx = socket(AF_INET, SOCK_STREAM, 0);
+    if (-1 == *tx || -1 == connect(*tx, (struct sockaddr *)&addr, sizeof(addr))) {
+        error(EXIT_FAILURE, errno, "connect");
+    }
+    *rx = accept(listener, NULL, NULL);
+    if (-1 == *rx) {
+        error(EXIT_FAILURE, errno, "accept");
+    }
+    close(listener);
+}
+
+static void *receive(void *arg)
+{
+    static uint8_t buf[4 * CANSTREAM_BUF_SIZE];
+    static struct can_frame frames[sizeof(buf) / 5];
+    struct receiver *r = arg;
+    size_t fill = 0;
+
+    while (r->received < r->expected) {
+        unsigned int count;
+        unsigned int i;
+        uint64_t now;
+        ssize_t n;
+        int used;
+
+        n = recv(r->fd, buf + fill, sizeof(buf) - fill, 0);
+        if (n <= 0) {
+            error(EXIT_FAILURE, errno, "recv");
+        }
+        now = monotonic_ns();
+        fill += n;
+
+        used = cannelloni_decode_stream(buf, fill, frames, sizeof(frames) / sizeof(frames[0]),
+                                        &count);
+        if (-1 == used) {
+            error(EXIT_FAILURE, 0, "malformed stream");
+        }
+        for (i = 0; i < count && r->received < r->expected; i++) {
+            uint64_t stamp;
+
+            memcpy(&stamp, frames[i].data, sizeof(stamp));
+            r->latency[r->received++] = now - stamp;
+        }
+        memmove(buf, buf + used, fill - used);
+        fill -= used;
+    }
+
+    return NULL;
+}
+
+/* Send whatever is buffered, waiting for the socket to take it */
+static void flush(struct canstream *s, int more)
+{
+    int rc;
+
+    while (0 != (rc = canstream_flush(s, more))) {
+        if (-1 == rc) {
+            error(EXIT_FAILURE, errno, "send");
+        }
+        sched_yield();
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t data_segments(int fd)
+{
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (-1 == getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len)) {
+        return 0;
+    }
+    return info.tcpi_data_segs_out;
+}
+
+static void bench(const struct run *run, const struct args *args)
+{
+    const uint64_t total = run->rate ? run->rate * args->seconds : FLAT_OUT_FRAMES;
+    struct receiver r;
+    struct canstream s;
+    struct can_frame frame;
+    pthread_t thread;
+    uint64_t segments;
+    uint64_t start;
+    uint64_t sum = 0;
+    uint64_t sent = 0;
+    double seconds;
+    char rate[32];
+    uint64_t i;
+    int tx;
+    int rc;
+
+    connect_pair(&tx, &r.fd);
+    if (-1 == canstream_init(&s, tx, run->timeout, run->zerocopy)) {
+        error(EXIT_FAILURE, errno, "stream");
+    }
+    if (run->zerocopy && !s.zerocopy) {
+        printf("%-10s zero-copy sends not supported\n", "");
+        canstream_free(&s);
+        close(tx);
+        close(r.fd);
+        return;
+    }
+
+    r.expected = total;
+    r.received = 0;
+    r.latency = malloc(total * sizeof(*r.latency));
+    if (NULL == r.latency) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+    rc = pthread_create(&thread, NULL, receive, &r);
+    if (0 != rc) {
+        error(EXIT_FAILURE, rc, "pthread_create");
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.len = CAN_MAX_DLEN;
+    segments = data_segments(tx);
+    start = monotonic_ns();
+
+    while (sent < total) {
+        uint64_t now = monotonic_ns();
+        uint64_t due = run->rate ? (now - start) * run->rate / 1000000000 + 1 : sent + BATCH;
+        uint64_t deadline;
+
+        if (due > total) {
+            due = total;
+        }
+
+        /* Hand over every frame due, each stamped with the time it was */
+        for (; sent < due; sent++) {
+            frame.can_id = 0x100 + sent % NIDS;
+            memcpy(frame.data, &now, sizeof(now));
+            if (-1 == canstream_add(&s, &frame, now)) {
+                flush(&s, 1);
+                canstream_add(&s, &frame, now);
+            }
+        }
+
+        deadline = canstream_deadline(&s);
+        if (now >= deadline) {
+            flush(&s, 0 == run->rate && sent < total);
+            deadline = UINT64_MAX;
+        }
+
+        if (run->rate) {
+            const uint64_t next = start + sent * 1000000000 / run->rate;
+            sleep_until((next < deadline) ? next : deadline);
+        }
+    }
+    flush(&s, 0);
+
+    pthread_join(thread, NULL);
+    seconds = (monotonic_ns() - start) / 1e9;
+    segments = data_segments(tx) - segments;
+
+    for (i = 0; i < total; i++) {
+        sum += r.latency[i];
+    }
+    qsort(r.latency, total, sizeof(*r.latency), compare_u64);
+
+    if (run->rate) {
+        snprintf(rate, sizeof(rate), "%lu/s", run->rate);
+    } else {
+        snprintf(rate, sizeof(rate), "flat out");
+    }
+    printf("%-10s %-10s %10.0f %8.2f %8.2f %8.1f %9.1f %9.1f %9.1f\n",
+           rate, run->zerocopy ? "zero-copy" : run->timeout ? "adaptive" : "immediate",
+           total / seconds, (double)s.bytes / total,
+           (double)(s.bytes + segments * SEGMENT_OVERHEAD) / total,
+           (double)total / s.sends, sum / 1e3 / total,
+           r.latency[total * 99 / 100] / 1e3, r.latency[total - 1] / 1e3);
+
+    if (run->zerocopy) {
+        canstream_reap(&s);
+        printf("%-10s %llu of %llu zero-copy sends copied by the kernel after all\n", "",
+               (unsigned long long)s.zerocopy_copied, (unsigned long long)s.zerocopy_sends);
+    }
+
+    free(r.latency);
+    canstream_free(&s);
+    close(tx);
+    close(r.fd);
+}
+
+int main(int argc, char **argv)
+{
+    struct args args;
+    size_t i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    /* A quiet bus, a full 1 Mbit/s bus, several buses together, and flat out */
+    const unsigned long rates[] = {1000, 9000, 100000, 0};
+    const uint64_t timeout = args.timeout * 1000;
+
+    printf("%-10s %-10s %10s %8s %8s %8s %9s %9s %9s\n", "Rate", "Flush", "Frames/s",
+           "B/frame", "Wire B/f", "Fr/send", "Mean us", "p99 us", "Max us");
+
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        const struct run immediate = {rates[i], 0, 0};
+        const struct run adaptive = {rates[i], timeout, 0};
+
+        bench(&immediate, &args);
+        bench(&adaptive, &args);
+        if (0 == rates[i]) {
+            const struct run zerocopy = {rates[i], timeout, 1};
+            bench(&zerocopy, &args);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
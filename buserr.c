@@ -0,0 +1,240 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Bus Health Metrics
+
+An error frame is first reduced to a mask with one bit per counter it
+increments, so counting, state tracking and printing all work from the same
+decoding. The class is in the CAN ID and the details are in the payload, see
+linux/can/error.h.
+*/
+
+#include <string.h>
+
+#include <linux/can/error.h>
+
+#include "buserr.h"
+
+#define BIT(counter) (UINT32_C(1) << (counter))
+
+static const char *const names[BUSERR_COUNTERS] = {
+    [BUSERR_TX_TIMEOUT] = "tx-timeout",
+    [BUSERR_LOST_ARBITRATION] = "lost-arbitration",
+    [BUSERR_RX_OVERFLOW] = "rx-overflow",
+    [BUSERR_TX_OVERFLOW] = "tx-overflow",
+    [BUSERR_WARNING] = "error-warning",
+    [BUSERR_PASSIVE] = "error-passive",
+    [BUSERR_PROTOCOL] = "protocol",
+    [BUSERR_BIT] = "bit",
+    [BUSERR_FORM] = "form",
+    [BUSERR_STUFF] = "stuff",
+    [BUSERR_CRC] = "crc",
+    [BUSERR_TRANSCEIVER] = "transceiver",
+    [BUSERR_NO_ACK] = "no-ack",
+    [BUSERR_BUS_OFF] = "bus-off",
+    [BUSERR_BUS_ERROR] = "bus-error",
+    [BUSERR_RESTARTED] = "restarted",
+    [BUSERR_TX_RETRY] = "tx-retry",
+    [BUSERR_ERROR_FRAMES] = "error-frames",
+    [BUSERR_RX_FRAMES] = "rx-frames",
+    [BUSERR_TX_FRAMES] = "tx-frames",
+};
+
+static const char *const states[] = {
+    [BUSERR_ACTIVE] = "error-active",
+    [BUSERR_STATE_WARNING] = "error-warning",
+    [BUSERR_STATE_PASSIVE] = "error-passive",
+    [BUSERR_STATE_BUS_OFF] = "bus-off",
+};
+
+void buserr_init(struct buserr *b, const char *iface, uint64_t now)
+{
+    memset(b, 0, sizeof(*b));
+    b->iface = iface;
+    b->since = now;
+    b->state = BUSERR_ACTIVE;
+}
+
+/* The counters an error frame increments */
+static uint32_t classify(const struct can_frame *frame)
+{
+    const canid_t class = frame->can_id & CAN_ERR_MASK;
+    const uint8_t *d = frame->data;
+    uint32_t m = BIT(BUSERR_ERROR_FRAMES);
+
+    if (class & CAN_ERR_TX_TIMEOUT) {
+        m |= BIT(BUSERR_TX_TIMEOUT);
+    }
+
+    if (class & CAN_ERR_LOSTARB) {
+        m |= BIT(BUSERR_LOST_ARBITRATION) | BIT(BUSERR_TX_RETRY);
+    }
+
+    if (class & CAN_ERR_CRTL) {
+        if (d[1] & CAN_ERR_CRTL_RX_OVERFLOW) {
+            m |= BIT(BUSERR_RX_OVERFLOW);
+        }
+        if (d[1] & CAN_ERR_CRTL_TX_OVERFLOW) {
+            m |= BIT(BUSERR_TX_OVERFLOW);
+        }
+        if (d[1] & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING)) {
+            m |= BIT(BUSERR_WARNING);
+        }
+        if (d[1] & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE)) {
+            m |= BIT(BUSERR_PASSIVE);
+        }
+    }
+
+    if (class & CAN_ERR_PROT) {
+        m |= BIT(BUSERR_PROTOCOL);
+        if (d[2] & (CAN_ERR_PROT_BIT | CAN_ERR_PROT_BIT0 | CAN_ERR_PROT_BIT1)) {
+            m |= BIT(BUSERR_BIT);
+        }
+        if (d[2] & CAN_ERR_PROT_FORM) {
+            m |= BIT(BUSERR_FORM);
+        }
+        if (d[2] & CAN_ERR_PROT_STUFF) {
+            m |= BIT(BUSERR_STUFF);
+        }
+        if (CAN_ERR_PROT_LOC_CRC_SEQ == d[3] || CAN_ERR_PROT_LOC_CRC_DEL == d[3]) {
+            m |= BIT(BUSERR_CRC);
+        }
+        if (d[2] & CAN_ERR_PROT_TX) {
+            m |= BIT(BUSERR_TX_RETRY);
+        }
+    }
+
+    if (class & CAN_ERR_TRX) {
+        m |= BIT(BUSERR_TRANSCEIVER);
+    }
+
+    if (class & CAN_ERR_ACK) {
+        m |= BIT(BUSERR_NO_ACK) | BIT(BUSERR_TX_RETRY);
+    }
+
+    if (class & CAN_ERR_BUSOFF) {
+        m |= BIT(BUSERR_BUS_OFF);
+    }
+
+    if (class & CAN_ERR_BUSERROR) {
+        m |= BIT(BUSERR_BUS_ERROR);
+    }
+
+    if (class & CAN_ERR_RESTARTED) {
+        m |= BIT(BUSERR_RESTARTED);
+    }
+
+    return m;
+}
+
+void buserr_add(struct buserr *b, const struct can_frame *frame)
+{
+    uint32_t m;
+
+    if (0 == (frame->can_id & CAN_ERR_FLAG)) {
+        b->counts[BUSERR_RX_FRAMES]++;
+        return;
+    }
+
+    m = classify(frame);
+    while (0 != m) {
+        b->counts[__builtin_ctz(m)]++;
+        m &= m - 1;
+    }
+
+    /* Follow the controller through its error states */
+    if (frame->can_id & CAN_ERR_BUSOFF) {
+        b->state = BUSERR_STATE_BUS_OFF;
+    } else if ((frame->can_id & CAN_ERR_RESTARTED) ||
+               ((frame->can_id & CAN_ERR_CRTL) && (frame->data[1] & CAN_ERR_CRTL_ACTIVE))) {
+        b->state = BUSERR_ACTIVE;
+    } else if ((frame->can_id & CAN_ERR_CRTL) &&
+               (frame->data[1] & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE))) {
+        b->state = BUSERR_STATE_PASSIVE;
+    } else if ((frame->can_id & CAN_ERR_CRTL) &&
+               (frame->data[1] & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING))) {
+        b->state = BUSERR_STATE_WARNING;
+    }
+
+    if (frame->can_id & CAN_ERR_CNT) {
+        b->tec = frame->data[6];
+        b->rec = frame->data[7];
+        b->have_counters = 1;
+    }
+}
+
+void buserr_print(const struct can_frame *frame, FILE *fp)
+{
+    uint32_t m = classify(frame) & ~BIT(BUSERR_ERROR_FRAMES);
+
+    fputs("ERR:", fp);
+    while (0 != m) {
+        fprintf(fp, " %s", names[__builtin_ctz(m)]);
+        m &= m - 1;
+    }
+
+    if ((frame->can_id & CAN_ERR_LOSTARB) && CAN_ERR_LOSTARB_UNSPEC != frame->data[0]) {
+        fprintf(fp, " (at bit %u)", frame->data[0]);
+    }
+
+    if (frame->can_id & CAN_ERR_CNT) {
+        fprintf(fp, " (TEC %u, REC %u)", frame->data[6], frame->data[7]);
+    }
+
+    fputc('\n', fp);
+}
+
+void buserr_report(struct buserr *b, uint64_t now, FILE *fp)
+{
+    const double seconds = (now > b->since) ? (now - b->since) / 1e9 : 0;
+    const uint64_t sent = b->counts[BUSERR_TX_FRAMES] - b->reported[BUSERR_TX_FRAMES];
+    const uint64_t retries = b->counts[BUSERR_TX_RETRY] - b->reported[BUSERR_TX_RETRY];
+    int i;
+
+    fprintf(fp, "Bus health of %s over the last %.3f s: %s", b->iface, seconds, states[b->state]);
+    if (b->have_counters) {
+        fprintf(fp, ", TEC %u, REC %u", b->tec, b->rec);
+    }
+    if (sent > 0) {
+        fprintf(fp, ", %.2f inferred retries per sent frame", (double)retries / sent);
+    }
+    fprintf(fp, "\n%-18s %12s %12s\n", "Counter", "Total", "Per second");
+
+    /* Traffic is always shown, errors only once they happened */
+    for (i = 0; i < BUSERR_COUNTERS; i++) {
+        const uint64_t delta = b->counts[i] - b->reported[i];
+
+        if (0 == b->counts[i] && i != BUSERR_RX_FRAMES && i != BUSERR_TX_FRAMES) {
+            continue;
+        }
+
+        fprintf(fp, "%-18s %12llu %12.1f\n", names[i],
+                (unsigned long long)b->counts[i],
+                (seconds > 0) ? delta / seconds : 0.0);
+    }
+
+    memcpy(b->reported, b->counts, sizeof(b->reported));
+    b->since = now;
+}
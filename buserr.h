@@ -0,0 +1,114 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Bus Health Metrics
+
+Decodes the error frames SocketCAN delivers when a raw socket sets
+CAN_RAW_ERR_FILTER, and keeps counters of every error class for one
+interface, along with the controller's error state and error counters and the
+number of frames received and sent. Reports give both totals and rates over
+the time since the previous report.
+
+The kernel does not report retransmissions. They are inferred from the errors
+which make a controller send a frame again: lost arbitration, a missing
+acknowledgement, and protocol errors flagged as occurring during transmission.
+*/
+
+#ifndef BUSERR_H
+#define BUSERR_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <linux/can.h>
+
+enum buserr_counter
+{
+    BUSERR_TX_TIMEOUT,
+    BUSERR_LOST_ARBITRATION,
+    BUSERR_RX_OVERFLOW,
+    BUSERR_TX_OVERFLOW,
+    BUSERR_WARNING,
+    BUSERR_PASSIVE,
+    BUSERR_PROTOCOL,
+    BUSERR_BIT,
+    BUSERR_FORM,
+    BUSERR_STUFF,
+    BUSERR_CRC,
+    BUSERR_TRANSCEIVER,
+    BUSERR_NO_ACK,
+    BUSERR_BUS_OFF,
+    BUSERR_BUS_ERROR,
+    BUSERR_RESTARTED,
+    BUSERR_TX_RETRY,    /* Inferred, not reported by the kernel */
+    BUSERR_ERROR_FRAMES,
+    BUSERR_RX_FRAMES,
+    BUSERR_TX_FRAMES,
+    BUSERR_COUNTERS
+};
+
+enum buserr_state
+{
+    BUSERR_ACTIVE,
+    BUSERR_STATE_WARNING,
+    BUSERR_STATE_PASSIVE,
+    BUSERR_STATE_BUS_OFF,
+};
+
+struct buserr
+{
+    const char *iface;
+    uint64_t counts[BUSERR_COUNTERS];
+    uint64_t reported[BUSERR_COUNTERS]; /* Counts at the previous report */
+    uint64_t since;         /* Time of the previous report */
+    enum buserr_state state;
+    int have_counters;      /* Whether the driver reported TEC and REC */
+    uint8_t tec;            /* Transmit error counter */
+    uint8_t rec;            /* Receive error counter */
+};
+
+/* The error classes worth capturing, for CAN_RAW_ERR_FILTER */
+#define BUSERR_MASK (CAN_ERR_MASK)
+
+void buserr_init(struct buserr *b, const char *iface, uint64_t now);
+
+/* Account for a received frame, error frame or not */
+void buserr_add(struct buserr *b, const struct can_frame *frame);
+
+/* Account for a frame sent on the interface */
+static inline void buserr_sent(struct buserr *b)
+{
+    b->counts[BUSERR_TX_FRAMES]++;
+}
+
+/* Print the error classes of an error frame as a single line */
+void buserr_print(const struct can_frame *frame, FILE *fp);
+
+/* Print totals and the rates since the previous report, then start a new
+ * reporting period
+ */
+void buserr_report(struct buserr *b, uint64_t now, FILE *fp);
+
+#endif /* BUSERR_H */
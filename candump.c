@@ -0,0 +1,418 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+candump Log Reader
+
+A line is taken apart in a single pass without copying it. The timestamp and
+the CAN ID are short and converted digit by digit. The payload, up to sixteen
+hex digits, is decoded in one go with vector operations (see hexvec.h). The
+vector load may read past the end of the line into the next one, so it is
+only used while 16 bytes of the data remain.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "candump.h"
+#include "hexvec.h"
+
+/* Digits in a standard and an extended CAN ID */
+#define SFF_DIGITS (3)
+#define EFF_DIGITS (8)
+
+static const uint64_t scale[10] = {
+    1000000000, 100000000, 10000000, 1000000, 100000,
+    10000, 1000, 100, 10, 1,
+};
+
+int candump_open(struct candump *log, const char *path)
+{
+    struct stat st;
+    int saved;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    if (-1 == fstat(fd, &st)) {
+        goto fail;
+    }
+
+    candump_init(log, "", 0);
+    if (st.st_size > 0) {
+        log->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == log->map) {
+            log->map = NULL;
+            goto fail;
+        }
+        madvise(log->map, st.st_size, MADV_SEQUENTIAL);
+        log->data = log->map;
+        log->size = st.st_size;
+    }
+
+    close(fd);
+    return 0;
+
+fail:
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+}
+
+void candump_init(struct candump *log, const char *data, size_t size)
+{
+    memset(log, 0, sizeof(*log));
+    log->data = data;
+    log->size = size;
+}
+
+void candump_close(struct candump *log)
+{
+    if (NULL != log->map) {
+        munmap(log->map, log->size);
+    }
+    memset(log, 0, sizeof(*log));
+}
+
+/* Value of the eight decimal digits in v, first digit in the low byte, or -1 if one is not a digit. Each
+ * step merges neighbouring groups of digits in every lane at once.
+ */
+static int64_t decimal8(uint64_t v)
+{
+    v -= UINT64_C(0x3030303030303030);
+    if ((v | (v + UINT64_C(0x7676767676767676))) & UINT64_C(0x8080808080808080)) {
+        return -1;
+    }
+    v = v * 10 + (v >> 8);
+    return ((v & UINT64_C(0x000000FF000000FF)) * (100 + (UINT64_C(1000000) << 32)) +
+            ((v >> 16) & UINT64_C(0x000000FF000000FF)) * (1 + (UINT64_C(10000) << 32))) >> 32;
+}
+
+/* Parse the (SEC.USEC) written by candump, ten digits of seconds and six of
+ * microseconds, starting after the parenthesis. Returns -1 for any other
+ * layout.
+ */
+static int64_t fixed_stamp(const char *p, const char *end)
+{
+    uint64_t v;
+    int64_t sec;
+    int64_t usec;
+
+    if (end - p < 19 || '.' != p[10] || ')' != p[17] ||
+        (unsigned char)(p[0] - '0') >= 10 || (unsigned char)(p[1] - '0') >= 10) {
+        return -1;
+    }
+
+    memcpy(&v, p + 2, sizeof(v));
+    sec = decimal8(v);
+
+    /* The six digits, with the two bytes in front of them made zeros */
+    memcpy(&v, p + 9, sizeof(v));
+    usec = decimal8((v & ~UINT64_C(0xFFFF)) | 0x3030);
+
+    if (sec < 0 || usec < 0) {
+        return -1;
+    }
+    sec += ((p[0] - '0') * 10 + (p[1] - '0')) * INT64_C(100000000);
+    return sec * 1000000000 + usec * 1000;
+}
+
+/* Decode a payload of digits hex digits at p into out */
+static int decode(const struct candump *log, const char *p, size_t digits, uint8_t *out)
+{
+    if (digits % 2 || digits > 2 * CAN_MAX_DLEN) {
+        return -1;
+    }
+    if (log->data + log->size - p >= (ptrdiff_t)sizeof(hexvec_chars)) {
+        return hexvec_decode(p, digits, out);
+    }
+    return hexvec_decode_scalar(p, digits, out);
+}
+
+/* Channel number of an interface name, numbering new names as they appear */
+static int channel_of(struct candump *log, const char *name, size_t len)
+{
+    unsigned int i;
+
+    if (0 == len || len >= IFNAMSIZ) {
+        return -1;
+    }
+
+    /* Most logs come from one interface, or a few interleaved */
+    if (log->nchannels > 0 &&
+        0 == memcmp(log->channels[log->last], name, len) &&
+        '\0' == log->channels[log->last][len]) {
+        return log->last;
+    }
+
+    for (i = 0; i < log->nchannels; i++) {
+        if (0 == memcmp(log->channels[i], name, len) && '\0' == log->channels[i][len]) {
+            log->last = i;
+            return i;
+        }
+    }
+
+    if (log->nchannels >= CANDUMP_MAX_CHANNELS) {
+        return -1;
+    }
+
+    memcpy(log->channels[i], name, len);
+    log->channels[i][len] = '\0';
+    log->nchannels++;
+    log->last = i;
+    return i;
+}
+
+int candump_parse_line(struct candump *log, const char *line, const char *end,
+                       struct canlog_record *r)
+{
+    const char *p = line;
+    const char *name;
+    const char *payload;
+    uint64_t sec = 0;
+    uint64_t frac = 0;
+    unsigned int nfrac = 0;
+    int64_t stamp;
+    unsigned int digits;
+    uint32_t id = 0;
+    int channel;
+
+    if (end > line && '\r' == end[-1]) {
+        end--;
+    }
+
+    /* (SEC.FRACTION), nearly always in the layout candump writes */
+    if (p == end || '(' != *p++) {
+        return -1;
+    }
+    stamp = fixed_stamp(p, end);
+    if (stamp >= 0) {
+        p += 19;
+        goto interface;
+    }
+    for (digits = 0; p < end && (unsigned char)(*p - '0') < 10; p++, digits++) {
+        sec = sec * 10 + (*p - '0');
+    }
+    if (0 == digits || digits > 12 || p == end || '.' != *p++) {
+        return -1;
+    }
+    for (; p < end && (unsigned char)(*p - '0') < 10; p++) {
+        /* Anything finer than a nanosecond is dropped */
+        if (nfrac < 9) {
+            frac = frac * 10 + (*p - '0');
+            nfrac++;
+        }
+    }
+    if (0 == nfrac || end - p < 2 || ')' != p[0] || ' ' != p[1]) {
+        return -1;
+    }
+    p += 2;
+    stamp = sec * UINT64_C(1000000000) + frac * scale[nfrac];
+
+interface:
+    name = p;
+    p = memchr(p, ' ', end - p);
+    if (NULL == p) {
+        return -1;
+    }
+    channel = channel_of(log, name, p - name);
+    if (channel < 0) {
+        return -1;
+    }
+    p++;
+
+    /* ID, whose digit count tells standard from extended */
+    for (digits = 0; p < end && '#' != *p; p++, digits++) {
+        const int d = hexvec_digit(*p);
+        if (d < 0 || digits == EFF_DIGITS) {
+            return -1;
+        }
+        id = id << 4 | d;
+    }
+    if (p == end) {
+        return -1;
+    }
+    p++;
+
+    if (SFF_DIGITS == digits) {
+        if (id > CAN_SFF_MASK) {
+            return -1;
+        }
+    } else if (EFF_DIGITS == digits) {
+        /* Error frames are written with the error flag in their 8 digits */
+        id |= (id & CAN_ERR_FLAG) ? 0 : CAN_EFF_FLAG;
+    } else {
+        return -1;
+    }
+
+    r->stamp = stamp;
+    r->can_id = id;
+    r->flags = 0;
+    r->channel = channel;
+    r->lap = 0;
+
+    /* CAN FD frames do not fit a record */
+    if (p < end && '#' == *p) {
+        return -1;
+    }
+
+    /* Remote frames, with an optional length */
+    if (p < end && 'R' == *p) {
+        p++;
+        r->can_id |= CAN_RTR_FLAG;
+        r->len = 0;
+        if (p < end && (unsigned char)(*p - '0') <= CAN_MAX_DLEN) {
+            r->len = *p++ - '0';
+        }
+        memset(r->data, 0, CAN_MAX_DLEN);
+        return (p == end || ' ' == *p) ? 0 : -1;
+    }
+
+    /* Data, to the end of the line unless a space ends it earlier. The space
+     * is rare and only looked for once the whole line fails to decode.
+     */
+    payload = p;
+    digits = end - payload;
+    if (0 == decode(log, payload, digits, r->data)) {
+        r->len = digits / 2;
+        return 0;
+    }
+    p = memchr(payload, ' ', end - payload);
+    if (NULL == p) {
+        return -1;
+    }
+    digits = p - payload;
+    r->len = digits / 2;
+    return decode(log, payload, digits, r->data);
+}
+
+int candump_each(struct candump *log, candump_fn fn, void *ctx)
+{
+    const char *p = log->data;
+    const char *const stop = log->data + log->size;
+    struct canlog_record r;
+
+    while (p < stop) {
+        const char *end = memchr(p, '\n', stop - p);
+        if (NULL == end) {
+            end = stop;
+        }
+
+        if (end > p) {
+            log->lines++;
+            if (0 == candump_parse_line(log, p, end, &r)) {
+                const int rc = fn(ctx, &r);
+                log->frames++;
+                if (0 != rc) {
+                    return rc;
+                }
+            } else {
+                log->skipped++;
+            }
+        }
+
+        p = end + 1;
+    }
+
+    return 0;
+}
+
+/* Write the low digits hex digits of v at p */
+static char *put_hex(char *p, uint32_t v, unsigned int digits)
+{
+    static const char hex[16] = "0123456789ABCDEF";
+
+    while (digits-- > 0) {
+        p[digits] = hex[v & 0xF];
+        v >>= 4;
+    }
+    return p;
+}
+
+/* Write v as exactly digits decimal digits at p */
+static void put_decimal(char *p, uint64_t v, unsigned int digits)
+{
+    while (digits-- > 0) {
+        p[digits] = '0' + v % 10;
+        v /= 10;
+    }
+}
+
+size_t candump_format(char *buf, const struct canlog_record *r, const char *iface)
+{
+    const uint64_t sec = r->stamp / 1000000000;
+    const size_t name = strnlen(iface, IFNAMSIZ - 1);
+    uint64_t rest;
+    unsigned int digits;
+    char *p = buf;
+
+    /* Seconds take ten digits, as in candump, until the year 2286 */
+    *p++ = '(';
+    digits = 10;
+    for (rest = sec / UINT64_C(10000000000); rest > 0; rest /= 10) {
+        digits++;
+    }
+    put_decimal(p, sec, digits);
+    p += digits;
+    *p++ = '.';
+    put_decimal(p, r->stamp % 1000000000 / 1000, 6);
+    p += 6;
+    *p++ = ')';
+    *p++ = ' ';
+
+    memcpy(p, iface, name);
+    p += name;
+    *p++ = ' ';
+
+    if (r->can_id & CAN_ERR_FLAG) {
+        p = put_hex(p, r->can_id & (CAN_ERR_MASK | CAN_ERR_FLAG), EFF_DIGITS) + EFF_DIGITS;
+    } else if (r->can_id & CAN_EFF_FLAG) {
+        p = put_hex(p, r->can_id & CAN_EFF_MASK, EFF_DIGITS) + EFF_DIGITS;
+    } else {
+        p = put_hex(p, r->can_id & CAN_SFF_MASK, SFF_DIGITS) + SFF_DIGITS;
+    }
+    *p++ = '#';
+
+    if (r->can_id & CAN_RTR_FLAG) {
+        *p++ = 'R';
+        if (r->len > 0 && r->len <= CAN_MAX_DLEN) {
+            *p++ = '0' + r->len;
+        }
+    } else {
+        p += hexvec_encode(p, r->data, (r->len < CAN_MAX_DLEN) ? r->len : CAN_MAX_DLEN);
+    }
+    *p++ = '\n';
+
+    return p - buf;
+}
@@ -0,0 +1,99 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+candump Log Reader
+
+Reads the log files written by candump -l (and accepted by canplayer), one
+frame per line:
+
+    (1436509052.249713) can0 123#DEADBEEF
+    (1436509052.250022) can1 18DAF110#0210
+    (1436509052.250311) can0 7DF#R
+
+Each frame is turned into a capture record (see canlog.h) with a nanosecond
+timestamp, the CAN ID with its EFF, RTR or ERR flag, and a channel number
+given to every interface name in order of appearance. CAN FD lines (ID##...)
+do not fit a classic record and are skipped and counted, as are malformed
+lines. Records can be written back out as log lines too.
+
+The file is mapped rather than read, lines are found with memchr(), and the
+payload is decoded sixteen hex digits at a time with vector operations.
+*/
+
+#ifndef CANDUMP_H
+#define CANDUMP_H
+
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "canlog.h"
+
+#define CANDUMP_MAX_CHANNELS (256)
+
+/* Longest line candump_format() writes, newline included */
+#define CANDUMP_MAX_LINE (80)
+
+struct candump
+{
+    const char *data;
+    size_t size;
+    void *map;              /* The mapping, NULL for a caller's buffer */
+    char channels[CANDUMP_MAX_CHANNELS][IFNAMSIZ];
+    unsigned int nchannels;
+    unsigned int last;      /* Channel of the previous line */
+    uint64_t lines;
+    uint64_t frames;
+    uint64_t skipped;       /* Malformed or CAN FD lines */
+};
+
+/* Called for every frame, a non-zero return stops reading */
+typedef int (*candump_fn)(void *ctx, const struct canlog_record *r);
+
+/* Map a log file. Returns 0 on success and -1 with errno set on failure. */
+int candump_open(struct candump *log, const char *path);
+
+/* Read a log held in memory */
+void candump_init(struct candump *log, const char *data, size_t size);
+
+void candump_close(struct candump *log);
+
+/* Parse the line in [line, end), end being its newline or the end of the
+ * data. Returns 0 and fills r for a frame, otherwise -1.
+ */
+int candump_parse_line(struct candump *log, const char *line, const char *end,
+                       struct canlog_record *r);
+
+/* Parse every line in turn. Returns 0 once all lines were read, or the first
+ * non-zero value fn returned.
+ */
+int candump_each(struct candump *log, candump_fn fn, void *ctx);
+
+/* Write r as a log line of interface iface, the way candump -l does, to buf
+ * which holds at least CANDUMP_MAX_LINE bytes. Returns the length of the line.
+ */
+size_t candump_format(char *buf, const struct canlog_record *r, const char *iface);
+
+#endif /* CANDUMP_H */
@@ -0,0 +1,345 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Index
+
+The three probes of an ID are taken from one 64 bit multiplicative hash, as
+three 12 bit fields of its upper half. Blocks are checked for every ID of a
+query, so a single ID costs three bit tests per block and a block is only
+read if one of the IDs passes all three.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "canindex.h"
+
+/* The RTR flag is a property of the frame, not of the ID */
+static canid_t key_of(canid_t can_id)
+{
+    return can_id & ~CAN_RTR_FLAG;
+}
+
+static uint64_t hash(canid_t key)
+{
+    return (key + UINT64_C(1)) * UINT64_C(0x9E3779B97F4A7C15);
+}
+
+static void bloom_add(uint64_t *bloom, canid_t key)
+{
+    const uint64_t h = hash(key);
+    unsigned int i;
+
+    for (i = 0; i < 3; i++) {
+        const unsigned int bit = (h >> (28 + 12 * i)) & 4095;
+        bloom[bit / 64] |= UINT64_C(1) << (bit % 64);
+    }
+}
+
+static int bloom_has(const uint64_t *bloom, canid_t key)
+{
+    const uint64_t h = hash(key);
+    unsigned int i;
+
+    for (i = 0; i < 3; i++) {
+        const unsigned int bit = (h >> (28 + 12 * i)) & 4095;
+        if (0 == (bloom[bit / 64] & (UINT64_C(1) << (bit % 64)))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int canindex_build(struct canindex *ix, const struct canlog_record *records, size_t n)
+{
+    const uint64_t nblocks = (n + CANINDEX_BLOCK - 1) / CANINDEX_BLOCK;
+    struct canindex_header *header;
+    struct canindex_block *blocks;
+    uint64_t previous = 0;
+    size_t i;
+
+    memset(ix, 0, sizeof(*ix));
+
+    ix->size = sizeof(*header) + nblocks * sizeof(*blocks);
+    ix->map = calloc(1, ix->size);
+    if (NULL == ix->map) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    header = ix->map;
+    blocks = (struct canindex_block *)(header + 1);
+    memcpy(header->magic, CANINDEX_MAGIC, sizeof(header->magic));
+    header->version = CANINDEX_VERSION;
+    header->block = CANINDEX_BLOCK;
+    header->records = n;
+    header->nblocks = nblocks;
+    header->ordered = 1;
+
+    for (i = 0; i < n; i++) {
+        struct canindex_block *b = &blocks[i / CANINDEX_BLOCK];
+        const uint64_t stamp = records[i].stamp;
+
+        if (0 == i % CANINDEX_BLOCK) {
+            b->first = stamp;
+            b->last = stamp;
+        } else if (stamp < b->first) {
+            b->first = stamp;
+        } else if (stamp > b->last) {
+            b->last = stamp;
+        }
+
+        if (stamp < previous) {
+            header->ordered = 0;
+        }
+        previous = stamp;
+
+        bloom_add(b->bloom, key_of(records[i].can_id));
+    }
+
+    ix->header = header;
+    ix->blocks = blocks;
+    return 0;
+}
+
+int canindex_write(const struct canindex *ix, const char *path)
+{
+    const char *p = ix->map;
+    size_t done = 0;
+    int saved;
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    while (done < ix->size) {
+        const ssize_t n = write(fd, p + done, ix->size - done);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            goto fail;
+        }
+        done += n;
+    }
+
+    if (-1 == close(fd)) {
+        unlink(path);
+        return -1;
+    }
+    return 0;
+
+fail:
+    saved = errno;
+    close(fd);
+    unlink(path);
+    errno = saved;
+    return -1;
+}
+
+int canindex_open(struct canindex *ix, const char *path, size_t n)
+{
+    const struct canindex_header *header;
+    struct stat st;
+    int saved;
+    int fd;
+
+    memset(ix, 0, sizeof(*ix));
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    if (-1 == fstat(fd, &st)) {
+        goto fail;
+    }
+    if ((size_t)st.st_size < sizeof(*header)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    ix->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == ix->map) {
+        ix->map = NULL;
+        goto fail;
+    }
+    ix->size = st.st_size;
+    ix->mapped = 1;
+    close(fd);
+
+    header = ix->map;
+    if (0 != memcmp(header->magic, CANINDEX_MAGIC, sizeof(header->magic)) ||
+        CANINDEX_VERSION != header->version ||
+        CANINDEX_BLOCK != header->block ||
+        header->nblocks != (header->records + CANINDEX_BLOCK - 1) / CANINDEX_BLOCK ||
+        ix->size != sizeof(*header) + header->nblocks * sizeof(struct canindex_block)) {
+        canindex_close(ix);
+        errno = EINVAL;
+        return -1;
+    }
+    if (header->records != n) {
+        canindex_close(ix);
+        errno = ESTALE;
+        return -1;
+    }
+
+    ix->header = header;
+    ix->blocks = (const struct canindex_block *)(header + 1);
+    return 0;
+
+fail:
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+}
+
+void canindex_close(struct canindex *ix)
+{
+    if (ix->mapped) {
+        munmap(ix->map, ix->size);
+    } else {
+        free(ix->map);
+    }
+    memset(ix, 0, sizeof(*ix));
+}
+
+/* Whether the block may hold a frame of one of the query's IDs */
+static int block_may_match(const struct canindex_block *b, const struct canindex_query *q)
+{
+    size_t i;
+
+    if (0 == q->nranges) {
+        return 1;
+    }
+
+    for (i = 0; i < q->nranges; i++) {
+        const struct canindex_range *r = &q->ranges[i];
+        canid_t key;
+
+        if (r->high - r->low >= CANINDEX_MAX_PROBES) {
+            return 1;
+        }
+        for (key = r->low; key <= r->high; key++) {
+            if (bloom_has(b->bloom, key)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int frame_matches(const struct canlog_record *r, const struct canindex_query *q)
+{
+    const canid_t key = key_of(r->can_id);
+    size_t i;
+
+    if (r->stamp < q->from || r->stamp > q->to) {
+        return 0;
+    }
+    if (0 == q->nranges) {
+        return 1;
+    }
+
+    for (i = 0; i < q->nranges; i++) {
+        if (key >= q->ranges[i].low && key <= q->ranges[i].high) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int canindex_query(
+    const struct canindex *ix,
+    const struct canlog_record *records,
+    struct canindex_query *q,
+    canindex_fn fn,
+    void *ctx)
+{
+    const uint64_t nblocks = ix->header->nblocks;
+    uint64_t b = 0;
+    int rc;
+
+    /* In a capture in time order the latest times of the blocks only grow,
+     * so the first block reaching the span can be searched for
+     */
+    if (ix->header->ordered) {
+        uint64_t high = nblocks;
+
+        while (b < high) {
+            const uint64_t mid = b + (high - b) / 2;
+            if (ix->blocks[mid].last < q->from) {
+                b = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+    }
+
+    for (; b < nblocks; b++) {
+        const struct canindex_block *block = &ix->blocks[b];
+        const size_t start = b * CANINDEX_BLOCK;
+        size_t end = start + CANINDEX_BLOCK;
+        size_t i;
+
+        if (block->first > q->to) {
+            if (ix->header->ordered) {
+                break;
+            }
+            continue;
+        }
+        if (block->last < q->from) {
+            continue;
+        }
+        if (!block_may_match(block, q)) {
+            q->blocks_skipped++;
+            continue;
+        }
+
+        q->blocks_read++;
+        if (end > ix->header->records) {
+            end = ix->header->records;
+        }
+        for (i = start; i < end; i++) {
+            if (frame_matches(&records[i], q)) {
+                rc = fn(ctx, &records[i]);
+                if (0 != rc) {
+                    return rc;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Index
+
+A sparse index over a capture file (see canlog.h), kept next to it, which
+lets a query for some IDs over a span of time read only the parts of the
+capture that can hold such frames. The capture is cut into blocks of
+CANINDEX_BLOCK records, and for each block the index holds:
+
+    first, last     the earliest and latest timestamp in the block
+    bloom           a Bloom filter of the CAN IDs in the block
+
+A query finds the blocks overlapping its time span, by binary search when the
+capture is in time order, and skips every block whose filter shows that none
+of the wanted IDs is in it. Only the remaining blocks of the capture are
+read. A filter of 4096 bits with three probes per ID wrongly lets through
+about 2% of blocks holding 400 distinct IDs.
+
+The header records how many records were indexed, so an index left behind by
+a capture which has since grown is recognised as stale. All values are in
+host byte order.
+*/
+
+#ifndef CANINDEX_H
+#define CANINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/can.h>
+
+#include "canlog.h"
+
+#define CANINDEX_MAGIC "CANIDX\0\0"
+#define CANINDEX_VERSION (1)
+
+/* Records per block */
+#define CANINDEX_BLOCK (4096)
+
+/* Bloom filter size of a block, in 64 bit words */
+#define CANINDEX_BLOOM_WORDS (64)
+
+/* Widest ID range whose IDs are looked up in the filters one by one, wider
+ * ranges read every block in the time span
+ */
+#define CANINDEX_MAX_PROBES (64)
+
+struct canindex_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t block;         /* CANINDEX_BLOCK */
+    uint64_t records;       /* Records of the capture indexed */
+    uint64_t nblocks;
+    uint32_t ordered;       /* 1 if the capture is in time order */
+    uint32_t reserved;
+};
+
+struct canindex_block
+{
+    uint64_t first;         /* Earliest timestamp */
+    uint64_t last;          /* Latest timestamp */
+    uint64_t bloom[CANINDEX_BLOOM_WORDS];
+};
+
+struct canindex
+{
+    void *map;              /* Header followed by the blocks */
+    size_t size;
+    int mapped;             /* 1 if read from a file, 0 if built in memory */
+    const struct canindex_header *header;
+    const struct canindex_block *blocks;
+};
+
+/* IDs from low to high inclusive, both with the EFF or ERR flag */
+struct canindex_range
+{
+    canid_t low;
+    canid_t high;
+};
+
+struct canindex_query
+{
+    const struct canindex_range *ranges;
+    size_t nranges;         /* 0 for every ID */
+    uint64_t from;
+    uint64_t to;
+
+    /* Blocks in the span which canindex_query() read, or ruled out by their
+     * filter
+     */
+    uint64_t blocks_read;
+    uint64_t blocks_skipped;
+};
+
+/* Called for every matching frame, a non-zero return stops the query */
+typedef int (*canindex_fn)(void *ctx, const struct canlog_record *r);
+
+/* Index n records in memory. Returns 0 on success and -1 with errno set on
+ * failure.
+ */
+int canindex_build(struct canindex *ix, const struct canlog_record *records, size_t n);
+
+/* Write an index to path. Returns 0 on success and -1 with errno set. */
+int canindex_write(const struct canindex *ix, const char *path);
+
+/* Map the index at path of a capture holding n records. Returns 0 on success
+ * and -1 with errno set on failure, EINVAL meaning the file is not an index
+ * and ESTALE that it was made for a different capture.
+ */
+int canindex_open(struct canindex *ix, const char *path, size_t n);
+
+void canindex_close(struct canindex *ix);
+
+/* Call fn in capture order for every one of the indexed records with an ID
+ * in q's ranges, ignoring the RTR flag, stamped in [q->from, q->to]. Returns
+ * 0 once all were read, or the first non-zero value fn returned.
+ */
+int canindex_query(
+    const struct canindex *ix,
+    const struct canlog_record *records,
+    struct canindex_query *q,
+    canindex_fn fn,
+    void *ctx);
+
+#endif /* CANINDEX_H */
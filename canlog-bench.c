@@ -0,0 +1,589 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Tools Benchmark
+
+This program measures how fast the offline capture tools take logs apart. A
+candump log of a synthetic bus, with 400 standard and extended IDs, payloads
+of every length and a few remote frames on two interfaces, is generated in
+memory and parsed over and over. The rate is reported in megabytes and
+millions of lines per second, against a baseline which splits lines the same
+way but parses each with sscanf(), as most log readers do. The log is then
+parsed in chunks on a growing number of threads to show how the parallel
+processing scales.
+
+Finally the frames are written to a columnar store and indexed in place.
+Reading one ID over one percent of the capture's time span is timed with
+both, against a scan of every record in memory. The frames are then split by
+ID into a few dozen captures, which are merged back into one in time order.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include <linux/can.h>
+
+#include "candump.h"
+#include "canindex.h"
+#include "canlog.h"
+#include "colstore.h"
+#include "merge.h"
+#include "parallel.h"
+
+#define VERSION "2.0.0"
+
+#define NLINES (1 << 20)
+#define NIDS (400)
+#define NQUERIES (200)
+#define NSOURCES (32)
+#define DEFAULT_ROUNDS (10)
+
+/* Longest line generated, with room to spare */
+#define MAX_LINE (64)
+
+/* Input bytes per chunk when parsing in parallel */
+#define CHUNK_SIZE (1 << 20)
+
+struct args
+{
+    unsigned long rounds;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS]\n"
+        "\n"
+        "Options:\n"
+        "  --rounds, -r N   Parse the generated log N times (default: %d)\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, DEFAULT_ROUNDS
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    args->rounds = DEFAULT_ROUNDS;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "r:Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'r':
+            args->rounds = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->rounds) {
+                error(EXIT_FAILURE, 0, "invalid round count: %s", optarg);
+            }
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc != optind) {
+        error(0, 0, "no arguments expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A candump log of NLINES frames of NIDS IDs, returning its length */
+static size_t generate_log(char *buf, canid_t *ids)
+{
+    uint64_t usec = UINT64_C(1436509052000000);
+    char *p = buf;
+    int i;
+
+    for (i = 0; i < NIDS; i++) {
+        ids[i] = (i % 4) ? (canid_t)(rand() % (CAN_SFF_MASK + 1)) :
+                 CAN_EFF_FLAG | (rand() % (CAN_EFF_MASK + 1));
+    }
+
+    for (i = 0; i < NLINES; i++) {
+        const canid_t id = ids[rand() % NIDS];
+        const int len = rand() % (CAN_MAX_DLEN + 1);
+        int j;
+
+        usec += rand() % 500;
+        p += sprintf(p, "(%llu.%06llu) can%d ",
+                     (unsigned long long)(usec / 1000000),
+                     (unsigned long long)(usec % 1000000), rand() % 2);
+
+        if (id & CAN_EFF_FLAG) {
+            p += sprintf(p, "%08X#", id & CAN_EFF_MASK);
+        } else {
+            p += sprintf(p, "%03X#", id);
+        }
+
+        if (0 == rand() % 100) {
+            p += sprintf(p, "R\n");
+            continue;
+        }
+
+        for (j = 0; j < len; j++) {
+            p += sprintf(p, "%02X", rand() % 256);
+        }
+        *p++ = '\n';
+    }
+
+    return p - buf;
+}
+
+/* Folds everything a frame carries into a checksum */
+static uint64_t mix(uint64_t sum, const struct canlog_record *r)
+{
+    uint64_t data;
+
+    memcpy(&data, r->data, sizeof(data));
+    sum = (sum ^ r->stamp) * UINT64_C(0x100000001B3);
+    sum = (sum ^ r->can_id ^ (uint64_t)r->len << 32 ^ (uint64_t)r->channel << 40) *
+          UINT64_C(0x100000001B3);
+    return (sum ^ data) * UINT64_C(0x100000001B3);
+}
+
+/* The usual way: each line is copied out, as fgets() would, and parsed with
+ * sscanf()
+ */
+static int parse_sscanf(const char *line, struct canlog_record *r)
+{
+    static char names[CANDUMP_MAX_CHANNELS][IFNAMSIZ];
+    static unsigned int nnames;
+    unsigned long long sec;
+    unsigned long long usec;
+    char iface[IFNAMSIZ];
+    char id[9];
+    char payload[2 * CAN_MAX_DLEN + 1];
+    unsigned int i;
+
+    payload[0] = '\0';
+    if (sscanf(line, "(%llu.%llu) %15s %8[0-9A-Fa-f]#%16s", &sec, &usec, iface, id, payload) < 4) {
+        return -1;
+    }
+
+    r->stamp = sec * UINT64_C(1000000000) + usec * 1000;
+    r->can_id = strtoul(id, NULL, 16);
+    if (8 == strlen(id)) {
+        r->can_id |= CAN_EFF_FLAG;
+    }
+    r->flags = 0;
+    for (i = 0; i < nnames && 0 != strcmp(names[i], iface); i++) {
+    }
+    if (i == nnames) {
+        strcpy(names[nnames++], iface);
+    }
+    r->channel = i;
+    r->lap = 0;
+    memset(r->data, 0, CAN_MAX_DLEN);
+
+    if ('R' == payload[0]) {
+        r->can_id |= CAN_RTR_FLAG;
+        r->len = 0;
+        return 0;
+    }
+
+    r->len = strlen(payload) / 2;
+    for (i = 0; i < r->len; i++) {
+        if (1 != sscanf(payload + 2 * i, "%2hhx", &r->data[i])) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int checksum(void *ctx, const struct canlog_record *r)
+{
+    uint64_t *sum = ctx;
+    *sum = mix(*sum, r);
+    return 0;
+}
+
+static size_t line_boundary(void *ctx, const char *data, size_t size, size_t offset)
+{
+    const char *nl = memchr(data + offset, '\n', size - offset);
+
+    (void)ctx;
+    return (NULL != nl) ? (size_t)(nl - data) + 1 : size;
+}
+
+/* Frames of a chunk, the chunk's result being their number */
+static void *parse_chunk(void *ctx, unsigned int worker, const char *data, size_t size)
+{
+    struct candump log;
+    uint64_t sum = 0;
+
+    (void)ctx;
+    (void)worker;
+    candump_init(&log, data, size);
+    candump_each(&log, checksum, &sum);
+    return (void *)(uintptr_t)log.frames;
+}
+
+static void add_frames(void *ctx, size_t index, void *result)
+{
+    uint64_t *frames = ctx;
+
+    (void)index;
+    *frames += (uintptr_t)result;
+}
+
+/* Records of the log, gathered to build a store from */
+struct records
+{
+    struct canlog_record *r;
+    size_t n;
+};
+
+static int gather(void *ctx, const struct canlog_record *r)
+{
+    struct records *records = ctx;
+    records->r[records->n++] = *r;
+    return 0;
+}
+
+static int count_frame(void *ctx, const struct canlog_record *r)
+{
+    uint64_t *frames = ctx;
+
+    (void)r;
+    (*frames)++;
+    return 0;
+}
+
+static void report_queries(const char *name, double seconds, uint64_t frames)
+{
+    printf("%-14s %8.1f us/query %8.1f frames/query\n", name,
+           seconds * 1e6 / NQUERIES, (double)frames / NQUERIES);
+}
+
+static void report(const char *name, double seconds, unsigned long rounds, size_t size)
+{
+    printf("%-14s %8.1f MB/s %8.2f M lines/s\n", name,
+           rounds * size / seconds / 1e6, rounds * (double)NLINES / seconds / 1e6);
+}
+
+/* Split the frames into NSOURCES captures by ID and merge them back together */
+static void merge_bench(const struct records *records, unsigned long rounds)
+{
+    struct canlog_record *split;
+    struct canlog_record rec;
+    size_t start[NSOURCES + 1];
+    size_t fill[NSOURCES];
+    uint64_t expected = 0;
+    uint64_t merged;
+    uint64_t frames = 0;
+    uint64_t previous;
+    unsigned long r;
+    unsigned int k;
+    size_t j;
+    double t0;
+
+    split = malloc(records->n * sizeof(*split));
+    if (NULL == split) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    memset(start, 0, sizeof(start));
+    for (j = 0; j < records->n; j++) {
+        start[records->r[j].can_id % NSOURCES + 1]++;
+        expected ^= mix(0, &records->r[j]);
+    }
+    for (k = 0; k < NSOURCES; k++) {
+        start[k + 1] += start[k];
+        fill[k] = start[k];
+    }
+    for (j = 0; j < records->n; j++) {
+        split[fill[records->r[j].can_id % NSOURCES]++] = records->r[j];
+    }
+
+    t0 = now();
+    for (r = 0; r < rounds; r++) {
+        struct merge m;
+
+        if (-1 == merge_init(&m, NSOURCES)) {
+            error(EXIT_FAILURE, errno, "merge");
+        }
+        for (k = 0; k < NSOURCES; k++) {
+            merge_add(&m, &split[start[k]], start[k + 1] - start[k], 0, 0);
+        }
+
+        previous = 0;
+        merged = 0;
+        while (0 == merge_next(&m, &rec)) {
+            if (rec.stamp < previous) {
+                error(EXIT_FAILURE, 0, "merge out of order");
+            }
+            previous = rec.stamp;
+            merged ^= mix(0, &rec);
+            frames++;
+        }
+        merge_free(&m);
+
+        if (merged != expected) {
+            error(EXIT_FAILURE, 0, "merge changed frames");
+        }
+    }
+    t0 = now() - t0;
+    printf("%-14s %8.1f MB/s %8.2f M frames/s from %d captures\n", "Merge",
+           frames * sizeof(rec) / t0 / 1e6, frames / t0 / 1e6, NSOURCES);
+
+    if (frames != rounds * records->n) {
+        error(EXIT_FAILURE, 0, "merge lost frames");
+    }
+    free(split);
+}
+
+int main(int argc, char **argv)
+{
+    struct args args;
+    canid_t ids[NIDS];
+    uint64_t baseline = 0;
+    uint64_t fast = 0;
+    size_t size;
+    char *buf;
+    double t0;
+    unsigned long r;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    srand(1);
+
+    buf = malloc((size_t)NLINES * MAX_LINE);
+    if (NULL == buf) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    size = generate_log(buf, ids);
+    printf("Log of %d lines, %.1f MB\n", NLINES, size / 1e6);
+
+    {
+        struct canlog_record rec;
+        char line[MAX_LINE + 1];
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            const char *p = buf;
+            const char *const stop = buf + size;
+
+            while (p < stop) {
+                const char *end = memchr(p, '\n', stop - p);
+                const size_t len = end - p;
+
+                memcpy(line, p, len);
+                line[len] = '\0';
+                if (0 == parse_sscanf(line, &rec)) {
+                    baseline = mix(baseline, &rec);
+                }
+                p = end + 1;
+            }
+        }
+        report("sscanf", now() - t0, args.rounds, size);
+    }
+
+    {
+        struct candump log;
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            candump_init(&log, buf, size);
+            candump_each(&log, checksum, &fast);
+        }
+        report("candump", now() - t0, args.rounds, size);
+
+        if (fast != baseline || log.frames != NLINES) {
+            error(EXIT_FAILURE, 0, "parsers disagree (%llu frames)", (unsigned long long)log.frames);
+        }
+    }
+
+    {
+        const unsigned int cores = parallel_default_threads();
+        struct parallel p;
+        uint64_t frames;
+        unsigned int t;
+        char name[32];
+
+        p.boundary = line_boundary;
+        p.work = parse_chunk;
+        p.merge = add_frames;
+        p.ctx = &frames;
+        p.chunk_size = CHUNK_SIZE;
+
+        for (t = 1; t <= cores; t = (t < cores && 2 * t > cores) ? cores : 2 * t) {
+            p.threads = t;
+            frames = 0;
+
+            t0 = now();
+            for (r = 0; r < args.rounds; r++) {
+                if (-1 == parallel_run(&p, buf, size)) {
+                    error(EXIT_FAILURE, errno, "parallel");
+                }
+            }
+            snprintf(name, sizeof(name), "%u thread%s", t, (1 == t) ? "" : "s");
+            report(name, now() - t0, args.rounds, size);
+
+            if (frames != args.rounds * (uint64_t)NLINES) {
+                error(EXIT_FAILURE, 0, "chunks lost frames");
+            }
+        }
+    }
+
+    {
+        static const char channels[2][IFNAMSIZ] = {"can0", "can1"};
+        struct records records;
+        struct colstore store;
+        struct candump log;
+        char path[] = "/tmp/canlog-bench-XXXXXX";
+        canid_t keys[NQUERIES];
+        uint64_t from[NQUERIES];
+        uint64_t span;
+        struct canindex index;
+        uint64_t in_store = 0;
+        uint64_t in_index = 0;
+        uint64_t scanned = 0;
+        size_t j;
+        int q;
+        int tmp;
+
+        records.r = malloc(NLINES * sizeof(*records.r));
+        records.n = 0;
+        if (NULL == records.r) {
+            error(EXIT_FAILURE, errno, "malloc");
+        }
+        candump_init(&log, buf, size);
+        candump_each(&log, gather, &records);
+
+        tmp = mkstemp(path);
+        if (-1 == tmp) {
+            error(EXIT_FAILURE, errno, "mkstemp");
+        }
+        close(tmp);
+
+        t0 = now();
+        if (-1 == colstore_write(path, records.r, records.n, channels, 2) ||
+            -1 == colstore_open(&store, path)) {
+            error(EXIT_FAILURE, errno, "%s", path);
+        }
+        printf("%-14s %8.1f ms for %u IDs\n", "Store build", (now() - t0) * 1e3, store.header->nids);
+
+        span = store.header->last - store.header->first;
+        for (q = 0; q < NQUERIES; q++) {
+            keys[q] = ids[rand() % NIDS];
+            from[q] = store.header->first + (uint64_t)((double)rand() / RAND_MAX * span * 0.99);
+        }
+
+        t0 = now();
+        for (q = 0; q < NQUERIES; q++) {
+            const struct colstore_id *id = colstore_find(&store, keys[q]);
+            if (NULL != id) {
+                colstore_query(&store, id, from[q], from[q] + span / 100, count_frame, &in_store);
+            }
+        }
+        report_queries("Query store", now() - t0, in_store);
+
+        if (-1 == canindex_build(&index, records.r, records.n)) {
+            error(EXIT_FAILURE, errno, "index");
+        }
+
+        t0 = now();
+        for (q = 0; q < NQUERIES; q++) {
+            struct canindex_range range = {keys[q], keys[q]};
+            struct canindex_query query = {
+                .ranges = &range,
+                .nranges = 1,
+                .from = from[q],
+                .to = from[q] + span / 100,
+            };
+            canindex_query(&index, records.r, &query, count_frame, &in_index);
+        }
+        report_queries("Query index", now() - t0, in_index);
+        canindex_close(&index);
+
+        t0 = now();
+        for (q = 0; q < NQUERIES; q++) {
+            for (j = 0; j < records.n; j++) {
+                const struct canlog_record *rec = &records.r[j];
+                if ((rec->can_id & ~CAN_RTR_FLAG) == keys[q] &&
+                    rec->stamp >= from[q] && rec->stamp <= from[q] + span / 100) {
+                    scanned++;
+                }
+            }
+        }
+        report_queries("Query scan", now() - t0, scanned);
+
+        if (in_store != scanned || in_index != scanned) {
+            error(EXIT_FAILURE, 0, "store, index and scan disagree");
+        }
+
+        colstore_close(&store);
+        unlink(path);
+
+        merge_bench(&records, args.rounds);
+        free(records.r);
+    }
+
+    free(buf);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Columnar Capture Export
+
+This program converts a candump log or a capture file (see canlog.h) into a
+columnar store (see colstore.h), in which the frames of each ID are kept
+together and indexed by time. canlog-query reads the store back.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include "candump.h"
+#include "canlog.h"
+#include "colstore.h"
+
+#define VERSION "2.0.0"
+
+struct args
+{
+    const char *input;
+    const char *output;
+};
+
+/* Records parsed from a candump log */
+struct records
+{
+    struct canlog_record *r;
+    size_t n;
+    size_t size;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] INPUT OUTPUT\n"
+        "\n"
+        "Arguments:\n"
+        "  INPUT    candump log or capture file to convert\n"
+        "  OUTPUT   Columnar store to write\n"
+        "\n"
+        "Options:\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        error(0, 0, "an input file and an output file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->input = argv[optind];
+    args->output = argv[optind + 1];
+}
+
+static int append(void *ctx, const struct canlog_record *r)
+{
+    struct records *records = ctx;
+
+    if (records->n == records->size) {
+        const size_t size = (records->size > 0) ? 2 * records->size : 1 << 16;
+        struct canlog_record *grown = realloc(records->r, size * sizeof(*grown));
+        if (NULL == grown) {
+            return -1;
+        }
+        records->r = grown;
+        records->size = size;
+    }
+    records->r[records->n++] = *r;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static char names[COLSTORE_MAX_CHANNELS][IFNAMSIZ];
+    const struct canlog_record *records;
+    struct canlog_header header;
+    struct records parsed = {NULL, 0, 0};
+    struct candump input;
+    struct colstore store;
+    struct args args;
+    unsigned int nchannels;
+    size_t n;
+    unsigned int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    if (-1 == candump_open(&input, args.input)) {
+        error(EXIT_FAILURE, errno, "%s", args.input);
+    }
+
+    /* A capture is used in place, a candump log is parsed first */
+    if (input.size >= sizeof(header) && 0 == memcmp(input.data, CANLOG_MAGIC, sizeof(header.magic))) {
+        memcpy(&header, input.data, sizeof(header));
+        if (!canlog_header_valid(&header)) {
+            error(EXIT_FAILURE, 0, "%s: unsupported capture file", args.input);
+        }
+        records = (const struct canlog_record *)(input.data + sizeof(header));
+        n = (input.size - sizeof(header)) / sizeof(*records);
+        nchannels = COLSTORE_MAX_CHANNELS;
+        for (i = 0; i < nchannels; i++) {
+            snprintf(names[i], IFNAMSIZ, "can%u", i);
+        }
+    } else {
+        if (0 != candump_each(&input, append, &parsed)) {
+            error(EXIT_FAILURE, ENOMEM, "%s", args.input);
+        }
+        records = parsed.r;
+        n = parsed.n;
+        nchannels = input.nchannels;
+        memcpy(names, input.channels, sizeof(input.channels));
+    }
+
+    if (-1 == colstore_write(args.output, records, n, (const char (*)[IFNAMSIZ])names, nchannels)) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    if (-1 == colstore_open(&store, args.output)) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+    printf("%s: %llu frames of %u IDs in %llu blocks\n", args.output,
+           (unsigned long long)store.header->frames, store.header->nids,
+           (unsigned long long)store.header->nblocks);
+    colstore_close(&store);
+
+    free(parsed.r);
+    candump_close(&input);
+    return EXIT_SUCCESS;
+}
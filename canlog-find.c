@@ -0,0 +1,360 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Indexed Capture Query
+
+This program prints the frames of a capture file (see canlog.h) which have
+one of a set of IDs and fall within a span of time, as candump log lines. It
+reads the capture through the sparse index of canindex.h kept next to it, in
+CAPTURE.idx, so only the blocks which can hold such frames are read. The
+index is built by the first query of a capture, or when the capture has grown
+since, and saved for the queries after it.
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "candump.h"
+#include "canindex.h"
+#include "canlog.h"
+
+#define VERSION "2.0.0"
+
+#define MAX_RANGES (64)
+
+struct args
+{
+    const char *capture;
+    struct canindex_range ranges[MAX_RANGES];
+    size_t nranges;
+    uint64_t from;
+    uint64_t to;
+    int count;
+    int stats;
+};
+
+struct output
+{
+    uint64_t frames;
+    int count;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] CAPTURE\n"
+        "\n"
+        "Arguments:\n"
+        "  CAPTURE  Capture file to query\n"
+        "\n"
+        "Options:\n"
+        "  --id, -i ID[-ID] Print the frames of a hex CAN ID or range of IDs, eight\n"
+        "                   digits being an extended ID, up to %d times\n"
+        "                   (default: every ID)\n"
+        "  --from, -f SEC   Start at this time, in seconds since the epoch\n"
+        "  --to, -t SEC     End at this time, in seconds since the epoch\n"
+        "  --count, -c      Print the number of frames instead of the frames\n"
+        "  --stats, -s      Print how many blocks were read and skipped\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, MAX_RANGES
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+/* Parse SEC[.FRACTION] into nanoseconds. Returns 0 on success and -1 if the
+ * time is malformed.
+ */
+static int parse_time(const char *s, uint64_t *ns)
+{
+    uint64_t scale = 100000000;
+    char *end;
+
+    *ns = strtoull(s, &end, 10) * UINT64_C(1000000000);
+    if (end == s) {
+        return -1;
+    }
+    if ('.' == *end) {
+        for (s = end + 1; *s >= '0' && *s <= '9'; s++) {
+            *ns += (*s - '0') * scale;
+            scale /= 10;
+        }
+        end = (char *)s;
+    }
+    return ('\0' == *end) ? 0 : -1;
+}
+
+/* Parse a hex ID, eight digits being an extended ID, up to the character
+ * stop. Returns 0 on success and -1 if the ID is malformed.
+ */
+static int parse_id(const char *s, char stop, canid_t *can_id)
+{
+    char *end;
+
+    *can_id = strtoul(s, &end, 16);
+    if (stop != *end || end == s || *can_id > CAN_EFF_MASK) {
+        return -1;
+    }
+    if (*can_id > CAN_SFF_MASK || 8 == end - s) {
+        *can_id |= CAN_EFF_FLAG;
+    }
+    return 0;
+}
+
+static void parse_range(const char *s, struct canindex_range *r)
+{
+    const char *dash = strchr(s, '-');
+
+    if (NULL == dash) {
+        if (-1 == parse_id(s, '\0', &r->low)) {
+            error(EXIT_FAILURE, 0, "invalid ID: %s", s);
+        }
+        r->high = r->low;
+        return;
+    }
+
+    if (-1 == parse_id(s, '-', &r->low) || -1 == parse_id(dash + 1, '\0', &r->high) ||
+        r->low > r->high || (r->low ^ r->high) & CAN_EFF_FLAG) {
+        error(EXIT_FAILURE, 0, "invalid ID range: %s", s);
+    }
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"id", required_argument, NULL, 'i'},
+        {"from", required_argument, NULL, 'f'},
+        {"to", required_argument, NULL, 't'},
+        {"count", no_argument, NULL, 'c'},
+        {"stats", no_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+    args->to = UINT64_MAX;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "i:f:t:csVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'i':
+            if (args->nranges >= MAX_RANGES) {
+                error(EXIT_FAILURE, 0, "too many IDs, at most %d", MAX_RANGES);
+            }
+            parse_range(optarg, &args->ranges[args->nranges++]);
+            break;
+        case 'f':
+            if (-1 == parse_time(optarg, &args->from)) {
+                error(EXIT_FAILURE, 0, "invalid time: %s", optarg);
+            }
+            break;
+        case 't':
+            if (-1 == parse_time(optarg, &args->to)) {
+                error(EXIT_FAILURE, 0, "invalid time: %s", optarg);
+            }
+            break;
+        case 'c':
+            args->count = 1;
+            break;
+        case 's':
+            args->stats = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 1) {
+        error(0, 0, "a capture argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->capture = argv[optind];
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Map a capture, returning its records and their number in n */
+static const struct canlog_record *map_capture(const char *path, size_t *n, size_t *size)
+{
+    const struct canlog_header *header;
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd || -1 == fstat(fd, &st)) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+    if ((size_t)st.st_size < sizeof(*header)) {
+        error(EXIT_FAILURE, 0, "%s: not a capture", path);
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == map) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+    close(fd);
+
+    header = map;
+    if (!canlog_header_valid(header)) {
+        error(EXIT_FAILURE, 0, "%s: not a capture", path);
+    }
+
+    /* A capture still being written holds every whole record so far */
+    *n = (st.st_size - sizeof(*header)) / sizeof(struct canlog_record);
+    *size = st.st_size;
+    return (const struct canlog_record *)(header + 1);
+}
+
+static void load_index(struct canindex *ix, const char *path,
+                       const struct canlog_record *records, size_t n)
+{
+    if (0 == canindex_open(ix, path, n)) {
+        return;
+    }
+    if (ENOENT != errno && ESTALE != errno && EINVAL != errno) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+
+    if (-1 == canindex_build(ix, records, n)) {
+        error(EXIT_FAILURE, errno, "index");
+    }
+
+    /* Queries work without a saved index, they just build it again */
+    if (-1 == canindex_write(ix, path)) {
+        error(0, errno, "%s", path);
+    }
+}
+
+static int print_frame(void *ctx, const struct canlog_record *r)
+{
+    struct output *out = ctx;
+    char line[CANDUMP_MAX_LINE];
+    char name[IFNAMSIZ];
+
+    out->frames++;
+    if (out->count) {
+        return 0;
+    }
+
+    snprintf(name, sizeof(name), "can%u", r->channel);
+    fwrite(line, candump_format(line, r, name), 1, stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const struct canlog_record *records;
+    struct canindex_query query;
+    struct canindex ix;
+    struct output out;
+    struct args args;
+    char path[PATH_MAX];
+    size_t size;
+    size_t n;
+    double t0;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    records = map_capture(args.capture, &n, &size);
+
+    if ((size_t)snprintf(path, sizeof(path), "%s.idx", args.capture) >= sizeof(path)) {
+        error(EXIT_FAILURE, ENAMETOOLONG, "%s", args.capture);
+    }
+
+    t0 = now();
+    load_index(&ix, path, records, n);
+    if (args.stats) {
+        fprintf(stderr, "%s: %llu blocks, %s, loaded in %.1f ms\n", path,
+                (unsigned long long)ix.header->nblocks,
+                ix.mapped ? "saved" : "built", (now() - t0) * 1e3);
+    }
+
+    memset(&query, 0, sizeof(query));
+    query.ranges = args.ranges;
+    query.nranges = args.nranges;
+    query.from = args.from;
+    query.to = args.to;
+
+    out.frames = 0;
+    out.count = args.count;
+
+    t0 = now();
+    canindex_query(&ix, records, &query, print_frame, &out);
+
+    if (args.count) {
+        printf("%llu\n", (unsigned long long)out.frames);
+    }
+    if (args.stats) {
+        fprintf(stderr, "%llu frames, %llu blocks read, %llu skipped, in %.1f ms\n",
+                (unsigned long long)out.frames, (unsigned long long)query.blocks_read,
+                (unsigned long long)query.blocks_skipped, (now() - t0) * 1e3);
+    }
+
+    canindex_close(&ix);
+    munmap((void *)((const struct canlog_header *)records - 1), size);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+candump Log Import
+
+This program converts a log written by candump -l into a capture file (see
+canlog.h), which the other capture tools read without parsing any text. Each
+interface named in the log becomes a channel, numbered in order of first
+appearance; the numbering is printed once the log is converted. Lines which
+are not classic CAN frames, such as CAN FD frames or comments, are skipped and
+counted.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include "candump.h"
+#include "canlog.h"
+
+#define VERSION "2.0.0"
+
+/* Records buffered before they are written out */
+#define OUTPUT_BUFFER (1 << 20)
+
+struct args
+{
+    const char *log;
+    const char *output;
+};
+
+struct import
+{
+    FILE *out;
+    uint64_t records;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] LOG OUTPUT\n"
+        "\n"
+        "Arguments:\n"
+        "  LOG      candump log file to convert\n"
+        "  OUTPUT   Capture file to write\n"
+        "\n"
+        "Options:\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        error(0, 0, "a log file and an output file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->log = argv[optind];
+    args->output = argv[optind + 1];
+}
+
+static int write_record(void *ctx, const struct canlog_record *r)
+{
+    struct import *im = ctx;
+
+    if (1 != fwrite(r, sizeof(*r), 1, im->out)) {
+        return -1;
+    }
+    im->records++;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct canlog_header header;
+    struct candump log;
+    struct import im;
+    struct args args;
+    unsigned int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    if (-1 == candump_open(&log, args.log)) {
+        error(EXIT_FAILURE, errno, "%s", args.log);
+    }
+
+    im.records = 0;
+    im.out = fopen(args.output, "w");
+    if (NULL == im.out) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+    setvbuf(im.out, NULL, _IOFBF, OUTPUT_BUFFER);
+
+    /* The record count is filled in once it is known */
+    canlog_header_init(&header, 0);
+    if (1 != fwrite(&header, sizeof(header), 1, im.out) ||
+        0 != candump_each(&log, write_record, &im)) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    canlog_header_init(&header, im.records);
+    if (0 != fseek(im.out, 0, SEEK_SET) ||
+        1 != fwrite(&header, sizeof(header), 1, im.out) ||
+        0 != fclose(im.out)) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    printf("%s: %llu frames from %llu lines, %llu skipped\n",
+           args.output, (unsigned long long)log.frames,
+           (unsigned long long)log.lines, (unsigned long long)log.skipped);
+    for (i = 0; i < log.nchannels; i++) {
+        printf("  channel %u: %s\n", i, log.channels[i]);
+    }
+
+    candump_close(&log);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,252 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Merge
+
+This program merges capture files (see canlog.h) into a single capture in time
+order, such as the per-interface captures of one recording or captures of
+the same bus taken on several machines. Each input may be given a clock
+offset in seconds, INPUT@OFFSET, which is added to its timestamps before they
+are compared. An input whose last '@' is not followed by a valid offset is
+taken whole as a path. With --separate, the channels of the n-th input are
+numbered from n, so that per-interface captures which all call their
+interface channel 0 stay apart.
+
+The inputs are mapped and read in order, never loaded whole, and the output is
+written in large batches as the merge goes.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include "canlog.h"
+#include "merge.h"
+
+#define VERSION "2.0.0"
+
+/* Records merged before they are written out */
+#define BATCH (65536)
+
+struct args
+{
+    const char *output;
+    char **inputs;
+    unsigned int ninputs;
+    int separate;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] OUTPUT INPUT[@OFFSET]...\n"
+        "\n"
+        "Arguments:\n"
+        "  OUTPUT   Capture file to write\n"
+        "  INPUT    Capture file to merge, with a clock offset in seconds, such as\n"
+        "           box2.canlog@-0.0125, added to its timestamps\n"
+        "\n"
+        "Options:\n"
+        "  --separate, -s   Number the channels of the n-th input from n\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"separate", no_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "sVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 's':
+            args->separate = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) < 2) {
+        error(0, 0, "an output file and at least one input file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->output = argv[optind];
+    args->inputs = &argv[optind + 1];
+    args->ninputs = argc - optind - 1;
+
+    if (args->separate && args->ninputs > 256) {
+        error(EXIT_FAILURE, 0, "at most 256 inputs can be kept apart");
+    }
+}
+
+/* Parse a signed offset of SEC[.frac] seconds */
+static int parse_offset(const char *s, int64_t *ns)
+{
+    const int negative = ('-' == *s);
+    int64_t scale = 100000000;
+    char *end;
+
+    if ('-' == *s || '+' == *s) {
+        s++;
+    }
+    if ('.' != *s && (*s < '0' || *s > '9')) {
+        return -1;
+    }
+
+    *ns = strtoll(s, &end, 10) * INT64_C(1000000000);
+    if ('.' == *end) {
+        for (s = end + 1; *s >= '0' && *s <= '9'; s++) {
+            *ns += (*s - '0') * scale;
+            scale /= 10;
+        }
+        end = (char *)s;
+    }
+    if (negative) {
+        *ns = -*ns;
+    }
+    return ('\0' == *end) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    struct canlog_header header;
+    struct canlog_record *batch;
+    struct merge m;
+    struct args args;
+    uint64_t records = 0;
+    uint64_t disorder = 0;
+    unsigned int i;
+    FILE *out;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    if (-1 == merge_init(&m, args.ninputs)) {
+        error(EXIT_FAILURE, errno, "merge");
+    }
+
+    for (i = 0; i < args.ninputs; i++) {
+        char *path = args.inputs[i];
+        char *at = strrchr(path, '@');
+        int64_t offset = 0;
+
+        /* Paths may contain '@' too, so only a valid offset is split off */
+        if (NULL != at && 0 == parse_offset(at + 1, &offset)) {
+            *at = '\0';
+        }
+
+        if (-1 == merge_add_file(&m, path, offset, args.separate ? i : 0)) {
+            error(EXIT_FAILURE, errno, "%s", path);
+        }
+    }
+
+    batch = malloc(BATCH * sizeof(*batch));
+    if (NULL == batch) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    out = fopen(args.output, "w");
+    if (NULL == out) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    /* The record count is filled in once it is known */
+    canlog_header_init(&header, 0);
+    if (1 != fwrite(&header, sizeof(header), 1, out)) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    for (;;) {
+        size_t n = 0;
+
+        while (n < BATCH && 0 == merge_next(&m, &batch[n])) {
+            n++;
+        }
+        if (0 == n) {
+            break;
+        }
+        if (n != fwrite(batch, sizeof(*batch), n, out)) {
+            error(EXIT_FAILURE, errno, "%s", args.output);
+        }
+        records += n;
+    }
+
+    canlog_header_init(&header, records);
+    if (0 != fseek(out, 0, SEEK_SET) ||
+        1 != fwrite(&header, sizeof(header), 1, out) ||
+        0 != fclose(out)) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    printf("%s: %llu frames from %u inputs\n", args.output,
+           (unsigned long long)records, args.ninputs);
+    for (i = 0; i < args.ninputs; i++) {
+        disorder += m.sources[i].disorder;
+        if (m.sources[i].disorder > 0) {
+            error(0, 0, "%s: %llu frames out of time order", args.inputs[i],
+                  (unsigned long long)m.sources[i].disorder);
+        }
+    }
+
+    free(batch);
+    merge_free(&m);
+    return (0 == disorder) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,262 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Packing
+
+This program compresses a capture file (see canlog.h) into the packed format
+of canpack.h, or with --unpack turns a packed capture back into a capture
+file, record for record.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "canlog.h"
+#include "canpack.h"
+
+#define VERSION "2.0.0"
+
+/* Records buffered before they are written out */
+#define OUTPUT_BUFFER (1 << 20)
+
+struct args
+{
+    const char *input;
+    const char *output;
+    int unpack;
+};
+
+struct unpack
+{
+    FILE *out;
+    uint64_t records;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] INPUT OUTPUT\n"
+        "\n"
+        "Arguments:\n"
+        "  INPUT    Capture file to pack, or packed capture to unpack\n"
+        "  OUTPUT   File to write\n"
+        "\n"
+        "Options:\n"
+        "  --unpack, -d     Unpack a packed capture\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"unpack", no_argument, NULL, 'd'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    args->unpack = 0;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "dVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'd':
+            args->unpack = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        error(0, 0, "an input file and an output file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->input = argv[optind];
+    args->output = argv[optind + 1];
+}
+
+static int write_record(void *ctx, const struct canlog_record *r)
+{
+    struct unpack *u = ctx;
+
+    if (1 != fwrite(r, sizeof(*r), 1, u->out)) {
+        return 1;
+    }
+    u->records++;
+    return 0;
+}
+
+static void pack(const struct args *args, const void *map, size_t size)
+{
+    const struct canlog_record *records;
+    struct canlog_header header;
+    struct canpack w;
+    uint64_t n;
+    uint64_t i;
+    int fd;
+
+    if (size < sizeof(header)) {
+        error(EXIT_FAILURE, 0, "%s: not a capture file", args->input);
+    }
+    memcpy(&header, map, sizeof(header));
+    if (!canlog_header_valid(&header)) {
+        error(EXIT_FAILURE, 0, "%s: not a capture file", args->input);
+    }
+    records = (const struct canlog_record *)((const char *)map + sizeof(header));
+    n = (size - sizeof(header)) / sizeof(*records);
+
+    fd = open(args->output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == fd || -1 == canpack_init(&w, fd)) {
+        error(EXIT_FAILURE, errno, "%s", args->output);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (-1 == canpack_write(&w, &records[i])) {
+            error(EXIT_FAILURE, errno, "%s", args->output);
+        }
+    }
+    if (-1 == canpack_flush(&w) || -1 == close(fd)) {
+        error(EXIT_FAILURE, errno, "%s", args->output);
+    }
+
+    printf("%s: %llu frames, %zu bytes packed into %llu (%.1fx)\n", args->output,
+           (unsigned long long)n, size, (unsigned long long)w.bytes,
+           (w.bytes > 0) ? (double)size / w.bytes : 0.0);
+    canpack_free(&w);
+}
+
+/* Returns 0, or -1 if the input was corrupt or cut short and only the frames
+ * before were kept
+ */
+static int unpack(const struct args *args, const void *map, size_t size)
+{
+    struct canlog_header header;
+    struct unpack u;
+    int rc;
+
+    u.records = 0;
+    u.out = fopen(args->output, "w");
+    if (NULL == u.out) {
+        error(EXIT_FAILURE, errno, "%s", args->output);
+    }
+    setvbuf(u.out, NULL, _IOFBF, OUTPUT_BUFFER);
+
+    /* The record count is filled in once it is known */
+    canlog_header_init(&header, 0);
+    if (1 != fwrite(&header, sizeof(header), 1, u.out)) {
+        error(EXIT_FAILURE, errno, "%s", args->output);
+    }
+
+    rc = canpack_decode(map, size, write_record, &u);
+    if (1 == rc) {
+        error(EXIT_FAILURE, errno, "%s", args->output);
+    }
+    if (-1 == rc) {
+        error(0, 0, "%s: corrupt or cut short, kept the %llu frames before",
+              args->input, (unsigned long long)u.records);
+    }
+
+    canlog_header_init(&header, u.records);
+    if (0 != fseek(u.out, 0, SEEK_SET) ||
+        1 != fwrite(&header, sizeof(header), 1, u.out) ||
+        0 != fclose(u.out)) {
+        error(EXIT_FAILURE, errno, "%s", args->output);
+    }
+
+    printf("%s: %llu frames\n", args->output, (unsigned long long)u.records);
+    return (-1 == rc) ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct args args;
+    struct stat st;
+    void *map = NULL;
+    int status = EXIT_SUCCESS;
+    int fd;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    fd = open(args.input, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd || -1 == fstat(fd, &st)) {
+        error(EXIT_FAILURE, errno, "%s", args.input);
+    }
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == map) {
+            error(EXIT_FAILURE, errno, "%s", args.input);
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    if (args.unpack) {
+        if (-1 == unpack(&args, map, st.st_size)) {
+            status = EXIT_FAILURE;
+        }
+    } else {
+        pack(&args, map, st.st_size);
+    }
+
+    if (NULL != map) {
+        munmap(map, st.st_size);
+    }
+    close(fd);
+    return status;
+}
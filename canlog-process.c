@@ -0,0 +1,734 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Processing
+
+This program filters, summarises and converts large logs using every core.
+The input is a candump log or a capture file (see canlog.h), told apart by
+the capture header. It is mapped and split into chunks at line or record
+boundaries, which a pool of threads processes independently: each keeps the
+frames matching the filters, counts them per ID and converts them to the
+output format. The converted chunks are written out in their original order,
+so the output is identical whatever the number of threads.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include <linux/can.h>
+
+#include "candump.h"
+#include "canlog.h"
+#include "idtable.h"
+#include "parallel.h"
+
+#define VERSION "2.0.0"
+
+#define MAX_FILTERS (16)
+
+/* Input bytes per chunk */
+#define CHUNK_SIZE (16UL << 20)
+
+/* Distinct IDs counted by each thread */
+#define MAX_IDS (8192)
+
+/* Records buffered before they are written out */
+#define OUTPUT_BUFFER (1 << 20)
+
+struct filter
+{
+    canid_t id;
+    canid_t mask;
+};
+
+struct args
+{
+    const char *input;
+    const char *output;
+    int text;
+    int stats;
+    unsigned int threads;
+    struct filter filters[MAX_FILTERS];
+    unsigned int nfilters;
+};
+
+struct id_stats
+{
+    canid_t can_id;
+    uint64_t frames;
+    uint64_t first;
+    uint64_t last;
+    uint8_t min_len;
+    uint8_t max_len;
+};
+
+/* Per-ID counts of one thread, merged once all chunks are done */
+struct counts
+{
+    struct idtable index;
+    struct id_stats *ids;
+    uint64_t untracked;     /* Frames of IDs which did not fit */
+};
+
+/* What one chunk turns into */
+struct chunk
+{
+    char *out;              /* Records or log lines for the output */
+    size_t fill;
+    size_t size;
+    uint64_t frames;
+    uint64_t matched;
+    uint64_t skipped;       /* Lines which were not frames */
+    uint64_t first;
+    uint64_t last;
+    int failed;             /* Ran out of memory */
+
+    /* Interfaces in the order they appear in a candump chunk */
+    char channels[CANDUMP_MAX_CHANNELS][IFNAMSIZ];
+    unsigned int nchannels;
+};
+
+struct job
+{
+    const struct args *args;
+    int capture;            /* Whether the input is a capture file */
+    struct counts *counts;  /* One per thread */
+    char names[CANDUMP_MAX_CHANNELS][IFNAMSIZ]; /* Interfaces of a capture */
+
+    /* Written by the merge only */
+    FILE *out;
+    int failed;
+    char channels[CANDUMP_MAX_CHANNELS][IFNAMSIZ];
+    unsigned int nchannels;
+    uint64_t frames;
+    uint64_t matched;
+    uint64_t skipped;
+    uint64_t first;
+    uint64_t last;
+};
+
+/* What the frame callback needs while a chunk is processed */
+struct pass
+{
+    struct job *job;
+    struct counts *counts;
+    struct chunk *chunk;
+    const struct candump *log;  /* NULL for a capture */
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] INPUT\n"
+        "\n"
+        "Arguments:\n"
+        "  INPUT    candump log or capture file to process\n"
+        "\n"
+        "Options:\n"
+        "  --filter, -f ID[:MASK]\n"
+        "                   Keep only frames matching a hex ID and mask, eight\n"
+        "                   digits being an extended ID; may be given up to %d\n"
+        "                   times (default: keep every frame)\n"
+        "  --output, -o FILE\n"
+        "                   Write the frames kept to a capture file\n"
+        "  --text, -t       Write the output as a candump log instead\n"
+        "  --stats, -s      Print statistics for every ID\n"
+        "  --jobs, -j N     Use N threads (default: one per core)\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, MAX_FILTERS
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+/* Parse ID[:MASK] with hex numbers, as in candump filters. Returns 0 on
+ * success and -1 if the filter is malformed.
+ */
+static int parse_filter(const char *s, struct filter *f)
+{
+    char *end;
+    int eff;
+
+    f->id = strtoul(s, &end, 16);
+    if (end == s) {
+        return -1;
+    }
+
+    /* Eight digits make an extended ID, as in candump logs */
+    eff = (f->id > CAN_SFF_MASK || 8 == end - s);
+    f->mask = eff ? CAN_EFF_MASK : CAN_SFF_MASK;
+    if (':' == *end) {
+        s = end + 1;
+        f->mask = strtoul(s, &end, 16);
+        if (end == s) {
+            return -1;
+        }
+    }
+
+    /* Extended IDs only match extended frames and vice versa */
+    if (eff) {
+        f->id |= CAN_EFF_FLAG;
+    }
+    f->mask |= CAN_EFF_FLAG;
+
+    return ('\0' == *end) ? 0 : -1;
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"filter", required_argument, NULL, 'f'},
+        {"output", required_argument, NULL, 'o'},
+        {"text", no_argument, NULL, 't'},
+        {"stats", no_argument, NULL, 's'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+    args->threads = parallel_default_threads();
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "f:o:tsj:Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'f':
+            if (args->nfilters == MAX_FILTERS) {
+                error(EXIT_FAILURE, 0, "at most %d filters", MAX_FILTERS);
+            }
+            if (-1 == parse_filter(optarg, &args->filters[args->nfilters++])) {
+                error(EXIT_FAILURE, 0, "invalid filter: %s", optarg);
+            }
+            break;
+        case 'o':
+            args->output = optarg;
+            break;
+        case 't':
+            args->text = 1;
+            break;
+        case 's':
+            args->stats = 1;
+            break;
+        case 'j':
+            args->threads = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->threads || args->threads > 1024) {
+                error(EXIT_FAILURE, 0, "invalid thread count: %s", optarg);
+            }
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 1) {
+        error(0, 0, "an input file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    if (args->text && NULL == args->output) {
+        error(EXIT_FAILURE, 0, "--text needs --output");
+    }
+
+    args->input = argv[optind];
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int matches(const struct args *args, canid_t can_id)
+{
+    unsigned int i;
+
+    if (0 == args->nfilters) {
+        return 1;
+    }
+    for (i = 0; i < args->nfilters; i++) {
+        if (0 == ((can_id ^ args->filters[i].id) & args->filters[i].mask)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void count(struct counts *c, const struct canlog_record *r)
+{
+    const uint32_t key = idtable_key(r->can_id);
+    struct id_stats *s;
+    uint32_t slot;
+
+    slot = idtable_find(&c->index, key);
+    if (IDTABLE_EMPTY == slot) {
+        slot = c->index.count;
+        if (1 != idtable_insert(&c->index, key, slot)) {
+            c->untracked++;
+            return;
+        }
+        s = &c->ids[slot];
+        s->can_id = key;
+        s->frames = 0;
+        s->first = r->stamp;
+        s->last = r->stamp;
+        s->min_len = r->len;
+        s->max_len = r->len;
+    }
+
+    s = &c->ids[slot];
+    s->frames++;
+    s->first = (r->stamp < s->first) ? r->stamp : s->first;
+    s->last = (r->stamp > s->last) ? r->stamp : s->last;
+    s->min_len = (r->len < s->min_len) ? r->len : s->min_len;
+    s->max_len = (r->len > s->max_len) ? r->len : s->max_len;
+}
+
+/* Room for n more bytes of output */
+static char *reserve(struct chunk *chunk, size_t n)
+{
+    if (chunk->fill + n > chunk->size) {
+        const size_t size = (chunk->size > 0) ? 2 * chunk->size : 1 << 16;
+        char *out = realloc(chunk->out, size);
+        if (NULL == out) {
+            chunk->failed = 1;
+            return NULL;
+        }
+        chunk->out = out;
+        chunk->size = size;
+    }
+    return chunk->out + chunk->fill;
+}
+
+static int take(void *ctx, const struct canlog_record *r)
+{
+    struct pass *pass = ctx;
+    struct chunk *chunk = pass->chunk;
+    const struct args *args = pass->job->args;
+    char *p;
+
+    chunk->frames++;
+    if (!matches(args, r->can_id)) {
+        return 0;
+    }
+
+    if (0 == chunk->matched || r->stamp < chunk->first) {
+        chunk->first = r->stamp;
+    }
+    if (0 == chunk->matched || r->stamp > chunk->last) {
+        chunk->last = r->stamp;
+    }
+    chunk->matched++;
+
+    if (args->stats) {
+        count(pass->counts, r);
+    }
+
+    if (NULL == args->output) {
+        return 0;
+    }
+
+    if (args->text) {
+        const char *name = (NULL != pass->log) ?
+                           pass->log->channels[r->channel] : pass->job->names[r->channel];
+        p = reserve(chunk, CANDUMP_MAX_LINE);
+        if (NULL == p) {
+            return -1;
+        }
+        chunk->fill += candump_format(p, r, name);
+    } else {
+        p = reserve(chunk, sizeof(*r));
+        if (NULL == p) {
+            return -1;
+        }
+        memcpy(p, r, sizeof(*r));
+        chunk->fill += sizeof(*r);
+    }
+    return 0;
+}
+
+static size_t line_boundary(void *ctx, const char *data, size_t size, size_t offset)
+{
+    const char *nl = memchr(data + offset, '\n', size - offset);
+
+    (void)ctx;
+    return (NULL != nl) ? (size_t)(nl - data) + 1 : size;
+}
+
+static size_t record_boundary(void *ctx, const char *data, size_t size, size_t offset)
+{
+    const size_t rounded = (offset + sizeof(struct canlog_record) - 1) /
+                           sizeof(struct canlog_record) * sizeof(struct canlog_record);
+
+    (void)ctx;
+    (void)data;
+    return (rounded < size) ? rounded : size;
+}
+
+static void *process(void *ctx, unsigned int worker, const char *data, size_t size)
+{
+    struct job *job = ctx;
+    struct chunk *chunk;
+    struct pass pass;
+
+    chunk = calloc(1, sizeof(*chunk));
+    if (NULL == chunk) {
+        return NULL;
+    }
+
+    pass.job = job;
+    pass.counts = &job->counts[worker];
+    pass.chunk = chunk;
+
+    if (job->capture) {
+        const struct canlog_record *records = (const void *)data;
+        const size_t n = size / sizeof(*records);
+        size_t i;
+
+        pass.log = NULL;
+        for (i = 0; i < n && 0 == take(&pass, &records[i]); i++) {
+        }
+    } else {
+        struct candump log;
+
+        candump_init(&log, data, size);
+        pass.log = &log;
+        candump_each(&log, take, &pass);
+        chunk->skipped = log.skipped;
+        memcpy(chunk->channels, log.channels, sizeof(chunk->channels));
+        chunk->nchannels = log.nchannels;
+    }
+
+    return chunk;
+}
+
+/* Global channel of a chunk's local one, numbering new interfaces in order */
+static int global_channel(struct job *job, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < job->nchannels; i++) {
+        if (0 == strcmp(job->channels[i], name)) {
+            return i;
+        }
+    }
+    if (job->nchannels == CANDUMP_MAX_CHANNELS) {
+        return -1;
+    }
+    strcpy(job->channels[i], name);
+    job->nchannels++;
+    return i;
+}
+
+/* Renumber the channels of a candump chunk's records after the interfaces
+ * of the whole log, as each chunk numbered them in its own order
+ */
+static void renumber(struct job *job, struct chunk *chunk)
+{
+    uint8_t map[CANDUMP_MAX_CHANNELS];
+    int identity = 1;
+    unsigned int i;
+    size_t off;
+
+    for (i = 0; i < chunk->nchannels; i++) {
+        const int channel = global_channel(job, chunk->channels[i]);
+        map[i] = (channel < 0) ? 0 : channel;
+        identity &= (map[i] == i);
+    }
+
+    if (identity || job->capture || job->args->text) {
+        return;
+    }
+
+    for (off = 0; off < chunk->fill; off += sizeof(struct canlog_record)) {
+        struct canlog_record *r = (struct canlog_record *)(chunk->out + off);
+        r->channel = map[r->channel];
+    }
+}
+
+static void merge(void *ctx, size_t index, void *result)
+{
+    struct job *job = ctx;
+    struct chunk *chunk = result;
+
+    (void)index;
+
+    if (NULL == chunk || chunk->failed) {
+        job->failed = ENOMEM;
+    } else {
+        renumber(job, chunk);
+
+        if (NULL != job->out && !job->failed && chunk->fill > 0 &&
+            1 != fwrite(chunk->out, chunk->fill, 1, job->out)) {
+            job->failed = errno;
+        }
+
+        if (chunk->matched > 0) {
+            if (0 == job->matched || chunk->first < job->first) {
+                job->first = chunk->first;
+            }
+            if (0 == job->matched || chunk->last > job->last) {
+                job->last = chunk->last;
+            }
+        }
+        job->frames += chunk->frames;
+        job->matched += chunk->matched;
+        job->skipped += chunk->skipped;
+    }
+
+    if (NULL != chunk) {
+        free(chunk->out);
+        free(chunk);
+    }
+}
+
+static int by_id(const void *a, const void *b)
+{
+    const struct id_stats *x = a;
+    const struct id_stats *y = b;
+    return (x->can_id > y->can_id) - (x->can_id < y->can_id);
+}
+
+/* Fold the counts of every thread into the first and print them by ID */
+static void print_stats(struct job *job)
+{
+    struct counts *total = &job->counts[0];
+    unsigned int t;
+    uint32_t i;
+
+    for (t = 1; t < job->args->threads; t++) {
+        const struct counts *c = &job->counts[t];
+
+        total->untracked += c->untracked;
+        for (i = 0; i < c->index.count; i++) {
+            const struct id_stats *s = &c->ids[i];
+            uint32_t slot = idtable_find(&total->index, s->can_id);
+
+            if (IDTABLE_EMPTY == slot) {
+                slot = total->index.count;
+                if (1 != idtable_insert(&total->index, s->can_id, slot)) {
+                    total->untracked += s->frames;
+                    continue;
+                }
+                total->ids[slot] = *s;
+                continue;
+            }
+
+            total->ids[slot].frames += s->frames;
+            total->ids[slot].first = (s->first < total->ids[slot].first) ? s->first : total->ids[slot].first;
+            total->ids[slot].last = (s->last > total->ids[slot].last) ? s->last : total->ids[slot].last;
+            total->ids[slot].min_len = (s->min_len < total->ids[slot].min_len) ? s->min_len : total->ids[slot].min_len;
+            total->ids[slot].max_len = (s->max_len > total->ids[slot].max_len) ? s->max_len : total->ids[slot].max_len;
+        }
+    }
+
+    qsort(total->ids, total->index.count, sizeof(*total->ids), by_id);
+
+    printf("%8s %12s %12s %7s\n", "ID", "Frames", "Period ms", "Length");
+    for (i = 0; i < total->index.count; i++) {
+        const struct id_stats *s = &total->ids[i];
+        const double period = (s->frames > 1) ? (s->last - s->first) / 1e6 / (s->frames - 1) : 0.0;
+
+        if (s->can_id & CAN_EFF_FLAG) {
+            printf("%08X", s->can_id & CAN_EFF_MASK);
+        } else {
+            printf("%8X", s->can_id);
+        }
+        printf(" %12llu %12.3f %3u-%-3u\n",
+               (unsigned long long)s->frames, period, s->min_len, s->max_len);
+    }
+    if (total->untracked > 0) {
+        printf("%llu frames of IDs beyond the first %d not counted\n",
+               (unsigned long long)total->untracked, MAX_IDS);
+    }
+}
+
+static void print_time(uint64_t stamp)
+{
+    printf("%llu.%09llu",
+           (unsigned long long)(stamp / 1000000000),
+           (unsigned long long)(stamp % 1000000000));
+}
+
+int main(int argc, char **argv)
+{
+    struct canlog_header header;
+    struct parallel parallel;
+    struct candump input;
+    struct args args;
+    struct job *job;
+    const char *data;
+    size_t size;
+    double t0;
+    long chunks;
+    unsigned int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    if (-1 == candump_open(&input, args.input)) {
+        error(EXIT_FAILURE, errno, "%s", args.input);
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (NULL == job) {
+        error(EXIT_FAILURE, errno, "calloc");
+    }
+    job->args = &args;
+
+    /* A capture file starts with its header, anything else is taken as text */
+    data = input.data;
+    size = input.size;
+    if (size >= sizeof(header) && 0 == memcmp(data, CANLOG_MAGIC, sizeof(header.magic))) {
+        memcpy(&header, data, sizeof(header));
+        if (!canlog_header_valid(&header)) {
+            error(EXIT_FAILURE, 0, "%s: unsupported capture file", args.input);
+        }
+        job->capture = 1;
+        data += sizeof(header);
+        size = (size - sizeof(header)) / sizeof(struct canlog_record) * sizeof(struct canlog_record);
+        for (i = 0; i < CANDUMP_MAX_CHANNELS; i++) {
+            snprintf(job->names[i], IFNAMSIZ, "can%u", i);
+        }
+    }
+
+    if (args.stats) {
+        job->counts = calloc(args.threads, sizeof(*job->counts));
+        if (NULL == job->counts) {
+            error(EXIT_FAILURE, errno, "calloc");
+        }
+        for (i = 0; i < args.threads; i++) {
+            job->counts[i].ids = malloc(MAX_IDS * sizeof(*job->counts[i].ids));
+            if (NULL == job->counts[i].ids || -1 == idtable_init(&job->counts[i].index, MAX_IDS)) {
+                error(EXIT_FAILURE, errno, "malloc");
+            }
+        }
+    }
+
+    if (NULL != args.output) {
+        job->out = fopen(args.output, "w");
+        if (NULL == job->out) {
+            error(EXIT_FAILURE, errno, "%s", args.output);
+        }
+        setvbuf(job->out, NULL, _IOFBF, OUTPUT_BUFFER);
+
+        /* The record count is filled in once it is known */
+        if (!args.text) {
+            canlog_header_init(&header, 0);
+            if (1 != fwrite(&header, sizeof(header), 1, job->out)) {
+                error(EXIT_FAILURE, errno, "%s", args.output);
+            }
+        }
+    }
+
+    parallel.boundary = job->capture ? record_boundary : line_boundary;
+    parallel.work = process;
+    parallel.merge = merge;
+    parallel.ctx = job;
+    parallel.chunk_size = CHUNK_SIZE;
+    parallel.threads = args.threads;
+
+    t0 = now();
+    chunks = parallel_run(&parallel, data, size);
+    if (-1 == chunks) {
+        error(EXIT_FAILURE, errno, "%s", args.input);
+    }
+    if (0 != job->failed) {
+        error(EXIT_FAILURE, job->failed, "%s", (ENOMEM == job->failed) ? args.input : args.output);
+    }
+
+    if (NULL != job->out) {
+        if (!args.text) {
+            canlog_header_init(&header, job->matched);
+            if (0 != fseek(job->out, 0, SEEK_SET) ||
+                1 != fwrite(&header, sizeof(header), 1, job->out)) {
+                error(EXIT_FAILURE, errno, "%s", args.output);
+            }
+        }
+        if (0 != fclose(job->out)) {
+            error(EXIT_FAILURE, errno, "%s", args.output);
+        }
+    }
+
+    printf("%s: %llu frames, %llu kept, %llu lines skipped\n", args.input,
+           (unsigned long long)job->frames, (unsigned long long)job->matched,
+           (unsigned long long)job->skipped);
+    printf("%ld chunks on %u threads in %.3f s, %.1f MB/s\n",
+           chunks, args.threads, now() - t0, input.size / (now() - t0) / 1e6);
+    if (job->matched > 0) {
+        printf("Frames kept from ");
+        print_time(job->first);
+        printf(" to ");
+        print_time(job->last);
+        putchar('\n');
+    }
+    if (!job->capture && NULL != args.output && !args.text) {
+        for (i = 0; i < job->nchannels; i++) {
+            printf("  channel %u: %s\n", i, job->channels[i]);
+        }
+    }
+
+    if (args.stats) {
+        print_stats(job);
+        for (i = 0; i < args.threads; i++) {
+            idtable_free(&job->counts[i].index);
+            free(job->counts[i].ids);
+        }
+        free(job->counts);
+    }
+
+    free(job);
+    candump_close(&input);
+    return EXIT_SUCCESS;
+}
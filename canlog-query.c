@@ -0,0 +1,280 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Columnar Capture Query
+
+This program reads the frames of one CAN ID over a span of time from a
+columnar store written by canlog-columns, and prints them as candump log
+lines. Only the blocks of that ID which overlap the span are read. Without
+an ID, it lists the IDs in the store.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include <linux/can.h>
+
+#include "candump.h"
+#include "colstore.h"
+
+#define VERSION "2.0.0"
+
+struct args
+{
+    const char *store;
+    canid_t can_id;
+    int have_id;
+    uint64_t from;
+    uint64_t to;
+    int count;
+};
+
+struct output
+{
+    const struct colstore *store;
+    uint64_t frames;
+    int count;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] STORE\n"
+        "\n"
+        "Arguments:\n"
+        "  STORE    Columnar store to query\n"
+        "\n"
+        "Options:\n"
+        "  --id, -i ID      Print the frames of a hex CAN ID, eight digits being\n"
+        "                   an extended ID (default: list the IDs)\n"
+        "  --from, -f SEC   Start at this time, in seconds since the epoch\n"
+        "  --to, -t SEC     End at this time, in seconds since the epoch\n"
+        "  --count, -c      Print the number of frames instead of the frames\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+/* Parse SEC[.FRACTION] into nanoseconds. Returns 0 on success and -1 if the
+ * time is malformed.
+ */
+static int parse_time(const char *s, uint64_t *ns)
+{
+    uint64_t scale = 100000000;
+    char *end;
+
+    *ns = strtoull(s, &end, 10) * UINT64_C(1000000000);
+    if (end == s) {
+        return -1;
+    }
+    if ('.' == *end) {
+        for (s = end + 1; *s >= '0' && *s <= '9'; s++) {
+            *ns += (*s - '0') * scale;
+            scale /= 10;
+        }
+        end = (char *)s;
+    }
+    return ('\0' == *end) ? 0 : -1;
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"id", required_argument, NULL, 'i'},
+        {"from", required_argument, NULL, 'f'},
+        {"to", required_argument, NULL, 't'},
+        {"count", no_argument, NULL, 'c'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+    args->to = UINT64_MAX;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "i:f:t:cVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'i':
+            args->can_id = strtoul(optarg, &end, 16);
+            if ('\0' != *end || end == optarg || args->can_id > CAN_EFF_MASK) {
+                error(EXIT_FAILURE, 0, "invalid ID: %s", optarg);
+            }
+            if (args->can_id > CAN_SFF_MASK || 8 == end - optarg) {
+                args->can_id |= CAN_EFF_FLAG;
+            }
+            args->have_id = 1;
+            break;
+        case 'f':
+            if (-1 == parse_time(optarg, &args->from)) {
+                error(EXIT_FAILURE, 0, "invalid time: %s", optarg);
+            }
+            break;
+        case 't':
+            if (-1 == parse_time(optarg, &args->to)) {
+                error(EXIT_FAILURE, 0, "invalid time: %s", optarg);
+            }
+            break;
+        case 'c':
+            args->count = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 1) {
+        error(0, 0, "a store argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->store = argv[optind];
+}
+
+static void print_time(uint64_t stamp)
+{
+    printf("%llu.%09llu",
+           (unsigned long long)(stamp / 1000000000),
+           (unsigned long long)(stamp % 1000000000));
+}
+
+static void print_id(canid_t can_id)
+{
+    if (can_id & (CAN_EFF_FLAG | CAN_ERR_FLAG)) {
+        printf("%08X", can_id & (CAN_EFF_MASK | CAN_ERR_FLAG));
+    } else {
+        printf("%8X", can_id);
+    }
+}
+
+static void list_ids(const struct colstore *s)
+{
+    uint32_t i;
+
+    printf("%llu frames of %u IDs from ", (unsigned long long)s->header->frames, s->header->nids);
+    print_time(s->header->first);
+    printf(" to ");
+    print_time(s->header->last);
+    printf("\n%8s %12s %8s  %s\n", "ID", "Frames", "Blocks", "Span");
+
+    for (i = 0; i < s->header->nids; i++) {
+        const struct colstore_id *id = &s->ids[i];
+        const struct colstore_block *last = &s->blocks[id->block + id->nblocks - 1];
+
+        print_id(id->can_id);
+        printf(" %12llu %8u  ", (unsigned long long)id->frames, id->nblocks);
+        print_time(s->blocks[id->block].first);
+        printf(" to ");
+        print_time(last->last);
+        putchar('\n');
+    }
+}
+
+static int print_frame(void *ctx, const struct canlog_record *r)
+{
+    struct output *out = ctx;
+    char line[CANDUMP_MAX_LINE];
+    const char *name = "can";
+
+    out->frames++;
+    if (out->count) {
+        return 0;
+    }
+
+    if (r->channel < out->store->header->nchannels) {
+        name = out->store->header->channels[r->channel];
+    }
+    fwrite(line, candump_format(line, r, name), 1, stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const struct colstore_id *id;
+    struct colstore store;
+    struct output out;
+    struct args args;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    if (-1 == colstore_open(&store, args.store)) {
+        if (EINVAL == errno) {
+            error(EXIT_FAILURE, 0, "%s: not a columnar store", args.store);
+        }
+        error(EXIT_FAILURE, errno, "%s", args.store);
+    }
+
+    if (!args.have_id) {
+        list_ids(&store);
+        colstore_close(&store);
+        return EXIT_SUCCESS;
+    }
+
+    out.store = &store;
+    out.frames = 0;
+    out.count = args.count;
+
+    id = colstore_find(&store, args.can_id);
+    if (NULL != id) {
+        colstore_query(&store, id, args.from, args.to, print_frame, &out);
+    }
+
+    if (args.count) {
+        printf("%llu\n", (unsigned long long)out.frames);
+    }
+
+    colstore_close(&store);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,196 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Flight Recorder Recovery
+
+This program extracts the frames which survived in a flight recorder ring
+file (see --ring-file of the raw demo) after the recorder crashed or the
+machine lost power. The records of the ring's last lap are written, oldest
+first, to an ordinary capture file. The ring file itself is only read.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "canlog.h"
+#include "flightrec.h"
+
+#define VERSION "2.0.0"
+
+struct args
+{
+    const char *ring;
+    const char *output;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] RING OUTPUT\n"
+        "\n"
+        "Arguments:\n"
+        "  RING     Flight recorder ring file to recover\n"
+        "  OUTPUT   Capture file to write\n"
+        "\n"
+        "Options:\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        error(0, 0, "a ring file and an output file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->ring = argv[optind];
+    args->output = argv[optind + 1];
+}
+
+static void print_time(uint64_t stamp)
+{
+    printf("%llu.%09llu",
+           (unsigned long long)(stamp / 1000000000),
+           (unsigned long long)(stamp % 1000000000));
+}
+
+int main(int argc, char **argv)
+{
+    const struct canlog_ring *ring;
+    const struct canlog_record *records;
+    struct canlog_header header;
+    struct args args;
+    struct stat st;
+    uint64_t first;
+    uint64_t end;
+    uint64_t i;
+    FILE *out;
+    void *map;
+    int fd;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    fd = open(args.ring, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd || -1 == fstat(fd, &st)) {
+        error(EXIT_FAILURE, errno, "%s", args.ring);
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == map) {
+        error(EXIT_FAILURE, errno, "%s", args.ring);
+    }
+
+    if (-1 == flightrec_scan(map, st.st_size, &first, &end)) {
+        error(EXIT_FAILURE, 0, "%s: not a flight recorder ring file", args.ring);
+    }
+
+    ring = map;
+    records = (const struct canlog_record *)((const char *)map + CANLOG_RING_DATA);
+
+    out = fopen(args.output, "w");
+    if (NULL == out) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    canlog_header_init(&header, end - first);
+    fwrite(&header, sizeof(header), 1, out);
+
+    /* Clear the ring tags, they mean nothing outside of the ring */
+    for (i = first; i < end; i++) {
+        struct canlog_record r = records[i & (ring->capacity - 1)];
+        r.lap = 0;
+        fwrite(&r, sizeof(r), 1, out);
+    }
+
+    if (0 != fclose(out)) {
+        error(EXIT_FAILURE, errno, "%s", args.output);
+    }
+
+    printf("%s: recovered %llu of %llu frames recorded",
+           args.output, (unsigned long long)(end - first), (unsigned long long)end);
+    if (end > first) {
+        printf(", ");
+        print_time(records[first & (ring->capacity - 1)].stamp);
+        printf(" to ");
+        print_time(records[(end - 1) & (ring->capacity - 1)].stamp);
+    }
+    putchar('\n');
+
+    if (end != ring->head) {
+        printf("The stored head (%llu) was %s the records on disk\n",
+               (unsigned long long)ring->head, (ring->head < end) ? "behind" : "ahead of");
+    }
+
+    munmap(map, st.st_size);
+    close(fd);
+    return EXIT_SUCCESS;
+}
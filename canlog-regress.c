@@ -0,0 +1,758 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Record/Replay Regression Harness
+
+This program checks a demo against a recorded capture. It starts the demo,
+sends the frames of a capture file or candump log to it over a CAN interface
+(a vcan interface keeps the run off any real bus) with their recorded timing,
+and records every frame the demo transmits in response. The responses are
+compared against a golden capture, frame by frame, ignoring their times, and
+the differences are printed as candump log lines. With --update, the golden
+capture is written instead.
+
+Along the way, the response rate and the latency from each frame sent to the
+responses it caused are measured. Appending them to a history file with
+--history keeps a record of how fast the demo's receive and transmit path is
+from one change to the next.
+
+The harness has the frames it sends echoed back to it, and takes the kernel
+timestamp of each echo as the time the frame went out, so that latencies
+compare two kernel timestamps rather than one taken by the sender after its
+write returned. Echoes are told apart by MSG_CONFIRM and not recorded, so on an
+otherwise quiet interface every response recorded came from the demo.
+
+A demo which exits with a failure status or is killed by a signal other than
+the SIGTERM which ends the run fails the run, whatever its responses.
+*/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "candump.h"
+#include "canlog.h"
+#include "replay.h"
+
+#define VERSION "2.0.0"
+
+/* Default time given to the demo to start up, and to answer the last frame */
+#define DEFAULT_SETTLE_MS (500)
+
+/* How often the receiver checks whether to stop */
+#define RECV_TIMEOUT_US (50000)
+
+/* Differences printed before giving up */
+#define MAX_DIFFS (10)
+
+/* Responses recorded beyond one per frame sent */
+#define SPARE_RESPONSES (65536)
+
+struct args
+{
+    const char *iface;
+    const char *input;
+    char **command;
+    const char *golden;
+    const char *output;
+    const char *history;
+    double speed;
+    unsigned long settle;   /* Milliseconds */
+    int update;
+    int quiet;
+};
+
+struct receiver
+{
+    int sfd;
+    uint64_t *sent;         /* Time each frame sent was echoed back */
+    size_t nsent;
+    size_t echoes;
+    struct canlog_record *responses;
+    size_t capacity;
+    size_t count;
+    uint64_t overflow;      /* Responses beyond the capacity */
+    atomic_int running;
+    pthread_t thread;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] IFACE INPUT -- COMMAND [ARGS...]\n"
+        "\n"
+        "Arguments:\n"
+        "  IFACE    CAN network interface shared with the demo (e.g. vcan0)\n"
+        "  INPUT    Capture file or candump log to send\n"
+        "  COMMAND  Demo to start, with its arguments (e.g. ./socketcan-raw-demo vcan0)\n"
+        "\n"
+        "Options:\n"
+        "  --golden, -g FILE\n"
+        "                   Compare the responses against this capture\n"
+        "  --update, -u     Write the responses to the --golden capture instead\n"
+        "  --output, -o FILE\n"
+        "                   Write the responses to this capture as well\n"
+        "  --history, -H FILE\n"
+        "                   Append the results to this file, one line per run\n"
+        "  --speed, -s X    Send X times as fast as recorded, 0 for as fast as\n"
+        "                   possible (default: 1)\n"
+        "  --settle, -w MS  Wait this long for the demo to start, and for the\n"
+        "                   last responses (default: %d)\n"
+        "  --quiet, -q      Only print differences\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, DEFAULT_SETTLE_MS
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"golden", required_argument, NULL, 'g'},
+        {"update", no_argument, NULL, 'u'},
+        {"output", required_argument, NULL, 'o'},
+        {"history", required_argument, NULL, 'H'},
+        {"speed", required_argument, NULL, 's'},
+        {"settle", required_argument, NULL, 'w'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+    args->speed = 1.0;
+    args->settle = DEFAULT_SETTLE_MS;
+
+    for (;;) {
+        /* Leave the demo's own options alone */
+        const int opt = getopt_long(argc, argv, "+g:uo:H:s:w:qVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'g':
+            args->golden = optarg;
+            break;
+        case 'u':
+            args->update = 1;
+            break;
+        case 'o':
+            args->output = optarg;
+            break;
+        case 'H':
+            args->history = optarg;
+            break;
+        case 's':
+            args->speed = strtod(optarg, &end);
+            if ('\0' != *end || end == optarg || !(args->speed >= 0)) {
+                error(EXIT_FAILURE, 0, "invalid speed: %s", optarg);
+            }
+            break;
+        case 'w':
+            args->settle = strtoul(optarg, &end, 0);
+            if ('\0' != *end || end == optarg) {
+                error(EXIT_FAILURE, 0, "invalid settle time: %s", optarg);
+            }
+            break;
+        case 'q':
+            args->quiet = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Option parsing stops at the interface, so the "--" before the command
+     * is still there
+     */
+    if ((argc - optind) > 2 && 0 == strcmp(argv[optind + 2], "--")) {
+        argv[optind + 2] = argv[optind + 1];
+        argv[optind + 1] = argv[optind];
+        optind++;
+    }
+
+    if ((argc - optind) < 3) {
+        error(0, 0, "an interface, an input file and a command argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+    if (args->update && NULL == args->golden) {
+        error(EXIT_FAILURE, 0, "--update needs a --golden capture to write");
+    }
+
+    args->iface = argv[optind];
+    args->input = argv[optind + 1];
+    args->command = &argv[optind + 2];
+}
+
+static int init_socket(const char *iface)
+{
+    const struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = RECV_TIMEOUT_US,
+    };
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int sfd;
+    int rc;
+
+    /* Create a raw CAN socket, which the demo does not inherit */
+    sfd = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+
+    /* Determine the interface index */
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ);
+    rc = ioctl(sfd, SIOCGIFINDEX, &ifr);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "ioctl");
+    }
+
+    /* Have the kernel timestamp every received frame, echo the frames sent
+     * back to timestamp them too, and let reads time out so that the receiver
+     * notices when to stop
+     */
+    if (-1 == setsockopt(sfd, SOL_SOCKET, SO_TIMESTAMPNS, &(int){1}, sizeof(int)) ||
+        -1 == setsockopt(sfd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &(int){1}, sizeof(int)) ||
+        -1 == setsockopt(sfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))) {
+        error(EXIT_FAILURE, errno, "setsockopt");
+    }
+
+    /* Set the local address to bind to */
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    /* Bind the address to the socket */
+    rc = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+
+    return sfd;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void sleep_ms(unsigned long ms)
+{
+    const struct timespec ts = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (ms % 1000) * 1000000L,
+    };
+    nanosleep(&ts, NULL);
+}
+
+struct records
+{
+    struct canlog_record *r;
+    size_t n;
+    size_t capacity;
+};
+
+static int gather(void *ctx, const struct canlog_record *r)
+{
+    struct records *records = ctx;
+
+    if (records->n == records->capacity) {
+        const size_t capacity = records->capacity ? 2 * records->capacity : 65536;
+        struct canlog_record *p = realloc(records->r, capacity * sizeof(*p));
+        if (NULL == p) {
+            return -1;
+        }
+        records->r = p;
+        records->capacity = capacity;
+    }
+    records->r[records->n++] = *r;
+    return 0;
+}
+
+/* Read a capture file or a candump log into memory */
+static void load(const char *path, struct records *records)
+{
+    struct canlog_header header;
+    struct candump input;
+
+    memset(records, 0, sizeof(*records));
+    if (-1 == candump_open(&input, path)) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+
+    if (input.size >= sizeof(header) &&
+        0 == memcmp(input.data, CANLOG_MAGIC, sizeof(header.magic))) {
+        memcpy(&header, input.data, sizeof(header));
+        if (!canlog_header_valid(&header)) {
+            error(EXIT_FAILURE, 0, "%s: unsupported capture file", path);
+        }
+        records->n = (input.size - sizeof(header)) / sizeof(struct canlog_record);
+        records->capacity = records->n;
+        records->r = malloc((records->n ? records->n : 1) * sizeof(*records->r));
+        if (NULL == records->r) {
+            error(EXIT_FAILURE, errno, "malloc");
+        }
+        memcpy(records->r, input.data + sizeof(header), records->n * sizeof(*records->r));
+    } else if (0 != candump_each(&input, gather, records)) {
+        error(EXIT_FAILURE, ENOMEM, "%s", path);
+    }
+
+    candump_close(&input);
+}
+
+static void write_capture(const char *path, const struct canlog_record *records, size_t n)
+{
+    struct canlog_header header;
+    FILE *out;
+
+    out = fopen(path, "w");
+    if (NULL == out) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+
+    canlog_header_init(&header, n);
+    if (1 != fwrite(&header, sizeof(header), 1, out) ||
+        n != fwrite(records, sizeof(*records), n, out) ||
+        0 != fclose(out)) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+}
+
+/* Record every frame received until told to stop, and the time of every frame
+ * sent from its echo
+ */
+static void *receive_loop(void *arg)
+{
+    struct receiver *rx = arg;
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct can_frame frame;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    sigset_t mask;
+
+    /* Leave every signal to the main thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (atomic_load(&rx->running)) {
+        uint64_t stamp = 0;
+
+        iov.iov_base = &frame;
+        iov.iov_len = sizeof(frame);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (-1 == recvmsg(rx->sfd, &msg, 0)) {
+            if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+                continue;
+            }
+            error(0, errno, "recvmsg");
+            break;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (SOL_SOCKET == cmsg->cmsg_level && SO_TIMESTAMPNS == cmsg->cmsg_type) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                stamp = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+            }
+        }
+        if (0 == stamp) {
+            stamp = now_ns();
+        }
+
+        if (msg.msg_flags & MSG_CONFIRM) {
+            if (rx->echoes < rx->nsent) {
+                rx->sent[rx->echoes++] = stamp;
+            }
+            continue;
+        }
+
+        if (rx->count < rx->capacity) {
+            canlog_record_set(&rx->responses[rx->count++], stamp, &frame, CANLOG_TX, 0);
+        } else {
+            rx->overflow++;
+        }
+    }
+
+    return NULL;
+}
+
+static pid_t start_demo(char **command)
+{
+    pid_t pid;
+    int null;
+
+    pid = fork();
+    if (-1 == pid) {
+        error(EXIT_FAILURE, errno, "fork");
+    }
+    if (0 != pid) {
+        return pid;
+    }
+
+    /* Keep the demo's per-frame output from slowing it down */
+    null = open("/dev/null", O_WRONLY);
+    if (-1 != null) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+
+    execvp(command[0], command);
+    error(127, errno, "%s", command[0]);
+    return -1;
+}
+
+/* Send every frame with its recorded timing */
+static void send_frames(int sfd, const struct records *input, double speed)
+{
+    struct replay_clock clock;
+    struct can_frame frame;
+    size_t i;
+
+    replay_clock_init(&clock, input->r, input->n, speed);
+
+    for (i = 0; i < input->n; i++) {
+        const struct canlog_record *r = &input->r[i];
+        const uint64_t due = replay_due(&clock, r->stamp, 0);
+        uint64_t now = monotonic_ns();
+
+        while (due > now) {
+            const struct timespec ts = {
+                .tv_sec = due / 1000000000,
+                .tv_nsec = due % 1000000000,
+            };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            now = monotonic_ns();
+        }
+
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = r->can_id;
+        frame.len = r->len;
+        memcpy(frame.data, r->data, CAN_MAX_DLEN);
+
+        while (-1 == write(sfd, &frame, sizeof(frame))) {
+            if (ENOBUFS != errno && EINTR != errno) {
+                error(EXIT_FAILURE, errno, "write");
+            }
+            sleep_ms(1);
+        }
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+struct latency
+{
+    uint64_t count;
+    double mean;            /* Microseconds */
+    double p99;
+    double max;
+};
+
+/* Latency of every response from the last frame sent before it */
+static void measure(const uint64_t *sent, size_t nsent,
+                    const struct canlog_record *responses, size_t nresponses,
+                    struct latency *lat)
+{
+    uint64_t *samples;
+    uint64_t total = 0;
+    size_t i;
+    size_t j = 0;
+
+    memset(lat, 0, sizeof(*lat));
+    samples = malloc((nresponses ? nresponses : 1) * sizeof(*samples));
+    if (NULL == samples) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    for (i = 0; i < nresponses; i++) {
+        const uint64_t stamp = responses[i].stamp;
+
+        while (j < nsent && sent[j] <= stamp) {
+            j++;
+        }
+        if (0 == j) {
+            continue;
+        }
+        samples[lat->count] = stamp - sent[j - 1];
+        total += samples[lat->count];
+        lat->count++;
+    }
+
+    if (lat->count > 0) {
+        qsort(samples, lat->count, sizeof(*samples), compare_u64);
+        lat->mean = total / 1e3 / lat->count;
+        lat->p99 = samples[(lat->count - 1) * 99 / 100] / 1e3;
+        lat->max = samples[lat->count - 1] / 1e3;
+    }
+    free(samples);
+}
+
+static void print_record(char sign, size_t index, const struct canlog_record *r)
+{
+    char line[CANDUMP_MAX_LINE];
+    size_t len;
+
+    len = candump_format(line, r, "can0");
+    printf("%c%8zu %.*s", sign, index, (int)len, line);
+}
+
+static int same_frame(const struct canlog_record *a, const struct canlog_record *b)
+{
+    return a->can_id == b->can_id && a->len == b->len &&
+           0 == memcmp(a->data, b->data, a->len > CAN_MAX_DLEN ? CAN_MAX_DLEN : a->len);
+}
+
+/* Compare the responses against the golden ones, ignoring times. Returns the
+ * number of differences.
+ */
+static size_t compare(const struct records *golden,
+                      const struct canlog_record *responses, size_t n)
+{
+    const size_t common = (golden->n < n) ? golden->n : n;
+    size_t diffs = 0;
+    size_t i;
+
+    for (i = 0; i < common; i++) {
+        if (!same_frame(&golden->r[i], &responses[i])) {
+            if (diffs++ < MAX_DIFFS) {
+                print_record('-', i, &golden->r[i]);
+                print_record('+', i, &responses[i]);
+            }
+        }
+    }
+
+    for (i = common; i < golden->n; i++) {
+        if (diffs++ < MAX_DIFFS) {
+            print_record('-', i, &golden->r[i]);
+        }
+    }
+    for (i = common; i < n; i++) {
+        if (diffs++ < MAX_DIFFS) {
+            print_record('+', i, &responses[i]);
+        }
+    }
+
+    if (diffs > MAX_DIFFS) {
+        printf("... %zu differences in all\n", diffs);
+    }
+    return diffs;
+}
+
+static void append_history(const struct args *args, size_t nsent, size_t nresponses,
+                           double seconds, const struct latency *lat, const char *result)
+{
+    char stamp[32];
+    time_t t = time(NULL);
+    FILE *f;
+    int i;
+
+    f = fopen(args->history, "a");
+    if (NULL == f) {
+        error(EXIT_FAILURE, errno, "%s", args->history);
+    }
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S%z", localtime(&t));
+    fprintf(f, "%s\t%s\t", stamp, args->input);
+    for (i = 0; NULL != args->command[i]; i++) {
+        fprintf(f, "%s%s", (0 == i) ? "" : " ", args->command[i]);
+    }
+    fprintf(f, "\t%g\t%zu\t%zu\t%.0f\t%.1f\t%.1f\t%.1f\t%s\n",
+            args->speed, nsent, nresponses, nresponses / seconds,
+            lat->mean, lat->p99, lat->max, result);
+
+    if (0 != fclose(f)) {
+        error(EXIT_FAILURE, errno, "%s", args->history);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct records input;
+    struct records golden;
+    struct receiver rx;
+    struct latency lat;
+    struct args args;
+    const char *result = "ran";
+    uint64_t t0;
+    double seconds;
+    size_t diffs = 0;
+    pid_t demo;
+    int failed = 0;
+    int status;
+    int rc;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    load(args.input, &input);
+
+    memset(&rx, 0, sizeof(rx));
+    rx.sfd = init_socket(args.iface);
+    rx.nsent = input.n;
+    rx.sent = malloc((input.n ? input.n : 1) * sizeof(*rx.sent));
+    if (NULL == rx.sent) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+    rx.capacity = input.n + SPARE_RESPONSES;
+    rx.responses = malloc(rx.capacity * sizeof(*rx.responses));
+    if (NULL == rx.responses) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    demo = start_demo(args.command);
+    sleep_ms(args.settle);
+    if (0 != waitpid(demo, &status, WNOHANG)) {
+        error(EXIT_FAILURE, 0, "%s exited before any frame was sent", args.command[0]);
+    }
+
+    atomic_init(&rx.running, 1);
+    rc = pthread_create(&rx.thread, NULL, receive_loop, &rx);
+    if (0 != rc) {
+        error(EXIT_FAILURE, rc, "pthread_create");
+    }
+
+    t0 = monotonic_ns();
+    send_frames(rx.sfd, &input, args.speed);
+    seconds = (monotonic_ns() - t0) / 1e9;
+
+    sleep_ms(args.settle);
+    atomic_store(&rx.running, 0);
+    pthread_join(rx.thread, NULL);
+
+    /* A demo still running is ended with SIGTERM, any other end is its own */
+    if (0 == waitpid(demo, &status, WNOHANG)) {
+        kill(demo, SIGTERM);
+        waitpid(demo, &status, 0);
+    }
+    if (WIFEXITED(status) && EXIT_SUCCESS != WEXITSTATUS(status)) {
+        error(0, 0, "%s exited with status %d", args.command[0], WEXITSTATUS(status));
+        failed = 1;
+    } else if (WIFSIGNALED(status) && SIGTERM != WTERMSIG(status)) {
+        error(0, 0, "%s killed by signal %d", args.command[0], WTERMSIG(status));
+        failed = 1;
+    }
+    if (rx.echoes < input.n) {
+        error(0, 0, "%zu frames sent but %zu echoed, latency is measured from those echoed",
+              input.n, rx.echoes);
+    }
+    if (rx.overflow > 0) {
+        error(0, 0, "%llu responses beyond the first %zu not recorded",
+              (unsigned long long)rx.overflow, rx.capacity);
+    }
+
+    measure(rx.sent, rx.echoes, rx.responses, rx.count, &lat);
+
+    if (NULL != args.output) {
+        write_capture(args.output, rx.responses, rx.count);
+    }
+
+    if (failed) {
+        result = "fail";
+    } else if (args.update) {
+        write_capture(args.golden, rx.responses, rx.count);
+        result = "updated";
+    } else if (NULL != args.golden) {
+        load(args.golden, &golden);
+        diffs = compare(&golden, rx.responses, rx.count);
+        result = (0 == diffs) ? "pass" : "fail";
+        free(golden.r);
+    }
+
+    if (!args.quiet) {
+        printf("%zu frames sent in %.3f s, %zu responses (%.0f/s)\n",
+               input.n, seconds, rx.count, rx.count / seconds);
+        printf("Latency: mean %.1f us, p99 %.1f us, max %.1f us\n", lat.mean, lat.p99, lat.max);
+        if (NULL != args.golden) {
+            printf("%s: %s\n", args.golden, result);
+        }
+    }
+
+    if (NULL != args.history) {
+        append_history(&args, input.n, rx.count, seconds, &lat, result);
+    }
+
+    close(rx.sfd);
+    free(rx.responses);
+    free(rx.sent);
+    free(input.r);
+    return (!failed && 0 == diffs) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
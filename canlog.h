@@ -0,0 +1,131 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Binary CAN Capture Format
+
+A capture is a fixed size header followed by fixed size records, one per
+frame, in host byte order. Fixed size records keep writing a frame to a
+single copy and let readers seek to any record by index or map a whole file
+and walk it as an array.
+
+The flight recorder can also keep its ring in a file, so that it survives a
+crash of the process or of the machine. Such a ring file starts with its own
+header page holding the number of records written so far (the commit
+cursor), followed by the slots of the ring. Every record in a ring file
+carries a tag derived from how many times the ring had wrapped when it was
+written, so a reader can tell records of the last lap from stale ones even if
+the cursor did not reach the disk.
+*/
+
+#ifndef CANLOG_H
+#define CANLOG_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#define CANLOG_MAGIC "CANLOG\0\0"
+#define CANLOG_VERSION (1)
+
+/* Record flags */
+#define CANLOG_TX (0x01)    /* Sent by us rather than received */
+
+struct canlog_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;   /* sizeof(struct canlog_record) */
+    uint64_t records;       /* Number of records, 0 if not known */
+    uint64_t reserved;
+};
+
+struct canlog_record
+{
+    uint64_t stamp;         /* Nanoseconds since the epoch */
+    canid_t can_id;         /* With the EFF, RTR and ERR flags */
+    uint8_t len;
+    uint8_t flags;
+    uint8_t channel;
+    uint8_t lap;            /* Ring lap tag in ring files, 0 elsewhere */
+    uint8_t data[CAN_MAX_DLEN];
+};
+
+#define CANLOG_RING_MAGIC "CANRING\0"
+
+/* Offset of the first slot in a ring file */
+#define CANLOG_RING_DATA (4096)
+
+struct canlog_ring
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;   /* sizeof(struct canlog_record) */
+    uint64_t capacity;      /* Slots, a power of two */
+    uint64_t head;          /* Records written so far, stored with release semantics */
+};
+
+static inline void canlog_header_init(struct canlog_header *h, uint64_t records)
+{
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, CANLOG_MAGIC, sizeof(h->magic));
+    h->version = CANLOG_VERSION;
+    h->record_size = sizeof(struct canlog_record);
+    h->records = records;
+}
+
+/* Returns 1 if the header describes a capture this code can read */
+static inline int canlog_header_valid(const struct canlog_header *h)
+{
+    return 0 == memcmp(h->magic, CANLOG_MAGIC, sizeof(h->magic)) &&
+           CANLOG_VERSION == h->version &&
+           sizeof(struct canlog_record) == h->record_size;
+}
+
+static inline void canlog_record_set(
+    struct canlog_record *r,
+    uint64_t stamp,
+    const struct can_frame *frame,
+    uint8_t flags,
+    uint8_t channel)
+{
+    r->stamp = stamp;
+    r->can_id = frame->can_id;
+    r->len = frame->len;
+    r->flags = flags;
+    r->channel = channel;
+    r->lap = 0;
+    memcpy(r->data, frame->data, CAN_MAX_DLEN);
+}
+
+/* Tag of the record with the given index in a ring of 2^shift slots. Tags run
+ * from 1 to 255, so a slot which was never written (0) never matches.
+ */
+static inline uint8_t canlog_lap(uint64_t index, unsigned int shift)
+{
+    return 1 + (index >> shift) % 255;
+}
+
+#endif /* CANLOG_H */
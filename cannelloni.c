@@ -0,0 +1,163 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+cannelloni Framing
+*/
+
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "cannelloni.h"
+
+#define CANFD_FRAME (0x80)
+
+size_t cannelloni_put_frame(uint8_t *p, const struct can_frame *frame)
+{
+    const uint32_t id = htonl(frame->can_id);
+    size_t len = frame->len;
+
+    if (len > CAN_MAX_DLEN) {
+        len = CAN_MAX_DLEN;
+    }
+
+    memcpy(p, &id, sizeof(id));
+    p[4] = len;
+    if (frame->can_id & CAN_RTR_FLAG) {
+        return 5;
+    }
+
+    memcpy(p + 5, frame->data, len);
+    return 5 + len;
+}
+
+size_t cannelloni_finish(struct cannelloni_packet *p, uint8_t seq)
+{
+    p->buf[0] = CANNELLONI_VERSION;
+    p->buf[1] = CANNELLONI_OP_DATA;
+    p->buf[2] = seq;
+    p->buf[3] = p->count >> 8;
+    p->buf[4] = p->count;
+    return p->fill;
+}
+
+/* Decode the frame at p, of which size bytes are available. Returns the size
+ * of its encoding, 0 if it is incomplete, or -1 if it is malformed. Whether it
+ * is a classic frame, which is stored in frame, is stored in classic.
+ */
+static int get_frame(const uint8_t *p, size_t size, struct can_frame *frame, int *classic)
+{
+    uint32_t id;
+    size_t data;
+    size_t len;
+
+    if (size < 5) {
+        return 0;
+    }
+    memcpy(&id, p, sizeof(id));
+    id = ntohl(id);
+    len = p[4] & ~CANFD_FRAME;
+
+    if (p[4] & CANFD_FRAME) {
+        /* The flags byte, then the payload */
+        if (len > CANFD_MAX_DLEN) {
+            return -1;
+        }
+        *classic = 0;
+        return (size < 6 + len) ? 0 : (int)(6 + len);
+    }
+
+    /* Remote frames carry a length but no payload */
+    data = (id & CAN_RTR_FLAG) ? 0 : len;
+    if (len > CAN_MAX_DLEN) {
+        return -1;
+    }
+    if (size < 5 + data) {
+        return 0;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    frame->can_id = id;
+    frame->len = len;
+    memcpy(frame->data, p + 5, data);
+    *classic = 1;
+    return 5 + data;
+}
+
+int cannelloni_decode(const uint8_t *buf, size_t size, uint8_t *seq,
+                      struct can_frame *frames, unsigned int max)
+{
+    struct can_frame spare;
+    size_t pos = CANNELLONI_HEADER_SIZE;
+    unsigned int count;
+    unsigned int i;
+    int n = 0;
+
+    if (size < CANNELLONI_HEADER_SIZE || CANNELLONI_VERSION != buf[0] ||
+        CANNELLONI_OP_DATA != buf[1]) {
+        return -1;
+    }
+    *seq = buf[2];
+    count = (unsigned int)buf[3] << 8 | buf[4];
+
+    for (i = 0; i < count; i++) {
+        int classic;
+        const int used = get_frame(buf + pos, size - pos,
+                                   ((unsigned int)n < max) ? &frames[n] : &spare, &classic);
+        if (used <= 0) {
+            return -1;
+        }
+        pos += used;
+        if (classic && (unsigned int)n < max) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+int cannelloni_decode_stream(const uint8_t *buf, size_t size, struct can_frame *frames,
+                             unsigned int max, unsigned int *count)
+{
+    size_t pos = 0;
+
+    *count = 0;
+    while (*count < max) {
+        int classic;
+        const int used = get_frame(buf + pos, size - pos, &frames[*count], &classic);
+        if (-1 == used) {
+            return -1;
+        }
+        if (0 == used) {
+            break;
+        }
+        pos += used;
+        if (classic) {
+            (*count)++;
+        }
+    }
+
+    return pos;
+}
@@ -0,0 +1,122 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+cannelloni Framing
+
+Packs CAN frames into datagrams the way cannelloni does, so that a bridge
+can talk to cannelloni on the other end. A data packet is a five byte header
+followed by the frames, all multi-byte fields big-endian:
+
+    version     2
+    op code     0 for data
+    sequence    incremented by one for every packet, modulo 256
+    count       number of frames in the packet, 16 bits
+
+and each frame is
+
+    can_id      32 bits, with the EFF, RTR and ERR flags
+    len         payload length, with 0x80 set for a CAN FD frame
+    flags       CAN FD frames only
+    data        len bytes, none for a remote frame
+
+Over a stream, such as TCP, frames follow one another with no packet header.
+
+See https://github.com/mguentner/cannelloni
+*/
+
+#ifndef CANNELLONI_H
+#define CANNELLONI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/can.h>
+
+#define CANNELLONI_VERSION (2)
+#define CANNELLONI_OP_DATA (0)
+
+#define CANNELLONI_HEADER_SIZE (5)
+
+/* Largest encoding of a classic frame */
+#define CANNELLONI_MAX_FRAME (5 + CAN_MAX_DLEN)
+
+/* A packet being filled */
+struct cannelloni_packet
+{
+    uint8_t *buf;
+    size_t size;            /* Of buf */
+    size_t fill;
+    unsigned int count;
+};
+
+/* Start an empty packet in buf */
+static inline void cannelloni_begin(struct cannelloni_packet *p, uint8_t *buf, size_t size)
+{
+    p->buf = buf;
+    p->size = size;
+    p->fill = CANNELLONI_HEADER_SIZE;
+    p->count = 0;
+}
+
+/* Whether another frame of the largest size fits */
+static inline int cannelloni_full(const struct cannelloni_packet *p)
+{
+    return p->fill + CANNELLONI_MAX_FRAME > p->size || p->count == UINT16_MAX;
+}
+
+/* Encode a frame at p, returning its size. p has room for CANNELLONI_MAX_FRAME
+ * bytes.
+ */
+size_t cannelloni_put_frame(uint8_t *p, const struct can_frame *frame);
+
+/* Append a frame, the caller having checked that the packet is not full */
+static inline void cannelloni_add(struct cannelloni_packet *p, const struct can_frame *frame)
+{
+    p->fill += cannelloni_put_frame(p->buf + p->fill, frame);
+    p->count++;
+}
+
+/* Write the header of the packet with sequence number seq. Returns the size
+ * of the packet.
+ */
+size_t cannelloni_finish(struct cannelloni_packet *p, uint8_t seq);
+
+/* Decode the frames of the packet in buf into frames, which has room for max
+ * of them. The packet's sequence number is stored in seq. Returns the number
+ * of frames, or -1 if the packet is malformed or not a data packet. CAN FD
+ * frames do not fit a classic frame and are left out.
+ */
+int cannelloni_decode(const uint8_t *buf, size_t size, uint8_t *seq,
+                      struct can_frame *frames, unsigned int max);
+
+/* Decode the whole frames at the start of a stream of frames without packet
+ * headers, as sent over TCP, into frames, which has room for max of them. The
+ * number decoded is stored in count. Returns the number of bytes consumed,
+ * which stops short of an incomplete frame, or -1 if a frame is malformed.
+ */
+int cannelloni_decode_stream(const uint8_t *buf, size_t size, struct can_frame *frames,
+                             unsigned int max, unsigned int *count);
+
+#endif /* CANNELLONI_H */
@@ -0,0 +1,467 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Packed Capture Format
+
+The encoder keeps, for every ID of the current block, the last payload,
+length, channel and flags, found through the fixed size ID table whose slot
+numbers double as the dictionary indices. Starting a block resets the table,
+so the decoder rebuilds the same dictionary from the block alone.
+
+Every block is followed by MAX_FRAME bytes of zero padding, which lets the
+decoder check once per frame that the largest possible frame fits rather
+than check every byte it reads.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "canpack.h"
+
+/* Encoded bytes per block, before the frame which crosses it */
+#define BLOCK_BYTES (64 * 1024)
+
+/* Largest encoded frame: tag, three varints, channel, flags, length, mask
+ * and eight bytes
+ */
+#define MAX_FRAME (48)
+
+#define PAYLOAD_SAME (0)
+#define PAYLOAD_XOR (1)
+#define PAYLOAD_LEN (2)
+#define PAYLOAD_REPEAT (3)  /* Changed bytes at the same places as last time */
+#define PAYLOAD_MASK (0x03)
+#define TAG_RTR (0x04)
+#define TAG_META (0x08)
+#define INDEX_SHIFT (4)
+#define INDEX_ESCAPE (15)
+
+#define HEADER_SIZE (sizeof(struct canpack_block))
+#define BUFFER_SIZE (HEADER_SIZE + BLOCK_BYTES + 2 * MAX_FRAME)
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+/* Read a varint of at most ten bytes, the caller having checked they exist */
+static uint64_t get_varint(const uint8_t **p)
+{
+    const uint8_t *q = *p;
+    uint64_t v = 0;
+    unsigned int shift;
+
+    for (shift = 0; shift < 70; shift += 7) {
+        const uint8_t byte = *q++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (0 == (byte & 0x80)) {
+            break;
+        }
+    }
+    *p = q;
+    return v;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/* A bit per byte of v, set if the byte is not zero */
+static uint8_t nonzero_bytes(uint64_t v)
+{
+    v |= v >> 4;
+    v |= v >> 2;
+    v |= v >> 1;
+    v &= UINT64_C(0x0101010101010101);
+    return (v * UINT64_C(0x0102040810204080)) >> 56;
+}
+
+static int write_all(int fd, const void *buf, size_t size)
+{
+    const char *p = buf;
+
+    while (size > 0) {
+        const ssize_t n = write(fd, p, size);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int canpack_init(struct canpack *w, int fd)
+{
+    struct canpack_header header;
+
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    w->fill = HEADER_SIZE;
+
+    w->entries = idtable_init_entries(&w->index, CANPACK_MAX_IDS, sizeof(*w->entries));
+    if (NULL == w->entries) {
+        return -1;
+    }
+    w->buf = malloc(BUFFER_SIZE);
+    if (NULL == w->buf) {
+        canpack_free(w);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CANPACK_MAGIC, sizeof(header.magic));
+    header.version = CANPACK_VERSION;
+    if (-1 == write_all(fd, &header, sizeof(header))) {
+        canpack_free(w);
+        return -1;
+    }
+    w->bytes = sizeof(header);
+    return 0;
+}
+
+void canpack_free(struct canpack *w)
+{
+    idtable_free(&w->index);
+    free(w->entries);
+    free(w->buf);
+    w->entries = NULL;
+    w->buf = NULL;
+}
+
+static void start_block(struct canpack *w, uint64_t stamp)
+{
+    idtable_reset(&w->index, w->index.slots, w->index.bits, w->index.capacity);
+    w->block.magic = CANPACK_BLOCK_MAGIC;
+    w->block.frames = 0;
+    w->block.base = stamp;
+    w->block.unit = (0 == stamp % 1000) ? 1000 : 1;
+    w->previous = stamp;
+    w->fill = HEADER_SIZE;
+}
+
+int canpack_flush(struct canpack *w)
+{
+    size_t size;
+
+    if (0 == w->block.frames) {
+        return 0;
+    }
+
+    memset(w->buf + w->fill, 0, MAX_FRAME);
+    w->block.size = w->fill - HEADER_SIZE + MAX_FRAME;
+    memcpy(w->buf, &w->block, HEADER_SIZE);
+
+    size = HEADER_SIZE + w->block.size;
+    w->block.frames = 0;
+    w->fill = HEADER_SIZE;
+    if (-1 == write_all(w->fd, w->buf, size)) {
+        return -1;
+    }
+    w->bytes += size;
+    return 0;
+}
+
+int canpack_write(struct canpack *w, const struct canlog_record *r)
+{
+    const uint32_t key = r->can_id & ~CAN_RTR_FLAG;
+    struct canpack_entry *e;
+    uint64_t previous;
+    uint64_t current;
+    uint64_t x;
+    uint32_t slot;
+    uint8_t *p;
+    uint8_t tag;
+    uint8_t mask;
+    int fresh = 0;
+
+    /* A stamp finer than the block's tick needs a block of its own */
+    if (w->block.frames > 0 &&
+        (w->fill >= HEADER_SIZE + BLOCK_BYTES || 0 != r->stamp % w->block.unit)) {
+        if (-1 == canpack_flush(w)) {
+            return -1;
+        }
+    }
+    if (0 == w->block.frames) {
+        start_block(w, r->stamp);
+    }
+
+    slot = idtable_find(&w->index, key);
+    if (IDTABLE_EMPTY == slot) {
+        if (1 != idtable_insert(&w->index, key, w->index.count)) {
+            /* Out of dictionary entries, this ID opens the next block */
+            if (-1 == canpack_flush(w)) {
+                return -1;
+            }
+            start_block(w, r->stamp);
+            idtable_insert(&w->index, key, 0);
+        }
+        slot = w->index.count - 1;
+        memset(&w->entries[slot], 0, sizeof(w->entries[slot]));
+        fresh = 1;
+    }
+    e = &w->entries[slot];
+
+    memcpy(&previous, e->data, sizeof(previous));
+    memcpy(&current, r->data, sizeof(current));
+    x = previous ^ current;
+
+    tag = (slot < INDEX_ESCAPE ? slot : INDEX_ESCAPE) << INDEX_SHIFT;
+    if (fresh || r->len != e->len) {
+        tag |= PAYLOAD_LEN;
+    } else if (0 != x) {
+        tag |= PAYLOAD_XOR;
+    }
+    if (r->can_id & CAN_RTR_FLAG) {
+        tag |= TAG_RTR;
+    }
+    if (r->channel != e->channel || r->flags != e->flags) {
+        tag |= TAG_META;
+    }
+
+    p = w->buf + w->fill;
+    *p++ = tag;
+    if (slot >= INDEX_ESCAPE) {
+        p += put_varint(p, slot - INDEX_ESCAPE);
+    }
+    if (fresh) {
+        p += put_varint(p, key);
+    }
+    p += put_varint(p, zigzag((int64_t)(r->stamp - w->previous) / (int64_t)w->block.unit));
+    if (tag & TAG_META) {
+        *p++ = r->channel;
+        *p++ = r->flags;
+    }
+    if (PAYLOAD_LEN == (tag & PAYLOAD_MASK)) {
+        *p++ = r->len;
+    }
+    if (PAYLOAD_SAME != (tag & PAYLOAD_MASK)) {
+        uint8_t bytes[sizeof(x)];
+
+        memcpy(bytes, &x, sizeof(x));
+        mask = nonzero_bytes(x);
+
+        /* A counter ticking leaves the same mask frame after frame */
+        if (PAYLOAD_XOR == (tag & PAYLOAD_MASK) && mask == e->mask) {
+            w->buf[w->fill] |= PAYLOAD_REPEAT;
+        } else {
+            *p++ = mask;
+        }
+        e->mask = mask;
+        while (0 != mask) {
+            *p++ = bytes[__builtin_ctz(mask)];
+            mask &= mask - 1;
+        }
+    }
+
+    memcpy(e->data, r->data, CAN_MAX_DLEN);
+    e->len = r->len;
+    e->channel = r->channel;
+    e->flags = r->flags;
+
+    w->previous = r->stamp;
+    w->fill = p - w->buf;
+    w->block.frames++;
+    w->frames++;
+    return 0;
+}
+
+/* Decoder state for one ID of a block */
+struct entry
+{
+    uint64_t data;
+    canid_t key;
+    uint8_t mask;
+    uint8_t len;
+    uint8_t channel;
+    uint8_t flags;
+};
+
+static int decode_block(
+    const struct canpack_block *block,
+    const uint8_t *p,
+    struct entry *dict,
+    canpack_fn fn,
+    void *ctx)
+{
+    const uint8_t *const end = p + block->size;
+    struct canlog_record r;
+    uint64_t stamp = block->base;
+    uint32_t n = 0;
+    uint32_t i;
+
+    r.lap = 0;
+
+    for (i = 0; i < block->frames; i++) {
+        struct entry *e;
+        uint32_t index;
+        uint8_t tag;
+        int rc;
+
+        if (end - p < MAX_FRAME) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        tag = *p++;
+        index = tag >> INDEX_SHIFT;
+        if (INDEX_ESCAPE == index) {
+            index += get_varint(&p);
+        }
+        if (index == n && n < CANPACK_MAX_IDS) {
+            dict[n].key = get_varint(&p);
+            dict[n].data = 0;
+            dict[n].mask = 0;
+            dict[n].len = 0;
+            dict[n].channel = 0;
+            dict[n].flags = 0;
+            n++;
+        } else if (index >= n) {
+            errno = EINVAL;
+            return -1;
+        }
+        e = &dict[index];
+
+        stamp += unzigzag(get_varint(&p)) * block->unit;
+        if (tag & TAG_META) {
+            e->channel = *p++;
+            e->flags = *p++;
+        }
+
+        switch (tag & PAYLOAD_MASK) {
+        case PAYLOAD_LEN:
+            e->len = *p++;
+            if (e->len > CAN_MAX_DLEN) {
+                errno = EINVAL;
+                return -1;
+            }
+            /* Fall through */
+        case PAYLOAD_XOR:
+            e->mask = *p++;
+            /* Fall through */
+        case PAYLOAD_REPEAT: {
+            uint8_t bytes[sizeof(e->data)];
+            uint8_t mask = e->mask;
+
+            memcpy(bytes, &e->data, sizeof(bytes));
+            while (0 != mask) {
+                bytes[__builtin_ctz(mask)] ^= *p++;
+                mask &= mask - 1;
+            }
+            memcpy(&e->data, bytes, sizeof(bytes));
+            break;
+        }
+        default:
+            break;
+        }
+
+        r.stamp = stamp;
+        r.can_id = e->key | ((tag & TAG_RTR) ? CAN_RTR_FLAG : 0);
+        r.len = e->len;
+        r.flags = e->flags;
+        r.channel = e->channel;
+        memcpy(r.data, &e->data, CAN_MAX_DLEN);
+
+        rc = fn(ctx, &r);
+        if (0 != rc) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+int canpack_decode(const void *data, size_t size, canpack_fn fn, void *ctx)
+{
+    const uint8_t *p = data;
+    const uint8_t *const end = p + size;
+    struct canpack_header header;
+    struct entry *dict;
+    int rc = 0;
+
+    if (size < sizeof(header)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(&header, p, sizeof(header));
+    if (0 != memcmp(header.magic, CANPACK_MAGIC, sizeof(header.magic)) ||
+        CANPACK_VERSION != header.version) {
+        errno = EINVAL;
+        return -1;
+    }
+    p += sizeof(header);
+
+    dict = malloc(CANPACK_MAX_IDS * sizeof(*dict));
+    if (NULL == dict) {
+        return -1;
+    }
+
+    while (p < end) {
+        struct canpack_block block;
+
+        if ((size_t)(end - p) < sizeof(block)) {
+            errno = EINVAL;
+            rc = -1;
+            break;
+        }
+        memcpy(&block, p, sizeof(block));
+        p += sizeof(block);
+        if (CANPACK_BLOCK_MAGIC != block.magic || 0 == block.unit ||
+            block.size > (size_t)(end - p)) {
+            errno = EINVAL;
+            rc = -1;
+            break;
+        }
+
+        rc = decode_block(&block, p, dict, fn, ctx);
+        if (0 != rc) {
+            break;
+        }
+        p += block.size;
+    }
+
+    free(dict);
+    return rc;
+}
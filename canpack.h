@@ -0,0 +1,140 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Packed Capture Format
+
+A compressed alternative to the capture format of canlog.h, meant to be
+written while recording. Frames are encoded one after another into blocks of
+about 64 KiB, each starting with its own header and decodable on its own, so
+a file cut short by a crash loses at most the block being written.
+
+Within a block, every CAN ID is given a small dictionary index the first
+time it appears, and later frames of the ID refer to it by index. Timestamps
+are variable length deltas from the previous frame, counted in microseconds
+when the block's stamps allow it. Payloads are stored as their XOR against
+the previous payload of the same ID, keeping only the bytes which changed.
+A cyclic frame whose counter byte ticks takes three to five bytes instead of
+a 24 byte record.
+
+Every frame starts with a tag byte:
+
+    bits 0-1    payload: same as before, changed bytes, changed bytes at
+                the same places as last time, or new length and changed
+                bytes
+    bit 2       remote frame
+    bit 3       channel and flags bytes follow
+    bits 4-7    dictionary index, 15 meaning a varint index - 15 follows
+
+then the index (if 15 or more), the CAN ID for an index seen for the first
+time, the zigzag varint time delta, the channel and flags, the length, a mask
+of the changed bytes unless it is repeated, and their XOR values. All values are in
+host byte order.
+*/
+
+#ifndef CANPACK_H
+#define CANPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "canlog.h"
+#include "idtable.h"
+
+#define CANPACK_MAGIC "CANPACK\0"
+#define CANPACK_VERSION (1)
+#define CANPACK_BLOCK_MAGIC (0x4B4C4250)   /* "PBLK" */
+
+/* Distinct IDs in a block, a new block is started once they run out */
+#define CANPACK_MAX_IDS (2048)
+
+struct canpack_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct canpack_block
+{
+    uint32_t magic;
+    uint32_t frames;
+    uint32_t size;          /* Bytes of encoded frames after this header */
+    uint32_t unit;          /* Nanoseconds per timestamp tick */
+    uint64_t base;          /* Time of the block's first frame */
+};
+
+/* Encoder state for one ID of the current block */
+struct canpack_entry
+{
+    uint8_t data[CAN_MAX_DLEN];
+    uint8_t mask;           /* Bytes which changed last time */
+    uint8_t len;
+    uint8_t channel;
+    uint8_t flags;
+};
+
+struct canpack
+{
+    struct idtable index;
+    struct canpack_entry *entries;
+    struct canpack_block block;
+    uint8_t *buf;           /* The block header, then its frames */
+    size_t fill;
+    uint64_t previous;      /* Time of the previous frame */
+    int fd;
+
+    uint64_t frames;
+    uint64_t bytes;         /* Written to the file */
+};
+
+/* Called for every decoded frame, a non-zero return stops decoding */
+typedef int (*canpack_fn)(void *ctx, const struct canlog_record *r);
+
+/* Start writing a packed capture to fd. Returns 0 on success and -1 with
+ * errno set on failure.
+ */
+int canpack_init(struct canpack *w, int fd);
+
+/* Add a frame, writing out the block when it is full. Returns 0 on success
+ * and -1 with errno set if writing failed.
+ */
+int canpack_write(struct canpack *w, const struct canlog_record *r);
+
+/* Write out the block in progress. Returns 0 on success and -1 with errno
+ * set on failure.
+ */
+int canpack_flush(struct canpack *w);
+
+/* Release the encoder, without flushing. The file descriptor is left open. */
+void canpack_free(struct canpack *w);
+
+/* Decode the packed capture of size bytes at data, calling fn for every frame.
+ * Returns 0 once every frame was decoded, the first non-zero value fn
+ * returned, or -1 with errno set to EINVAL if the data is corrupt or cut
+ * short; the frames before that point are still decoded.
+ */
+int canpack_decode(const void *data, size_t size, canpack_fn fn, void *ctx);
+
+#endif /* CANPACK_H */
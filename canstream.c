@@ -0,0 +1,250 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+CAN Stream Writer
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <linux/errqueue.h>
+
+#include "canstream.h"
+
+/* How long to wait for a zero-copy buffer to be released */
+#define REAP_WAIT_MS (10)
+
+static int is_busy(const struct canstream *s, unsigned int buf)
+{
+    return 0 != s->busy[buf] && (int32_t)(s->busy[buf] - s->zc_done) > 0;
+}
+
+int canstream_init(struct canstream *s, int fd, uint64_t timeout, int zerocopy)
+{
+    const int one = 1;
+    socklen_t len;
+    int mss;
+    int flags;
+
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->timeout = timeout;
+    s->gap = timeout;
+    s->target = CANSTREAM_BUF_SIZE / 2;
+
+    /* Batching is done here, so segments should leave as soon as sent */
+    if (-1 == setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one))) {
+        return -1;
+    }
+
+    len = sizeof(mss);
+    if (0 == getsockopt(fd, IPPROTO_TCP, TCP_MAXSEG, &mss, &len) &&
+        mss > 0 && (size_t)mss < s->target) {
+        s->target = mss;
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    if (-1 == flags || -1 == fcntl(fd, F_SETFL, flags | O_NONBLOCK)) {
+        return -1;
+    }
+
+    /* Kernels before 4.14 lack zero-copy sends, which is no reason to fail */
+    if (zerocopy && 0 == setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+        s->zerocopy = 1;
+    }
+
+    s->bufs = malloc(CANSTREAM_NBUFS * CANSTREAM_BUF_SIZE);
+    if (NULL == s->bufs) {
+        return -1;
+    }
+    return 0;
+}
+
+void canstream_free(struct canstream *s)
+{
+    free(s->bufs);
+    s->bufs = NULL;
+}
+
+uint64_t canstream_deadline(const struct canstream *s)
+{
+    const size_t pending = s->fill - s->sent;
+    uint64_t fill_by;
+
+    /* A tail held back with MSG_MORE is bounded like frames not sent yet */
+    if (0 == pending) {
+        return s->corked ? s->first + s->timeout : UINT64_MAX;
+    }
+
+    /* A full segment, or a bus too quiet to add much to it in time, goes at
+     * once
+     */
+    if (pending >= s->target || s->gap * CANSTREAM_MIN_WAIT >= s->timeout) {
+        return s->first;
+    }
+
+    /* Otherwise wait as long as a segment should take to fill, within the
+     * bound
+     */
+    fill_by = s->last + s->gap * ((s->target - pending) / CANNELLONI_MAX_FRAME + 1);
+    return (fill_by < s->first + s->timeout) ? fill_by : s->first + s->timeout;
+}
+
+void canstream_reap(struct canstream *s)
+{
+    char control[128];
+
+    for (;;) {
+        struct msghdr msg;
+        struct cmsghdr *cm;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (-1 == recvmsg(s->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT)) {
+            return;
+        }
+
+        for (cm = CMSG_FIRSTHDR(&msg); NULL != cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err ee;
+
+            if (!((SOL_IP == cm->cmsg_level && IP_RECVERR == cm->cmsg_type) ||
+                  (SOL_IPV6 == cm->cmsg_level && IPV6_RECVERR == cm->cmsg_type))) {
+                continue;
+            }
+            memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+            if (SO_EE_ORIGIN_ZEROCOPY != ee.ee_origin) {
+                continue;
+            }
+
+            /* Sends ee_info to ee_data completed */
+            if ((int32_t)(ee.ee_data + 1 - s->zc_done) > 0) {
+                s->zc_done = ee.ee_data + 1;
+            }
+            if (ee.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                s->zerocopy_copied += ee.ee_data - ee.ee_info + 1;
+            }
+        }
+    }
+}
+
+/* Move on to the next buffer once the kernel has let go of it */
+static int next_buffer(struct canstream *s)
+{
+    s->cur = (s->cur + 1) % CANSTREAM_NBUFS;
+    s->fill = 0;
+    s->sent = 0;
+
+    for (;;) {
+        struct pollfd pfd = {.fd = s->fd, .events = 0};
+
+        canstream_reap(s);
+        if (!is_busy(s, s->cur)) {
+            s->busy[s->cur] = 0;
+            return 0;
+        }
+
+        /* Completions are signalled as an error condition */
+        if (-1 == poll(&pfd, 1, REAP_WAIT_MS) && EINTR != errno) {
+            return -1;
+        }
+        if (pfd.revents & (POLLHUP | POLLNVAL)) {
+            errno = EPIPE;
+            return -1;
+        }
+    }
+}
+
+int canstream_flush(struct canstream *s, int more)
+{
+    uint8_t *buf = s->bufs + s->cur * CANSTREAM_BUF_SIZE;
+
+    while (s->sent < s->fill) {
+        const size_t pending = s->fill - s->sent;
+        int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+        const int zerocopy = s->zerocopy && pending >= CANSTREAM_ZEROCOPY_MIN;
+        ssize_t n;
+
+        if (more) {
+            flags |= MSG_MORE;
+        }
+        if (zerocopy) {
+            flags |= MSG_ZEROCOPY;
+        }
+
+        n = send(s->fd, buf + s->sent, pending, flags);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                return 1;
+            }
+            /* Out of memory to pin pages with, so copy this one */
+            if (zerocopy && ENOBUFS == errno) {
+                n = send(s->fd, buf + s->sent, pending, flags & ~MSG_ZEROCOPY);
+            }
+            if (-1 == n) {
+                return (EAGAIN == errno || EWOULDBLOCK == errno) ? 1 : -1;
+            }
+        } else if (zerocopy) {
+            s->busy[s->cur] = ++s->zc_next;
+            s->zerocopy_sends++;
+        }
+
+        s->sent += n;
+        s->bytes += n;
+        s->sends++;
+        s->corked = more;
+    }
+
+    /* Clearing TCP_CORK pushes out what MSG_MORE held back */
+    if (s->corked && !more) {
+        const int one = 1;
+        const int zero = 0;
+
+        if (-1 == setsockopt(s->fd, IPPROTO_TCP, TCP_CORK, &one, sizeof(one)) ||
+            -1 == setsockopt(s->fd, IPPROTO_TCP, TCP_CORK, &zero, sizeof(zero))) {
+            return -1;
+        }
+        s->corked = 0;
+    }
+
+    /* A buffer the kernel may still be reading from is not written to */
+    if (is_busy(s, s->cur)) {
+        return next_buffer(s);
+    }
+    s->fill = 0;
+    s->sent = 0;
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+CAN Stream Writer
+
+Sends CAN frames over a stream socket, such as TCP, in the frame encoding of
+cannelloni (see cannelloni.h), batching them to trade latency for fewer and
+fuller segments.
+
+Frames are appended to a buffer in user space and sent with one send() call
+when the batch is due. A batch is due at once if it fills a segment, or if
+fewer than CANSTREAM_MIN_WAIT more frames are expected to arrive within the
+latency bound, so a quiet bus sends every frame as it comes. Otherwise it
+waits as long as a segment should take to fill, so a busy bus packs frames
+into full segments. Either way, no frame waits longer than the bound. The
+expected gap between frames is a moving average of the gaps seen so far.
+
+A sender that knows more frames are waiting passes MSG_MORE, which holds back
+the partial segment as TCP_CORK would, without the extra system calls of
+setting and clearing it. The held back tail stays due by the bound of its
+oldest frame, even as more frames are added, and if the frames expected never
+come, the flush pushes it out by setting and clearing TCP_CORK, as a send of
+nothing does not. Batches of CANSTREAM_ZEROCOPY_MIN bytes or more are sent
+with MSG_ZEROCOPY, when enabled, which saves copying them into the kernel. A
+buffer sent that way stays in use until the kernel reports the send
+completed, so the writer rotates through CANSTREAM_NBUFS buffers.
+
+The socket is used non-blocking. A send that could not complete is picked up
+again by the next flush, which the caller makes once the socket is writable.
+*/
+
+#ifndef CANSTREAM_H
+#define CANSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/can.h>
+
+#include "cannelloni.h"
+
+#define CANSTREAM_NBUFS (8)
+#define CANSTREAM_BUF_SIZE (65536)
+
+/* Fewest frames worth waiting for */
+#define CANSTREAM_MIN_WAIT (4)
+
+/* Smallest batch sent without copying */
+#define CANSTREAM_ZEROCOPY_MIN (16384)
+
+struct canstream
+{
+    int fd;
+    int zerocopy;               /* Whether MSG_ZEROCOPY is used */
+    uint8_t *bufs;              /* CANSTREAM_NBUFS buffers */
+    uint32_t busy[CANSTREAM_NBUFS]; /* One past the last zero-copy send from a buffer */
+    unsigned int cur;           /* Buffer being filled */
+    size_t fill;
+    size_t sent;                /* Bytes of the buffer already sent */
+    size_t target;              /* Bytes worth waiting for, a segment */
+    uint64_t timeout;           /* Latency bound in nanoseconds */
+    uint64_t first;             /* Arrival of the oldest frame not sent or held back */
+    uint64_t last;              /* Arrival of the newest frame */
+    uint64_t gap;               /* Moving average of the gap between frames */
+    int corked;                 /* Whether the last send held back a partial segment */
+    uint32_t zc_next;           /* Number of the next zero-copy send */
+    uint32_t zc_done;           /* Zero-copy sends before this one have completed */
+
+    /* Statistics */
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t sends;
+    uint64_t zerocopy_sends;
+    uint64_t zerocopy_copied;   /* Zero-copy sends the kernel copied after all */
+};
+
+/* Set up a writer for the connected socket fd, which is made non-blocking.
+ * Frames wait at most timeout nanoseconds to be batched, 0 sending every
+ * frame at once. With zerocopy, large batches are sent with MSG_ZEROCOPY if
+ * the kernel supports it. Returns 0 on success, or -1 with errno set.
+ */
+int canstream_init(struct canstream *s, int fd, uint64_t timeout, int zerocopy);
+
+void canstream_free(struct canstream *s);
+
+/* Append a frame arriving at now, in nanoseconds on the monotonic clock.
+ * Returns 0 on success, or -1 if the buffer is full and must be flushed
+ * first.
+ */
+static inline int canstream_add(struct canstream *s, const struct can_frame *frame,
+                                uint64_t now)
+{
+    if (s->fill + CANNELLONI_MAX_FRAME > CANSTREAM_BUF_SIZE) {
+        return -1;
+    }
+
+    /* A tail held back with MSG_MORE keeps the arrival of its oldest frame */
+    if (s->fill == s->sent && !s->corked) {
+        s->first = now;
+    }
+    if (0 != s->last) {
+        s->gap = s->gap - s->gap / 8 + (now - s->last) / 8;
+    }
+    s->last = now;
+
+    s->fill += cannelloni_put_frame(s->bufs + s->cur * CANSTREAM_BUF_SIZE + s->fill, frame);
+    s->frames++;
+    return 0;
+}
+
+/* When the frames not sent yet, or held back by the kernel after a send with
+ * MSG_MORE, are due to be sent, UINT64_MAX if there are none
+ */
+uint64_t canstream_deadline(const struct canstream *s);
+
+/* Send the frames not sent yet, with MSG_MORE if more are known to follow
+ * shortly. Without more, frames held back by an earlier send with MSG_MORE
+ * are pushed out too. Returns 0 once all are sent, 1 if the socket is not
+ * writable, or -1 with errno set on an error.
+ */
+int canstream_flush(struct canstream *s, int more);
+
+/* Collect zero-copy completions, letting their buffers be reused */
+void canstream_reap(struct canstream *s);
+
+#endif /* CANSTREAM_H */
@@ -0,0 +1,529 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Columnar Capture Store
+
+The store is built in memory: the records are counted per ID, the IDs sorted,
+and the record indices scattered into one run per ID with a counting sort,
+which keeps each run in capture order. A run is only sorted by time if the
+capture was not. The columns are written first, then the header, directory
+and block table in front of them once every offset is known.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "colstore.h"
+#include "idtable.h"
+
+/* Longest LEB128 encoding of a 64-bit value */
+#define MAX_VARINT (10)
+
+/* One block's columns on their way to the file */
+struct columns
+{
+    uint8_t stamps[COLSTORE_BLOCK * MAX_VARINT + 8];
+    uint8_t data[COLSTORE_BLOCK][CAN_MAX_DLEN];
+    uint8_t len[COLSTORE_BLOCK];
+    uint8_t flags[COLSTORE_BLOCK];
+    uint8_t channel[COLSTORE_BLOCK + 8];   /* With the padding after it */
+};
+
+static size_t pad8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/* Bytes the columns of a block of count frames take after its timestamps */
+static size_t columns_size(uint32_t count)
+{
+    return pad8((size_t)count * (CAN_MAX_DLEN + 3));
+}
+
+static uint32_t key_of(canid_t can_id)
+{
+    return can_id & ~CAN_RTR_FLAG;
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+/* Decode a varint at *p, not reading at or past end. Returns 0 and advances
+ * *p, or -1 if the encoding runs off the end.
+ */
+static int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+    unsigned int shift = 0;
+    uint64_t value = 0;
+    const uint8_t *q = *p;
+
+    while (q < end && shift < 64) {
+        const uint8_t byte = *q++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (0 == (byte & 0x80)) {
+            *p = q;
+            *v = value;
+            return 0;
+        }
+        shift += 7;
+    }
+    return -1;
+}
+
+static int by_stamp(const void *a, const void *b, void *arg)
+{
+    const struct canlog_record *records = arg;
+    const size_t x = *(const size_t *)a;
+    const size_t y = *(const size_t *)b;
+
+    if (records[x].stamp != records[y].stamp) {
+        return (records[x].stamp > records[y].stamp) ? 1 : -1;
+    }
+    return (x > y) - (x < y);
+}
+
+static int by_key(const void *a, const void *b, void *arg)
+{
+    const uint32_t *keys = arg;
+    const uint32_t x = keys[*(const uint32_t *)a];
+    const uint32_t y = keys[*(const uint32_t *)b];
+    return (x > y) - (x < y);
+}
+
+/* Encode one block of records and append it to the file */
+static int write_block(
+    FILE *fp,
+    struct columns *c,
+    const struct canlog_record *records,
+    const size_t *run,
+    uint32_t count,
+    struct colstore_block *block)
+{
+    uint64_t previous = records[run[0]].stamp;
+    size_t stamps = 0;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        const struct canlog_record *r = &records[run[i]];
+
+        stamps += put_varint(c->stamps + stamps, r->stamp - previous);
+        previous = r->stamp;
+        memcpy(c->data[i], r->data, CAN_MAX_DLEN);
+        c->len[i] = r->len;
+        c->flags[i] = (r->flags & ~COLSTORE_RTR) | ((r->can_id & CAN_RTR_FLAG) ? COLSTORE_RTR : 0);
+        c->channel[i] = r->channel;
+    }
+    memset(c->stamps + stamps, 0, pad8(stamps) - stamps);
+
+    block->first = records[run[0]].stamp;
+    block->last = previous;
+    block->offset = ftello(fp);
+    block->count = count;
+    block->stamps_size = pad8(stamps);
+
+    /* The three byte columns share the padding at their end */
+    memset(c->channel + count, 0, columns_size(count) - (size_t)count * (CAN_MAX_DLEN + 3));
+
+    if (1 != fwrite(c->stamps, block->stamps_size, 1, fp) ||
+        1 != fwrite(c->data, (size_t)count * CAN_MAX_DLEN, 1, fp) ||
+        1 != fwrite(c->len, count, 1, fp) ||
+        1 != fwrite(c->flags, count, 1, fp) ||
+        1 != fwrite(c->channel, columns_size(count) - (size_t)count * (CAN_MAX_DLEN + 2), 1, fp)) {
+        return -1;
+    }
+    return 0;
+}
+
+int colstore_write(
+    const char *path,
+    const struct canlog_record *records,
+    size_t n,
+    const char (*channels)[IFNAMSIZ],
+    unsigned int nchannels)
+{
+    struct colstore_header header;
+    struct colstore_id *ids = NULL;
+    struct colstore_block *blocks = NULL;
+    struct columns *columns = NULL;
+    struct idtable index;
+    uint32_t *keys = NULL;
+    uint32_t *order = NULL;
+    uint32_t *rank = NULL;
+    uint64_t *counts = NULL;
+    size_t *start = NULL;
+    size_t *perm = NULL;
+    uint64_t nblocks = 0;
+    uint64_t b;
+    FILE *fp = NULL;
+    uint32_t nids;
+    uint32_t i;
+    size_t j;
+    int saved;
+    int rc = -1;
+
+    if (nchannels > COLSTORE_MAX_CHANNELS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (-1 == idtable_init(&index, COLSTORE_MAX_IDS)) {
+        return -1;
+    }
+
+    keys = malloc(COLSTORE_MAX_IDS * sizeof(*keys));
+    counts = calloc(COLSTORE_MAX_IDS, sizeof(*counts));
+    perm = malloc((n + 1) * sizeof(*perm));
+    columns = malloc(sizeof(*columns));
+    if (NULL == keys || NULL == counts || NULL == perm || NULL == columns) {
+        goto out;
+    }
+
+    /* Count the frames of every ID */
+    for (j = 0; j < n; j++) {
+        const uint32_t key = key_of(records[j].can_id);
+        uint32_t slot = idtable_find(&index, key);
+
+        if (IDTABLE_EMPTY == slot) {
+            slot = index.count;
+            if (1 != idtable_insert(&index, key, slot)) {
+                errno = E2BIG;
+                goto out;
+            }
+            keys[slot] = key;
+        }
+        counts[slot]++;
+    }
+    nids = index.count;
+
+    /* Lay the IDs out in ascending order */
+    order = malloc((nids + 1) * sizeof(*order));
+    rank = malloc((nids + 1) * sizeof(*rank));
+    start = malloc((nids + 1) * sizeof(*start));
+    ids = calloc(nids + 1, sizeof(*ids));
+    if (NULL == order || NULL == rank || NULL == start || NULL == ids) {
+        goto out;
+    }
+    for (i = 0; i < nids; i++) {
+        order[i] = i;
+    }
+    qsort_r(order, nids, sizeof(*order), by_key, keys);
+
+    for (i = 0, j = 0; i < nids; i++) {
+        const uint64_t count = counts[order[i]];
+
+        rank[order[i]] = i;
+        start[i] = j;
+        j += count;
+
+        ids[i].can_id = keys[order[i]];
+        ids[i].frames = count;
+        ids[i].block = nblocks;
+        ids[i].nblocks = (count + COLSTORE_BLOCK - 1) / COLSTORE_BLOCK;
+        nblocks += ids[i].nblocks;
+    }
+
+    /* Scatter the records into one run per ID, each in capture order */
+    for (j = 0; j < n; j++) {
+        const uint32_t slot = idtable_find(&index, key_of(records[j].can_id));
+        perm[start[rank[slot]]++] = j;
+    }
+
+    blocks = calloc(nblocks + 1, sizeof(*blocks));
+    if (NULL == blocks) {
+        goto out;
+    }
+
+    fp = fopen(path, "w");
+    if (NULL == fp) {
+        goto out;
+    }
+
+    if (0 != fseeko(fp, pad8(sizeof(header) + nids * sizeof(*ids) + nblocks * sizeof(*blocks)), SEEK_SET)) {
+        goto out;
+    }
+
+    for (i = 0, j = 0, b = 0; i < nids; i++) {
+        size_t *run = perm + j;
+        uint64_t k;
+
+        /* Only a capture which is out of order needs sorting */
+        for (k = 1; k < ids[i].frames; k++) {
+            if (records[run[k]].stamp < records[run[k - 1]].stamp) {
+                qsort_r(run, ids[i].frames, sizeof(*run), by_stamp, (void *)records);
+                break;
+            }
+        }
+
+        for (k = 0; k < ids[i].frames; k += COLSTORE_BLOCK, b++) {
+            const uint64_t left = ids[i].frames - k;
+            const uint32_t count = (left < COLSTORE_BLOCK) ? left : COLSTORE_BLOCK;
+
+            if (-1 == write_block(fp, columns, records, run + k, count, &blocks[b])) {
+                goto out;
+            }
+        }
+        j += ids[i].frames;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLSTORE_MAGIC, sizeof(header.magic));
+    header.version = COLSTORE_VERSION;
+    header.nids = nids;
+    header.nblocks = nblocks;
+    header.frames = n;
+    for (j = 0; j < n; j++) {
+        if (0 == j || records[j].stamp < header.first) {
+            header.first = records[j].stamp;
+        }
+        if (0 == j || records[j].stamp > header.last) {
+            header.last = records[j].stamp;
+        }
+    }
+    header.nchannels = nchannels;
+    memcpy(header.channels, channels, nchannels * sizeof(*channels));
+
+    if (0 != fseeko(fp, 0, SEEK_SET) ||
+        1 != fwrite(&header, sizeof(header), 1, fp) ||
+        (nids > 0 && 1 != fwrite(ids, nids * sizeof(*ids), 1, fp)) ||
+        (nblocks > 0 && 1 != fwrite(blocks, nblocks * sizeof(*blocks), 1, fp))) {
+        goto out;
+    }
+
+    rc = fclose(fp);
+    fp = NULL;
+
+out:
+    saved = errno;
+    if (NULL != fp) {
+        fclose(fp);
+    }
+    free(blocks);
+    free(ids);
+    free(start);
+    free(rank);
+    free(order);
+    free(columns);
+    free(perm);
+    free(counts);
+    free(keys);
+    idtable_free(&index);
+    errno = saved;
+    return rc;
+}
+
+/* Check that every table and block lies within the file */
+static int valid(const struct colstore *s)
+{
+    const struct colstore_header *h = s->header;
+    uint64_t tables;
+    uint64_t i;
+
+    if (s->size < sizeof(*h) ||
+        0 != memcmp(h->magic, COLSTORE_MAGIC, sizeof(h->magic)) ||
+        COLSTORE_VERSION != h->version ||
+        h->nchannels > COLSTORE_MAX_CHANNELS ||
+        h->nids > COLSTORE_MAX_IDS ||
+        h->nblocks > s->size / sizeof(struct colstore_block)) {
+        return 0;
+    }
+
+    tables = sizeof(*h) + h->nids * sizeof(struct colstore_id) +
+             h->nblocks * sizeof(struct colstore_block);
+    if (tables > s->size) {
+        return 0;
+    }
+
+    for (i = 0; i < h->nids; i++) {
+        const struct colstore_id *id = &s->ids[i];
+        /* Every ID has at least one frame, so at least one block */
+        if (0 == id->nblocks || id->block > h->nblocks ||
+            id->nblocks > h->nblocks - id->block) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < h->nblocks; i++) {
+        const struct colstore_block *b = &s->blocks[i];
+        if (b->count > COLSTORE_BLOCK || b->offset < tables || b->offset > s->size ||
+            (uint64_t)b->stamps_size + columns_size(b->count) > s->size - b->offset) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int colstore_open(struct colstore *s, const char *path)
+{
+    struct stat st;
+    int saved;
+    int fd;
+
+    memset(s, 0, sizeof(*s));
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    if (-1 == fstat(fd, &st)) {
+        goto fail;
+    }
+    if ((size_t)st.st_size < sizeof(struct colstore_header)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    s->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == s->map) {
+        s->map = NULL;
+        goto fail;
+    }
+    s->size = st.st_size;
+    s->header = s->map;
+    s->ids = (const struct colstore_id *)(s->header + 1);
+    s->blocks = (const struct colstore_block *)(s->ids + s->header->nids);
+
+    if (!valid(s)) {
+        colstore_close(s);
+        errno = EINVAL;
+        goto fail;
+    }
+
+    close(fd);
+    return 0;
+
+fail:
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+}
+
+void colstore_close(struct colstore *s)
+{
+    if (NULL != s->map) {
+        munmap(s->map, s->size);
+    }
+    memset(s, 0, sizeof(*s));
+}
+
+const struct colstore_id *colstore_find(const struct colstore *s, canid_t can_id)
+{
+    const uint32_t key = key_of(can_id);
+    uint32_t lo = 0;
+    uint32_t hi = s->header->nids;
+
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (s->ids[mid].can_id < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return (lo < s->header->nids && s->ids[lo].can_id == key) ? &s->ids[lo] : NULL;
+}
+
+int colstore_query(
+    const struct colstore *s,
+    const struct colstore_id *id,
+    uint64_t from,
+    uint64_t to,
+    colstore_fn fn,
+    void *ctx)
+{
+    struct canlog_record r;
+    uint64_t b;
+
+    memset(&r, 0, sizeof(r));
+
+    for (b = id->block; b < id->block + id->nblocks; b++) {
+        const struct colstore_block *block = &s->blocks[b];
+        const uint8_t *p = (const uint8_t *)s->map + block->offset;
+        const uint8_t *const stamps_end = p + block->stamps_size;
+        const uint8_t (*data)[CAN_MAX_DLEN] = (const void *)stamps_end;
+        const uint8_t *len = stamps_end + (size_t)block->count * CAN_MAX_DLEN;
+        const uint8_t *flags = len + block->count;
+        const uint8_t *channel = flags + block->count;
+        uint64_t stamp = block->first;
+        uint32_t i;
+
+        /* The block index alone rules most blocks out */
+        if (block->last < from) {
+            continue;
+        }
+        if (block->first > to) {
+            break;
+        }
+
+        for (i = 0; i < block->count; i++) {
+            uint64_t delta;
+            int rc;
+
+            if (-1 == get_varint(&p, stamps_end, &delta)) {
+                break;
+            }
+            stamp += delta;
+            if (stamp < from) {
+                continue;
+            }
+            if (stamp > to) {
+                return 0;
+            }
+
+            r.stamp = stamp;
+            r.can_id = id->can_id | ((flags[i] & COLSTORE_RTR) ? CAN_RTR_FLAG : 0);
+            r.len = len[i];
+            r.flags = flags[i] & ~COLSTORE_RTR;
+            r.channel = channel[i];
+            memcpy(r.data, data[i], CAN_MAX_DLEN);
+
+            rc = fn(ctx, &r);
+            if (0 != rc) {
+                return rc;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Columnar Capture Store
+
+Stores a capture grouped by CAN ID rather than in arrival order, so that the
+frames of one ID over a span of time can be read without touching any other
+frame. The file is meant to be mapped and read in place:
+
+    header          counts, time span and interface names
+    directory       one entry per ID, sorted by ID
+    block table     one entry per block, the blocks of each ID in time order
+    columns         per block: timestamps, payloads, lengths, flags, channels
+
+Each ID's frames are cut into blocks of up to COLSTORE_BLOCK frames. A block
+entry holds the time of its first and last frame, so a query skips every
+block outside its time span without reading it. Within a block, timestamps
+are stored as variable length deltas from the previous frame, and payloads as
+eight bytes per frame one after the other, so a signal can be read with a
+fixed stride.
+
+Frames are grouped by their CAN ID with the EFF and ERR flags; the RTR flag
+is kept per frame with the capture flags. All values are in host byte order.
+*/
+
+#ifndef COLSTORE_H
+#define COLSTORE_H
+
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/can.h>
+
+#include "canlog.h"
+
+#define COLSTORE_MAGIC "CANCOLS\0"
+#define COLSTORE_VERSION (1)
+
+/* Frames per block */
+#define COLSTORE_BLOCK (4096)
+
+/* Distinct IDs a store may hold */
+#define COLSTORE_MAX_IDS (65536)
+
+#define COLSTORE_MAX_CHANNELS (256)
+
+/* Set in the flags column for a remote frame */
+#define COLSTORE_RTR (0x80)
+
+struct colstore_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nids;
+    uint64_t nblocks;
+    uint64_t frames;
+    uint64_t first;         /* Time of the earliest frame */
+    uint64_t last;          /* Time of the latest frame */
+    uint32_t nchannels;
+    uint32_t reserved;
+    char channels[COLSTORE_MAX_CHANNELS][IFNAMSIZ];
+};
+
+struct colstore_id
+{
+    canid_t can_id;         /* With the EFF and ERR flags */
+    uint32_t nblocks;
+    uint64_t block;         /* Index of the first block */
+    uint64_t frames;
+};
+
+struct colstore_block
+{
+    uint64_t first;         /* Time of the first frame */
+    uint64_t last;          /* Time of the last frame */
+    uint64_t offset;        /* Of the block's columns */
+    uint32_t count;         /* Frames */
+    uint32_t stamps_size;   /* Bytes of timestamp deltas, padded to 8 */
+};
+
+/* A store mapped for reading */
+struct colstore
+{
+    void *map;
+    size_t size;
+    const struct colstore_header *header;
+    const struct colstore_id *ids;
+    const struct colstore_block *blocks;
+};
+
+/* Called for every frame, a non-zero return stops the query */
+typedef int (*colstore_fn)(void *ctx, const struct canlog_record *r);
+
+/* Write n records, in any order, as a store to path. Channel i of the
+ * records is named channels[i]. Returns 0 on success and -1 with errno set on
+ * failure.
+ */
+int colstore_write(
+    const char *path,
+    const struct canlog_record *records,
+    size_t n,
+    const char (*channels)[IFNAMSIZ],
+    unsigned int nchannels);
+
+/* Map a store. Returns 0 on success and -1 with errno set on failure, EINVAL
+ * meaning the file is not a valid store.
+ */
+int colstore_open(struct colstore *s, const char *path);
+
+void colstore_close(struct colstore *s);
+
+/* Directory entry of a CAN ID (with its EFF or ERR flag), NULL if absent */
+const struct colstore_id *colstore_find(const struct colstore *s, canid_t can_id);
+
+/* Call fn in time order for every frame of id stamped in [from, to]. Returns
+ * 0 once all were read, or the first non-zero value fn returned.
+ */
+int colstore_query(
+    const struct colstore *s,
+    const struct colstore_id *id,
+    uint64_t from,
+    uint64_t to,
+    colstore_fn fn,
+    void *ctx);
+
+#endif /* COLSTORE_H */
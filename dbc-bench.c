@@ -0,0 +1,400 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+DBC Decoding Benchmark
+
+This program measures how fast the DBC signal database loads and decodes. If
+no DBC file is given, a synthetic database resembling a vehicle bus (500
+messages with a mix of Intel and Motorola, signed, scaled and multiplexed
+signals) is generated first.
+
+Startup is measured both ways: parsing the DBC text, and mapping the binary
+image compiled from it. Frames with random payloads are then looked up and
+decoded from the mapped image in a tight loop and the rate is reported in
+signals per second.
+
+Finally the deadband filter is run over a stream in which each message's
+payload drifts slowly, as most real signals do, to report its throughput and
+how much it reduces the number of published values, and the same stream is
+fed through the windowed aggregation. Every frame of the stream changes one
+byte of its payload, which moves one or two of its signals by a step larger
+than the deadband, so the reduction reported is a worst case. A bus whose
+cyclic frames often repeat their previous values does better.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "aggregate.h"
+#include "dbc.h"
+#include "deadband.h"
+
+#define VERSION "2.0.0"
+
+#define NMESSAGES (500)
+#define NFRAMES (4096)
+#define DEFAULT_ROUNDS (2000)
+
+struct args
+{
+    const char *dbc;
+    unsigned long rounds;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] [DBC]\n"
+        "\n"
+        "Arguments:\n"
+        "  DBC      DBC file to benchmark (default: a generated %d message file)\n"
+        "\n"
+        "Options:\n"
+        "  --rounds, -r N   Decode the frame set N times (default: %d)\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, NMESSAGES, DEFAULT_ROUNDS
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    args->dbc = NULL;
+    args->rounds = DEFAULT_ROUNDS;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "r:Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'r':
+            args->rounds = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->rounds) {
+                error(EXIT_FAILURE, 0, "invalid round count: %s", optarg);
+            }
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) > 1) {
+        error(0, 0, "at most one DBC file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((argc - optind) == 1) {
+        args->dbc = argv[optind];
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Write a DBC file resembling a production vehicle bus */
+static void generate_dbc(FILE *fp)
+{
+    int m;
+
+    fputs("VERSION \"\"\n\nNS_ :\n\nBS_:\n\nBU_: ECU1 ECU2 ECU3\n\n", fp);
+
+    for (m = 0; m < NMESSAGES; m++) {
+        /* Mostly standard IDs, with some extended IDs at the end */
+        const unsigned long id = (m < 400) ? 0x100UL + m * 3 : 0x80000000UL | (0x18FF0000 + m);
+        const int big_endian = (0 == m % 4);
+        const int multiplexed = (0 == m % 25);
+        int bit = 0;
+        int s = 0;
+
+        fprintf(fp, "BO_ %lu Message_%d: 8 ECU%d\n", id, m, 1 + m % 3);
+
+        if (multiplexed) {
+            fprintf(fp, " SG_ Mux_%d M : %d|4@%d+ (1,0) [0|15] \"\" ECU2\n",
+                    m, big_endian ? 7 : 0, big_endian ? 0 : 1);
+            bit = 4;
+        }
+
+        while (bit < 64) {
+            const int remaining = 64 - bit;
+            int len = 1 + rand() % 16;
+            const int is_signed = (0 == rand() % 3);
+            const double factor = (rand() % 2) ? 0.1 : 1.0;
+            int start;
+
+            if (len > remaining) {
+                len = remaining;
+            }
+
+            if (big_endian) {
+                start = (bit / 8) * 8 + (7 - bit % 8);
+            } else {
+                start = bit;
+            }
+
+            fprintf(fp, " SG_ Signal_%d_%d", m, s);
+            if (multiplexed && s > 0) {
+                fprintf(fp, " m%d", s % 4);
+            }
+            fprintf(fp, " : %d|%d@%d%c (%g,%d) [0|0] \"unit\" ECU2,ECU3\n",
+                    start, len, big_endian ? 0 : 1, is_signed ? '-' : '+',
+                    factor, (rand() % 2) ? -40 : 0);
+
+            bit += len;
+            s++;
+        }
+
+        fputc('\n', fp);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static struct can_frame frames[NFRAMES];
+    static const struct dbc_message *msgs[NFRAMES];
+    char tmpl[] = "/tmp/dbc-bench-XXXXXX";
+    char cache[] = "/tmp/dbc-bench-cache-XXXXXX";
+    struct stat st;
+    static uint8_t payloads[NMESSAGES][CAN_MAX_DLEN];
+    double values[DBC_MAX_SIGNALS];
+    uint16_t changed[DBC_MAX_SIGNALS];
+    struct deadband deadband;
+    struct aggregate aggregate;
+    unsigned long long nsignals = 0;
+    struct args args;
+    const char *path;
+    double checksum = 0;
+    double t0;
+    double t1;
+    struct dbc db;
+    unsigned long r;
+    int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    srand(1);
+
+    path = args.dbc;
+    if (NULL == path) {
+        FILE *fp;
+        const int fd = mkstemp(tmpl);
+        if (-1 == fd) {
+            error(EXIT_FAILURE, errno, "mkstemp");
+        }
+
+        fp = fdopen(fd, "w");
+        if (NULL == fp) {
+            error(EXIT_FAILURE, errno, "fdopen");
+        }
+
+        generate_dbc(fp);
+        fclose(fp);
+        path = tmpl;
+    }
+
+    t0 = now();
+    if (-1 == dbc_parse(&db, path)) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+    t1 = now();
+
+    printf("Parsed %u messages and %u signals in %.3f ms\n",
+           db.nmessages, db.nsignals, (t1 - t0) * 1e3);
+
+    if (-1 == stat(path, &st)) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+
+    if (-1 == close(mkstemp(cache)) || -1 == dbc_compile(&db, cache)) {
+        error(EXIT_FAILURE, errno, "%s", cache);
+    }
+    dbc_free(&db);
+
+    t0 = now();
+    if (-1 == dbc_map(&db, cache, &st)) {
+        error(EXIT_FAILURE, errno, "%s", cache);
+    }
+    t1 = now();
+
+    printf("Mapped %zu byte image in %.3f ms\n", db.storage_len, (t1 - t0) * 1e3);
+
+    unlink(cache);
+    if (NULL == args.dbc) {
+        unlink(tmpl);
+    }
+
+    if (0 == db.nmessages) {
+        error(EXIT_FAILURE, 0, "%s: no messages", path);
+    }
+
+    /* Frames with random payloads for random messages of the database */
+    for (i = 0; i < NFRAMES; i++) {
+        const struct dbc_message *msg = &db.messages[rand() % db.nmessages];
+        int j;
+
+        frames[i].can_id = msg->can_id;
+        frames[i].len = (msg->dlc > CAN_MAX_DLEN) ? CAN_MAX_DLEN : msg->dlc;
+        for (j = 0; j < CAN_MAX_DLEN; j++) {
+            frames[i].data[j] = rand();
+        }
+    }
+
+    /* Lookups are part of the measurement, the messages array is only used
+     * to count how many signals were decoded.
+     */
+    for (i = 0; i < NFRAMES; i++) {
+        msgs[i] = dbc_lookup(&db, frames[i].can_id);
+    }
+
+    t0 = now();
+    for (r = 0; r < args.rounds; r++) {
+        for (i = 0; i < NFRAMES; i++) {
+            const struct can_frame *frame = &frames[i];
+            const struct dbc_message *msg = dbc_lookup(&db, frame->can_id);
+
+            dbc_decode(&db, msg, frame->data, frame->len, values);
+            checksum += values[0];
+        }
+    }
+    t1 = now();
+
+    for (i = 0; i < NFRAMES; i++) {
+        nsignals += msgs[i]->count;
+    }
+    nsignals *= args.rounds;
+
+    printf("Decoded %lu frames, %llu signals in %.3f s\n",
+           args.rounds * NFRAMES, nsignals, t1 - t0);
+    printf("%.2f M frames/s, %.2f M signals/s (checksum %g)\n",
+           args.rounds * NFRAMES / (t1 - t0) / 1e6,
+           nsignals / (t1 - t0) / 1e6,
+           checksum);
+
+    /* A slowly drifting bus: every frame nudges one byte of the previous
+     * payload of its message, leaving all other signals untouched.
+     */
+    memset(payloads, 0, sizeof(payloads));
+    for (i = 0; i < NFRAMES; i++) {
+        const uint32_t m = (msgs[i] - db.messages) % NMESSAGES;
+        payloads[m][rand() % CAN_MAX_DLEN] += (rand() % 2) ? 1 : -1;
+        memcpy(frames[i].data, payloads[m], CAN_MAX_DLEN);
+    }
+
+    if (-1 == deadband_init(&deadband, &db, 0.5)) {
+        error(EXIT_FAILURE, errno, "deadband");
+    }
+
+    t0 = now();
+    for (r = 0; r < args.rounds; r++) {
+        for (i = 0; i < NFRAMES; i++) {
+            const struct can_frame *frame = &frames[i];
+            const struct dbc_message *msg = dbc_lookup(&db, frame->can_id);
+
+            dbc_decode(&db, msg, frame->data, frame->len, values);
+            checksum += deadband_update(&deadband, msg, values, changed);
+        }
+    }
+    t1 = now();
+
+    printf("Deadband filtered %.2f M signals/s, published %llu of %llu values "
+           "(%.1f%% reduction)\n",
+           deadband.decoded / (t1 - t0) / 1e6,
+           (unsigned long long)deadband.published,
+           (unsigned long long)deadband.decoded,
+           100.0 * (deadband.decoded - deadband.published) / deadband.decoded);
+
+    /* One window per pass over the frame set, one microsecond per frame */
+    if (-1 == aggregate_init(&aggregate, &db, NFRAMES * UINT64_C(1000))) {
+        error(EXIT_FAILURE, errno, "aggregate");
+    }
+
+    nsignals = 0;
+    t0 = now();
+    for (r = 0; r < args.rounds; r++) {
+        for (i = 0; i < NFRAMES; i++) {
+            const struct can_frame *frame = &frames[i];
+            const struct dbc_message *msg = dbc_lookup(&db, frame->can_id);
+            const uint64_t stamp = (r * NFRAMES + i + 1) * UINT64_C(1000);
+
+            if (aggregate_due(&aggregate, stamp)) {
+                aggregate_flush(&aggregate, stamp);
+                checksum += aggregate.result_mean[0];
+            }
+
+            dbc_decode(&db, msg, frame->data, frame->len, values);
+            aggregate_add(&aggregate, stamp, msg, values);
+            nsignals += msg->count;
+        }
+    }
+    t1 = now();
+
+    printf("Aggregated %.2f M signals/s over %lu windows\n",
+           nsignals / (t1 - t0) / 1e6, args.rounds);
+
+    aggregate_free(&aggregate);
+    deadband_free(&deadband);
+    dbc_free(&db);
+    return EXIT_SUCCESS;
+}
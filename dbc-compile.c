@@ -0,0 +1,147 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+DBC Compiler
+
+This program parses a DBC file and writes its binary image, which the demos
+map directly at startup instead of parsing the text. By default the image is
+written next to the DBC file, where the demos look for it. An image can also
+be given to the demos in place of the DBC file, which is useful on targets
+that only ship the compiled database.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include "dbc.h"
+
+#define VERSION "2.0.0"
+
+struct args
+{
+    const char *dbc;
+    const char *image;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] DBC [IMAGE]\n"
+        "\n"
+        "Arguments:\n"
+        "  DBC      DBC file to compile\n"
+        "  IMAGE    Binary image to write (default: DBC" DBC_CACHE_SUFFIX ")\n"
+        "\n"
+        "Options:\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) < 1 || (argc - optind) > 2) {
+        error(0, 0, "a DBC file and an optional image argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->dbc = argv[optind];
+    args->image = ((argc - optind) == 2) ? argv[optind + 1] : NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct args args;
+    struct dbc db;
+    char *image;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+
+    if (NULL != args.image) {
+        image = strdup(args.image);
+    } else if (-1 == asprintf(&image, "%s" DBC_CACHE_SUFFIX, args.dbc)) {
+        image = NULL;
+    }
+    if (NULL == image) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    if (-1 == dbc_parse(&db, args.dbc)) {
+        error(EXIT_FAILURE, errno, "%s", args.dbc);
+    }
+
+    if (-1 == dbc_compile(&db, image)) {
+        error(EXIT_FAILURE, errno, "%s", image);
+    }
+
+    printf("%s: %u messages, %u signals, %zu bytes\n",
+           image, db.nmessages, db.nsignals, db.storage_len);
+
+    dbc_free(&db);
+    free(image);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1005 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+DBC Signal Database
+
+Only the parts of the DBC format needed for decoding are understood: message
+definitions (BO_), signal definitions (SG_) including simple multiplexing, and
+float value types (SIG_VALTYPE_). Everything else is skipped.
+
+Signals can start at any bit, but must fit in a single 64-bit load window,
+which limits them to 57 bits unless they are byte aligned.
+
+A parsed database occupies one block of memory laid out as a binary image: a
+header followed by the tables. dbc_compile() writes that block to a file and
+dbc_map() maps such a file read-only and points the tables straight into it.
+The header records the size and modification time of the DBC file the image
+was built from, so a stale cache is detected and rebuilt.
+*/
+
+#include <ctype.h>
+#include <endian.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <error.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dbc.h"
+
+/* Pseudo message which holds signals that are not sent by any node */
+#define DBC_INDEPENDENT_FLAG (0x40000000U)
+
+/* Extended frame flag as encoded in DBC message IDs */
+#define DBC_EXTENDED_FLAG (0x80000000U)
+
+#define DBC_IMAGE_MAGIC "DBCIMG\0\0"
+#define DBC_IMAGE_VERSION (1)
+#define DBC_IMAGE_BYTE_ORDER (0x01020304U)
+
+/* Header of the binary image. The tables follow at the given offsets from
+ * the start of the image, in the same layout as they have in memory.
+ */
+struct dbc_image
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    /* Identity of the DBC file the image was compiled from */
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+
+    /* Structure sizes, to reject images from a different ABI */
+    uint16_t message_size;
+    uint16_t plan_size;
+    uint16_t signal_size;
+    uint16_t slot_size;
+
+    uint32_t nmessages;
+    uint32_t nsignals;
+    uint32_t nstrings;
+    uint32_t index_bits;
+
+    uint64_t messages;
+    uint64_t plans;
+    uint64_t signals;
+    uint64_t index;
+    uint64_t strings;
+    uint64_t length;
+};
+
+struct builder
+{
+    const char *path;
+    unsigned int line;
+
+    struct dbc_message *messages;
+    size_t nmessages;
+    size_t messages_cap;
+
+    struct dbc_signal *signals;
+    struct dbc_plan *plans;
+    size_t nsignals;
+    size_t signals_cap;
+    size_t plans_cap;
+
+    char *strings;
+    size_t nstrings;
+    size_t strings_cap;
+
+    /* Message that SG_ lines belong to, NULL while skipping */
+    struct dbc_message *current;
+};
+
+static int syntax_error(struct builder *b, const char *what)
+{
+    error_at_line(0, 0, b->path, b->line, "%s", what);
+    errno = EINVAL;
+    return -1;
+}
+
+static int grow(void **array, size_t *cap, size_t need, size_t size)
+{
+    size_t n = *cap ? *cap : 64;
+    void *p;
+
+    if (need <= *cap) {
+        return 0;
+    }
+
+    while (n < need) {
+        n *= 2;
+    }
+
+    p = realloc(*array, n * size);
+    if (NULL == p) {
+        return -1;
+    }
+
+    *array = p;
+    *cap = n;
+    return 0;
+}
+
+static int add_string(struct builder *b, const char *s, size_t len, uint32_t *offset)
+{
+    if (0 == len) {
+        *offset = 0;
+        return 0;
+    }
+
+    if (-1 == grow((void **)&b->strings, &b->strings_cap, b->nstrings + len + 1, 1)) {
+        return -1;
+    }
+
+    *offset = b->nstrings;
+    memcpy(b->strings + b->nstrings, s, len);
+    b->strings[b->nstrings + len] = '\0';
+    b->nstrings += len + 1;
+    return 0;
+}
+
+static const char *skip_space(const char *p)
+{
+    while (' ' == *p || '\t' == *p) {
+        p++;
+    }
+    return p;
+}
+
+static const char *parse_word(const char *p, const char **word, size_t *len)
+{
+    const char *start = skip_space(p);
+
+    p = start;
+    while (isalnum((unsigned char)*p) || '_' == *p) {
+        p++;
+    }
+
+    *word = start;
+    *len = p - start;
+    return (p == start) ? NULL : p;
+}
+
+static const char *expect(const char *p, char c)
+{
+    p = skip_space(p);
+    return (*p == c) ? p + 1 : NULL;
+}
+
+static const char *parse_ulong(const char *p, unsigned long *value)
+{
+    char *end;
+
+    p = skip_space(p);
+    if (!isdigit((unsigned char)*p)) {
+        return NULL;
+    }
+
+    errno = 0;
+    *value = strtoul(p, &end, 10);
+    return (0 == errno) ? end : NULL;
+}
+
+static const char *parse_double(const char *p, double *value)
+{
+    char *end;
+
+    *value = strtod(skip_space(p), &end);
+    return (end == skip_space(p)) ? NULL : end;
+}
+
+/* BO_ <id> <name>: <dlc> <transmitter> */
+static int parse_message(struct builder *b, const char *p)
+{
+    struct dbc_message *msg;
+    unsigned long id;
+    unsigned long dlc;
+    const char *name;
+    size_t name_len;
+
+    if (NULL == (p = parse_ulong(p, &id)) ||
+        NULL == (p = parse_word(p, &name, &name_len)) ||
+        NULL == (p = expect(p, ':')) ||
+        NULL == (p = parse_ulong(p, &dlc))) {
+        return syntax_error(b, "malformed message definition");
+    }
+
+    b->current = NULL;
+    if (id & DBC_INDEPENDENT_FLAG) {
+        return 0;
+    }
+
+    if (id & DBC_EXTENDED_FLAG) {
+        id = CAN_EFF_FLAG | (id & CAN_EFF_MASK);
+    } else if (id > CAN_SFF_MASK) {
+        return syntax_error(b, "standard message ID out of range");
+    }
+
+    if (dlc > CANFD_MAX_DLEN) {
+        return syntax_error(b, "message length out of range");
+    }
+
+    if (-1 == grow((void **)&b->messages, &b->messages_cap,
+                   b->nmessages + 1, sizeof(*b->messages))) {
+        return -1;
+    }
+
+    msg = &b->messages[b->nmessages++];
+    memset(msg, 0, sizeof(*msg));
+    msg->can_id = id;
+    msg->first = b->nsignals;
+    msg->dlc = dlc;
+    msg->mux = -1;
+    if (-1 == add_string(b, name, name_len, &msg->name)) {
+        return -1;
+    }
+
+    b->current = msg;
+    return 0;
+}
+
+/* SG_ <name> [M|m<n>] : <start>|<length>@<order><sign> (<factor>,<offset>)
+ *     [<min>|<max>] "<unit>" <receivers>
+ */
+static int parse_signal(struct builder *b, const char *p)
+{
+    struct dbc_message *msg = b->current;
+    struct dbc_signal *sig;
+    struct dbc_plan *plan;
+    const char *name;
+    size_t name_len;
+    const char *unit;
+    unsigned long start;
+    unsigned long length;
+    const char *end;
+
+    if (NULL == msg) {
+        return 0;
+    }
+
+    if (msg->count >= DBC_MAX_SIGNALS) {
+        return syntax_error(b, "too many signals in message");
+    }
+
+    if (-1 == grow((void **)&b->signals, &b->signals_cap,
+                   b->nsignals + 1, sizeof(*b->signals)) ||
+        -1 == grow((void **)&b->plans, &b->plans_cap,
+                   b->nsignals + 1, sizeof(*b->plans))) {
+        return -1;
+    }
+
+    sig = &b->signals[b->nsignals];
+    plan = &b->plans[b->nsignals];
+    memset(sig, 0, sizeof(*sig));
+    memset(plan, 0, sizeof(*plan));
+    plan->mux = -1;
+
+    if (NULL == (p = parse_word(p, &name, &name_len))) {
+        return syntax_error(b, "malformed signal name");
+    }
+
+    /* Optional multiplexer indicator */
+    p = skip_space(p);
+    if ('M' == *p) {
+        if (msg->mux >= 0) {
+            return syntax_error(b, "message has more than one multiplexer");
+        }
+        sig->is_multiplexer = 1;
+        msg->mux = b->nsignals;
+        p++;
+    } else if ('m' == *p) {
+        unsigned long value;
+        if (NULL == (p = parse_ulong(p + 1, &value)) || value > INT32_MAX) {
+            return syntax_error(b, "malformed multiplexer value");
+        }
+        plan->mux = value;
+
+        /* Extended multiplexing (m<n>M) is treated as simple multiplexing */
+        if ('M' == *p) {
+            p++;
+        }
+    }
+
+    if (NULL == (p = expect(p, ':')) ||
+        NULL == (p = parse_ulong(p, &start)) ||
+        NULL == (p = expect(p, '|')) ||
+        NULL == (p = parse_ulong(p, &length)) ||
+        NULL == (p = expect(p, '@'))) {
+        return syntax_error(b, "malformed signal layout");
+    }
+
+    if ('0' != p[0] && '1' != p[0]) {
+        return syntax_error(b, "malformed signal byte order");
+    }
+    if ('+' != p[1] && '-' != p[1]) {
+        return syntax_error(b, "malformed signal sign");
+    }
+    sig->order = p[0] - '0';
+    sig->is_signed = ('-' == p[1]);
+    p += 2;
+
+    if (NULL == (p = expect(p, '(')) ||
+        NULL == (p = parse_double(p, &plan->factor)) ||
+        NULL == (p = expect(p, ',')) ||
+        NULL == (p = parse_double(p, &plan->offset)) ||
+        NULL == (p = expect(p, ')')) ||
+        NULL == (p = expect(p, '[')) ||
+        NULL == (p = parse_double(p, &sig->minimum)) ||
+        NULL == (p = expect(p, '|')) ||
+        NULL == (p = parse_double(p, &sig->maximum)) ||
+        NULL == (p = expect(p, ']')) ||
+        NULL == (p = expect(p, '"'))) {
+        return syntax_error(b, "malformed signal scaling");
+    }
+
+    unit = p;
+    end = strchr(unit, '"');
+    if (NULL == end) {
+        return syntax_error(b, "unterminated signal unit");
+    }
+
+    if (0 == length || length > 64 || start >= CANFD_MAX_DLEN * 8) {
+        return syntax_error(b, "signal layout out of range");
+    }
+
+    sig->start = start;
+    sig->length = length;
+    sig->type = DBC_INTEGER;
+
+    if (-1 == add_string(b, name, name_len, &sig->name) ||
+        -1 == add_string(b, unit, end - unit, &sig->unit)) {
+        return -1;
+    }
+
+    b->nsignals++;
+    msg->count++;
+    return 0;
+}
+
+/* SIG_VALTYPE_ <id> <name> : <type>; */
+static int parse_valtype(struct builder *b, const char *p)
+{
+    unsigned long id;
+    unsigned long type;
+    const char *name;
+    size_t name_len;
+    size_t i;
+
+    if (NULL == (p = parse_ulong(p, &id)) ||
+        NULL == (p = parse_word(p, &name, &name_len)) ||
+        NULL == (p = expect(p, ':')) ||
+        NULL == (p = parse_ulong(p, &type)) ||
+        type > DBC_FLOAT64) {
+        return syntax_error(b, "malformed signal value type");
+    }
+
+    if (id & DBC_EXTENDED_FLAG) {
+        id = CAN_EFF_FLAG | (id & CAN_EFF_MASK);
+    }
+
+    for (i = 0; i < b->nmessages; i++) {
+        const struct dbc_message *msg = &b->messages[i];
+        uint32_t j;
+
+        if (msg->can_id != id) {
+            continue;
+        }
+
+        for (j = msg->first; j < msg->first + msg->count; j++) {
+            const char *s = b->strings + b->signals[j].name;
+            if (strlen(s) == name_len && 0 == memcmp(s, name, name_len)) {
+                b->signals[j].type = type;
+                return 0;
+            }
+        }
+    }
+
+    return syntax_error(b, "value type for unknown signal");
+}
+
+/* Work out the load window, shift and masks of a signal */
+static int compile_plan(const struct dbc_signal *sig, struct dbc_plan *plan)
+{
+    unsigned int last;
+
+    if (DBC_LITTLE_ENDIAN == sig->order) {
+        /* The start bit is the least significant bit, counting upwards */
+        plan->byte = sig->start / 8;
+        plan->shift = sig->start % 8;
+        last = sig->start + sig->length - 1;
+        if (plan->shift + sig->length > 64) {
+            return -1;
+        }
+    } else {
+        /* The start bit is the most significant bit in sawtooth numbering.
+         * Convert it to a position in the big-endian bit stream of the
+         * payload, where bit 0 is the MSB of byte 0.
+         */
+        const unsigned int msb = (sig->start / 8) * 8 + (7 - sig->start % 8);
+        const unsigned int lsb = msb + sig->length - 1;
+        plan->byte = msb / 8;
+        if (lsb - plan->byte * 8 > 63) {
+            return -1;
+        }
+        plan->shift = 63 - (lsb - plan->byte * 8);
+        last = lsb;
+    }
+
+    if (last / 8 >= CANFD_MAX_DLEN) {
+        return -1;
+    }
+
+    if ((DBC_FLOAT32 == sig->type && 32 != sig->length) ||
+        (DBC_FLOAT64 == sig->type && 64 != sig->length)) {
+        return -1;
+    }
+
+    plan->need = last / 8 + 1;
+    plan->order = sig->order;
+    plan->type = sig->type;
+    plan->mask = (64 == sig->length) ? UINT64_MAX : (UINT64_C(1) << sig->length) - 1;
+    plan->sign = sig->is_signed ? UINT64_C(1) << (sig->length - 1) : 0;
+    return 0;
+}
+
+static int parse(struct builder *b, char *text)
+{
+    char *line = text;
+
+    while (NULL != line && '\0' != *line) {
+        char *next = strchr(line, '\n');
+        const char *p;
+        size_t len;
+        int rc = 0;
+
+        b->line++;
+        if (NULL != next) {
+            *next++ = '\0';
+        }
+
+        len = strlen(line);
+        if (len > 0 && '\r' == line[len - 1]) {
+            line[len - 1] = '\0';
+        }
+
+        p = skip_space(line);
+        if (0 == strncmp(p, "BO_ ", 4)) {
+            rc = parse_message(b, p + 4);
+        } else if (0 == strncmp(p, "SG_ ", 4)) {
+            rc = parse_signal(b, p + 4);
+        } else if (0 == strncmp(p, "SIG_VALTYPE_ ", 13)) {
+            rc = parse_valtype(b, p + 13);
+        } else if ('\0' != *p && p == line) {
+            /* Any other top level statement ends the current message */
+            b->current = NULL;
+        }
+
+        if (-1 == rc) {
+            return -1;
+        }
+
+        line = next;
+    }
+
+    return 0;
+}
+
+static size_t align8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+/* Fill in the image header for a database of the given size */
+static void layout(
+    struct dbc_image *img, uint32_t nmessages, uint32_t nsignals, uint32_t nstrings)
+{
+    const uint32_t bits = idtable_bits(nmessages);
+    uint64_t off = align8(sizeof(*img));
+
+    memset(img, 0, sizeof(*img));
+    memcpy(img->magic, DBC_IMAGE_MAGIC, sizeof(img->magic));
+    img->version = DBC_IMAGE_VERSION;
+    img->byte_order = DBC_IMAGE_BYTE_ORDER;
+    img->message_size = sizeof(struct dbc_message);
+    img->plan_size = sizeof(struct dbc_plan);
+    img->signal_size = sizeof(struct dbc_signal);
+    img->slot_size = sizeof(struct idtable_slot);
+
+    img->nmessages = nmessages;
+    img->nsignals = nsignals;
+    img->nstrings = nstrings;
+    img->index_bits = bits;
+
+    img->messages = off;
+    off += align8((uint64_t)nmessages * sizeof(struct dbc_message));
+    img->plans = off;
+    off += align8((uint64_t)nsignals * sizeof(struct dbc_plan));
+    img->signals = off;
+    off += align8((uint64_t)nsignals * sizeof(struct dbc_signal));
+    img->index = off;
+    off += align8((uint64_t)sizeof(struct idtable_slot) << bits);
+    img->strings = off;
+    off += align8(nstrings);
+    img->length = off;
+}
+
+/* Point the database tables into an image */
+static void attach(struct dbc *db, void *storage)
+{
+    struct dbc_image *img = storage;
+    unsigned char *base = storage;
+
+    db->storage = storage;
+    db->storage_len = img->length;
+    db->nmessages = img->nmessages;
+    db->nsignals = img->nsignals;
+    db->nstrings = img->nstrings;
+    db->messages = (const struct dbc_message *)(base + img->messages);
+    db->plans = (const struct dbc_plan *)(base + img->plans);
+    db->signals = (const struct dbc_signal *)(base + img->signals);
+    db->strings = (const char *)(base + img->strings);
+    db->index.slots = (struct idtable_slot *)(base + img->index);
+    db->index.bits = img->index_bits;
+    db->index.count = img->nmessages;
+    db->index.capacity = img->nmessages;
+}
+
+/* Move the builder tables into a single block of memory laid out exactly
+ * like the binary image, so that dbc_compile() is a single write.
+ */
+static int finish(struct builder *b, struct dbc *db, const struct stat *st)
+{
+    struct dbc_image img;
+    unsigned char *storage;
+    size_t i;
+
+    for (i = 0; i < b->nsignals; i++) {
+        if (-1 == compile_plan(&b->signals[i], &b->plans[i])) {
+            error(0, 0, "%s: signal %s does not fit a 64-bit load window",
+                  b->path, b->strings + b->signals[i].name);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    layout(&img, b->nmessages, b->nsignals, b->nstrings);
+    img.source_size = st->st_size;
+    img.source_mtime_sec = st->st_mtim.tv_sec;
+    img.source_mtime_nsec = st->st_mtim.tv_nsec;
+
+    /* Zeroed so that padding written out to the image is deterministic */
+    storage = calloc(1, img.length);
+    if (NULL == storage) {
+        return -1;
+    }
+
+    memcpy(storage, &img, sizeof(img));
+    memcpy(storage + img.messages, b->messages, b->nmessages * sizeof(struct dbc_message));
+    memcpy(storage + img.plans, b->plans, b->nsignals * sizeof(struct dbc_plan));
+    memcpy(storage + img.signals, b->signals, b->nsignals * sizeof(struct dbc_signal));
+    memcpy(storage + img.strings, b->strings, b->nstrings);
+    idtable_reset(&db->index, (struct idtable_slot *)(storage + img.index), img.index_bits,
+                  b->nmessages);
+
+    for (i = 0; i < b->nmessages; i++) {
+        if (1 != idtable_insert(&db->index, b->messages[i].can_id, i)) {
+            error(0, 0, "%s: duplicate definition of message %s",
+                  b->path, b->strings + b->messages[i].name);
+            free(storage);
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    attach(db, storage);
+    return 0;
+}
+
+static char *read_file(const char *path, struct stat *st)
+{
+    char *text;
+    size_t off = 0;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return NULL;
+    }
+
+    if (-1 == fstat(fd, st)) {
+        close(fd);
+        return NULL;
+    }
+
+    text = malloc(st->st_size + 1);
+    if (NULL == text) {
+        close(fd);
+        return NULL;
+    }
+
+    while (off < (size_t)st->st_size) {
+        const ssize_t n = read(fd, text + off, st->st_size - off);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            free(text);
+            close(fd);
+            return NULL;
+        }
+        if (0 == n) {
+            break;
+        }
+        off += n;
+    }
+
+    text[off] = '\0';
+    close(fd);
+    return text;
+}
+
+int dbc_parse(struct dbc *db, const char *path)
+{
+    struct builder b;
+    struct stat st;
+    char *text;
+    int rc;
+
+    memset(db, 0, sizeof(*db));
+    memset(&b, 0, sizeof(b));
+    b.path = path;
+
+    text = read_file(path, &st);
+    if (NULL == text) {
+        return -1;
+    }
+
+    /* Offset 0 of the string pool is the empty string */
+    rc = grow((void **)&b.strings, &b.strings_cap, 1, 1);
+    if (0 == rc) {
+        b.strings[0] = '\0';
+        b.nstrings = 1;
+        rc = parse(&b, text);
+    }
+    if (0 == rc) {
+        rc = finish(&b, db, &st);
+    }
+
+    free(text);
+    free(b.messages);
+    free(b.signals);
+    free(b.plans);
+    free(b.strings);
+    return rc;
+}
+
+/* Check that an image is internally consistent, so that decoding from it can
+ * never index outside of the mapping.
+ */
+static int validate(const struct dbc *db, const struct dbc_image *img, size_t size)
+{
+    const uint64_t table_end[] = {
+        img->messages + (uint64_t)img->nmessages * sizeof(struct dbc_message),
+        img->plans + (uint64_t)img->nsignals * sizeof(struct dbc_plan),
+        img->signals + (uint64_t)img->nsignals * sizeof(struct dbc_signal),
+        img->index + ((uint64_t)sizeof(struct idtable_slot) << img->index_bits),
+        img->strings + img->nstrings,
+    };
+    const uint64_t table_start[] = {
+        img->messages, img->plans, img->signals, img->index, img->strings,
+    };
+    uint32_t used;
+    uint32_t i;
+
+    if (img->length != size || img->nstrings == 0 ||
+        img->index_bits < 4 || img->index_bits > 30 ||
+        img->nmessages > (UINT32_C(3) << img->index_bits) / 4) {
+        return -1;
+    }
+
+    for (i = 0; i < sizeof(table_start) / sizeof(table_start[0]); i++) {
+        if (table_start[i] % 8 || table_start[i] < sizeof(*img) ||
+            table_end[i] < table_start[i] || table_end[i] > size) {
+            return -1;
+        }
+    }
+
+    if ('\0' != db->strings[db->nstrings - 1]) {
+        return -1;
+    }
+
+    for (i = 0; i < db->nmessages; i++) {
+        const struct dbc_message *msg = &db->messages[i];
+        /* Decoders fill arrays of DBC_MAX_SIGNALS values */
+        if ((uint64_t)msg->first + msg->count > db->nsignals ||
+            msg->count > DBC_MAX_SIGNALS || msg->name >= db->nstrings ||
+            (msg->mux >= 0 && (uint32_t)msg->mux >= db->nsignals)) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < db->nsignals; i++) {
+        const struct dbc_plan *plan = &db->plans[i];
+        const struct dbc_signal *sig = &db->signals[i];
+        if (plan->byte >= CANFD_MAX_DLEN || plan->shift > 63 ||
+            sig->name >= db->nstrings || sig->unit >= db->nstrings) {
+            return -1;
+        }
+    }
+
+    /* Lookups rely on the index never being full */
+    for (i = 0, used = 0; i < idtable_size(&db->index); i++) {
+        const struct idtable_slot *slot = &db->index.slots[i];
+        if (IDTABLE_EMPTY == slot->key) {
+            continue;
+        }
+        if (slot->value >= db->nmessages || ++used > img->nmessages) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int dbc_map(struct dbc *db, const char *cache, const struct stat *source)
+{
+    const struct dbc_image *img;
+    struct stat st;
+    void *p;
+    int fd;
+
+    memset(db, 0, sizeof(*db));
+
+    fd = open(cache, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    if (-1 == fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+
+    if ((size_t)st.st_size < sizeof(*img)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == p) {
+        return -1;
+    }
+
+    img = p;
+    if (0 != memcmp(img->magic, DBC_IMAGE_MAGIC, sizeof(img->magic)) ||
+        DBC_IMAGE_VERSION != img->version ||
+        DBC_IMAGE_BYTE_ORDER != img->byte_order ||
+        sizeof(struct dbc_message) != img->message_size ||
+        sizeof(struct dbc_plan) != img->plan_size ||
+        sizeof(struct dbc_signal) != img->signal_size ||
+        sizeof(struct idtable_slot) != img->slot_size) {
+        munmap(p, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (NULL != source &&
+        ((uint64_t)source->st_size != img->source_size ||
+         source->st_mtim.tv_sec != img->source_mtime_sec ||
+         source->st_mtim.tv_nsec != img->source_mtime_nsec)) {
+        munmap(p, st.st_size);
+        errno = ESTALE;
+        return -1;
+    }
+
+    attach(db, p);
+    db->mapped = 1;
+    if (-1 == validate(db, img, st.st_size)) {
+        dbc_free(db);
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int dbc_compile(const struct dbc *db, const char *cache)
+{
+    char *tmp;
+    size_t off = 0;
+    int saved;
+    int fd;
+    int rc;
+
+    if (-1 == asprintf(&tmp, "%s.XXXXXX", cache)) {
+        return -1;
+    }
+
+    /* Write to a temporary file and rename it into place, so readers never
+     * see a partial image and existing mappings stay valid.
+     */
+    fd = mkostemp(tmp, O_CLOEXEC);
+    if (-1 == fd) {
+        free(tmp);
+        return -1;
+    }
+
+    while (off < db->storage_len) {
+        const ssize_t n = write(fd, (const char *)db->storage + off, db->storage_len - off);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        off += n;
+    }
+
+    rc = (off == db->storage_len) ? fchmod(fd, 0644) : -1;
+    saved = errno;
+
+    /* Close the file whatever happened, keeping the first error */
+    if (-1 == close(fd) && 0 == rc) {
+        rc = -1;
+        saved = errno;
+    }
+
+    if (-1 == rc) {
+        unlink(tmp);
+        free(tmp);
+        errno = saved;
+        return -1;
+    }
+
+    if (-1 == rename(tmp, cache)) {
+        const int saved = errno;
+        unlink(tmp);
+        free(tmp);
+        errno = saved;
+        return -1;
+    }
+
+    free(tmp);
+    return 0;
+}
+
+int dbc_load(struct dbc *db, const char *path)
+{
+    char magic[sizeof(((struct dbc_image *)0)->magic)];
+    struct stat st;
+    char *cache;
+    ssize_t n;
+    int fd;
+
+    /* A compiled image can be loaded directly, without its source */
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    n = read(fd, magic, sizeof(magic));
+    if (-1 == fstat(fd, &st)) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    if (sizeof(magic) == n && 0 == memcmp(magic, DBC_IMAGE_MAGIC, sizeof(magic))) {
+        return dbc_map(db, path, NULL);
+    }
+
+    if (-1 == asprintf(&cache, "%s" DBC_CACHE_SUFFIX, path)) {
+        return -1;
+    }
+
+    if (0 == dbc_map(db, cache, &st)) {
+        free(cache);
+        return 0;
+    }
+
+    if (-1 == dbc_parse(db, path)) {
+        const int saved = errno;
+        free(cache);
+        errno = saved;
+        return -1;
+    }
+
+    /* Refreshing the cache is best effort, the directory may be read-only */
+    dbc_compile(db, cache);
+    free(cache);
+    return 0;
+}
+
+void dbc_free(struct dbc *db)
+{
+    if (db->mapped) {
+        munmap(db->storage, db->storage_len);
+    } else {
+        free(db->storage);
+    }
+    memset(db, 0, sizeof(*db));
+}
+
+void dbc_decode(
+    const struct dbc *db,
+    const struct dbc_message *msg,
+    const uint8_t *data,
+    uint8_t len,
+    double *values)
+{
+    const struct dbc_plan *plans = &db->plans[msg->first];
+    uint8_t buf[CANFD_MAX_DLEN + 8] __attribute__((aligned(8)));
+    int64_t selector = -1;
+    uint16_t i;
+
+    /* Zero padding lets every load window read a full 64 bits */
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, data, len);
+
+    if (msg->mux >= 0) {
+        const struct dbc_plan *p = &db->plans[msg->mux];
+        uint64_t w;
+        memcpy(&w, &buf[p->byte], sizeof(w));
+        w = (DBC_LITTLE_ENDIAN == p->order) ? le64toh(w) : be64toh(w);
+        selector = (w >> p->shift) & p->mask;
+    }
+
+    for (i = 0; i < msg->count; i++) {
+        const struct dbc_plan *p = &plans[i];
+        const int present = (p->mux < 0 || p->mux == selector) && p->need <= len;
+        uint64_t raw;
+        double value;
+
+        memcpy(&raw, &buf[p->byte], sizeof(raw));
+        raw = (DBC_LITTLE_ENDIAN == p->order) ? le64toh(raw) : be64toh(raw);
+        raw = (raw >> p->shift) & p->mask;
+
+        if (__builtin_expect(DBC_INTEGER == p->type, 1)) {
+            /* Sign extension without a branch, a no-op when sign is 0 */
+            const uint64_t ext = (raw ^ p->sign) - p->sign;
+            value = p->sign ? (double)(int64_t)ext : (double)raw;
+        } else if (DBC_FLOAT32 == p->type) {
+            const uint32_t bits = raw;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            value = f;
+        } else {
+            memcpy(&value, &raw, sizeof(value));
+        }
+
+        values[i] = present ? value * p->factor + p->offset : NAN;
+    }
+}
@@ -0,0 +1,173 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+DBC Signal Database
+
+Loads the messages and signals of a DBC file and compiles every signal into an
+extraction plan: which payload byte to start a 64-bit load at, which byte
+order to load it in, how far to shift, what to mask, how to sign extend and
+how to scale. Decoding a frame is then a single loop over the plans of its
+message with no string handling at all.
+
+All tables are flat arrays which refer to each other by index, never by
+pointer. Names and units live in one string pool and are referred to by
+offset.
+*/
+
+#ifndef DBC_H
+#define DBC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "idtable.h"
+
+/* Appended to the DBC file name to find its binary cache */
+#define DBC_CACHE_SUFFIX ".cache"
+
+/* Largest number of signals accepted in a single message */
+#define DBC_MAX_SIGNALS (512)
+
+/* Byte orders, using the DBC encoding of the @ field */
+#define DBC_BIG_ENDIAN (0)
+#define DBC_LITTLE_ENDIAN (1)
+
+/* Value types */
+#define DBC_INTEGER (0)
+#define DBC_FLOAT32 (1)
+#define DBC_FLOAT64 (2)
+
+/* Everything needed to turn a payload into the physical value of a signal */
+struct dbc_plan
+{
+    uint64_t mask;      /* Applied after the shift */
+    uint64_t sign;      /* Sign bit of a signed signal, 0 if unsigned */
+    double factor;
+    double offset;
+    int32_t mux;        /* Selecting multiplexer value, -1 if always present */
+    uint8_t byte;       /* First byte of the 64-bit load window */
+    uint8_t shift;      /* Right shift applied to the loaded window */
+    uint8_t order;      /* DBC_BIG_ENDIAN or DBC_LITTLE_ENDIAN */
+    uint8_t type;       /* DBC_INTEGER, DBC_FLOAT32 or DBC_FLOAT64 */
+    uint8_t need;       /* Payload length which contains the whole signal */
+};
+
+/* Descriptive data of a signal which is not needed for decoding */
+struct dbc_signal
+{
+    uint32_t name;      /* Offset into the string pool */
+    uint32_t unit;      /* Offset into the string pool */
+    double minimum;
+    double maximum;
+    uint16_t start;     /* Start bit as written in the DBC file */
+    uint8_t length;
+    uint8_t order;
+    uint8_t is_signed;
+    uint8_t is_multiplexer;
+    uint8_t type;
+};
+
+struct dbc_message
+{
+    uint32_t can_id;    /* Includes CAN_EFF_FLAG for extended IDs */
+    uint32_t name;      /* Offset into the string pool */
+    uint32_t first;     /* Index of the first plan and signal */
+    uint16_t count;     /* Number of plans and signals */
+    uint8_t dlc;
+    int32_t mux;        /* Index of the multiplexer plan, -1 if none */
+};
+
+struct dbc
+{
+    const struct dbc_message *messages;
+    const struct dbc_plan *plans;
+    const struct dbc_signal *signals;
+    const char *strings;
+    uint32_t nmessages;
+    uint32_t nsignals;
+    uint32_t nstrings;
+    struct idtable index; /* Maps CAN IDs to message numbers */
+    void *storage;        /* Binary image holding all of the above */
+    size_t storage_len;
+    int mapped;           /* Whether storage is a file mapping */
+};
+
+/* Load a database from either a DBC file or a binary image.
+ * For a DBC file, the cache next to it (path + DBC_CACHE_SUFFIX) is mapped if
+ * it is up to date. Otherwise the file is parsed and the cache is rewritten if
+ * the directory allows it. Returns 0 on success and -1 with errno set on
+ * failure.
+ */
+int dbc_load(struct dbc *db, const char *path);
+
+/* Parse a DBC file and compile its extraction plans.
+ * Syntax errors are reported against the offending line. Returns 0 on success
+ * and -1 with errno set on failure.
+ */
+int dbc_parse(struct dbc *db, const char *path);
+
+/* Map a binary image read-only. If source is not NULL, the image must have
+ * been compiled from a file with the same size and modification time or the
+ * call fails with ESTALE.
+ */
+int dbc_map(struct dbc *db, const char *cache, const struct stat *source);
+
+/* Atomically write the binary image of a database to a file */
+int dbc_compile(const struct dbc *db, const char *cache);
+
+void dbc_free(struct dbc *db);
+
+static inline const char *dbc_string(const struct dbc *db, uint32_t offset)
+{
+    return db->strings + offset;
+}
+
+/* Find the message a frame belongs to, NULL if it is not in the database */
+static inline const struct dbc_message *dbc_lookup(
+    const struct dbc *db, canid_t can_id)
+{
+    const uint32_t i = idtable_find(&db->index, idtable_key(can_id));
+    if (IDTABLE_EMPTY == i) {
+        return NULL;
+    }
+    return &db->messages[i];
+}
+
+/* Decode every signal of msg from a payload of len bytes into values, which
+ * must have room for msg->count entries. Signals that are not present in the
+ * frame (wrong multiplexer value or a short payload) decode as NAN.
+ */
+void dbc_decode(
+    const struct dbc *db,
+    const struct dbc_message *msg,
+    const uint8_t *data,
+    uint8_t len,
+    double *values);
+
+#endif /* DBC_H */
@@ -0,0 +1,138 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Signal Deadband Filter
+
+The comparison uses GCC vector extensions rather than intrinsics, so the
+compiler picks whatever vector width the target offers (two SSE2 registers
+on baseline x86-64, one AVX register when enabled, NEON on ARM).
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deadband.h"
+
+#define LANES (4)
+
+typedef double vdouble __attribute__((vector_size(LANES * sizeof(double))));
+typedef int64_t vmask __attribute__((vector_size(LANES * sizeof(int64_t))));
+
+/* Clears the sign bit of a double */
+#define ABS_MASK (INT64_MAX)
+
+int deadband_init(struct deadband *d, const struct dbc *db, double band)
+{
+    uint32_t i;
+
+    memset(d, 0, sizeof(*d));
+
+    d->last = malloc((db->nsignals ? db->nsignals : 1) * sizeof(double));
+    d->band = malloc((db->nsignals ? db->nsignals : 1) * sizeof(double));
+    if (NULL == d->last || NULL == d->band) {
+        deadband_free(d);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (i = 0; i < db->nsignals; i++) {
+        d->last[i] = NAN;
+        d->band[i] = band;
+    }
+
+    d->nsignals = db->nsignals;
+    return 0;
+}
+
+void deadband_free(struct deadband *d)
+{
+    free(d->last);
+    free(d->band);
+    memset(d, 0, sizeof(*d));
+}
+
+uint16_t deadband_update(
+    struct deadband *d,
+    const struct dbc_message *msg,
+    const double *values,
+    uint16_t *changed)
+{
+    double *last = &d->last[msg->first];
+    const double *band = &d->band[msg->first];
+    const vmask abs_mask = {ABS_MASK, ABS_MASK, ABS_MASK, ABS_MASK};
+    uint16_t present = 0;
+    uint16_t n = 0;
+    uint16_t i;
+
+    for (i = 0; i + LANES <= msg->count; i += LANES) {
+        vdouble v;
+        vdouble l;
+        vdouble b;
+        vmask moved;
+        vmask fresh;
+        vmask here;
+        vmask m;
+        int k;
+
+        memcpy(&v, &values[i], sizeof(v));
+        memcpy(&l, &last[i], sizeof(l));
+        memcpy(&b, &band[i], sizeof(b));
+
+        /* NAN compares false, so absent values and never seen signals drop
+         * out of the deadband test. Never seen signals are published the
+         * first time they are present.
+         */
+        here = v == v;
+        moved = (vdouble)((vmask)(v - l) & abs_mask) > b;
+        fresh = (l != l) & here;
+        m = moved | fresh;
+
+        l = (vdouble)(((vmask)v & m) | ((vmask)l & ~m));
+        memcpy(&last[i], &l, sizeof(l));
+
+        /* Branch-free compaction of the changed lanes */
+        for (k = 0; k < LANES; k++) {
+            changed[n] = i + k;
+            n += m[k] & 1;
+            present += here[k] & 1;
+        }
+    }
+
+    for (; i < msg->count; i++) {
+        const double v = values[i];
+        const int m = (fabs(v - last[i]) > band[i]) | ((last[i] != last[i]) & (v == v));
+
+        last[i] = m ? v : last[i];
+        changed[n] = i;
+        n += m;
+        present += (v == v);
+    }
+
+    d->decoded += present;
+    d->published += n;
+    return n;
+}
@@ -0,0 +1,71 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Signal Deadband Filter
+
+Remembers the last published value of every signal of a DBC database and
+reports which signals of a freshly decoded message moved by more than a
+deadband. Last values and deadbands are kept as separate arrays indexed like
+the extraction plans, so the signals of one message are contiguous and are
+compared a whole vector at a time.
+*/
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <stdint.h>
+
+#include "dbc.h"
+
+struct deadband
+{
+    double *last;       /* Last published value, NAN until first seen */
+    double *band;       /* Change needed before a value is published again */
+    uint32_t nsignals;
+    uint64_t decoded;   /* Signal values present and compared */
+    uint64_t published; /* Signal values which passed the deadband */
+};
+
+/* Set up last values for every signal of db, all using the same deadband.
+ * A deadband of 0 publishes every change. Returns 0 on success and -1 with
+ * errno set on failure.
+ */
+int deadband_init(struct deadband *d, const struct dbc *db, double band);
+
+void deadband_free(struct deadband *d);
+
+/* Compare the decoded values of msg against the last published ones. The
+ * indexes (relative to the message) of the signals which changed are written
+ * to changed, which must have room for msg->count entries, and their last
+ * values are updated. Signals that decoded as NAN never count as changed.
+ * Returns the number of changed signals.
+ */
+uint16_t deadband_update(
+    struct deadband *d,
+    const struct dbc_message *msg,
+    const double *values,
+    uint16_t *changed);
+
+#endif /* DEADBAND_H */
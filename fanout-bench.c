@@ -0,0 +1,298 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Fan-out Benchmark
+
+This program measures what it costs the network server demo to hand a frame
+to its clients, as the number of clients grows. Frames of a synthetic bus of
+200 IDs are delivered to clients which each subscribed to a few random IDs,
+through the shared subscriber bitmaps of fanout.c. The baseline asks every
+client in turn whether it wants the frame, and formats the frame with
+snprintf() for each client that does, the way a server with a filter per
+client would. A last run has every client in raw mode, taking every frame.
+
+Only the server's own work is timed: the lines are copied to the clients'
+output buffers, which are emptied instead of sent.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include <linux/can.h>
+
+#include "fanout.h"
+
+#define VERSION "2.0.0"
+
+#define NIDS (200)
+#define NFRAMES (1 << 18)
+#define DEFAULT_ROUNDS (4)
+
+/* IDs each client subscribes to */
+#define SUBS_PER_CLIENT (10)
+
+/* Frames delivered between emptying the output buffers */
+#define DRAIN_EVERY (256)
+
+struct args
+{
+    unsigned long rounds;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS]\n"
+        "\n"
+        "Options:\n"
+        "  --rounds, -r N   Deliver the generated bus N times (default: %d)\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, DEFAULT_ROUNDS
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    args->rounds = DEFAULT_ROUNDS;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "r:Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'r':
+            args->rounds = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->rounds) {
+                error(EXIT_FAILURE, 0, "invalid round count: %s", optarg);
+            }
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc != optind) {
+        error(0, 0, "no arguments expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Empty the output buffers, counting the bytes in them */
+static uint64_t drain(struct fanout *f, int nclients)
+{
+    uint64_t bytes = 0;
+    int i;
+
+    for (i = 0; i < nclients; i++) {
+        bytes += f->clients[i].fill;
+        f->clients[i].fill = 0;
+    }
+    return bytes;
+}
+
+/* Each client's IDs, as indices into the bus's IDs */
+static void subscribe(struct fanout *f, int nclients, const canid_t *ids, int raw)
+{
+    int i;
+    int j;
+
+    for (i = 0; i < nclients; i++) {
+        if (i != fanout_attach(f, i)) {
+            error(EXIT_FAILURE, errno, "fanout_attach");
+        }
+        if (raw) {
+            fanout_set_raw(f, i, 1);
+            continue;
+        }
+        for (j = 0; j < SUBS_PER_CLIENT; j++) {
+            if (-1 == fanout_subscribe(f, i, ids[rand() % NIDS], 0, NULL)) {
+                error(EXIT_FAILURE, errno, "fanout_subscribe");
+            }
+        }
+    }
+}
+
+static void report(const char *name, int nclients, double seconds, unsigned long frames,
+                   uint64_t bytes)
+{
+    printf("%-12s %3d clients %9.1f ns/frame %8.2f M frames/s %8.1f bytes out/frame\n",
+           name, nclients, seconds * 1e9 / frames, frames / seconds / 1e6,
+           (double)bytes / frames);
+}
+
+int main(int argc, char **argv)
+{
+    static const int counts[] = {1, 4, 16, 64, 256};
+    struct can_frame *frames;
+    canid_t ids[NIDS];
+    struct args args;
+    size_t k;
+    int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    srand(1);
+
+    for (i = 0; i < NIDS; i++) {
+        ids[i] = (i < NIDS - 20) ? 0x100U + i : CAN_EFF_FLAG | (0x18FF0000 + i);
+    }
+
+    frames = malloc(NFRAMES * sizeof(*frames));
+    if (NULL == frames) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+    for (i = 0; i < NFRAMES; i++) {
+        memset(&frames[i], 0, sizeof(frames[i]));
+        frames[i].can_id = ids[rand() % NIDS];
+        frames[i].len = CAN_MAX_DLEN;
+        frames[i].data[0] = i;
+    }
+
+    for (k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+        const int nclients = counts[k];
+        const uint64_t stamp = UINT64_C(1700000000000000000);
+        const unsigned long total = args.rounds * NFRAMES;
+        static struct fanout f;
+        uint64_t bytes = 0;
+        unsigned long r;
+        double t0;
+
+        /* Shared subscriber bitmaps */
+        if (-1 == fanout_init(&f)) {
+            error(EXIT_FAILURE, errno, "fanout_init");
+        }
+        subscribe(&f, nclients, ids, 0);
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            for (i = 0; i < NFRAMES; i++) {
+                fanout_frame(&f, stamp + i, &frames[i]);
+                if (0 == i % DRAIN_EVERY) {
+                    bytes += drain(&f, nclients);
+                }
+            }
+        }
+        bytes += drain(&f, nclients);
+        report("Bitmap", nclients, now() - t0, total, bytes);
+
+        /* Every client asked in turn, formatting for itself */
+        bytes = 0;
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            for (i = 0; i < NFRAMES; i++) {
+                const uint32_t key = idtable_key(frames[i].can_id);
+                int c;
+
+                for (c = 0; c < nclients; c++) {
+                    char line[FANOUT_MAX_LINE + 1];
+                    const struct can_frame *fr = &frames[i];
+                    int len;
+
+                    if (IDTABLE_EMPTY == idtable_find(&f.clients[c].subs, key)) {
+                        continue;
+                    }
+                    len = snprintf(line, sizeof(line),
+                                   "< frame %03X %llu.%06llu %02X%02X%02X%02X%02X%02X%02X%02X >",
+                                   fr->can_id & CAN_EFF_MASK,
+                                   (unsigned long long)((stamp + i) / 1000000000),
+                                   (unsigned long long)((stamp + i) % 1000000000 / 1000),
+                                   fr->data[0], fr->data[1], fr->data[2], fr->data[3],
+                                   fr->data[4], fr->data[5], fr->data[6], fr->data[7]);
+                    fanout_write(&f, c, line, len);
+                }
+                if (0 == i % DRAIN_EVERY) {
+                    bytes += drain(&f, nclients);
+                }
+            }
+        }
+        bytes += drain(&f, nclients);
+        report("Per client", nclients, now() - t0, total, bytes);
+        fanout_free(&f);
+
+        /* Every client taking every frame */
+        if (-1 == fanout_init(&f)) {
+            error(EXIT_FAILURE, errno, "fanout_init");
+        }
+        subscribe(&f, nclients, ids, 1);
+        bytes = 0;
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            for (i = 0; i < NFRAMES; i++) {
+                fanout_frame(&f, stamp + i, &frames[i]);
+                if (0 == i % DRAIN_EVERY) {
+                    bytes += drain(&f, nclients);
+                }
+            }
+        }
+        bytes += drain(&f, nclients);
+        report("Raw", nclients, now() - t0, total, bytes);
+        fanout_free(&f);
+    }
+
+    free(frames);
+    return EXIT_SUCCESS;
+}
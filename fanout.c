@@ -0,0 +1,406 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Frame Fan-out
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fanout.h"
+
+static const char digits[] = "0123456789ABCDEF";
+
+int fanout_init(struct fanout *f)
+{
+    int i;
+
+    memset(f, 0, sizeof(*f));
+    if (-1 == idtable_init(&f->ids, FANOUT_MAX_IDS)) {
+        return -1;
+    }
+    f->subscribers = calloc(FANOUT_MAX_IDS, sizeof(*f->subscribers));
+    if (NULL == f->subscribers) {
+        idtable_free(&f->ids);
+        return -1;
+    }
+    for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+        f->clients[i].fd = -1;
+    }
+    return 0;
+}
+
+void fanout_free(struct fanout *f)
+{
+    int i;
+
+    for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+        if (-1 != f->clients[i].fd) {
+            fanout_detach(f, i);
+        }
+    }
+    free(f->subscribers);
+    idtable_free(&f->ids);
+}
+
+int fanout_attach(struct fanout *f, int fd)
+{
+    int i;
+
+    for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+        struct fanout_client *c = &f->clients[i];
+
+        if (-1 != c->fd) {
+            continue;
+        }
+        memset(c, 0, sizeof(*c));
+        c->sub = malloc(FANOUT_MAX_SUBS * sizeof(*c->sub));
+        c->out = malloc(FANOUT_OUT_SIZE);
+        if (NULL == c->sub || NULL == c->out || -1 == idtable_init(&c->subs, FANOUT_MAX_SUBS)) {
+            free(c->sub);
+            free(c->out);
+            c->fd = -1;
+            return -1;
+        }
+        c->fd = fd;
+        return i;
+    }
+
+    errno = EMFILE;
+    return -1;
+}
+
+static void clear_bit(uint64_t *bits, int client)
+{
+    bits[client / 64] &= ~(UINT64_C(1) << (client % 64));
+}
+
+static void set_bit(uint64_t *bits, int client)
+{
+    bits[client / 64] |= UINT64_C(1) << (client % 64);
+}
+
+void fanout_detach(struct fanout *f, int client)
+{
+    struct fanout_client *c = &f->clients[client];
+    uint32_t i;
+
+    for (i = 0; i < f->nids; i++) {
+        clear_bit(f->subscribers[i], client);
+    }
+    clear_bit(f->raw, client);
+    if (c->npending > 0) {
+        f->npending--;
+    }
+
+    idtable_free(&c->subs);
+    free(c->sub);
+    free(c->out);
+    c->fd = -1;
+}
+
+void fanout_set_raw(struct fanout *f, int client, int raw)
+{
+    f->clients[client].raw = raw;
+    if (raw) {
+        set_bit(f->raw, client);
+    } else {
+        clear_bit(f->raw, client);
+    }
+}
+
+int fanout_subscribe(struct fanout *f, int client, canid_t can_id, uint64_t interval,
+                     const uint8_t *mask)
+{
+    struct fanout_client *c = &f->clients[client];
+    const uint32_t key = idtable_key(can_id);
+    struct fanout_sub *sub;
+    uint32_t slot;
+    uint32_t index;
+
+    /* The bus wide slot of the ID */
+    slot = idtable_find(&f->ids, key);
+    if (IDTABLE_EMPTY == slot) {
+        if (1 != idtable_insert(&f->ids, key, f->nids)) {
+            errno = ENOSPC;
+            return -1;
+        }
+        slot = f->nids++;
+    }
+
+    /* The client's own state for the ID */
+    index = idtable_find(&c->subs, key);
+    if (IDTABLE_EMPTY == index) {
+        if (1 != idtable_insert(&c->subs, key, c->nsubs)) {
+            errno = ENOSPC;
+            return -1;
+        }
+        index = c->nsubs++;
+    } else if (c->sub[index].has_pending && 0 == --c->npending) {
+        f->npending--;
+    }
+
+    sub = &c->sub[index];
+    memset(sub, 0, sizeof(*sub));
+    sub->interval = interval;
+    if (NULL != mask) {
+        memcpy(sub->mask, mask, sizeof(sub->mask));
+        sub->filter = 1;
+    }
+    sub->active = 1;
+
+    set_bit(f->subscribers[slot], client);
+    return 0;
+}
+
+void fanout_unsubscribe(struct fanout *f, int client, canid_t can_id)
+{
+    struct fanout_client *c = &f->clients[client];
+    const uint32_t key = idtable_key(can_id);
+    const uint32_t slot = idtable_find(&f->ids, key);
+    const uint32_t index = idtable_find(&c->subs, key);
+
+    if (IDTABLE_EMPTY != slot) {
+        clear_bit(f->subscribers[slot], client);
+    }
+    if (IDTABLE_EMPTY != index) {
+        struct fanout_sub *sub = &c->sub[index];
+
+        if (sub->has_pending && 0 == --c->npending) {
+            f->npending--;
+        }
+        sub->has_pending = 0;
+        sub->active = 0;
+    }
+}
+
+size_t fanout_format(char *buf, uint64_t stamp, const struct can_frame *frame)
+{
+    uint64_t sec = stamp / 1000000000;
+    uint32_t usec = stamp % 1000000000 / 1000;
+    char decimal[20];
+    char *p = buf;
+    int n = 0;
+    int i;
+
+    memcpy(p, "< frame ", 8);
+    p += 8;
+
+    if (frame->can_id & CAN_EFF_FLAG) {
+        for (i = 7; i >= 0; i--) {
+            *p++ = digits[((frame->can_id & CAN_EFF_MASK) >> (4 * i)) & 0xF];
+        }
+    } else {
+        for (i = 2; i >= 0; i--) {
+            *p++ = digits[((frame->can_id & CAN_SFF_MASK) >> (4 * i)) & 0xF];
+        }
+    }
+    *p++ = ' ';
+
+    do {
+        decimal[n++] = '0' + sec % 10;
+        sec /= 10;
+    } while (sec > 0);
+    while (n > 0) {
+        *p++ = decimal[--n];
+    }
+    *p++ = '.';
+    for (i = 5; i >= 0; i--) {
+        p[i] = '0' + usec % 10;
+        usec /= 10;
+    }
+    p += 6;
+    *p++ = ' ';
+
+    for (i = 0; i < frame->len && i < CAN_MAX_DLEN; i++) {
+        *p++ = digits[frame->data[i] >> 4];
+        *p++ = digits[frame->data[i] & 0xF];
+    }
+    *p++ = ' ';
+    *p++ = '>';
+
+    return p - buf;
+}
+
+void fanout_write(struct fanout *f, int client, const char *line, size_t len)
+{
+    struct fanout_client *c = &f->clients[client];
+
+    if (c->fill + len > FANOUT_OUT_SIZE) {
+        c->dropped++;
+        return;
+    }
+    memcpy(c->out + c->fill, line, len);
+    c->fill += len;
+}
+
+/* Whether the payload bits under the mask differ from the previous frame */
+static int changed(const struct fanout_sub *sub, const struct can_frame *frame)
+{
+    int i;
+
+    if (!sub->has_previous || frame->len != sub->previous.len) {
+        return 1;
+    }
+    for (i = 0; i < CAN_MAX_DLEN; i++) {
+        if ((frame->data[i] ^ sub->previous.data[i]) & sub->mask[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Pass a frame through a subscription. Returns 1 if it is to be sent now. */
+static int admit(struct fanout *f, struct fanout_client *c, struct fanout_sub *sub,
+                 uint64_t stamp, const struct can_frame *frame)
+{
+    if (sub->filter) {
+        if (!changed(sub, frame)) {
+            return 0;
+        }
+        sub->previous = *frame;
+        sub->has_previous = 1;
+    }
+
+    if (0 != sub->interval && sub->last != 0 && stamp - sub->last < sub->interval) {
+        if (!sub->has_pending) {
+            sub->has_pending = 1;
+            if (1 == ++c->npending) {
+                f->npending++;
+            }
+        }
+        sub->pending = *frame;
+        sub->pending_stamp = stamp;
+        return 0;
+    }
+
+    /* A newer frame goes in place of one held back */
+    if (sub->has_pending) {
+        sub->has_pending = 0;
+        if (0 == --c->npending) {
+            f->npending--;
+        }
+    }
+    sub->last = stamp;
+    return 1;
+}
+
+void fanout_frame(struct fanout *f, uint64_t stamp, const struct can_frame *frame)
+{
+    const uint32_t key = idtable_key(frame->can_id);
+    const uint32_t slot = idtable_find(&f->ids, key);
+    uint64_t want[FANOUT_WORDS];
+    char line[FANOUT_MAX_LINE];
+    size_t len = 0;
+    int w;
+
+    for (w = 0; w < FANOUT_WORDS; w++) {
+        want[w] = f->raw[w];
+        if (IDTABLE_EMPTY != slot) {
+            want[w] |= f->subscribers[slot][w];
+        }
+    }
+
+    for (w = 0; w < FANOUT_WORDS; w++) {
+        while (0 != want[w]) {
+            const int client = w * 64 + __builtin_ctzll(want[w]);
+            struct fanout_client *c = &f->clients[client];
+
+            want[w] &= want[w] - 1;
+
+            if (!c->raw) {
+                const uint32_t index = idtable_find(&c->subs, key);
+                if (!admit(f, c, &c->sub[index], stamp, frame)) {
+                    continue;
+                }
+            }
+
+            /* Formatted once, for the first client taking it */
+            if (0 == len) {
+                len = fanout_format(line, stamp, frame);
+            }
+            fanout_write(f, client, line, len);
+        }
+    }
+}
+
+uint64_t fanout_next_due(const struct fanout *f)
+{
+    uint64_t next = UINT64_MAX;
+    int i;
+
+    if (0 == f->npending) {
+        return next;
+    }
+
+    for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+        const struct fanout_client *c = &f->clients[i];
+        uint32_t j;
+
+        if (-1 == c->fd || 0 == c->npending) {
+            continue;
+        }
+        for (j = 0; j < c->nsubs; j++) {
+            const struct fanout_sub *sub = &c->sub[j];
+            if (sub->has_pending && sub->last + sub->interval < next) {
+                next = sub->last + sub->interval;
+            }
+        }
+    }
+    return next;
+}
+
+void fanout_due(struct fanout *f, uint64_t now)
+{
+    char line[FANOUT_MAX_LINE];
+    int i;
+
+    if (0 == f->npending) {
+        return;
+    }
+
+    for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+        struct fanout_client *c = &f->clients[i];
+        uint32_t j;
+
+        if (-1 == c->fd || 0 == c->npending) {
+            continue;
+        }
+        for (j = 0; j < c->nsubs; j++) {
+            struct fanout_sub *sub = &c->sub[j];
+
+            if (!sub->has_pending || sub->last + sub->interval > now) {
+                continue;
+            }
+            fanout_write(f, i, line, fanout_format(line, sub->pending_stamp, &sub->pending));
+            sub->has_pending = 0;
+            sub->last = now;
+            if (0 == --c->npending) {
+                f->npending--;
+            }
+        }
+    }
+}
@@ -0,0 +1,149 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Frame Fan-out
+
+Delivers the frames of one bus to many clients of a socketcand style server
+(see socketcan-server-demo.c), each wanting a different part of them.
+
+Every ID any client subscribed to has a slot in an ID table (see idtable.h)
+holding a bitmap of the clients subscribed to it, and a second bitmap holds
+the clients in raw mode, which take every frame. Delivering a frame costs one
+lookup and an OR of the two bitmaps, however many clients there are. Only the
+clients whose bit is set are looked at. The frame is formatted as a
+socketcand line once, and the line is copied to the output buffer of each
+client taking it.
+
+A subscription may throttle an ID, sending at most one frame per interval,
+and filter it on content, sending a frame only when the payload bits under a
+mask changed, like the broadcast manager's RX_SETUP. A frame held back by the
+throttle is kept, and the latest one is sent once the interval is over.
+
+Clients which read too slowly lose lines, counted in dropped, rather than
+hold up the others.
+*/
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/can.h>
+
+#include "idtable.h"
+
+#define FANOUT_MAX_CLIENTS (256)
+#define FANOUT_WORDS (FANOUT_MAX_CLIENTS / 64)
+
+/* Most IDs subscribed to on one bus, and by one client */
+#define FANOUT_MAX_IDS (4096)
+#define FANOUT_MAX_SUBS (1024)
+
+/* Output buffered per client */
+#define FANOUT_OUT_SIZE (65536)
+
+/* Longest line of a frame, as in "< frame 1FFFFFFF 18446744073.709551 0011223344556677 >" */
+#define FANOUT_MAX_LINE (64)
+
+struct fanout_sub
+{
+    uint64_t interval;          /* Throttle in nanoseconds, 0 for none */
+    uint64_t last;              /* When a frame was last sent */
+    uint64_t pending_stamp;
+    struct can_frame pending;   /* Latest frame held back by the throttle */
+    struct can_frame previous;  /* Last frame seen, for the content filter */
+    uint8_t mask[CAN_MAX_DLEN];
+    uint8_t filter;             /* Whether mask applies */
+    uint8_t has_pending;
+    uint8_t has_previous;
+    uint8_t active;
+};
+
+struct fanout_client
+{
+    int fd;                     /* -1 for a free entry */
+    int raw;
+    struct idtable subs;        /* ID to index into sub */
+    struct fanout_sub *sub;
+    uint32_t nsubs;
+    uint32_t npending;          /* Subscriptions holding a frame back */
+    char *out;
+    size_t fill;
+    uint64_t dropped;
+};
+
+struct fanout
+{
+    struct idtable ids;         /* ID to index into subscribers */
+    uint64_t (*subscribers)[FANOUT_WORDS];
+    uint32_t nids;
+    uint64_t raw[FANOUT_WORDS];
+    struct fanout_client clients[FANOUT_MAX_CLIENTS];
+    uint32_t npending;          /* Clients with frames held back */
+};
+
+int fanout_init(struct fanout *f);
+void fanout_free(struct fanout *f);
+
+/* Add a client writing to fd. Returns its number, or -1 if there are
+ * FANOUT_MAX_CLIENTS already.
+ */
+int fanout_attach(struct fanout *f, int fd);
+void fanout_detach(struct fanout *f, int client);
+
+/* Send a client every frame, or only the IDs it subscribed to */
+void fanout_set_raw(struct fanout *f, int client, int raw);
+
+/* Subscribe a client to an ID, throttled to one frame per interval
+ * nanoseconds if not 0, and only sending changes of the payload bits set in
+ * mask if it is not NULL. Subscribing again replaces the settings. Returns 0
+ * on success, or -1 with errno set to ENOSPC if too many IDs are subscribed
+ * to.
+ */
+int fanout_subscribe(struct fanout *f, int client, canid_t can_id, uint64_t interval,
+                     const uint8_t *mask);
+void fanout_unsubscribe(struct fanout *f, int client, canid_t can_id);
+
+/* Deliver a frame received at stamp, in nanoseconds since the epoch */
+void fanout_frame(struct fanout *f, uint64_t stamp, const struct can_frame *frame);
+
+/* When the next frame held back by a throttle is due, UINT64_MAX if none */
+uint64_t fanout_next_due(const struct fanout *f);
+
+/* Send the frames held back by a throttle whose interval is over at now, in
+ * nanoseconds since the epoch
+ */
+void fanout_due(struct fanout *f, uint64_t now);
+
+/* Append a line of text to a client's output */
+void fanout_write(struct fanout *f, int client, const char *line, size_t len);
+
+/* Format a frame as a socketcand line into buf, which has room for
+ * FANOUT_MAX_LINE bytes. Returns the length of the line.
+ */
+size_t fanout_format(char *buf, uint64_t stamp, const struct can_frame *frame);
+
+#endif /* FANOUT_H */
@@ -0,0 +1,273 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Fault Injection Benchmark
+
+This program measures what it costs the fault injection demo to hold frames
+for a delay, as the number of frames held grows. Frames arrive at a steady
+rate in simulated time, each held for a random delay of up to two seconds,
+and are taken back out as their delays run out. The arrival rate sets how
+many frames are held at once. Frames are held in the timer wheel of
+timerwheel.c, against a binary heap ordered by expiry as the baseline, whose
+cost grows with the logarithm of the frames held.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+
+#include "timerwheel.h"
+
+#define VERSION "2.0.0"
+
+#define NDELAYS (1 << 20)
+#define NFRAMES (1 << 22)
+#define DEFAULT_ROUNDS (2)
+
+/* Same as the demo */
+#define TICK_NS (10000)
+
+/* Mean delay, the longest being twice this */
+#define MEAN_DELAY_NS (UINT64_C(1000000000))
+
+struct args
+{
+    unsigned long rounds;
+};
+
+struct entry
+{
+    uint64_t when;
+    uint32_t frame;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS]\n"
+        "\n"
+        "Options:\n"
+        "  --rounds, -r N   Pass N times as many frames through (default: %d)\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, DEFAULT_ROUNDS
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    args->rounds = DEFAULT_ROUNDS;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "r:Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'r':
+            args->rounds = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->rounds) {
+                error(EXIT_FAILURE, 0, "invalid round count: %s", optarg);
+            }
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc != optind) {
+        error(0, 0, "no arguments expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void heap_push(struct entry *heap, uint32_t *n, struct entry e)
+{
+    uint32_t i = (*n)++;
+
+    while (i > 0 && heap[(i - 1) / 2].when > e.when) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = e;
+}
+
+static struct entry heap_pop(struct entry *heap, uint32_t *n)
+{
+    const struct entry top = heap[0];
+    const struct entry last = heap[--(*n)];
+    uint32_t i = 0;
+
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= *n) {
+            break;
+        }
+        if (child + 1 < *n && heap[child + 1].when < heap[child].when) {
+            child++;
+        }
+        if (heap[child].when >= last.when) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+static void report(const char *name, uint32_t held, double seconds, unsigned long frames)
+{
+    printf("%-6s %8u held %8.1f ns/frame %8.2f M frames/s\n",
+           name, held, seconds * 1e9 / frames, frames / seconds / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t counts[] = {1000, 65536, 1 << 20, 1 << 22};
+    uint64_t *delays;
+    struct args args;
+    size_t c;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    srand(1);
+
+    /* Drawn up front, so drawing them is not timed */
+    delays = malloc(NDELAYS * sizeof(*delays));
+    if (NULL == delays) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+    for (c = 0; c < NDELAYS; c++) {
+        delays[c] = ((uint64_t)rand() << 31 | rand()) % (2 * MEAN_DELAY_NS);
+    }
+
+    for (c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        const uint32_t held = counts[c];
+        const uint64_t gap = MEAN_DELAY_NS / held;
+        const unsigned long frames = args.rounds * NFRAMES;
+        uint64_t clock;
+        unsigned long i;
+        double t0;
+
+        {
+            struct timerwheel w;
+            int t;
+
+            /* Room for the frames held to run above the mean */
+            if (-1 == timerwheel_init(&w, 2 * held, TICK_NS, 0)) {
+                error(EXIT_FAILURE, errno, "timer wheel");
+            }
+            for (i = 0; i < held; i++) {
+                timerwheel_add(&w, delays[i % NDELAYS] / 2 + i * gap);
+            }
+
+            clock = held * gap;
+            t0 = now();
+            for (i = 0; i < frames; i++) {
+                clock += gap;
+                if (-1 == timerwheel_add(&w, clock + delays[i % NDELAYS])) {
+                    error(EXIT_FAILURE, 0, "timer wheel full");
+                }
+                timerwheel_advance(&w, clock);
+                while (-1 != (t = timerwheel_next(&w))) {
+                    timerwheel_release(&w, t);
+                }
+            }
+            report("Wheel", held, now() - t0, frames);
+            timerwheel_free(&w);
+        }
+
+        {
+            struct entry *heap;
+            uint32_t n = 0;
+
+            heap = malloc(2 * held * sizeof(*heap));
+            if (NULL == heap) {
+                error(EXIT_FAILURE, errno, "malloc");
+            }
+            for (i = 0; i < held; i++) {
+                heap_push(heap, &n, (struct entry){delays[i % NDELAYS] / 2 + i * gap, i});
+            }
+
+            clock = held * gap;
+            t0 = now();
+            for (i = 0; i < frames; i++) {
+                clock += gap;
+                if (n == 2 * held) {
+                    error(EXIT_FAILURE, 0, "heap full");
+                }
+                heap_push(heap, &n, (struct entry){clock + delays[i % NDELAYS], i});
+                while (n > 0 && heap[0].when <= clock) {
+                    heap_pop(heap, &n);
+                }
+            }
+            report("Heap", held, now() - t0, frames);
+            free(heap);
+        }
+    }
+
+    free(delays);
+    return EXIT_SUCCESS;
+}
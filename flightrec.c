@@ -0,0 +1,451 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Flight Recorder
+
+The dumping thread never locks the ring. It copies a batch of records out,
+then reads the head again: any record the receive loop may have started to
+overwrite in the meantime is thrown away and counted, and the rest is
+written. So a dump of a ring which is too small for the trigger window, or a
+disk which is too slow, loses the oldest frames of the dump rather than
+slowing down reception.
+
+A ring file is preallocated so that the kernel never runs out of space while
+writing back pages of the mapping, which would kill the process with SIGBUS.
+After a crash, the head stored in the file may lag behind or run ahead of the
+records which reached the disk, since the kernel writes pages back in no
+particular order. Scanning therefore trusts the lap tags rather than the
+head. A slot holds the record with a given index only if its tag matches the
+lap of that index. Starting from the head, the scan moves forward over slots
+which hold records newer than the head, then back over slots whose pages
+never reached the disk, and takes the unbroken run of records before that.
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <error.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "flightrec.h"
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+/* How often the dumping thread looks for triggers and new frames */
+#define POLL_US (50000)
+
+/* Records copied out of the ring at a time */
+#define CHUNK (4096)
+
+/* How long past the end of the window to wait for frames on an idle bus */
+#define IDLE_GRACE (UINT64_C(1000000000))
+
+/* How often writeback of a ring file is started, in polls */
+#define WRITEBACK_POLLS (1000000 / POLL_US)
+
+struct dump
+{
+    int fd;
+    char path[PATH_MAX];
+    uint64_t next;      /* Index of the next record to write */
+    uint64_t end;       /* Records stamped after this are not part of the dump */
+    uint64_t written;
+    uint64_t lost;      /* Overwritten before they could be written */
+};
+
+static int map_memory(struct flightrec *fr, size_t n)
+{
+    void *p;
+
+    fr->size = (n * sizeof(struct canlog_record) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    /* Reserved huge pages first, then ordinary pages with a hint */
+    p = mmap(NULL, fr->size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (MAP_FAILED != p) {
+        fr->huge = 1;
+    } else {
+        p = mmap(NULL, fr->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == p) {
+            return -1;
+        }
+        madvise(p, fr->size, MADV_HUGEPAGE);
+
+        /* Fault every page in now rather than on the receive path */
+        memset(p, 0, fr->size);
+    }
+
+    fr->map = p;
+    fr->ring = p;
+    fr->head = &fr->local_head;
+    return 0;
+}
+
+static int map_file(struct flightrec *fr, size_t n, const char *file)
+{
+    struct canlog_ring *header;
+    uint64_t first;
+    uint64_t end;
+    void *p;
+    int rc;
+
+    fr->size = CANLOG_RING_DATA + n * sizeof(struct canlog_record);
+
+    fr->fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (-1 == fr->fd) {
+        return -1;
+    }
+
+    /* Allocate every block up front, writeback must never hit a full disk */
+    rc = (-1 == ftruncate(fr->fd, fr->size)) ? errno : posix_fallocate(fr->fd, 0, fr->size);
+    if (0 != rc) {
+        close(fr->fd);
+        errno = rc;
+        return -1;
+    }
+
+    p = mmap(NULL, fr->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fr->fd, 0);
+    if (MAP_FAILED == p) {
+        rc = errno;
+        close(fr->fd);
+        errno = rc;
+        return -1;
+    }
+
+    /* Carry on from the end of a ring of the same size, otherwise start over */
+    header = p;
+    if (-1 == flightrec_scan(p, fr->size, &first, &end) || header->capacity != n) {
+        memset(p, 0, fr->size);
+        memcpy(header->magic, CANLOG_RING_MAGIC, sizeof(header->magic));
+        header->version = CANLOG_VERSION;
+        header->record_size = sizeof(struct canlog_record);
+        header->capacity = n;
+        end = 0;
+    }
+
+    fr->map = p;
+    fr->ring = (struct canlog_record *)((char *)p + CANLOG_RING_DATA);
+    fr->head = (_Atomic uint64_t *)&header->head;
+    atomic_store_explicit(fr->head, end, memory_order_release);
+    return 0;
+}
+
+int flightrec_init(
+    struct flightrec *fr,
+    size_t capacity,
+    uint64_t before,
+    uint64_t after,
+    const char *prefix,
+    const char *file)
+{
+    size_t n = 2;
+    int rc;
+
+    memset(fr, 0, sizeof(*fr));
+    fr->fd = -1;
+    atomic_init(&fr->local_head, 0);
+    atomic_init(&fr->trigger, 0);
+    atomic_init(&fr->running, 0);
+
+    fr->shift = 1;
+    while (n < capacity) {
+        n *= 2;
+        fr->shift++;
+    }
+
+    rc = (NULL == file) ? map_memory(fr, n) : map_file(fr, n, file);
+    if (-1 == rc) {
+        return -1;
+    }
+
+    fr->mask = n - 1;
+    fr->before = before;
+    fr->after = after;
+    fr->prefix = prefix;
+    return 0;
+}
+
+int flightrec_scan(const void *map, size_t size, uint64_t *first, uint64_t *end)
+{
+    const struct canlog_ring *header = map;
+    const struct canlog_record *ring;
+    unsigned int shift;
+    uint64_t mask;
+    uint64_t newest;
+    uint64_t head;
+    uint64_t i;
+
+    if (size < CANLOG_RING_DATA ||
+        0 != memcmp(header->magic, CANLOG_RING_MAGIC, sizeof(header->magic)) ||
+        CANLOG_VERSION != header->version ||
+        sizeof(struct canlog_record) != header->record_size ||
+        header->capacity < 2 ||
+        0 != (header->capacity & (header->capacity - 1)) ||
+        (size - CANLOG_RING_DATA) / sizeof(struct canlog_record) < header->capacity) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ring = (const struct canlog_record *)((const char *)map + CANLOG_RING_DATA);
+    mask = header->capacity - 1;
+    shift = __builtin_ctzll(header->capacity);
+    head = atomic_load_explicit((_Atomic const uint64_t *)&header->head, memory_order_acquire);
+
+    /* Records written after the last head which reached the disk */
+    i = head;
+    while (i - head < header->capacity && ring[i & mask].lap == canlog_lap(i, shift)) {
+        i++;
+    }
+    newest = i;
+
+    /* Records whose pages were lost, if the head reached the disk before them */
+    while (i > 0 && newest - i < header->capacity &&
+           ring[(i - 1) & mask].lap != canlog_lap(i - 1, shift)) {
+        i--;
+    }
+    *end = i;
+
+    /* Records written before, back to a slot of an older lap */
+    while (i > 0 && *end - i < header->capacity &&
+           ring[(i - 1) & mask].lap == canlog_lap(i - 1, shift)) {
+        i--;
+    }
+    *first = i;
+    return 0;
+}
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/* Index of the oldest record still in the ring stamped at or after from */
+static uint64_t find_start(const struct flightrec *fr, uint64_t head, uint64_t from)
+{
+    const uint64_t oldest = (head > fr->mask) ? head - fr->mask : 0;
+    uint64_t i = head;
+
+    while (i > oldest && fr->ring[(i - 1) & fr->mask].stamp >= from) {
+        i--;
+    }
+    return i;
+}
+
+static int open_dump(struct flightrec *fr, struct dump *d, uint64_t trigger)
+{
+    struct canlog_header header;
+
+    snprintf(d->path, sizeof(d->path), "%s-%llu.%09llu.canlog", fr->prefix,
+             (unsigned long long)(trigger / 1000000000),
+             (unsigned long long)(trigger % 1000000000));
+
+    d->fd = open(d->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == d->fd) {
+        return -1;
+    }
+
+    /* The record count is filled in when the dump is complete */
+    canlog_header_init(&header, 0);
+    if (sizeof(header) != write(d->fd, &header, sizeof(header))) {
+        close(d->fd);
+        return -1;
+    }
+
+    d->next = find_start(fr, atomic_load_explicit(fr->head, memory_order_acquire),
+                         trigger - fr->before);
+    d->end = trigger + fr->after;
+    d->written = 0;
+    d->lost = 0;
+    return 0;
+}
+
+static void close_dump(struct dump *d)
+{
+    struct canlog_header header;
+
+    canlog_header_init(&header, d->written);
+    if (sizeof(header) != pwrite(d->fd, &header, sizeof(header), 0) || -1 == close(d->fd)) {
+        error(0, errno, "%s", d->path);
+        return;
+    }
+
+    fprintf(stderr, "Flight recorder: wrote %llu frames to %s", (unsigned long long)d->written, d->path);
+    if (d->lost) {
+        fprintf(stderr, ", %llu were overwritten first", (unsigned long long)d->lost);
+    }
+    fputc('\n', stderr);
+}
+
+/* Write out the frames recorded since the last call. Returns 1 once the dump
+ * window is complete.
+ */
+static int drain(struct flightrec *fr, struct dump *d, struct canlog_record *buf)
+{
+    const uint64_t capacity = fr->mask + 1;
+    uint64_t head = atomic_load_explicit(fr->head, memory_order_acquire);
+
+    while (d->next < head) {
+        uint64_t n = (head - d->next < CHUNK) ? head - d->next : CHUNK;
+        uint64_t skip = 0;
+        uint64_t valid;
+        uint64_t k;
+        int done = 0;
+
+        for (k = 0; k < n; k++) {
+            buf[k] = fr->ring[(d->next + k) & fr->mask];
+        }
+
+        /* Drop whatever the receive loop may have overwritten during the copy */
+        atomic_thread_fence(memory_order_acquire);
+        head = atomic_load_explicit(fr->head, memory_order_relaxed);
+        valid = (head >= capacity) ? head - capacity + 1 : 0;
+        if (d->next < valid) {
+            skip = (valid - d->next < n) ? valid - d->next : n;
+            d->lost += skip;
+        }
+
+        for (k = skip; k < n; k++) {
+            if (buf[k].stamp > d->end) {
+                done = 1;
+                break;
+            }
+        }
+
+        if (k > skip) {
+            const size_t bytes = (k - skip) * sizeof(*buf);
+            if (bytes != (size_t)write(d->fd, &buf[skip], bytes)) {
+                error(0, errno, "%s", d->path);
+                return 1;
+            }
+            d->written += k - skip;
+        }
+
+        if (done) {
+            return 1;
+        }
+        d->next += n;
+    }
+
+    /* Stop waiting for the rest of the window once the bus went quiet */
+    return wall_ns() > d->end + IDLE_GRACE;
+}
+
+static void *dump_loop(void *arg)
+{
+    struct flightrec *fr = arg;
+    struct canlog_record *buf;
+    struct dump d;
+    unsigned int polls = 0;
+    int dumping = 0;
+    int running = 1;
+    sigset_t mask;
+
+    /* Leave every signal to the receive loop */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    buf = malloc(CHUNK * sizeof(*buf));
+    if (NULL == buf) {
+        error(0, ENOMEM, "flight recorder");
+        return NULL;
+    }
+
+    while (running) {
+        const struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = POLL_US * 1000L,
+        };
+        uint64_t trigger;
+
+        running = atomic_load(&fr->running);
+
+        trigger = atomic_exchange(&fr->trigger, 0);
+        if (0 != trigger) {
+            if (dumping) {
+                /* Extend the dump in progress */
+                if (trigger + fr->after > d.end) {
+                    d.end = trigger + fr->after;
+                }
+            } else if (NULL == fr->prefix) {
+                /* Only the ring file is kept */
+            } else if (-1 == open_dump(fr, &d, trigger)) {
+                error(0, errno, "%s", d.path);
+            } else {
+                dumping = 1;
+            }
+        }
+
+        if (dumping && (drain(fr, &d, buf) || !running)) {
+            close_dump(&d);
+            dumping = 0;
+        }
+
+        /* Bound what a power loss can take with it, without waiting for it */
+        if (-1 != fr->fd && ++polls >= WRITEBACK_POLLS) {
+            sync_file_range(fr->fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+            polls = 0;
+        }
+
+        if (running) {
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+int flightrec_start(struct flightrec *fr)
+{
+    atomic_store(&fr->running, 1);
+    return pthread_create(&fr->dumper, NULL, dump_loop, fr);
+}
+
+void flightrec_free(struct flightrec *fr)
+{
+    if (atomic_load(&fr->running)) {
+        atomic_store(&fr->running, 0);
+        pthread_join(fr->dumper, NULL);
+    }
+
+    if (NULL != fr->map) {
+        if (-1 != fr->fd) {
+            msync(fr->map, fr->size, MS_SYNC);
+            close(fr->fd);
+        }
+        munmap(fr->map, fr->size);
+    }
+    memset(fr, 0, sizeof(*fr));
+    fr->fd = -1;
+}
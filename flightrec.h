@@ -0,0 +1,130 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Flight Recorder
+
+Keeps the most recent frames in a preallocated ring in memory and writes them
+to disk only when something interesting happens. A trigger makes a helper
+thread dump the frames from a window before the trigger up to a window after
+it into a capture file (see canlog.h). Triggers which arrive during a dump
+extend it.
+
+The receive loop only ever copies the frame into the next slot of the ring
+and publishes the new head, it never waits for the dump. The ring is backed
+by huge pages when the system has them reserved, otherwise by transparent
+huge pages where available, and is touched up front so that recording never
+page faults.
+
+The ring may instead live in a preallocated file mapped shared, with the head
+in the file's header (see canlog.h). Recording costs the same, the kernel
+writes the pages back in its own time, and the helper thread only nudges it
+to start writeback once a second. What the file holds after a crash is read
+back with flightrec_scan().
+*/
+
+#ifndef FLIGHTREC_H
+#define FLIGHTREC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/can.h>
+
+#include "canlog.h"
+
+struct flightrec
+{
+    /* Written by the receive loop */
+    _Alignas(64) _Atomic uint64_t local_head; /* Frames recorded, unless in a file */
+    _Atomic uint64_t trigger;               /* Pending trigger time, 0 if none */
+
+    /* Read-only after initialisation */
+    _Alignas(64) _Atomic uint64_t *head;    /* Frames recorded so far */
+    struct canlog_record *ring;
+    size_t mask;
+    unsigned int shift;     /* log2 of the number of slots */
+    void *map;
+    size_t size;            /* Bytes mapped for the ring */
+    int huge;               /* Whether the ring sits on reserved huge pages */
+    int fd;                 /* Ring file, -1 if the ring is in memory only */
+    uint64_t before;        /* Nanoseconds kept before a trigger */
+    uint64_t after;         /* Nanoseconds kept after a trigger */
+    const char *prefix;     /* Dumps go to PREFIX-SEC.NSEC.canlog, NULL for none */
+
+    pthread_t dumper;
+    atomic_int running;
+};
+
+/* Map a ring for at least capacity frames, keeping before nanoseconds of
+ * history ahead of a trigger and after nanoseconds behind it. If file is not
+ * NULL the ring is kept in that file; a ring file of the same capacity left
+ * behind by an earlier run is carried on from where it ends. Returns 0 on
+ * success and -1 with errno set on failure.
+ */
+int flightrec_init(
+    struct flightrec *fr,
+    size_t capacity,
+    uint64_t before,
+    uint64_t after,
+    const char *prefix,
+    const char *file);
+
+/* Start the dumping thread. Returns 0 on success or an error number. */
+int flightrec_start(struct flightrec *fr);
+
+/* Finish any dump in progress with the frames recorded so far, stop the
+ * dumping thread and unmap the ring
+ */
+void flightrec_free(struct flightrec *fr);
+
+static inline void flightrec_add(
+    struct flightrec *fr,
+    uint64_t stamp,
+    const struct can_frame *frame)
+{
+    const uint64_t head = atomic_load_explicit(fr->head, memory_order_relaxed);
+    struct canlog_record *r = &fr->ring[head & fr->mask];
+
+    canlog_record_set(r, stamp, frame, 0, 0);
+    r->lap = canlog_lap(head, fr->shift);
+    atomic_store_explicit(fr->head, head + 1, memory_order_release);
+}
+
+/* Request a dump around stamp. Safe to call from a signal handler. */
+static inline void flightrec_trigger(struct flightrec *fr, uint64_t stamp)
+{
+    atomic_store_explicit(&fr->trigger, stamp, memory_order_release);
+}
+
+/* Find the records of a mapped ring file which belong to its last lap. The
+ * file holds size bytes at map. On success, returns 0 and sets [first, end)
+ * to the range of record indices; record i is in slot i modulo the capacity.
+ * Returns -1 with errno set to EINVAL if this is not a ring file.
+ */
+int flightrec_scan(const void *map, size_t size, uint64_t *first, uint64_t *end);
+
+#endif /* FLIGHTREC_H */
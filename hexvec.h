@@ -0,0 +1,156 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Vector Hex Conversion
+
+Converts CAN payloads between bytes and hex digits eight bytes at a time.
+For decoding, up to sixteen hex digits are loaded into one 16 byte vector:
+every lane is checked to be a hex digit and turned into its value with the
+same few operations, and neighbouring lanes are then merged into bytes.
+Encoding runs the same steps backwards. The vector load may read past the end
+of the digits, and the store may write past the end of the payload, so both
+need 16 bytes at the pointer they are given. The lanes beyond the payload
+are ignored on the way in and left as junk on the way out.
+
+The vectors are GCC's generic vector extensions, which compile to SSE2 on
+x86-64 and to NEON on ARM.
+*/
+
+#ifndef HEXVEC_H
+#define HEXVEC_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+typedef uint8_t hexvec_chars __attribute__((vector_size(16)));
+typedef uint16_t hexvec_pairs __attribute__((vector_size(16)));
+typedef uint8_t hexvec_bytes __attribute__((vector_size(8)));
+
+/* One more than the value of each hex digit, 0 for anything else */
+static const uint8_t hexvec_table[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+/* Value of a hex digit, or -1. A table rather than comparisons, as digits and
+ * letters mix at random.
+ */
+static inline int hexvec_digit(unsigned char c)
+{
+    return hexvec_table[c] - 1;
+}
+
+/* Decode digits (even, at most 16) hex digits at p into out, zeroing the rest
+ * of its eight bytes. All 16 bytes at p must be readable. Returns 0, or -1 if
+ * one of the digits is not a hex digit.
+ */
+static inline int hexvec_decode(const char *p, unsigned int digits, uint8_t *out)
+{
+    static const hexvec_chars lane = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    static const hexvec_bytes byte_lane = {0, 1, 2, 3, 4, 5, 6, 7};
+    hexvec_chars c;
+    hexvec_chars lower;
+    hexvec_chars bad;
+    hexvec_pairs pairs;
+    hexvec_bytes bytes;
+    uint64_t halves[2];
+
+    memcpy(&c, p, sizeof(c));
+
+    /* Lanes of the payload which are not hex digits */
+    lower = c | 0x20;
+    bad = ~((hexvec_chars)((c >= '0') & (c <= '9')) |
+            (hexvec_chars)((lower >= 'a') & (lower <= 'f')));
+    bad &= (hexvec_chars)(lane < (uint8_t)digits);
+    memcpy(halves, &bad, sizeof(halves));
+    if (0 != (halves[0] | halves[1])) {
+        return -1;
+    }
+
+    /* Digits have bit 6 clear and their value in the low nibble, letters of
+     * either case have bit 6 set and a low nibble 9 short of their value
+     */
+    c = (c & 0x0F) + (c >> 6) * 9;
+
+    /* On a little-endian machine each 16 bit lane holds a high nibble in its
+     * low byte and a low nibble in its high byte
+     */
+    pairs = (hexvec_pairs)c;
+    pairs = ((pairs & 0xFF) << 4) | (pairs >> 8);
+    bytes = __builtin_convertvector(pairs, hexvec_bytes);
+    bytes &= (hexvec_bytes)(byte_lane < (uint8_t)(digits / 2));
+    memcpy(out, &bytes, sizeof(bytes));
+    return 0;
+}
+
+/* The same as hexvec_decode() a digit at a time, for digits at the end of a
+ * buffer
+ */
+static inline int hexvec_decode_scalar(const char *p, unsigned int digits, uint8_t *out)
+{
+    unsigned int i;
+
+    memset(out, 0, CAN_MAX_DLEN);
+    for (i = 0; i < digits; i += 2) {
+        const int hi = hexvec_digit(p[i]);
+        const int lo = hexvec_digit(p[i + 1]);
+        if (hi < 0 || lo < 0) {
+            return -1;
+        }
+        out[i / 2] = hi << 4 | lo;
+    }
+    return 0;
+}
+
+/* Write the eight bytes at data as 16 upper case hex digits at p. Returns
+ * the number of digits of the first len bytes, which are all the caller
+ * keeps.
+ */
+static inline unsigned int hexvec_encode(char *p, const uint8_t *data, unsigned int len)
+{
+    hexvec_bytes bytes;
+    hexvec_pairs pairs;
+    hexvec_chars c;
+
+    memcpy(&bytes, data, sizeof(bytes));
+
+    /* Each byte widened to a 16 bit lane, its high nibble to the low byte and
+     * its low nibble to the high byte, giving the digits in order
+     */
+    pairs = __builtin_convertvector(bytes, hexvec_pairs);
+    pairs = (pairs >> 4) | ((pairs & 0x0F) << 8);
+    c = (hexvec_chars)pairs;
+
+    /* Letters follow the digits after a gap of 7 */
+    c += '0' + ((hexvec_chars)(c > 9) & 7);
+    memcpy(p, &c, sizeof(c));
+    return 2 * len;
+}
+
+#endif /* HEXVEC_H */
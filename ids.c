@@ -0,0 +1,322 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Frequency Based Intrusion Detection
+
+The payload is handled as one 64-bit word, loaded little-endian with bytes
+beyond the frame length read as zero, like the bit profiler does. The byte
+ranges are two such words, so learning and checking all eight bytes is a
+pair of byte-wise vector compares.
+
+Rates are counted in tumbling windows which start at the first frame after
+the previous window ended. Training records the busiest window of every ID,
+and once armed an ID may send a multiple of that, plus some slack so that
+slow IDs with one or two frames per window do not trip on jitter.
+*/
+
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ids.h"
+
+/* Length of a rate window in nanoseconds */
+#define RATE_WINDOW (UINT64_C(250000000))
+
+/* Frames allowed per rate window are the training peak times this, plus the
+ * slack
+ */
+#define RATE_FACTOR (2)
+#define RATE_SLACK (2)
+
+/* Shortest time between two alerts about the same ID, in nanoseconds */
+#define HOLDOFF (UINT64_C(1000000000))
+
+/* Alerts which may wait for the reporting thread */
+#define QUEUE_LEN (256)
+
+typedef uint8_t vbytes __attribute__((vector_size(sizeof(uint64_t))));
+
+int ids_init(struct ids *ids, uint32_t capacity, uint64_t training)
+{
+    memset(ids, 0, sizeof(*ids));
+
+    ids->entries = idtable_init_entries(&ids->index, capacity, sizeof(*ids->entries));
+    if (NULL == ids->entries) {
+        return -1;
+    }
+
+    if (-1 == spsc_init(&ids->queue, QUEUE_LEN, sizeof(struct ids_alert))) {
+        free(ids->entries);
+        idtable_free(&ids->index);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    ids->capacity = capacity;
+    ids->training = training;
+    return 0;
+}
+
+void ids_free(struct ids *ids)
+{
+    idtable_free(&ids->index);
+    free(ids->entries);
+    spsc_free(&ids->queue);
+    memset(ids, 0, sizeof(*ids));
+}
+
+static uint8_t frame_len(const struct can_frame *frame)
+{
+    return (frame->len > CAN_MAX_DLEN) ? CAN_MAX_DLEN : frame->len;
+}
+
+static uint64_t payload_word(const struct can_frame *frame, uint8_t len)
+{
+    const uint64_t mask = (len == CAN_MAX_DLEN) ? UINT64_MAX : (UINT64_C(1) << (len * 8)) - 1;
+    uint64_t w;
+
+    memcpy(&w, frame->data, sizeof(w));
+    return le64toh(w) & mask;
+}
+
+/* Count the frame in the rate window of its ID */
+static void count_frame(struct ids_entry *e, uint64_t stamp)
+{
+    if (stamp - e->window >= RATE_WINDOW) {
+        e->window = stamp;
+        e->count = 0;
+    }
+    e->count++;
+}
+
+static void learn(struct ids *ids, uint64_t stamp, const struct can_frame *frame)
+{
+    const uint32_t key = idtable_key(frame->can_id);
+    const uint8_t len = frame_len(frame);
+    const vbytes w = (vbytes)payload_word(frame, len);
+    struct ids_entry *e;
+    uint32_t i;
+
+    i = idtable_find(&ids->index, key);
+    if (IDTABLE_EMPTY == i) {
+        i = ids->index.count;
+        if (1 != idtable_insert(&ids->index, key, i)) {
+            return;
+        }
+
+        e = &ids->entries[i];
+        e->can_id = key;
+        e->lo = (uint64_t)w;
+        e->hi = (uint64_t)w;
+        e->window = stamp;
+    } else {
+        const vbytes lo = (vbytes)ids->entries[i].lo;
+        const vbytes hi = (vbytes)ids->entries[i].hi;
+        const vbytes below = (vbytes)(w < lo);
+        const vbytes above = (vbytes)(w > hi);
+
+        e = &ids->entries[i];
+        e->lo = (uint64_t)((w & below) | (lo & ~below));
+        e->hi = (uint64_t)((w & above) | (hi & ~above));
+    }
+
+    e->lengths |= 1U << len;
+    count_frame(e, stamp);
+    e->peak = (e->count > e->peak) ? e->count : e->peak;
+}
+
+/* Freeze what was learned into per-ID limits */
+static void arm(struct ids *ids)
+{
+    uint32_t i;
+
+    for (i = 0; i < ids->index.count; i++) {
+        struct ids_entry *e = &ids->entries[i];
+        e->limit = e->peak * RATE_FACTOR + RATE_SLACK;
+        e->window = 0;
+        e->count = 0;
+    }
+    ids->armed = 1;
+}
+
+/* Queue an alert unless the ID raised one too recently */
+static int raise_alert(
+    struct ids *ids,
+    struct ids_entry *e,
+    uint64_t stamp,
+    const struct can_frame *frame,
+    struct ids_alert *alert)
+{
+    if (NULL != e) {
+        if (stamp < e->held) {
+            return 0;
+        }
+        e->held = stamp + HOLDOFF;
+    }
+
+    alert->stamp = stamp;
+    alert->can_id = idtable_key(frame->can_id);
+    alert->len = frame_len(frame);
+    memcpy(alert->data, frame->data, CAN_MAX_DLEN);
+
+    if (-1 == spsc_push(&ids->queue, alert)) {
+        ids->lost++;
+    } else {
+        ids->alerts++;
+    }
+    return 1;
+}
+
+static int detect(struct ids *ids, uint64_t stamp, const struct can_frame *frame)
+{
+    const uint32_t key = idtable_key(frame->can_id);
+    const uint8_t len = frame_len(frame);
+    struct ids_alert alert = {0};
+    struct ids_entry *e;
+    uint64_t bad;
+    uint32_t i;
+
+    ids->frames++;
+
+    i = idtable_find(&ids->index, key);
+    if (IDTABLE_EMPTY == i) {
+        /* Remember the ID so that it is reported once per hold off period.
+         * When the table is full every frame is reported and the ring sheds
+         * what the reporter cannot keep up with.
+         */
+        e = NULL;
+        i = ids->index.count;
+        if (1 == idtable_insert(&ids->index, key, i)) {
+            e = &ids->entries[i];
+            e->can_id = key;
+            e->unknown = 1;
+        }
+        alert.kind = IDS_UNKNOWN_ID;
+        return raise_alert(ids, e, stamp, frame, &alert);
+    }
+
+    e = &ids->entries[i];
+    if (e->unknown) {
+        alert.kind = IDS_UNKNOWN_ID;
+        return raise_alert(ids, e, stamp, frame, &alert);
+    }
+
+    count_frame(e, stamp);
+    if (e->count > e->limit) {
+        alert.kind = IDS_RATE;
+        alert.expected = e->limit;
+        alert.observed = e->count;
+        return raise_alert(ids, e, stamp, frame, &alert);
+    }
+
+    if (0 == (e->lengths & (1U << len))) {
+        alert.kind = IDS_LENGTH;
+        alert.expected = e->lengths;
+        alert.observed = len;
+        return raise_alert(ids, e, stamp, frame, &alert);
+    }
+
+    {
+        const vbytes w = (vbytes)payload_word(frame, len);
+        bad = (uint64_t)((w < (vbytes)e->lo) | (w > (vbytes)e->hi));
+    }
+    if (0 != bad) {
+        const unsigned int shift = __builtin_ctzll(bad) & ~7U;
+        const uint8_t lo = e->lo >> shift;
+        const uint8_t hi = e->hi >> shift;
+
+        alert.kind = (lo == hi) ? IDS_CONSTANT : IDS_RANGE;
+        alert.byte = shift / 8;
+        alert.expected = (uint32_t)lo << 8 | hi;
+        alert.observed = frame->data[alert.byte];
+        return raise_alert(ids, e, stamp, frame, &alert);
+    }
+
+    return 0;
+}
+
+int ids_check(struct ids *ids, uint64_t stamp, const struct can_frame *frame)
+{
+    if (!ids->armed) {
+        if (0 == ids->armed_at) {
+            ids->armed_at = stamp + ids->training;
+        }
+
+        if (stamp < ids->armed_at) {
+            learn(ids, stamp, frame);
+            return 0;
+        }
+
+        arm(ids);
+    }
+
+    return detect(ids, stamp, frame);
+}
+
+void ids_print_alert(const struct ids_alert *alert, FILE *fp)
+{
+    uint8_t i;
+
+    fprintf(fp, "ALERT: %llu.%09llu ",
+            (unsigned long long)(alert->stamp / 1000000000),
+            (unsigned long long)(alert->stamp % 1000000000));
+
+    if (alert->can_id & CAN_EFF_FLAG) {
+        fprintf(fp, "%08X", alert->can_id & CAN_EFF_MASK);
+    } else {
+        fprintf(fp, "%03X", alert->can_id);
+    }
+
+    fprintf(fp, "  [%u]", alert->len);
+    for (i = 0; i < alert->len; i++) {
+        fprintf(fp, " %02X", alert->data[i]);
+    }
+
+    switch (alert->kind) {
+    case IDS_UNKNOWN_ID:
+        fprintf(fp, "  unknown ID\n");
+        break;
+    case IDS_RATE:
+        fprintf(fp, "  rate: %u frames in %llu ms, limit %u\n",
+                alert->observed,
+                (unsigned long long)(RATE_WINDOW / 1000000),
+                alert->expected);
+        break;
+    case IDS_LENGTH:
+        fprintf(fp, "  length %u never seen\n", alert->observed);
+        break;
+    case IDS_CONSTANT:
+        fprintf(fp, "  byte %u: %02X, constant %02X\n",
+                alert->byte, alert->observed, alert->expected & 0xFF);
+        break;
+    case IDS_RANGE:
+        fprintf(fp, "  byte %u: %02X, outside %02X..%02X\n",
+                alert->byte, alert->observed,
+                alert->expected >> 8, alert->expected & 0xFF);
+        break;
+    }
+}
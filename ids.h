@@ -0,0 +1,125 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Frequency Based Intrusion Detection
+
+Learns what the bus normally looks like during a training window, then flags
+frames which do not fit: IDs never seen in training, IDs sent faster than
+they ever were, payload lengths never seen, and payload bytes outside the
+range they kept during training (a byte which never changed is simply a range
+of one value).
+
+Checking a frame costs one ID table lookup and a handful of word sized
+operations. Alerts are not printed; they are queued on a bounded single
+producer, single consumer ring which another thread drains at its own pace,
+so a flood of alerts can never stall the receive path. One detector serves
+one channel, each with its own ring.
+*/
+
+#ifndef IDS_H
+#define IDS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <linux/can.h>
+
+#include "idtable.h"
+#include "spsc.h"
+
+enum ids_kind
+{
+    IDS_UNKNOWN_ID,     /* ID never seen during training */
+    IDS_RATE,           /* More frames in a rate window than ever in training */
+    IDS_LENGTH,         /* Payload length never seen during training */
+    IDS_CONSTANT,       /* A byte which was constant during training changed */
+    IDS_RANGE,          /* A byte left the range it kept during training */
+};
+
+struct ids_alert
+{
+    uint64_t stamp;     /* Receive time of the offending frame */
+    uint32_t expected;  /* Frame limit, length mask or byte range (lo << 8 | hi) */
+    uint32_t observed;  /* Frame count, length or byte value */
+    canid_t can_id;
+    uint8_t kind;
+    uint8_t byte;       /* Offending payload byte */
+    uint8_t len;
+    uint8_t data[CAN_MAX_DLEN];
+};
+
+struct ids_entry
+{
+    uint64_t lo;        /* Smallest value of every payload byte, one per byte */
+    uint64_t hi;        /* Largest value of every payload byte */
+    uint64_t window;    /* Start of the current rate window */
+    uint64_t held;      /* No further alerts for this ID until this time */
+    uint32_t count;     /* Frames in the current rate window */
+    uint32_t peak;      /* Most frames in any rate window during training */
+    uint32_t limit;     /* Most frames allowed in a rate window once armed */
+    uint16_t lengths;   /* Bit n is set if length n was seen */
+    uint8_t unknown;    /* First seen after training */
+    canid_t can_id;
+};
+
+struct ids
+{
+    struct idtable index;   /* Maps CAN IDs to entries */
+    struct ids_entry *entries;
+    uint32_t capacity;
+    uint64_t training;      /* Length of the training window in nanoseconds */
+    uint64_t armed_at;      /* End of the training window, 0 until the first frame */
+    int armed;
+    uint64_t frames;        /* Frames checked since arming */
+    uint64_t alerts;        /* Alerts queued */
+    uint64_t lost;          /* Alerts dropped because the ring was full */
+    struct spsc queue;      /* Alerts for the reporting thread */
+};
+
+/* Allocate a detector for up to capacity distinct IDs which trains for
+ * training nanoseconds from the first frame. Returns 0 on success and -1 with
+ * errno set on failure.
+ */
+int ids_init(struct ids *ids, uint32_t capacity, uint64_t training);
+
+void ids_free(struct ids *ids);
+
+/* Learn from or check a frame received at stamp nanoseconds. Returns 1 if an
+ * alert was raised, otherwise 0.
+ */
+int ids_check(struct ids *ids, uint64_t stamp, const struct can_frame *frame);
+
+/* Take the oldest queued alert. Returns 0 on success and -1 if there is none.
+ * Safe to call from one thread other than the one calling ids_check().
+ */
+static inline int ids_next_alert(struct ids *ids, struct ids_alert *alert)
+{
+    return spsc_pop(&ids->queue, alert);
+}
+
+/* Print an alert as a single line */
+void ids_print_alert(const struct ids_alert *alert, FILE *fp);
+
+#endif /* IDS_H */
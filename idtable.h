@@ -0,0 +1,200 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+CAN ID Table
+
+A fixed capacity, open addressing hash table which maps CAN IDs onto dense
+slot numbers. Callers keep their per-ID state in flat arrays indexed by the
+slot number, so a lookup costs one multiply and (usually) one cache line.
+
+The table never grows. Once it holds the capacity it was set up with,
+further insertions fail, which keeps memory bounded no matter what shows up
+on the bus and lets callers size their arrays to the capacity.
+*/
+
+#ifndef IDTABLE_H
+#define IDTABLE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <linux/can.h>
+
+/* Marks an unused slot. Never a valid key since keys have the ERR and RTR
+ * flags masked off.
+ */
+#define IDTABLE_EMPTY (UINT32_MAX)
+
+/* Bits of a can_id which identify a message */
+#define IDTABLE_KEY_MASK (CAN_EFF_FLAG | CAN_EFF_MASK)
+
+struct idtable_slot
+{
+    uint32_t key;
+    uint32_t value;
+};
+
+struct idtable
+{
+    struct idtable_slot *slots;
+    uint32_t bits;
+    uint32_t count;
+    uint32_t capacity;  /* Keys it accepts, at most three quarters of the slots */
+};
+
+static inline uint32_t idtable_key(canid_t can_id)
+{
+    return can_id & IDTABLE_KEY_MASK;
+}
+
+static inline uint32_t idtable_size(const struct idtable *t)
+{
+    return UINT32_C(1) << t->bits;
+}
+
+static inline uint32_t idtable_hash(const struct idtable *t, uint32_t key)
+{
+    /* Fibonacci hashing, the high bits of the product are the best mixed */
+    return (uint32_t)(key * UINT32_C(0x9E3779B1)) >> (32 - t->bits);
+}
+
+/* Number of hash bits needed to hold capacity keys */
+static inline uint32_t idtable_bits(uint32_t capacity)
+{
+    uint32_t bits = 4;
+    while ((UINT32_C(3) << bits) / 4 < capacity) {
+        bits++;
+    }
+    return bits;
+}
+
+/* Set up an empty table for capacity keys on top of caller provided slot
+ * storage of idtable_bits(capacity) bits or more
+ */
+static inline void idtable_reset(
+    struct idtable *t, struct idtable_slot *slots, uint32_t bits, uint32_t capacity)
+{
+    uint32_t i;
+
+    t->slots = slots;
+    t->bits = bits;
+    t->count = 0;
+    t->capacity = capacity;
+    for (i = 0; i < idtable_size(t); i++) {
+        t->slots[i].key = IDTABLE_EMPTY;
+        t->slots[i].value = 0;
+    }
+}
+
+/* Allocate a table holding up to capacity keys */
+static inline int idtable_init(struct idtable *t, uint32_t capacity)
+{
+    const uint32_t bits = idtable_bits(capacity);
+    struct idtable_slot *slots;
+
+    slots = malloc(sizeof(*slots) << bits);
+    if (NULL == slots) {
+        return -1;
+    }
+
+    idtable_reset(t, slots, bits, capacity);
+    return 0;
+}
+
+static inline void idtable_free(struct idtable *t)
+{
+    free(t->slots);
+    t->slots = NULL;
+}
+
+/* Allocate a table for capacity keys along with a zeroed array of capacity
+ * entries of size bytes, for per-ID state indexed by the values stored.
+ * Returns the array, or NULL with errno set.
+ */
+static inline void *idtable_init_entries(struct idtable *t, uint32_t capacity, size_t size)
+{
+    void *entries;
+
+    if (-1 == idtable_init(t, capacity)) {
+        return NULL;
+    }
+
+    entries = calloc(capacity, size);
+    if (NULL == entries) {
+        idtable_free(t);
+        return NULL;
+    }
+    return entries;
+}
+
+/* Return the value stored for key, or IDTABLE_EMPTY if it is not present */
+static inline uint32_t idtable_find(const struct idtable *t, uint32_t key)
+{
+    const uint32_t mask = idtable_size(t) - 1;
+    uint32_t i = idtable_hash(t, key);
+
+    for (;;) {
+        const struct idtable_slot *slot = &t->slots[i];
+        if (slot->key == key) {
+            return slot->value;
+        }
+        if (slot->key == IDTABLE_EMPTY) {
+            return IDTABLE_EMPTY;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/* Insert key with the given value. Returns 1 if the key was added, 0 if it
+ * was already present (the stored value is left alone) and -1 if the table
+ * already holds its capacity.
+ */
+static inline int idtable_insert(struct idtable *t, uint32_t key, uint32_t value)
+{
+    const uint32_t mask = idtable_size(t) - 1;
+    uint32_t i = idtable_hash(t, key);
+
+    for (;;) {
+        struct idtable_slot *slot = &t->slots[i];
+        if (slot->key == key) {
+            return 0;
+        }
+        if (slot->key == IDTABLE_EMPTY) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+
+    if (t->count >= t->capacity) {
+        return -1;
+    }
+
+    t->slots[i].key = key;
+    t->slots[i].value = value;
+    t->count++;
+    return 1;
+}
+
+#endif /* IDTABLE_H */
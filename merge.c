@@ -0,0 +1,258 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Merge
+
+The heap holds one key per source which still has records, the adjusted time
+of its next record. Taking a record replaces the key at the root with that of
+the same source's following record and sifts it down, which is a single pass
+down the heap rather than a pop followed by a push. Ties are broken on the
+source index, so the output does not depend on the heap's layout.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "merge.h"
+
+int merge_init(struct merge *m, unsigned int capacity)
+{
+    memset(m, 0, sizeof(*m));
+
+    m->sources = calloc(capacity, sizeof(*m->sources));
+    m->heap = calloc(capacity, sizeof(*m->heap));
+    if (NULL == m->sources || NULL == m->heap) {
+        merge_free(m);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    m->capacity = capacity;
+    return 0;
+}
+
+void merge_free(struct merge *m)
+{
+    unsigned int i;
+
+    if (NULL != m->sources) {
+        for (i = 0; i < m->nsources; i++) {
+            if (NULL != m->sources[i].map) {
+                munmap(m->sources[i].map, m->sources[i].size);
+            }
+        }
+    }
+
+    free(m->sources);
+    free(m->heap);
+    memset(m, 0, sizeof(*m));
+}
+
+int merge_add(struct merge *m, const struct canlog_record *records, size_t count,
+              int64_t offset, unsigned int channel)
+{
+    struct merge_source *s;
+
+    if (m->started) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (m->nsources >= m->capacity) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    s = &m->sources[m->nsources];
+    memset(s, 0, sizeof(*s));
+    s->next = records;
+    s->end = records + count;
+    s->offset = offset;
+    s->channel = channel;
+    return m->nsources++;
+}
+
+int merge_add_file(struct merge *m, const char *path, int64_t offset, unsigned int channel)
+{
+    const struct canlog_header *header;
+    struct stat st;
+    size_t count;
+    void *map;
+    int saved;
+    int index;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        return -1;
+    }
+
+    if (-1 == fstat(fd, &st)) {
+        goto fail;
+    }
+    if ((size_t)st.st_size < sizeof(*header)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == map) {
+        goto fail;
+    }
+    close(fd);
+
+    header = map;
+    if (!canlog_header_valid(header)) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    /* A capture cut short still holds every whole record before the cut */
+    count = (st.st_size - sizeof(*header)) / sizeof(struct canlog_record);
+    index = merge_add(m, (const struct canlog_record *)(header + 1), count, offset, channel);
+    if (-1 == index) {
+        saved = errno;
+        munmap(map, st.st_size);
+        errno = saved;
+        return -1;
+    }
+
+    m->sources[index].map = map;
+    m->sources[index].size = st.st_size;
+    return index;
+
+fail:
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+}
+
+static uint64_t adjust(uint64_t stamp, int64_t offset)
+{
+    if (offset < 0 && stamp < (uint64_t)-offset) {
+        return 0;
+    }
+    if (offset > 0 && stamp > UINT64_MAX - (uint64_t)offset) {
+        return UINT64_MAX;
+    }
+    return stamp + offset;
+}
+
+static int before(const struct merge_key *a, const struct merge_key *b)
+{
+    return a->stamp < b->stamp || (a->stamp == b->stamp && a->source < b->source);
+}
+
+static void sift_down(struct merge *m, unsigned int i)
+{
+    struct merge_key *heap = m->heap;
+    const struct merge_key key = heap[i];
+
+    for (;;) {
+        unsigned int child = 2 * i + 1;
+
+        if (child >= m->nheap) {
+            break;
+        }
+        if (child + 1 < m->nheap && before(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!before(&heap[child], &key)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = key;
+}
+
+static void start(struct merge *m)
+{
+    unsigned int i;
+
+    m->nheap = 0;
+    for (i = 0; i < m->nsources; i++) {
+        const struct merge_source *s = &m->sources[i];
+        if (s->next < s->end) {
+            m->heap[m->nheap].stamp = adjust(s->next->stamp, s->offset);
+            m->heap[m->nheap].source = i;
+            m->nheap++;
+        }
+    }
+
+    for (i = m->nheap / 2; i-- > 0;) {
+        sift_down(m, i);
+    }
+    m->started = 1;
+}
+
+int merge_next(struct merge *m, struct canlog_record *r)
+{
+    struct merge_source *s;
+
+    if (!m->started) {
+        start(m);
+    }
+    if (0 == m->nheap) {
+        return -1;
+    }
+
+    s = &m->sources[m->heap[0].source];
+    *r = *s->next;
+    if (r->stamp < s->previous) {
+        s->disorder++;
+    }
+    s->previous = r->stamp;
+    r->stamp = m->heap[0].stamp;
+    r->channel += s->channel;
+    s->next++;
+
+    if (s->next < s->end) {
+        m->heap[0].stamp = adjust(s->next->stamp, s->offset);
+    } else {
+        m->heap[0] = m->heap[--m->nheap];
+    }
+    sift_down(m, 0);
+    return 0;
+}
+
+uint64_t merge_remaining(const struct merge *m)
+{
+    uint64_t n = 0;
+    unsigned int i;
+
+    for (i = 0; i < m->nsources; i++) {
+        n += m->sources[i].end - m->sources[i].next;
+    }
+    return n;
+}
@@ -0,0 +1,104 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Merge
+
+Merges any number of captures (see canlog.h) into one stream in time order.
+Each source is a capture file, mapped and read front to back, or records in
+memory, and must already be in time order on its own, as every capture the
+demos write is. A binary heap keyed on the time of each source's next record
+picks the source to read from, so a merge of k sources costs O(log k) per
+record and only ever looks at one record per source. Frames with equal times
+come out in the order the sources were added.
+
+Every source can have a clock offset, added to each of its timestamps, to
+line up captures recorded on machines whose clocks disagree, and can have its
+channel numbers moved up by a base so that channel 0 of two captures does not
+end up as the same channel.
+*/
+
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "canlog.h"
+
+struct merge_source
+{
+    const struct canlog_record *next;
+    const struct canlog_record *end;
+    void *map;              /* The mapping, NULL for a caller's records */
+    size_t size;
+    int64_t offset;         /* Nanoseconds added to every timestamp */
+    unsigned int channel;   /* Added to every channel number */
+    uint64_t previous;      /* Time of the previous record, before the offset */
+    uint64_t disorder;      /* Records older than the one before them */
+};
+
+struct merge_key
+{
+    uint64_t stamp;
+    unsigned int source;
+};
+
+struct merge
+{
+    struct merge_source *sources;
+    struct merge_key *heap;
+    unsigned int capacity;
+    unsigned int nsources;
+    unsigned int nheap;
+    int started;
+};
+
+/* Allocate room for up to capacity sources. Returns 0 on success and -1 with
+ * errno set on failure.
+ */
+int merge_init(struct merge *m, unsigned int capacity);
+
+void merge_free(struct merge *m);
+
+/* Map the capture file at path as the next source. Returns the index of the
+ * source, or -1 with errno set.
+ */
+int merge_add_file(struct merge *m, const char *path, int64_t offset, unsigned int channel);
+
+/* Add count records in memory, which must outlive the merge, as the next
+ * source. Returns the index of the source, or -1 with errno set.
+ */
+int merge_add(struct merge *m, const struct canlog_record *records, size_t count,
+              int64_t offset, unsigned int channel);
+
+/* Copy the next record in time order, with its source's offset and channel
+ * base applied, to r. Returns 0, or -1 once every source is exhausted.
+ */
+int merge_next(struct merge *m, struct canlog_record *r);
+
+/* Records left to merge */
+uint64_t merge_remaining(const struct merge *m);
+
+#endif /* MERGE_H */
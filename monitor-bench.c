@@ -0,0 +1,429 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Bus Monitor Benchmark
+
+This program measures the per-frame cost of the analyses the raw demo can run
+on its receive path. A synthetic bus of cyclic IDs with jittered periods and
+slowly changing payloads is generated in memory, then fed through each
+analysis in turn. The cost is reported in nanoseconds per frame and compared
+against the frame rate of a fully loaded 1 Mbit/s bus.
+*/
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "bitprof.h"
+#include "canpack.h"
+#include "ids.h"
+#include "pcapng.h"
+#include "slcan.h"
+#include "timing.h"
+
+#define VERSION "2.0.0"
+
+#define NIDS (200)
+#define NFRAMES (1 << 20)
+#define DEFAULT_ROUNDS (20)
+
+/* Frames per second of a 1 Mbit/s bus saturated with 8 byte standard frames,
+ * about 111 bits each including stuffing
+ */
+#define FULL_BUS_RATE (9000.0)
+
+struct args
+{
+    unsigned long rounds;
+};
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS]\n"
+        "\n"
+        "Options:\n"
+        "  --rounds, -r N   Replay the generated bus N times (default: %d)\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, DEFAULT_ROUNDS
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    args->rounds = DEFAULT_ROUNDS;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "r:Vh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'r':
+            args->rounds = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->rounds) {
+                error(EXIT_FAILURE, 0, "invalid round count: %s", optarg);
+            }
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc != optind) {
+        error(0, 0, "no arguments expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A bus of NIDS cyclic IDs with periods from 10 ms to 1 s, 2% jitter, an
+ * incrementing counter byte and a slowly drifting value in every payload
+ */
+static void generate_bus(struct can_frame *frames, uint64_t *stamps)
+{
+    uint64_t period[NIDS];
+    uint64_t due[NIDS];
+    uint8_t payload[NIDS][CAN_MAX_DLEN];
+    int i;
+
+    memset(payload, 0, sizeof(payload));
+    for (i = 0; i < NIDS; i++) {
+        period[i] = (10 + rand() % 991) * UINT64_C(1000000);
+        due[i] = rand() % period[i];
+    }
+
+    for (i = 0; i < NFRAMES; i++) {
+        int next = 0;
+        int j;
+
+        /* The ID with the earliest due time goes next */
+        for (j = 1; j < NIDS; j++) {
+            if (due[j] < due[next]) {
+                next = j;
+            }
+        }
+
+        payload[next][0]++;
+        if (0 == rand() % 8) {
+            payload[next][2] += (rand() % 2) ? 1 : -1;
+        }
+
+        frames[i].can_id = (next < NIDS - 20) ? 0x100U + next : CAN_EFF_FLAG | (0x18FF0000 + next);
+        frames[i].len = CAN_MAX_DLEN;
+        memcpy(frames[i].data, payload[next], CAN_MAX_DLEN);
+        stamps[i] = due[next];
+
+        due[next] += period[next] - period[next] / 50 + rand() % (period[next] / 25 + 1);
+    }
+}
+
+static int count_record(void *ctx, const struct canlog_record *r)
+{
+    uint64_t *n = ctx;
+
+    (void)r;
+    (*n)++;
+    return 0;
+}
+
+static void report(const char *name, double seconds, unsigned long frames)
+{
+    const double ns = seconds * 1e9 / frames;
+    printf("%-14s %8.1f ns/frame %8.2f M frames/s %9.4f%% of a core per full bus\n",
+           name, ns, frames / seconds / 1e6, 100.0 * ns * FULL_BUS_RATE / 1e9);
+}
+
+int main(int argc, char **argv)
+{
+    struct can_frame *frames;
+    uint64_t *stamps;
+    struct args args;
+    double t0;
+    unsigned long r;
+    int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    srand(1);
+
+    frames = malloc(NFRAMES * sizeof(*frames));
+    stamps = malloc(NFRAMES * sizeof(*stamps));
+    if (NULL == frames || NULL == stamps) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    generate_bus(frames, stamps);
+
+    {
+        struct bitprof bp;
+
+        if (-1 == bitprof_init(&bp, NIDS)) {
+            error(EXIT_FAILURE, errno, "bit profile");
+        }
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            for (i = 0; i < NFRAMES; i++) {
+                bitprof_add(&bp, stamps[i], &frames[i]);
+            }
+        }
+        report("Bit profile", now() - t0, args.rounds * NFRAMES);
+        bitprof_free(&bp);
+    }
+
+    {
+        struct timing t;
+        const uint64_t span = stamps[NFRAMES - 1] + UINT64_C(1000000000);
+
+        if (-1 == timing_init(&t, NIDS)) {
+            error(EXIT_FAILURE, errno, "timing");
+        }
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            for (i = 0; i < NFRAMES; i++) {
+                timing_add(&t, r * span + stamps[i], &frames[i]);
+            }
+        }
+        report("Timing", now() - t0, args.rounds * NFRAMES);
+        timing_free(&t);
+    }
+
+    {
+        struct ids ids;
+        struct ids_alert alert;
+        const uint64_t span = stamps[NFRAMES - 1] + UINT64_C(1000000000);
+
+        /* Train on the first half of the first round */
+        if (-1 == ids_init(&ids, NIDS, stamps[NFRAMES / 2])) {
+            error(EXIT_FAILURE, errno, "ids");
+        }
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            for (i = 0; i < NFRAMES; i++) {
+                ids_check(&ids, r * span + stamps[i], &frames[i]);
+
+                /* Stand in for the reporting thread */
+                if (0 == i % 1024) {
+                    while (0 == ids_next_alert(&ids, &alert)) {
+                    }
+                }
+            }
+        }
+        report("Intrusion", now() - t0, args.rounds * NFRAMES);
+        printf("%-14s %llu alerts, %llu lost\n", "",
+               (unsigned long long)ids.alerts, (unsigned long long)ids.lost);
+        ids_free(&ids);
+    }
+
+    {
+        struct pcapng w;
+        struct canfd_frame fd;
+        char path[] = "/tmp/monitor-bench-XXXXXX";
+        int tmp;
+
+        /* The whole path to disk, with every frame stretched to 64 byte CAN FD */
+        tmp = mkstemp(path);
+        if (-1 == tmp) {
+            error(EXIT_FAILURE, errno, "mkstemp");
+        }
+        close(tmp);
+
+        if (-1 == pcapng_init(&w, path, 0, 0) ||
+            -1 == pcapng_add_interface(&w, "can0") ||
+            -1 == pcapng_start(&w)) {
+            error(EXIT_FAILURE, errno, "%s", path);
+        }
+
+        memset(&fd, 0, sizeof(fd));
+        fd.len = CANFD_MAX_DLEN;
+        fd.flags = CANFD_BRS;
+
+        t0 = now();
+        for (i = 0; i < NFRAMES; i++) {
+            fd.can_id = frames[i].can_id;
+            memcpy(fd.data, frames[i].data, CAN_MAX_DLEN);
+
+            /* Wait for the writer rather than measure dropped frames */
+            while (-1 == pcapng_write(&w, 0, stamps[i], &fd, CANFD_MTU)) {
+                sched_yield();
+            }
+        }
+        pcapng_stop(&w);
+        report("pcapng (FD)", now() - t0, NFRAMES);
+
+        pcapng_free(&w);
+        unlink(path);
+    }
+
+    {
+        struct canlog_record *records;
+        struct canpack w;
+        char path[] = "/tmp/monitor-bench-XXXXXX";
+        uint64_t unpacked = 0;
+        struct stat st;
+        void *map;
+        int fd;
+
+        records = malloc(NFRAMES * sizeof(*records));
+        if (NULL == records) {
+            error(EXIT_FAILURE, errno, "malloc");
+        }
+        for (i = 0; i < NFRAMES; i++) {
+            canlog_record_set(&records[i], stamps[i], &frames[i], 0, 0);
+        }
+
+        fd = mkstemp(path);
+        if (-1 == fd || -1 == canpack_init(&w, fd)) {
+            error(EXIT_FAILURE, errno, "%s", path);
+        }
+
+        t0 = now();
+        for (i = 0; i < NFRAMES; i++) {
+            if (-1 == canpack_write(&w, &records[i])) {
+                error(EXIT_FAILURE, errno, "%s", path);
+            }
+        }
+        if (-1 == canpack_flush(&w)) {
+            error(EXIT_FAILURE, errno, "%s", path);
+        }
+        report("Pack", now() - t0, NFRAMES);
+        printf("%-14s %.1fx smaller than %zu byte records, %.2f bytes/frame\n", "",
+               (double)NFRAMES * sizeof(*records) / w.bytes, sizeof(*records),
+               (double)w.bytes / NFRAMES);
+
+        if (-1 == fstat(fd, &st)) {
+            error(EXIT_FAILURE, errno, "%s", path);
+        }
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == map) {
+            error(EXIT_FAILURE, errno, "%s", path);
+        }
+
+        t0 = now();
+        if (0 != canpack_decode(map, st.st_size, count_record, &unpacked) || NFRAMES != unpacked) {
+            error(EXIT_FAILURE, 0, "unpacking failed");
+        }
+        report("Unpack", now() - t0, NFRAMES);
+
+        munmap(map, st.st_size);
+        canpack_free(&w);
+        close(fd);
+        unlink(path);
+        free(records);
+    }
+
+    {
+        struct can_frame frame;
+        char *text;
+        size_t size = 0;
+        size_t pos;
+
+        /* Room for the vector loads past the last line */
+        text = malloc((size_t)NFRAMES * SLCAN_MAX_LINE + 16);
+        if (NULL == text) {
+            error(EXIT_FAILURE, errno, "malloc");
+        }
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            size = 0;
+            for (i = 0; i < NFRAMES; i++) {
+                size += slcan_encode(text + size, &frames[i]);
+            }
+        }
+        report("SLCAN encode", now() - t0, args.rounds * NFRAMES);
+
+        /* Serial lines send 10 bits a byte with one start and one stop bit */
+        printf("%-14s %.2f bytes/frame, %.0f baud for a full bus\n", "",
+               (double)size / NFRAMES, 10.0 * size / NFRAMES * FULL_BUS_RATE);
+
+        t0 = now();
+        for (r = 0; r < args.rounds; r++) {
+            for (i = 0, pos = 0; i < NFRAMES; i++) {
+                const char *cr = memchr(text + pos, '\r', size - pos);
+                if (0 != slcan_decode(text + pos, cr - (text + pos), &frame) ||
+                    frame.can_id != frames[i].can_id ||
+                    0 != memcmp(frame.data, frames[i].data, frame.len)) {
+                    error(EXIT_FAILURE, 0, "SLCAN round trip failed at frame %d", i);
+                }
+                pos = cr + 1 - text;
+            }
+        }
+        report("SLCAN decode", now() - t0, args.rounds * NFRAMES);
+
+        free(text);
+    }
+
+    free(frames);
+    free(stamps);
+    return EXIT_SUCCESS;
+}
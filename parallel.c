@@ -0,0 +1,217 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Parallel Chunk Processing
+
+Chunk boundaries are all found up front, which costs a search near each
+multiple of the chunk size, and the chunks are then claimed in order from a
+shared counter. A finished result is parked in a slot of a small window
+until the merge reaches it. A worker which would claim a chunk with no free
+slot for it waits for the merge to catch up instead.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+
+#include <unistd.h>
+
+#include "parallel.h"
+
+/* Chunks each thread may run ahead of the merge */
+#define AHEAD_PER_THREAD (2)
+
+struct pool
+{
+    const struct parallel *p;
+    const char *data;
+    size_t *offsets;        /* Chunk i is [offsets[i], offsets[i + 1]) */
+    size_t nchunks;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;   /* A result was parked */
+    pthread_cond_t room;    /* A slot was freed */
+    size_t next;            /* Next chunk to claim */
+    size_t merged;          /* Chunks merged so far */
+    size_t window;
+    void **results;         /* Chunk i parks in slot i % window */
+    unsigned char *done;
+};
+
+struct worker
+{
+    struct pool *pool;
+    unsigned int index;
+    pthread_t thread;
+};
+
+unsigned int parallel_default_threads(void)
+{
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? n : 1;
+}
+
+static void *work_loop(void *arg)
+{
+    struct worker *w = arg;
+    struct pool *pool = w->pool;
+    sigset_t mask;
+
+    /* Leave every signal to the calling thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    for (;;) {
+        void *result;
+        size_t i;
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->next < pool->nchunks && pool->next >= pool->merged + pool->window) {
+            pthread_cond_wait(&pool->room, &pool->lock);
+        }
+        if (pool->next >= pool->nchunks) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        result = pool->p->work(pool->p->ctx, w->index,
+                               pool->data + pool->offsets[i],
+                               pool->offsets[i + 1] - pool->offsets[i]);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->results[i % pool->window] = result;
+        pool->done[i % pool->window] = 1;
+        pthread_cond_signal(&pool->ready);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+/* Split the data into chunks, returning their number */
+static size_t split(struct pool *pool, size_t size)
+{
+    const struct parallel *p = pool->p;
+    size_t n = 0;
+    size_t offset = 0;
+
+    pool->offsets[0] = 0;
+    while (offset < size) {
+        size_t next = (size - offset > p->chunk_size) ? offset + p->chunk_size : size;
+        if (next < size) {
+            next = p->boundary(p->ctx, pool->data, size, next);
+        }
+        /* Never an empty chunk, even if a record is larger than a chunk */
+        if (next <= offset) {
+            next = size;
+        }
+        pool->offsets[++n] = next;
+        offset = next;
+    }
+    return n;
+}
+
+long parallel_run(const struct parallel *p, const char *data, size_t size)
+{
+    struct worker *workers;
+    struct pool pool;
+    unsigned int started;
+    unsigned int t;
+    size_t i;
+    int rc = 0;
+
+    pool.p = p;
+    pool.data = data;
+    pool.next = 0;
+    pool.merged = 0;
+    pool.window = (size_t)p->threads * AHEAD_PER_THREAD;
+    pool.offsets = malloc((size / p->chunk_size + 2) * sizeof(*pool.offsets));
+    pool.results = calloc(pool.window, sizeof(*pool.results));
+    pool.done = calloc(pool.window, sizeof(*pool.done));
+    workers = calloc(p->threads, sizeof(*workers));
+    if (NULL == pool.offsets || NULL == pool.results || NULL == pool.done || NULL == workers) {
+        rc = ENOMEM;
+        goto out;
+    }
+
+    pool.nchunks = split(&pool, size);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pthread_cond_init(&pool.room, NULL);
+
+    for (started = 0; started < p->threads; started++) {
+        workers[started].pool = &pool;
+        workers[started].index = started;
+        rc = pthread_create(&workers[started].thread, NULL, work_loop, &workers[started]);
+        if (0 != rc) {
+            break;
+        }
+    }
+
+    /* Carry on with fewer threads if some could not be started */
+    if (started > 0) {
+        rc = 0;
+        for (i = 0; i < pool.nchunks; i++) {
+            void *result;
+
+            pthread_mutex_lock(&pool.lock);
+            while (!pool.done[i % pool.window]) {
+                pthread_cond_wait(&pool.ready, &pool.lock);
+            }
+            result = pool.results[i % pool.window];
+            pool.done[i % pool.window] = 0;
+            pthread_mutex_unlock(&pool.lock);
+
+            p->merge(p->ctx, i, result);
+
+            pthread_mutex_lock(&pool.lock);
+            pool.merged++;
+            pthread_cond_broadcast(&pool.room);
+            pthread_mutex_unlock(&pool.lock);
+        }
+    }
+
+    for (t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+
+    pthread_cond_destroy(&pool.room);
+    pthread_cond_destroy(&pool.ready);
+    pthread_mutex_destroy(&pool.lock);
+
+out:
+    free(workers);
+    free(pool.done);
+    free(pool.results);
+    free(pool.offsets);
+    if (0 != rc) {
+        errno = rc;
+        return -1;
+    }
+    return pool.nchunks;
+}
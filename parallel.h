@@ -0,0 +1,72 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Parallel Chunk Processing
+
+Splits a large buffer, typically a mapped log file, into chunks which end on
+record boundaries and processes them on a pool of threads. Each chunk is
+turned into a result by a work function on one of the threads, and the
+results are handed to a merge function on the calling thread strictly in
+chunk order, so the outcome is the same whatever the number of threads.
+
+Workers only run a bounded number of chunks ahead of the merge, which keeps
+the memory held by results bounded however large the input is.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+/* Returns the first record boundary at or after offset in data */
+typedef size_t (*parallel_boundary_fn)(void *ctx, const char *data, size_t size, size_t offset);
+
+/* Processes one chunk on the given worker (0 to threads - 1) and returns its
+ * result, which may be NULL
+ */
+typedef void *(*parallel_work_fn)(void *ctx, unsigned int worker, const char *data, size_t size);
+
+/* Takes the result of chunk index, in order, on the calling thread */
+typedef void (*parallel_merge_fn)(void *ctx, size_t index, void *result);
+
+struct parallel
+{
+    parallel_boundary_fn boundary;
+    parallel_work_fn work;
+    parallel_merge_fn merge;
+    void *ctx;
+    size_t chunk_size;      /* Bytes per chunk before moving to a boundary */
+    unsigned int threads;
+};
+
+/* Number of threads to use when none is asked for: one per online core */
+unsigned int parallel_default_threads(void);
+
+/* Process size bytes at data as described by p. Returns the number of chunks
+ * processed, or -1 with errno set if the threads could not be started.
+ */
+long parallel_run(const struct parallel *p, const char *data, size_t size);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,416 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Streaming pcapng Writer
+
+Blocks are written in host byte order, which pcapng allows since the Section
+Header Block carries a byte order magic. The SocketCAN link type header is
+the exception: its CAN ID is always big-endian. Packets have the length of
+struct can_frame or struct canfd_frame, as a live capture of a CAN interface
+with libpcap would, so every version of Wireshark tells them apart.
+
+See https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html and
+https://www.tcpdump.org/linktypes/LINKTYPE_CAN_SOCKETCAN.html
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <error.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pcapng.h"
+
+#define LINKTYPE_CAN_SOCKETCAN (227)
+
+#define BLOCK_SHB (0x0A0D0D0A)
+#define BLOCK_IDB (0x00000001)
+#define BLOCK_EPB (0x00000006)
+
+#define BYTE_ORDER_MAGIC (0x1A2B3C4D)
+
+#define OPT_ENDOFOPT (0)
+#define OPT_IF_NAME (2)
+#define OPT_IF_TSRESOL (9)
+
+/* Size of the output buffer, written out whenever it fills up */
+#define BUFFER_SIZE (4UL << 20)
+#define BUFFER_ALIGN (4096)
+
+/* Frames each interface queue holds, about a second of a loaded CAN FD bus */
+#define QUEUE_LEN (16384)
+
+/* How long the writer sleeps when every queue is empty */
+#define POLL_US (10000)
+
+/* Frames taken from one queue before moving on to the next */
+#define BATCH (1024)
+
+/* Buffered data is written out at least this often while traffic trickles */
+#define FLUSH_INTERVAL (UINT64_C(1000000000))
+
+/* Largest block there is, an Enhanced Packet Block holding a CAN FD frame */
+#define MAX_BLOCK (32 + CANFD_MTU)
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static size_t pad4(size_t n)
+{
+    return (n + 3) & ~(size_t)3;
+}
+
+static void put32(unsigned char **p, uint32_t v)
+{
+    memcpy(*p, &v, sizeof(v));
+    *p += sizeof(v);
+}
+
+static void put16(unsigned char **p, uint16_t v)
+{
+    memcpy(*p, &v, sizeof(v));
+    *p += sizeof(v);
+}
+
+/* Append an option, padded to 32 bits */
+static void put_option(unsigned char **p, uint16_t code, const void *value, uint16_t len)
+{
+    put16(p, code);
+    put16(p, len);
+    memset(*p, 0, pad4(len));
+    if (len > 0) {
+        memcpy(*p, value, len);
+    }
+    *p += pad4(len);
+}
+
+int pcapng_init(struct pcapng *w, const char *path, uint64_t rotate_size, uint64_t rotate_age)
+{
+    int rc;
+
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->path = path;
+    w->rotate_size = rotate_size;
+    w->rotate_age = rotate_age;
+    atomic_init(&w->running, 0);
+
+    rc = posix_memalign((void **)&w->buf, BUFFER_ALIGN, BUFFER_SIZE);
+    if (0 != rc) {
+        w->buf = NULL;
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+int pcapng_add_interface(struct pcapng *w, const char *name)
+{
+    const unsigned int i = w->ninterfaces;
+
+    if (i >= PCAPNG_MAX_INTERFACES) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if (-1 == spsc_init(&w->queues[i], QUEUE_LEN, sizeof(struct pcapng_frame))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    w->names[i] = name;
+    w->ninterfaces++;
+    return i;
+}
+
+/* Write out the buffer */
+static void flush(struct pcapng *w)
+{
+    size_t done = 0;
+
+    while (done < w->fill && !w->failed) {
+        const ssize_t n = write(w->fd, w->buf + done, w->fill - done);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            error(0, errno, "%s", w->path);
+            w->failed = 1;
+            break;
+        }
+        done += n;
+    }
+    w->fill = 0;
+}
+
+/* A Section Header Block and one Interface Description Block per interface */
+static void put_header(struct pcapng *w)
+{
+    static const uint8_t nanoseconds = 9;
+    unsigned char *start = w->buf + w->fill;
+    unsigned char *p = start;
+    unsigned int i;
+
+    put32(&p, BLOCK_SHB);
+    put32(&p, 28);
+    put32(&p, BYTE_ORDER_MAGIC);
+    put16(&p, 1);
+    put16(&p, 0);
+    put32(&p, UINT32_MAX);  /* Section length unknown */
+    put32(&p, UINT32_MAX);
+    put32(&p, 28);
+
+    for (i = 0; i < w->ninterfaces; i++) {
+        unsigned char *block = p;
+        uint32_t len;
+
+        p += 8;
+        put16(&p, LINKTYPE_CAN_SOCKETCAN);
+        put16(&p, 0);
+        put32(&p, CANFD_MTU);
+        put_option(&p, OPT_IF_NAME, w->names[i], strlen(w->names[i]));
+        put_option(&p, OPT_IF_TSRESOL, &nanoseconds, sizeof(nanoseconds));
+        put_option(&p, OPT_ENDOFOPT, NULL, 0);
+
+        len = p - block + 4;
+        put32(&block, BLOCK_IDB);
+        put32(&block, len);
+        put32(&p, len);
+    }
+
+    w->fill += p - start;
+    w->file_bytes += p - start;
+}
+
+static void path_of(const struct pcapng *w, unsigned int index, char *path, size_t size)
+{
+    const char *dot = strrchr(w->path, '.');
+    const char *slash = strrchr(w->path, '/');
+    int stem;
+
+    if (0 == w->rotate_size && 0 == w->rotate_age) {
+        snprintf(path, size, "%s", w->path);
+        return;
+    }
+
+    /* Number the file in front of its extension, if it has one */
+    if (NULL == dot || (NULL != slash && dot < slash)) {
+        dot = w->path + strlen(w->path);
+    }
+    stem = dot - w->path;
+    snprintf(path, size, "%.*s-%05u%s", stem, w->path, index, dot);
+}
+
+static int open_file(struct pcapng *w)
+{
+    char path[PATH_MAX];
+
+    path_of(w, w->files, path, sizeof(path));
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (-1 == w->fd) {
+        return -1;
+    }
+
+    w->files++;
+    w->file_bytes = 0;
+    w->opened = monotonic_ns();
+    put_header(w);
+    return 0;
+}
+
+static void close_file(struct pcapng *w)
+{
+    flush(w);
+    if (-1 != w->fd && -1 == close(w->fd)) {
+        error(0, errno, "%s", w->path);
+    }
+    w->fd = -1;
+}
+
+static void rotate(struct pcapng *w)
+{
+    close_file(w);
+    if (-1 == open_file(w)) {
+        error(0, errno, "%s", w->path);
+        w->failed = 1;
+    }
+}
+
+/* Append an Enhanced Packet Block */
+static void put_packet(struct pcapng *w, unsigned int iface, const struct pcapng_frame *f)
+{
+    const uint32_t captured = f->fd ? CANFD_MTU : CAN_MTU;
+    const uint32_t len = 32 + captured;
+    unsigned char *p;
+
+    if (w->rotate_size && w->file_bytes + len > w->rotate_size && w->file_bytes > 0) {
+        rotate(w);
+    }
+
+    if (w->fill + MAX_BLOCK > BUFFER_SIZE) {
+        flush(w);
+    }
+
+    p = w->buf + w->fill;
+    put32(&p, BLOCK_EPB);
+    put32(&p, len);
+    put32(&p, iface);
+    put32(&p, f->stamp >> 32);
+    put32(&p, f->stamp);
+    put32(&p, captured);
+    put32(&p, captured);
+
+    /* The link type header: big-endian CAN ID, length, flags, two reserved */
+    put32(&p, htonl(f->frame.can_id));
+    *p++ = f->frame.len;
+    *p++ = f->fd ? f->frame.flags | CANFD_FDF : 0;
+    *p++ = 0;
+    *p++ = 0;
+    memcpy(p, f->frame.data, captured - 8);
+    p += captured - 8;
+
+    put32(&p, len);
+
+    w->fill += len;
+    w->file_bytes += len;
+    w->packets++;
+}
+
+static void *write_loop(void *arg)
+{
+    struct pcapng *w = arg;
+    struct pcapng_frame f;
+    uint64_t flushed = monotonic_ns();
+    int running = 1;
+    sigset_t mask;
+
+    /* Leave every signal to the receive loop */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    for (;;) {
+        const struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = POLL_US * 1000L,
+        };
+        unsigned int moved = 0;
+        unsigned int i;
+        uint64_t now;
+
+        /* Whatever was queued before the stop is still written */
+        running = atomic_load(&w->running);
+
+        for (i = 0; i < w->ninterfaces; i++) {
+            unsigned int n;
+            for (n = 0; n < BATCH && 0 == spsc_pop(&w->queues[i], &f); n++) {
+                if (!w->failed) {
+                    put_packet(w, i, &f);
+                }
+            }
+            moved += n;
+        }
+
+        now = monotonic_ns();
+        if (w->rotate_age && now - w->opened >= w->rotate_age && !w->failed) {
+            rotate(w);
+        }
+
+        if (moved > 0) {
+            continue;
+        }
+
+        if (!running) {
+            break;
+        }
+
+        /* Do not let a quiet bus keep frames in memory for long */
+        if (w->fill > 0 && now - flushed >= FLUSH_INTERVAL) {
+            flush(w);
+            flushed = now;
+        }
+
+        nanosleep(&ts, NULL);
+    }
+
+    return NULL;
+}
+
+int pcapng_start(struct pcapng *w)
+{
+    int rc;
+
+    if (-1 == open_file(w)) {
+        return -1;
+    }
+
+    atomic_store(&w->running, 1);
+    rc = pthread_create(&w->writer, NULL, write_loop, w);
+    if (0 != rc) {
+        atomic_store(&w->running, 0);
+        close_file(w);
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+void pcapng_stop(struct pcapng *w)
+{
+    if (atomic_load(&w->running)) {
+        atomic_store(&w->running, 0);
+        pthread_join(w->writer, NULL);
+    }
+
+    if (-1 != w->fd) {
+        close_file(w);
+    }
+}
+
+void pcapng_free(struct pcapng *w)
+{
+    unsigned int i;
+
+    if (NULL == w->buf) {
+        return;
+    }
+
+    pcapng_stop(w);
+    for (i = 0; i < w->ninterfaces; i++) {
+        spsc_free(&w->queues[i]);
+    }
+    free(w->buf);
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+}
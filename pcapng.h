@@ -0,0 +1,136 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Streaming pcapng Writer
+
+Writes CAN and CAN FD frames as a pcapng capture which Wireshark reads
+natively: one Interface Description Block per CAN interface, with the
+SocketCAN link type and nanosecond timestamps, followed by an Enhanced Packet
+Block per frame. The capture can be rotated into numbered files once a file
+reaches a size or an age, each file being a complete capture on its own.
+
+Each interface has its own single producer ring, so every receive thread
+hands its frames over without sharing anything with the others. A single
+writer thread drains the rings, encodes the blocks into a large page aligned
+buffer and writes it out in big chunks.
+*/
+
+#ifndef PCAPNG_H
+#define PCAPNG_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#include "spsc.h"
+
+#define PCAPNG_MAX_INTERFACES (8)
+
+/* A frame on its way to the writer */
+struct pcapng_frame
+{
+    uint64_t stamp;         /* Nanoseconds since the epoch */
+    uint32_t fd;            /* Whether this is a CAN FD frame */
+    struct canfd_frame frame;
+};
+
+struct pcapng
+{
+    struct spsc queues[PCAPNG_MAX_INTERFACES];
+    uint64_t dropped[PCAPNG_MAX_INTERFACES]; /* Frames refused by a full queue */
+    const char *names[PCAPNG_MAX_INTERFACES];
+    unsigned int ninterfaces;
+
+    const char *path;
+    uint64_t rotate_size;   /* Bytes per file, 0 to never rotate on size */
+    uint64_t rotate_age;    /* Nanoseconds per file, 0 to never rotate on age */
+    unsigned int files;     /* Files opened so far */
+    int fd;
+    uint64_t file_bytes;    /* Written to the current file, buffer included */
+    uint64_t opened;        /* When the current file was opened */
+
+    unsigned char *buf;
+    size_t fill;
+    uint64_t packets;
+    int failed;
+
+    pthread_t writer;
+    atomic_int running;
+};
+
+/* Prepare a capture to path, rotating when a file would grow past
+ * rotate_size bytes or gets older than rotate_age nanoseconds (0 disables
+ * either). Rotated files are numbered, capture.pcapng becomes
+ * capture-00000.pcapng, capture-00001.pcapng and so on. Returns 0 on success
+ * and -1 with errno set on failure.
+ */
+int pcapng_init(struct pcapng *w, const char *path, uint64_t rotate_size, uint64_t rotate_age);
+
+/* Add an interface before the writer is started. Returns its index, or -1
+ * with errno set on failure.
+ */
+int pcapng_add_interface(struct pcapng *w, const char *name);
+
+/* Open the first file and start the writer thread. Returns 0 on success and
+ * -1 with errno set on failure.
+ */
+int pcapng_start(struct pcapng *w);
+
+/* Write out every queued frame, stop the writer and close the capture */
+void pcapng_stop(struct pcapng *w);
+
+/* Stop if still running and release the queues and buffer */
+void pcapng_free(struct pcapng *w);
+
+/* Queue a frame received on an interface. The frame is a struct can_frame if
+ * size is CAN_MTU, or a struct canfd_frame if it is CANFD_MTU. Must only be
+ * called from one thread per interface. Returns 0 on success and -1 if the
+ * writer has fallen behind and the frame was dropped.
+ */
+static inline int pcapng_write(
+    struct pcapng *w,
+    unsigned int iface,
+    uint64_t stamp,
+    const void *frame,
+    size_t size)
+{
+    struct pcapng_frame f;
+
+    f.stamp = stamp;
+    f.fd = (CANFD_MTU == size);
+    memcpy(&f.frame, frame, size);
+
+    if (-1 == spsc_push(&w->queues[iface], &f)) {
+        w->dropped[iface]++;
+        return -1;
+    }
+    return 0;
+}
+
+#endif /* PCAPNG_H */
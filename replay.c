@@ -0,0 +1,286 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Replay
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <error.h>
+
+#include "replay.h"
+
+int replay_rules_init(struct replay_rules *rules)
+{
+    memset(rules, 0, sizeof(*rules));
+
+    rules->actions = calloc(REPLAY_MAX_RULES, sizeof(*rules->actions));
+    if (NULL == rules->actions || -1 == idtable_init(&rules->table, REPLAY_MAX_RULES)) {
+        free(rules->actions);
+        rules->actions = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+void replay_rules_free(struct replay_rules *rules)
+{
+    idtable_free(&rules->table);
+    free(rules->actions);
+    memset(rules, 0, sizeof(*rules));
+}
+
+/* Parse a hex ID, eight digits being an extended ID, up to the character
+ * stop. Returns a pointer to the stop character, or NULL if malformed.
+ */
+static const char *parse_id(const char *s, char stop, canid_t *can_id)
+{
+    char *end;
+
+    if (!isxdigit((unsigned char)*s)) {
+        return NULL;
+    }
+    *can_id = strtoul(s, &end, 16);
+    if (stop != *end || *can_id > CAN_EFF_MASK) {
+        return NULL;
+    }
+    if (*can_id > CAN_SFF_MASK || 8 == end - s) {
+        *can_id |= CAN_EFF_FLAG;
+    }
+    return end;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/* Parse payload bytes as hex pairs or ".." */
+static int parse_data(const char *s, struct replay_action *a)
+{
+    uint8_t mask[CAN_MAX_DLEN] = {0};
+    uint8_t value[CAN_MAX_DLEN] = {0};
+    unsigned int n = 0;
+    uint64_t m;
+    uint64_t v;
+
+    for (; '\0' != *s; s += 2, n++) {
+        if (n >= CAN_MAX_DLEN || '\0' == s[1]) {
+            return -1;
+        }
+        if ('.' == s[0] && '.' == s[1]) {
+            continue;
+        }
+        if (-1 == hex_digit(s[0]) || -1 == hex_digit(s[1])) {
+            return -1;
+        }
+        mask[n] = 0xFF;
+        value[n] = hex_digit(s[0]) << 4 | hex_digit(s[1]);
+    }
+    if (0 == n) {
+        return -1;
+    }
+
+    memcpy(&m, mask, sizeof(m));
+    memcpy(&v, value, sizeof(v));
+    a->mask |= m;
+    a->value = (a->value & ~m) | v;
+    if (a->len < n) {
+        a->len = n;
+    }
+    return 0;
+}
+
+int replay_rules_add(struct replay_rules *rules, const char *rule)
+{
+    static const struct {
+        const char *verb;
+        uint32_t action;
+        int has_arg;
+    } verbs[] = {
+        {"drop", REPLAY_DROP, 0},
+        {"keep", REPLAY_KEEP, 0},
+        {"map", REPLAY_MAP, 1},
+        {"set", REPLAY_SET, 1},
+    };
+    struct replay_action a;
+    const char *p;
+    canid_t can_id;
+    unsigned int v;
+    size_t len;
+    uint32_t i;
+    int rc;
+
+    for (v = 0; v < sizeof(verbs) / sizeof(verbs[0]); v++) {
+        len = strlen(verbs[v].verb);
+        if (0 == strncmp(rule, verbs[v].verb, len) && ' ' == rule[len]) {
+            break;
+        }
+    }
+    if (v == sizeof(verbs) / sizeof(verbs[0])) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    p = parse_id(rule + len + 1, verbs[v].has_arg ? '=' : '\0', &can_id);
+    if (NULL == p) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Work on a copy so that a malformed rule changes nothing */
+    i = idtable_find(&rules->table, idtable_key(can_id));
+    if (IDTABLE_EMPTY == i) {
+        memset(&a, 0, sizeof(a));
+    } else {
+        a = rules->actions[i];
+    }
+    a.actions |= verbs[v].action;
+
+    if (REPLAY_MAP == verbs[v].action && NULL == parse_id(p + 1, '\0', &a.to)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (REPLAY_SET == verbs[v].action && -1 == parse_data(p + 1, &a)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (IDTABLE_EMPTY == i) {
+        rc = idtable_insert(&rules->table, idtable_key(can_id), rules->count);
+        if (1 != rc) {
+            errno = ENOSPC;
+            return -1;
+        }
+        i = rules->count++;
+    }
+
+    rules->actions[i] = a;
+    if (REPLAY_KEEP == verbs[v].action) {
+        rules->keep_only = 1;
+    }
+    return 0;
+}
+
+int replay_rules_load(struct replay_rules *rules, const char *path)
+{
+    char line[256];
+    unsigned int number = 0;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (NULL == f) {
+        return -1;
+    }
+
+    while (NULL != fgets(line, sizeof(line), f)) {
+        char *start = line;
+        char *end;
+
+        number++;
+        end = strchr(line, '#');
+        if (NULL == end) {
+            end = line + strlen(line);
+        }
+        while (end > start && isspace((unsigned char)end[-1])) {
+            end--;
+        }
+        *end = '\0';
+        while (isspace((unsigned char)*start)) {
+            start++;
+        }
+        if ('\0' == *start) {
+            continue;
+        }
+
+        if (-1 == replay_rules_add(rules, start)) {
+            const int saved = errno;
+            if (ENOSPC == saved) {
+                error(0, 0, "%s:%u: too many IDs with rules, at most %d",
+                      path, number, REPLAY_MAX_RULES);
+            } else {
+                error(0, 0, "%s:%u: invalid rule: %s", path, number, start);
+            }
+            fclose(f);
+            errno = saved;
+            return -1;
+        }
+    }
+
+    if (ferror(f)) {
+        const int saved = errno;
+        fclose(f);
+        errno = saved;
+        return -1;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+void replay_clock_init(struct replay_clock *clock, const struct canlog_record *records,
+                       size_t count, double scale)
+{
+    struct timespec ts;
+    uint64_t first = UINT64_MAX;
+    uint64_t last = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (records[i].stamp < first) {
+            first = records[i].stamp;
+        }
+        if (records[i].stamp > last) {
+            last = records[i].stamp;
+        }
+    }
+    if (0 == count) {
+        first = 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    clock->start = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+    clock->first = first;
+    clock->period = (count > 1) ? (last - first) + (last - first) / (count - 1) : 0;
+    if (0 == clock->period) {
+        clock->period = UINT64_C(1000000000);
+    }
+    clock->scale = scale;
+}
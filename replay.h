@@ -0,0 +1,167 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Capture Replay
+
+Building blocks for sending a capture (see canlog.h) back out to a bus: a
+table of rules rewriting frames on the way out, and the clock turning the
+timestamps of a capture into times to send at.
+
+Rules are given one per line as a verb, a hex CAN ID (eight digits being an
+extended ID) and, for some verbs, an argument:
+
+    drop 123            never send frames of ID 123
+    keep 123            send only the frames of IDs with a keep rule
+    map 123=456         send frames of ID 123 as ID 456
+    set 123=..FF..01    overwrite payload bytes 1 and 3, ".." keeping a byte
+
+An ID may have several rules, which all apply. The rules are compiled into an
+ID table (see idtable.h) of actions, so rewriting a frame costs one lookup and
+a few masked stores, and never allocates.
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#include "canlog.h"
+#include "idtable.h"
+
+/* Most IDs rules can be given for */
+#define REPLAY_MAX_RULES (4096)
+
+/* Actions */
+#define REPLAY_DROP (0x01)
+#define REPLAY_KEEP (0x02)
+#define REPLAY_MAP (0x04)
+#define REPLAY_SET (0x08)
+
+struct replay_action
+{
+    uint32_t actions;
+    canid_t to;             /* New ID with its EFF flag */
+    uint64_t mask;          /* Payload bits to overwrite */
+    uint64_t value;
+    uint8_t len;            /* Frames are lengthened to at least this */
+};
+
+struct replay_rules
+{
+    struct idtable table;
+    struct replay_action *actions;
+    uint32_t count;
+    int keep_only;          /* Whether any keep rule was given */
+};
+
+/* Maps capture time onto the monotonic clock, sped up by a factor of scale.
+ * Every lap of a looped replay starts period nanoseconds of capture time
+ * after the one before.
+ */
+struct replay_clock
+{
+    uint64_t start;         /* CLOCK_MONOTONIC time of the first frame */
+    uint64_t first;         /* Capture time of the first frame */
+    uint64_t period;
+    double scale;           /* 0 to send as fast as possible */
+};
+
+int replay_rules_init(struct replay_rules *rules);
+
+void replay_rules_free(struct replay_rules *rules);
+
+/* Add a rule given as "VERB ID[=ARG]". Returns 0 on success and -1 with errno
+ * set on failure, EINVAL meaning the rule is malformed and ENOSPC that there
+ * are too many IDs.
+ */
+int replay_rules_add(struct replay_rules *rules, const char *rule);
+
+/* Add the rules of a file, one per line, "#" starting a comment. Returns 0 on
+ * success and -1 with errno set on failure, after printing the offending line
+ * for a malformed rule (EINVAL) or one past the limit of IDs (ENOSPC).
+ */
+int replay_rules_load(struct replay_rules *rules, const char *path);
+
+/* Rewrite frame by the rules. Returns 0 if it should be sent, -1 if not. */
+static inline int replay_rules_apply(const struct replay_rules *rules, struct can_frame *frame)
+{
+    const struct replay_action *a;
+    uint32_t i;
+
+    if (0 == rules->count) {
+        return 0;
+    }
+
+    i = idtable_find(&rules->table, idtable_key(frame->can_id));
+    if (IDTABLE_EMPTY == i) {
+        return rules->keep_only ? -1 : 0;
+    }
+
+    a = &rules->actions[i];
+    if ((a->actions & REPLAY_DROP) || (rules->keep_only && !(a->actions & REPLAY_KEEP))) {
+        return -1;
+    }
+
+    if (a->actions & REPLAY_MAP) {
+        frame->can_id = a->to | (frame->can_id & CAN_RTR_FLAG);
+    }
+
+    if (a->actions & REPLAY_SET) {
+        uint64_t data;
+
+        memcpy(&data, frame->data, sizeof(data));
+        data = (data & ~a->mask) | a->value;
+        memcpy(frame->data, &data, sizeof(data));
+        if (frame->len < a->len) {
+            frame->len = a->len;
+        }
+    }
+
+    return 0;
+}
+
+/* Set up a clock for count records, starting now. A lap lasts as long as the
+ * capture plus the mean gap between its frames, or a second if the capture
+ * takes no time at all.
+ */
+void replay_clock_init(struct replay_clock *clock, const struct canlog_record *records,
+                       size_t count, double scale);
+
+/* Monotonic time at which a frame stamped at stamp is due in the given lap */
+static inline uint64_t replay_due(const struct replay_clock *clock, uint64_t stamp,
+                                  unsigned long lap)
+{
+    const uint64_t offset = stamp - clock->first + lap * clock->period;
+
+    if (0 == clock->scale) {
+        return clock->start;
+    }
+    return clock->start + (uint64_t)(offset / clock->scale);
+}
+
+#endif /* REPLAY_H */
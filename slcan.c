@@ -0,0 +1,164 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+SLCAN Framing
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "hexvec.h"
+#include "slcan.h"
+
+/* Digits in a standard and an extended CAN ID */
+#define SFF_DIGITS (3)
+#define EFF_DIGITS (8)
+
+/* Milliseconds appended by adapters with time stamps turned on */
+#define STAMP_DIGITS (4)
+
+size_t slcan_encode(char *buf, const struct can_frame *frame)
+{
+    static const char hex[16] = "0123456789ABCDEF";
+    const unsigned int len = (frame->len < CAN_MAX_DLEN) ? frame->len : CAN_MAX_DLEN;
+    const int rtr = (frame->can_id & CAN_RTR_FLAG) != 0;
+    uint32_t id;
+    char *p = buf;
+    int digits;
+
+    if (frame->can_id & CAN_EFF_FLAG) {
+        *p++ = rtr ? 'R' : 'T';
+        id = frame->can_id & CAN_EFF_MASK;
+        digits = EFF_DIGITS;
+    } else {
+        *p++ = rtr ? 'r' : 't';
+        id = frame->can_id & CAN_SFF_MASK;
+        digits = SFF_DIGITS;
+    }
+    while (digits-- > 0) {
+        p[digits] = hex[id & 0xF];
+        id >>= 4;
+    }
+    p += (frame->can_id & CAN_EFF_FLAG) ? EFF_DIGITS : SFF_DIGITS;
+    *p++ = '0' + len;
+
+    if (!rtr) {
+        p += hexvec_encode(p, frame->data, len);
+    }
+    *p++ = '\r';
+
+    return p - buf;
+}
+
+int slcan_decode(const char *line, size_t len, struct can_frame *frame)
+{
+    unsigned int digits;
+    unsigned int dlc;
+    size_t rest;
+    uint32_t id = 0;
+    int rtr;
+    unsigned int i;
+
+    if (0 == len) {
+        return 1;
+    }
+
+    switch (line[0]) {
+    case 't':
+        digits = SFF_DIGITS;
+        rtr = 0;
+        break;
+    case 'T':
+        digits = EFF_DIGITS;
+        rtr = 0;
+        break;
+    case 'r':
+        digits = SFF_DIGITS;
+        rtr = 1;
+        break;
+    case 'R':
+        digits = EFF_DIGITS;
+        rtr = 1;
+        break;
+    default:
+        return 1;
+    }
+
+    if (len < 2 + digits) {
+        return -1;
+    }
+    for (i = 1; i <= digits; i++) {
+        const int d = hexvec_digit(line[i]);
+        if (d < 0) {
+            return -1;
+        }
+        id = id << 4 | d;
+    }
+    dlc = (unsigned char)(line[1 + digits] - '0');
+    if (dlc > CAN_MAX_DLEN) {
+        return -1;
+    }
+
+    if (SFF_DIGITS == digits) {
+        if (id > CAN_SFF_MASK) {
+            return -1;
+        }
+    } else {
+        if (id > CAN_EFF_MASK) {
+            return -1;
+        }
+        id |= CAN_EFF_FLAG;
+    }
+
+    memset(frame, 0, sizeof(*frame));
+    frame->can_id = id | (rtr ? CAN_RTR_FLAG : 0);
+    frame->len = dlc;
+
+    /* What follows the length is the payload, then perhaps a time stamp */
+    line += 2 + digits;
+    rest = len - 2 - digits;
+    if (rtr) {
+        return (0 == rest || STAMP_DIGITS == rest) ? 0 : -1;
+    }
+    if (rest != 2 * dlc && rest != 2 * dlc + STAMP_DIGITS) {
+        return -1;
+    }
+    return hexvec_decode(line, 2 * dlc, frame->data);
+}
+
+int slcan_bitrate(unsigned long bitrate)
+{
+    static const unsigned long rates[] = {
+        10000, 20000, 50000, 100000, 125000, 250000, 500000, 800000, 1000000
+    };
+    int i;
+
+    for (i = 0; i < (int)(sizeof(rates) / sizeof(rates[0])); i++) {
+        if (rates[i] == bitrate) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,70 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+SLCAN Framing
+
+Converts CAN frames to and from the ASCII protocol of Lawicel CAN232 and
+CANUSB adapters, spoken by most USB serial CAN dongles. Every frame is one
+line ended by a carriage return:
+
+    t1232DEAD       standard ID 123, two bytes
+    T18DAF1100      extended ID 18DAF110, no bytes
+    r1230           standard remote frame
+    R18DAF1102      extended remote frame of length 2
+
+A dongle with time stamps turned on adds four hex digits of milliseconds to
+the frames it receives, which are ignored. Payloads are converted with vector
+operations (see hexvec.h), so both directions need 16 bytes of room past the
+payload.
+*/
+
+#ifndef SLCAN_H
+#define SLCAN_H
+
+#include <stddef.h>
+
+#include <linux/can.h>
+
+/* Longest frame line, 'T', eight ID digits, the length, 16 data digits and
+ * the carriage return. A buffer written to needs this much room.
+ */
+#define SLCAN_MAX_LINE (27)
+
+/* Write frame as a line at buf, returning its length */
+size_t slcan_encode(char *buf, const struct can_frame *frame);
+
+/* Parse a line, without its carriage return, into frame. 16 bytes past the
+ * end of the line must be readable. Returns 0 for a frame, 1 for a line
+ * which is not a frame, such as the reply to a command, or -1 if the line is
+ * malformed.
+ */
+int slcan_decode(const char *line, size_t len, struct can_frame *frame);
+
+/* The number n of the Sn command setting a bitrate in bits per second, or -1
+ * if adapters have no such rate
+ */
+int slcan_bitrate(unsigned long bitrate);
+
+#endif /* SLCAN_H */
@@ -33,6 +33,7 @@ with the message ID defined by the macro MSGID.
 */
 
 #include <errno.h>
+#include <math.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,6 +50,8 @@ with the message ID defined by the macro MSGID.
 #include <linux/can.h>
 #include <linux/can/bcm.h>
 
+#include "dbc.h"
+
 #define VERSION "2.0.0"
 
 #define MSGID (0x0BC)
@@ -56,6 +59,7 @@ with the message ID defined by the macro MSGID.
 struct args
 {
     const char *iface;
+    const char *dbc;
 };
 
 static volatile sig_atomic_t run = 1;
@@ -135,6 +139,7 @@ static void print_help(const char *progname)
         "  IFACE    CAN network interface (e.g. can0)\n"
         "\n"
         "Options:\n"
+        "  --dbc, -d FILE   Decode received frames using a DBC file\n"
         "  --help, -h       Display this help then exit\n"
         "  --version, -V    Display version info then exit\n",
         progname
@@ -158,23 +163,55 @@ static void print_can_frame(const struct can_frame *const frame)
     }
 }
 
+static void print_signals(const struct dbc *db, const struct can_frame *const frame)
+{
+    const struct dbc_message *msg;
+    double values[DBC_MAX_SIGNALS];
+    uint16_t i;
+
+    msg = dbc_lookup(db, frame->can_id);
+    if (NULL == msg) {
+        return;
+    }
+
+    dbc_decode(db, msg, frame->data, frame->len, values);
+    for (i = 0; i < msg->count; i++) {
+        const struct dbc_signal *sig = &db->signals[msg->first + i];
+        if (isnan(values[i])) {
+            /* Not present in this frame */
+            continue;
+        }
+        printf("     %s.%s = %g %s\n",
+               dbc_string(db, msg->name),
+               dbc_string(db, sig->name),
+               values[i],
+               dbc_string(db, sig->unit));
+    }
+}
+
 static void parse_args(int argc, char **argv, struct args *args)
 {
     const char *progname = program_invocation_short_name;
 
     static const struct option long_options[] = {
+        {"dbc", required_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'h'},
         {"version", no_argument, NULL, 'V'},
         {0, 0, 0, 0}
     };
 
+    args->dbc = NULL;
+
     for (;;) {
-        const int opt = getopt_long(argc, argv, "Vh", long_options, NULL);
+        const int opt = getopt_long(argc, argv, "d:Vh", long_options, NULL);
         if (opt == -1) {
             break;
         }
 
         switch (opt) {
+        case 'd':
+            args->dbc = optarg;
+            break;
         case 'V':
             print_version();
             exit(EXIT_SUCCESS);
@@ -199,6 +236,7 @@ static void parse_args(int argc, char **argv, struct args *args)
 int main(int argc, char **argv)
 {
     struct args args;
+    struct dbc db;
     ssize_t n;
     int sfd;
 
@@ -211,6 +249,12 @@ int main(int argc, char **argv)
     program_invocation_name = program_invocation_short_name;
 
     parse_args(argc, argv, &args);
+
+    memset(&db, 0, sizeof(db));
+    if (NULL != args.dbc && -1 == dbc_load(&db, args.dbc)) {
+        error(EXIT_FAILURE, errno, "%s", args.dbc);
+    }
+
     init_signals();
     sfd = init_socket(args.iface);
 
@@ -245,6 +289,11 @@ int main(int argc, char **argv)
         print_can_frame(frame);
         printf("\n");
 
+        /* Print the decoded signals of the received CAN frame */
+        if (NULL != args.dbc) {
+            print_signals(&db, frame);
+        }
+
         /* Modify the CAN frame to use our message ID */
         frame->can_id = MSGID;
 
@@ -274,6 +323,7 @@ int main(int argc, char **argv)
     }
 
     cleanup(sfd);
+    dbc_free(&db);
     puts("Goodbye!");
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,924 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Network Bridge Demo
+
+This program demonstrates tunnelling a CAN bus over the network using
+SocketCAN's raw interface. Every frame received on the CAN interface is sent
+to the far end, and every frame arriving from the far end is written to the
+CAN interface, so two instances join two buses into one.
+
+Frames travel over UDP in the framing of cannelloni (see cannelloni.h), many
+to a datagram. A datagram is sent once it is full, or once its first frame
+has waited for the flush timeout, which bounds the latency the packing adds.
+Frames are read from the CAN socket and datagrams are read from and written
+to the UDP socket a batch at a time with recvmmsg() and sendmmsg(). Every
+datagram carries a sequence number, which the receiving end uses to count
+datagrams that were lost or arrived out of order.
+
+Where UDP is blocked, --tcp connects to the far end over TCP instead, and the
+far end accepts the connection with --listen. The frames then follow one
+another on the stream without packet headers, and are batched by a stream
+writer (see canstream.h) which keeps each frame within the flush timeout but
+otherwise waits as long as a segment should take to fill at the current frame
+rate. Large batches can be sent without copying them with --zerocopy.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <netdb.h>
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "cannelloni.h"
+#include "canstream.h"
+
+#define VERSION "2.0.0"
+
+/* Frames read from, or written to, the CAN socket in one call */
+#define CAN_BATCH (64)
+
+/* Datagrams read from, or written to, the UDP socket in one call */
+#define UDP_BATCH (32)
+
+/* Largest datagram accepted from the far end */
+#define MAX_DATAGRAM (65536)
+
+/* Most frames a datagram can hold, each being at least five bytes */
+#define MAX_DECODED ((MAX_DATAGRAM - CANNELLONI_HEADER_SIZE) / 5)
+
+#define DEFAULT_TIMEOUT_US (1000)
+#define DEFAULT_MTU (1400)
+
+/* How long to wait for room in the CAN transmit queue before dropping */
+#define TX_WAIT_MS (10)
+
+/* How often to wake up while both sides are idle */
+#define IDLE_TIMEOUT_MS (100)
+
+struct args
+{
+    const char *iface;
+    const char *local;      /* UDP port, or TCP address to listen on */
+    const char *remote;     /* UDP or TCP address of the far end */
+    unsigned long timeout;  /* Flush timeout in microseconds */
+    unsigned long mtu;      /* Largest datagram sent */
+    int tcp;
+    int listen;
+    int zerocopy;
+    int quiet;
+};
+
+struct stats
+{
+    uint64_t frames_out;    /* CAN to network */
+    uint64_t datagrams_out;
+    uint64_t frames_in;     /* Network to CAN */
+    uint64_t datagrams_in;
+    uint64_t lost;          /* Datagrams missing from the sequence */
+    uint64_t reordered;     /* Datagrams older than one already seen */
+    uint64_t malformed;
+    uint64_t dropped;       /* Frames the CAN interface had no room for */
+    uint64_t bytes_out;     /* Over TCP */
+    uint64_t sends;
+    uint64_t zerocopy_sends;
+    uint64_t zerocopy_copied;
+};
+
+/* Datagrams waiting to be sent, the last one being filled */
+struct outbox
+{
+    uint8_t (*bufs)[MAX_DATAGRAM];
+    struct mmsghdr msgs[UDP_BATCH];
+    struct iovec iovs[UDP_BATCH];
+    struct cannelloni_packet packet;
+    unsigned int ready;     /* Complete datagrams */
+    uint64_t deadline;      /* When the datagram being filled must go */
+    uint8_t seq;
+};
+
+static volatile sig_atomic_t run = 1;
+
+static void on_signal(int)
+{
+    run = 0;
+}
+
+static void init_signals(void)
+{
+    struct sigaction sa;
+    sa.sa_handler = on_signal;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+static int init_socket(const char *iface)
+{
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int sfd;
+    int rc;
+
+    /* Create a raw CAN socket */
+    sfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+
+    /* Determine the interface index */
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ);
+    rc = ioctl(sfd, SIOCGIFINDEX, &ifr);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "ioctl");
+    }
+
+    /* Set the local address to bind to */
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    /* Bind the address to the socket */
+    rc = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+
+    return sfd;
+}
+
+/* Resolve HOST:PORT, or [HOST]:PORT for an IPv6 address. Without a host,
+ * the wildcard address of the given family is used.
+ */
+static void resolve(const char *spec, int family, int type, struct sockaddr_storage *addr,
+                    socklen_t *len)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+    char host[256];
+    const char *port;
+    const char *colon = strrchr(spec, ':');
+    int rc;
+
+    host[0] = '\0';
+    port = spec;
+    if (NULL != colon) {
+        const char *start = spec;
+        size_t n = colon - spec;
+
+        if ('[' == *start && n >= 2 && ']' == colon[-1]) {
+            start++;
+            n -= 2;
+        }
+        if (n >= sizeof(host)) {
+            error(EXIT_FAILURE, 0, "invalid address: %s", spec);
+        }
+        memcpy(host, start, n);
+        host[n] = '\0';
+        port = colon + 1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = type;
+    hints.ai_flags = AI_PASSIVE;
+
+    rc = getaddrinfo('\0' == host[0] ? NULL : host, port, &hints, &res);
+    if (0 != rc) {
+        error(EXIT_FAILURE, 0, "%s: %s", spec, gai_strerror(rc));
+    }
+
+    memcpy(addr, res->ai_addr, res->ai_addrlen);
+    *len = res->ai_addrlen;
+    freeaddrinfo(res);
+}
+
+static int init_udp(const struct args *args, struct sockaddr_storage *remote, socklen_t *remote_len)
+{
+    struct sockaddr_storage local;
+    socklen_t local_len;
+    int sfd;
+
+    resolve(args->remote, AF_UNSPEC, SOCK_DGRAM, remote, remote_len);
+    resolve(args->local, remote->ss_family, SOCK_DGRAM, &local, &local_len);
+
+    sfd = socket(remote->ss_family, SOCK_DGRAM, 0);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+    if (-1 == bind(sfd, (struct sockaddr *)&local, local_len)) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+    return sfd;
+}
+
+static int init_tcp_listener(const struct args *args)
+{
+    struct sockaddr_storage local;
+    socklen_t local_len;
+    const int one = 1;
+    int sfd;
+
+    resolve(args->local, AF_UNSPEC, SOCK_STREAM, &local, &local_len);
+
+    sfd = socket(local.ss_family, SOCK_STREAM, 0);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+    setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (-1 == bind(sfd, (struct sockaddr *)&local, local_len)) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+    if (-1 == listen(sfd, 1)) {
+        error(EXIT_FAILURE, errno, "listen");
+    }
+    return sfd;
+}
+
+/* Wait for the far end to connect, or connect to it. Returns the connected
+ * socket, or -1 if interrupted.
+ */
+static int connect_tcp(const struct args *args, int listener)
+{
+    struct sockaddr_storage remote;
+    socklen_t remote_len;
+    int sfd;
+
+    if (-1 != listener) {
+        sfd = accept(listener, NULL, NULL);
+        if (-1 == sfd && EINTR != errno) {
+            error(EXIT_FAILURE, errno, "accept");
+        }
+        return sfd;
+    }
+
+    resolve(args->remote, AF_UNSPEC, SOCK_STREAM, &remote, &remote_len);
+    sfd = socket(remote.ss_family, SOCK_STREAM, 0);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+    if (-1 == connect(sfd, (struct sockaddr *)&remote, remote_len)) {
+        if (EINTR == errno) {
+            close(sfd);
+            return -1;
+        }
+        error(EXIT_FAILURE, errno, "connect %s", args->remote);
+    }
+    return sfd;
+}
+
+static void cleanup(int sfd)
+{
+    sigset_t mask;
+    int rc;
+
+    /* Block signals from interfering with graceful shutdown */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    /* Close the socket */
+    rc = close(sfd);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "close");
+    }
+}
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] IFACE [HOST:]PORT HOST:PORT\n"
+        "       %s [OPTIONS] --tcp IFACE HOST:PORT\n"
+        "       %s [OPTIONS] --listen IFACE [HOST:]PORT\n"
+        "\n"
+        "Arguments:\n"
+        "  IFACE    CAN network interface (e.g. can0)\n"
+        "  PORT     Local port to receive frames on, optionally with the\n"
+        "           address to bind to\n"
+        "  HOST     Address and port of the far end\n"
+        "\n"
+        "Options:\n"
+        "  --timeout, -t US Send a frame at most US microseconds after it\n"
+        "                   arrived (default: %d)\n"
+        "  --mtu, -m BYTES  Largest datagram to send (default: %d)\n"
+        "  --tcp, -T        Connect to the far end over TCP\n"
+        "  --listen, -L     Accept a TCP connection from the far end\n"
+        "  --zerocopy, -z   Send large TCP batches without copying them\n"
+        "  --quiet, -q      Do not print statistics at the end\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname, progname, progname, DEFAULT_TIMEOUT_US, DEFAULT_MTU
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"timeout", required_argument, NULL, 't'},
+        {"mtu", required_argument, NULL, 'm'},
+        {"tcp", no_argument, NULL, 'T'},
+        {"listen", no_argument, NULL, 'L'},
+        {"zerocopy", no_argument, NULL, 'z'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+    args->timeout = DEFAULT_TIMEOUT_US;
+    args->mtu = DEFAULT_MTU;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "t:m:TLzqVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 't':
+            args->timeout = strtoul(optarg, &end, 0);
+            if ('\0' != *end || end == optarg) {
+                error(EXIT_FAILURE, 0, "invalid timeout: %s", optarg);
+            }
+            break;
+        case 'm':
+            args->mtu = strtoul(optarg, &end, 0);
+            if ('\0' != *end || args->mtu < CANNELLONI_HEADER_SIZE + CANNELLONI_MAX_FRAME ||
+                args->mtu > MAX_DATAGRAM) {
+                error(EXIT_FAILURE, 0, "invalid datagram size: %s", optarg);
+            }
+            break;
+        case 'T':
+            args->tcp = 1;
+            break;
+        case 'L':
+            args->tcp = 1;
+            args->listen = 1;
+            break;
+        case 'z':
+            args->zerocopy = 1;
+            break;
+        case 'q':
+            args->quiet = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (args->tcp) {
+        if ((argc - optind) != 2) {
+            error(0, 0, "an interface and an address argument expected");
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+        args->iface = argv[optind];
+        if (args->listen) {
+            args->local = argv[optind + 1];
+        } else {
+            args->remote = argv[optind + 1];
+        }
+        return;
+    }
+
+    if ((argc - optind) != 3) {
+        error(0, 0, "an interface, a local port and a remote address argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->iface = argv[optind];
+    args->local = argv[optind + 1];
+    args->remote = argv[optind + 2];
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void init_outbox(struct outbox *out, const struct args *args,
+                        struct sockaddr_storage *remote, socklen_t remote_len)
+{
+    unsigned int i;
+
+    memset(out, 0, sizeof(*out));
+    out->bufs = malloc(UDP_BATCH * sizeof(*out->bufs));
+    if (NULL == out->bufs) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    for (i = 0; i < UDP_BATCH; i++) {
+        out->iovs[i].iov_base = out->bufs[i];
+        out->msgs[i].msg_hdr.msg_iov = &out->iovs[i];
+        out->msgs[i].msg_hdr.msg_iovlen = 1;
+        out->msgs[i].msg_hdr.msg_name = remote;
+        out->msgs[i].msg_hdr.msg_namelen = remote_len;
+    }
+    cannelloni_begin(&out->packet, out->bufs[0], args->mtu);
+}
+
+/* Send every complete datagram */
+static void send_ready(int udp, struct outbox *out, const struct args *args,
+                       struct stats *stats)
+{
+    unsigned int done = 0;
+
+    while (done < out->ready) {
+        const int n = sendmmsg(udp, &out->msgs[done], out->ready - done, 0);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            /* The far end not listening yet is no reason to stop */
+            if (ECONNREFUSED != errno) {
+                error(0, errno, "sendmmsg");
+            }
+            break;
+        }
+        done += n;
+    }
+    stats->datagrams_out += done;
+
+    /* The datagram being filled moves to the front */
+    if (out->packet.count > 0 && out->ready > 0) {
+        memcpy(out->bufs[0], out->packet.buf, out->packet.fill);
+    }
+    out->packet.buf = out->bufs[0];
+    out->packet.size = args->mtu;
+    out->ready = 0;
+}
+
+/* Complete the datagram being filled and start the next */
+static void finish_packet(int udp, struct outbox *out, const struct args *args,
+                          struct stats *stats)
+{
+    out->iovs[out->ready].iov_len = cannelloni_finish(&out->packet, out->seq++);
+    out->ready++;
+
+    if (UDP_BATCH == out->ready) {
+        cannelloni_begin(&out->packet, out->bufs[0], args->mtu);
+        send_ready(udp, out, args, stats);
+    } else {
+        cannelloni_begin(&out->packet, out->bufs[out->ready], args->mtu);
+    }
+}
+
+/* Read up to CAN_BATCH frames waiting on the CAN socket, returning how many */
+static int read_frames(int can, struct can_frame *frames)
+{
+    static struct mmsghdr msgs[CAN_BATCH];
+    static struct iovec iovs[CAN_BATCH];
+    int n;
+    int i;
+
+    for (i = 0; i < CAN_BATCH; i++) {
+        iovs[i].iov_base = &frames[i];
+        iovs[i].iov_len = sizeof(frames[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    n = recvmmsg(can, msgs, CAN_BATCH, MSG_DONTWAIT, NULL);
+    if (-1 == n) {
+        if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+            error(EXIT_FAILURE, errno, "recvmmsg");
+        }
+        return 0;
+    }
+    return n;
+}
+
+/* Move frames from the CAN socket into datagrams */
+static void can_to_udp(int can, int udp, struct outbox *out, const struct args *args,
+                       struct stats *stats)
+{
+    static struct can_frame frames[CAN_BATCH];
+    const int n = read_frames(can, frames);
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (0 == out->packet.count) {
+            out->deadline = monotonic_ns() + args->timeout * 1000;
+        }
+        cannelloni_add(&out->packet, &frames[i]);
+        if (cannelloni_full(&out->packet)) {
+            finish_packet(udp, out, args, stats);
+        }
+    }
+    stats->frames_out += n;
+}
+
+/* Write frames to the CAN socket a batch at a time, waiting a little for room
+ * in its transmit queue before dropping them
+ */
+static void write_frames(int can, struct can_frame *frames, unsigned int count,
+                         struct stats *stats)
+{
+    static struct mmsghdr msgs[CAN_BATCH];
+    static struct iovec iovs[CAN_BATCH];
+    unsigned int done = 0;
+    int waited = 0;
+
+    while (done < count) {
+        const unsigned int batch = (count - done < CAN_BATCH) ? count - done : CAN_BATCH;
+        unsigned int i;
+        int n;
+
+        for (i = 0; i < batch; i++) {
+            iovs[i].iov_base = &frames[done + i];
+            iovs[i].iov_len = sizeof(frames[0]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        n = sendmmsg(can, msgs, batch, 0);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if ((ENOBUFS == errno || EAGAIN == errno) && !waited) {
+                struct pollfd pfd = {.fd = can, .events = POLLOUT};
+                poll(&pfd, 1, TX_WAIT_MS);
+                waited = 1;
+                continue;
+            }
+            stats->dropped += count - done;
+            return;
+        }
+        done += n;
+        waited = 0;
+    }
+}
+
+/* Move frames from datagrams onto the CAN socket */
+static void udp_to_can(int udp, int can, uint8_t (*bufs)[MAX_DATAGRAM], struct stats *stats,
+                       int *have_seq, uint8_t *expected)
+{
+    static struct can_frame frames[MAX_DECODED];
+    static struct mmsghdr msgs[UDP_BATCH];
+    static struct iovec iovs[UDP_BATCH];
+    unsigned int fill = 0;
+    int n;
+    int i;
+
+    for (i = 0; i < UDP_BATCH; i++) {
+        iovs[i].iov_base = bufs[i];
+        iovs[i].iov_len = MAX_DATAGRAM;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    n = recvmmsg(udp, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+    if (-1 == n) {
+        if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno &&
+            ECONNREFUSED != errno) {
+            error(EXIT_FAILURE, errno, "recvmmsg");
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        const uint8_t *p = bufs[i];
+        const size_t size = msgs[i].msg_len;
+        uint8_t seq;
+        int count;
+
+        /* Make room for every frame the datagram could hold */
+        if (fill > 0 && size > CANNELLONI_HEADER_SIZE &&
+            fill + (size - CANNELLONI_HEADER_SIZE) / 5 > MAX_DECODED) {
+            write_frames(can, frames, fill, stats);
+            fill = 0;
+        }
+
+        count = cannelloni_decode(p, size, &seq, &frames[fill], MAX_DECODED - fill);
+        if (-1 == count) {
+            stats->malformed++;
+            continue;
+        }
+        stats->datagrams_in++;
+        stats->frames_in += count;
+        fill += count;
+
+        /* A gap of less than half the sequence space is taken as loss,
+         * anything else as a datagram overtaken by later ones
+         */
+        if (*have_seq && seq != *expected) {
+            const uint8_t gap = seq - *expected;
+            if (gap < 128) {
+                stats->lost += gap;
+            } else {
+                stats->reordered++;
+                continue;
+            }
+        }
+        *have_seq = 1;
+        *expected = seq + 1;
+    }
+
+    if (fill > 0) {
+        write_frames(can, frames, fill, stats);
+    }
+}
+
+static void run_udp(int can, const struct args *args, struct stats *stats)
+{
+    struct sockaddr_storage remote;
+    socklen_t remote_len;
+    struct outbox out;
+    uint8_t (*inbox)[MAX_DATAGRAM];
+    uint8_t expected = 0;
+    int have_seq = 0;
+    int udp;
+
+    udp = init_udp(args, &remote, &remote_len);
+    init_outbox(&out, args, &remote, remote_len);
+    inbox = malloc(UDP_BATCH * sizeof(*inbox));
+    if (NULL == inbox) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    while (run) {
+        struct pollfd fds[2] = {
+            {.fd = can, .events = POLLIN},
+            {.fd = udp, .events = POLLIN},
+        };
+        struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = IDLE_TIMEOUT_MS * 1000000L,
+        };
+        uint64_t now;
+
+        /* Wake up in time to send a partly filled datagram */
+        if (out.packet.count > 0) {
+            now = monotonic_ns();
+            const uint64_t wait = (out.deadline > now) ? out.deadline - now : 0;
+            ts.tv_sec = wait / 1000000000;
+            ts.tv_nsec = wait % 1000000000;
+        }
+
+        if (-1 == ppoll(fds, 2, &ts, NULL)) {
+            if (EINTR == errno) {
+                continue;
+            }
+            error(EXIT_FAILURE, errno, "ppoll");
+        }
+
+        if (fds[0].revents & POLLIN) {
+            can_to_udp(can, udp, &out, args, stats);
+        }
+
+        now = monotonic_ns();
+        if (out.packet.count > 0 && now >= out.deadline) {
+            finish_packet(udp, &out, args, stats);
+        }
+        if (out.ready > 0) {
+            send_ready(udp, &out, args, stats);
+        }
+
+        if (fds[1].revents & POLLIN) {
+            udp_to_can(udp, can, inbox, stats, &have_seq, &expected);
+        }
+    }
+
+    cleanup(udp);
+    free(inbox);
+    free(out.bufs);
+}
+
+/* Bridge over one TCP connection until it closes or the bridge is stopped */
+static void run_tcp(int can, int tcp, const struct args *args, struct stats *stats)
+{
+    static struct can_frame frames[MAX_DECODED];
+    static uint8_t inbox[CANSTREAM_BUF_SIZE];
+    struct canstream out;
+    size_t fill = 0;
+    int blocked = 0;
+
+    if (-1 == canstream_init(&out, tcp, args->timeout * 1000, args->zerocopy)) {
+        error(EXIT_FAILURE, errno, "stream");
+    }
+    if (args->zerocopy && !out.zerocopy && !args->quiet) {
+        error(0, 0, "zero-copy sends not supported, copying instead");
+    }
+
+    while (run) {
+        /* Read frames only while a whole batch of them fits the buffer */
+        const int room = out.fill + CAN_BATCH * CANNELLONI_MAX_FRAME <= CANSTREAM_BUF_SIZE;
+        struct pollfd fds[2] = {
+            {.fd = can, .events = (room && !blocked) ? POLLIN : 0},
+            {.fd = tcp, .events = POLLIN | (blocked ? POLLOUT : 0)},
+        };
+        struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = IDLE_TIMEOUT_MS * 1000000L,
+        };
+        const uint64_t deadline = canstream_deadline(&out);
+        uint64_t now = monotonic_ns();
+        int more = 0;
+        int rc = 0;
+
+        /* Wake up in time to send the batch */
+        if (!blocked && UINT64_MAX != deadline) {
+            const uint64_t wait = (deadline > now) ? deadline - now : 0;
+            if (wait < (uint64_t)IDLE_TIMEOUT_MS * 1000000) {
+                ts.tv_nsec = wait;
+            }
+        }
+
+        if (-1 == ppoll(fds, 2, &ts, NULL)) {
+            if (EINTR == errno) {
+                continue;
+            }
+            error(EXIT_FAILURE, errno, "ppoll");
+        }
+
+        /* Zero-copy completions are signalled as an error condition */
+        if (fds[1].revents & POLLERR) {
+            canstream_reap(&out);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            static struct can_frame batch[CAN_BATCH];
+            const int n = read_frames(can, batch);
+            int i;
+
+            now = monotonic_ns();
+            for (i = 0; i < n; i++) {
+                canstream_add(&out, &batch[i], now);
+            }
+            stats->frames_out += n;
+            more = (CAN_BATCH == n);
+        }
+
+        now = monotonic_ns();
+        if (blocked || now >= canstream_deadline(&out) ||
+            out.fill + CAN_BATCH * CANNELLONI_MAX_FRAME > CANSTREAM_BUF_SIZE) {
+            rc = canstream_flush(&out, more);
+            if (-1 == rc) {
+                if (EPIPE != errno && ECONNRESET != errno) {
+                    error(0, errno, "send");
+                }
+                break;
+            }
+            blocked = (1 == rc);
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            unsigned int count;
+            ssize_t n;
+            int used;
+
+            n = recv(tcp, inbox + fill, sizeof(inbox) - fill, MSG_DONTWAIT);
+            if (0 == n) {
+                break;
+            }
+            if (-1 == n) {
+                if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+                    continue;
+                }
+                if (ECONNRESET != errno) {
+                    error(0, errno, "recv");
+                }
+                break;
+            }
+            fill += n;
+
+            used = cannelloni_decode_stream(inbox, fill, frames, MAX_DECODED, &count);
+            if (-1 == used) {
+                error(0, 0, "malformed stream from the far end");
+                stats->malformed++;
+                break;
+            }
+            write_frames(can, frames, count, stats);
+            stats->frames_in += count;
+
+            /* Keep the start of an incomplete frame for the next read */
+            memmove(inbox, inbox + used, fill - used);
+            fill -= used;
+        }
+    }
+
+    stats->bytes_out += out.bytes;
+    stats->sends += out.sends;
+    stats->zerocopy_sends += out.zerocopy_sends;
+    stats->zerocopy_copied += out.zerocopy_copied;
+    canstream_free(&out);
+}
+
+int main(int argc, char **argv)
+{
+    struct stats stats;
+    struct args args;
+    int can;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    init_signals();
+    can = init_socket(args.iface);
+    memset(&stats, 0, sizeof(stats));
+
+    if (args.tcp) {
+        const int listener = args.listen ? init_tcp_listener(&args) : -1;
+
+        /* A listening bridge takes the next connection once one closes */
+        while (run) {
+            const int tcp = connect_tcp(&args, listener);
+            if (-1 == tcp) {
+                continue;
+            }
+            run_tcp(can, tcp, &args, &stats);
+            close(tcp);
+            if (-1 == listener) {
+                break;
+            }
+        }
+        if (-1 != listener) {
+            cleanup(listener);
+        }
+    } else {
+        run_udp(can, &args, &stats);
+    }
+
+    if (!args.quiet && args.tcp) {
+        printf("CAN to network: %llu frames, %.2f bytes/frame in %llu sends "
+               "(%.1f frames/send), %llu without copying (%llu copied after all)\n",
+               (unsigned long long)stats.frames_out,
+               stats.frames_out ? (double)stats.bytes_out / stats.frames_out : 0.0,
+               (unsigned long long)stats.sends,
+               stats.sends ? (double)stats.frames_out / stats.sends : 0.0,
+               (unsigned long long)stats.zerocopy_sends,
+               (unsigned long long)stats.zerocopy_copied);
+        printf("Network to CAN: %llu frames, %llu frames dropped\n",
+               (unsigned long long)stats.frames_in, (unsigned long long)stats.dropped);
+    } else if (!args.quiet) {
+        printf("CAN to network: %llu frames in %llu datagrams (%.1f frames/datagram)\n",
+               (unsigned long long)stats.frames_out, (unsigned long long)stats.datagrams_out,
+               stats.datagrams_out ? (double)stats.frames_out / stats.datagrams_out : 0.0);
+        printf("Network to CAN: %llu frames in %llu datagrams, %llu lost, %llu out of order, "
+               "%llu malformed, %llu frames dropped\n",
+               (unsigned long long)stats.frames_in, (unsigned long long)stats.datagrams_in,
+               (unsigned long long)stats.lost, (unsigned long long)stats.reordered,
+               (unsigned long long)stats.malformed, (unsigned long long)stats.dropped);
+    }
+
+    cleanup(can);
+    return EXIT_SUCCESS;
+}
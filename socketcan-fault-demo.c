@@ -0,0 +1,755 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Fault Injection Demo
+
+This program demonstrates a proxy between two CAN interfaces that forwards
+frames in both directions while injecting faults: delays drawn from a
+distribution, lost, duplicated, reordered and corrupted frames, and a slower
+link. Placed between two virtual interfaces, with the device under test on
+one and its peers on the other, it shows how gateways and protocol stacks
+cope with a degraded bus without any faulty hardware.
+
+Delayed frames wait in a timer wheel (see timerwheel.h), which costs the same
+per frame however many are waiting, so a delay of seconds on a busy bus holds
+millions of frames at no extra cost. The wheel ticks every 10 microseconds.
+The rate limit models the link as a queue which sends one frame at a time at
+the given bitrate. Frames which arrive to a full queue are lost, as on a
+gateway whose buffers overflow. Frames are read and written in batches, and
+random numbers come from a seeded generator, so a run can be repeated.
+*/
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "timerwheel.h"
+
+#define VERSION "2.0.0"
+
+/* Frames read from, or written to, a CAN socket in one call */
+#define CAN_BATCH (64)
+
+/* Length of a timer wheel tick */
+#define TICK_NS (10000)
+
+/* How long to wait for room in the CAN transmit queue before dropping */
+#define TX_WAIT_MS (10)
+
+/* How often to wake up while no frames are held */
+#define IDLE_TIMEOUT_MS (100)
+
+#define DEFAULT_HOLD_US (1000)
+#define DEFAULT_QUEUE (256)
+#define DEFAULT_LIMIT (1 << 20)
+
+/* Shape of the Pareto distribution, heavy tailed without an infinite mean */
+#define PARETO_SHAPE (1.5)
+
+enum distribution
+{
+    UNIFORM,
+    NORMAL,
+    PARETO,
+};
+
+struct args
+{
+    const char *iface[2];
+    double delay;           /* Microseconds */
+    double jitter;          /* Microseconds */
+    enum distribution distribution;
+    double loss;            /* Percentages */
+    double duplicate;
+    double reorder;
+    double corrupt;
+    unsigned long hold;     /* Extra delay of reordered frames in microseconds */
+    unsigned long bitrate;  /* Of the slower link, 0 for none */
+    unsigned long queue;    /* Frames waiting for the link */
+    unsigned long limit;    /* Frames held at once */
+    unsigned long long seed;
+    int one_way;
+    int quiet;
+};
+
+struct stats
+{
+    uint64_t received;
+    uint64_t sent;
+    uint64_t lost;
+    uint64_t duplicated;
+    uint64_t reordered;
+    uint64_t corrupted;
+    uint64_t overflowed;    /* Lost to a full link queue */
+    uint64_t full;          /* Lost because the limit of frames held was reached */
+    uint64_t dropped;       /* Lost to a full CAN transmit queue */
+    uint64_t late;          /* Total nanoseconds sent after they were due */
+    uint64_t late_max;
+};
+
+/* One direction frames travel */
+struct path
+{
+    int from;
+    int to;
+    uint64_t link_free;     /* When the link finishes its last frame */
+    unsigned long queued;   /* Frames waiting for or on the link */
+    struct can_frame out[CAN_BATCH];
+    unsigned int nout;
+    struct stats stats;
+};
+
+/* A frame held in the timer wheel */
+struct held
+{
+    struct can_frame frame;
+    uint64_t due;
+    uint8_t path;
+    uint8_t on_link;        /* Whether it is being sent over the link */
+};
+
+static volatile sig_atomic_t run = 1;
+
+static uint64_t rng_state;
+
+static void on_signal(int)
+{
+    run = 0;
+}
+
+static void init_signals(void)
+{
+    struct sigaction sa;
+    sa.sa_handler = on_signal;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+static int init_socket(const char *iface)
+{
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int sfd;
+    int rc;
+
+    /* Create a raw CAN socket */
+    sfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+
+    /* Determine the interface index */
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ);
+    rc = ioctl(sfd, SIOCGIFINDEX, &ifr);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "ioctl");
+    }
+
+    /* Set the local address to bind to */
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    /* Bind the address to the socket */
+    rc = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+
+    return sfd;
+}
+
+static void cleanup(int sfd)
+{
+    sigset_t mask;
+    int rc;
+
+    /* Block signals from interfering with graceful shutdown */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    /* Close the socket */
+    rc = close(sfd);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "close");
+    }
+}
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] IFACE IFACE\n"
+        "\n"
+        "Arguments:\n"
+        "  IFACE    CAN network interfaces to forward between (e.g. vcan0 vcan1)\n"
+        "\n"
+        "Options:\n"
+        "  --delay, -d US         Delay frames by US microseconds (default: 0)\n"
+        "  --jitter, -j US        Vary the delay by US microseconds (default: 0)\n"
+        "  --distribution, -D D   How the delay varies (default: uniform):\n"
+        "                           uniform  evenly, within the jitter either way\n"
+        "                           normal   with the jitter as standard deviation\n"
+        "                           pareto   upwards, with a long tail and the\n"
+        "                                    jitter as mean\n"
+        "  --loss, -l PCT         Lose PCT percent of frames\n"
+        "  --duplicate, -u PCT    Send PCT percent of frames twice\n"
+        "  --reorder, -r PCT      Hold back PCT percent of frames, so later ones\n"
+        "                         overtake them\n"
+        "  --hold, -H US          Hold back reordered frames by US microseconds\n"
+        "                         more (default: %d)\n"
+        "  --corrupt, -c PCT      Flip a bit in PCT percent of frames, in the\n"
+        "                         payload or in the ID of frames without one\n"
+        "  --bitrate, -b BPS      Send over a link of BPS bits per second\n"
+        "  --queue, -Q N          Lose frames arriving with N waiting for the link\n"
+        "                         (default: %d)\n"
+        "  --limit, -n N          Hold at most N frames at once (default: %d)\n"
+        "  --seed, -s N           Seed the random faults (default: the time)\n"
+        "  --one-way, -1          Only forward from the first interface\n"
+        "  --quiet, -q            Do not print statistics at the end\n"
+        "  --help, -h             Display this help then exit\n"
+        "  --version, -V          Display version info then exit\n",
+        progname, DEFAULT_HOLD_US, DEFAULT_QUEUE, DEFAULT_LIMIT
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static double parse_amount(const char *s, const char *what, double max)
+{
+    char *end;
+    const double value = strtod(s, &end);
+
+    if (end == s || '\0' != *end || !(value >= 0.0) || value > max) {
+        error(EXIT_FAILURE, 0, "invalid %s: %s", what, s);
+    }
+    return value;
+}
+
+static unsigned long parse_count(const char *s, const char *what, unsigned long max)
+{
+    char *end;
+    const unsigned long value = strtoul(s, &end, 0);
+
+    if (end == s || '\0' != *end || 0 == value || value > max) {
+        error(EXIT_FAILURE, 0, "invalid %s: %s", what, s);
+    }
+    return value;
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+
+    static const struct option long_options[] = {
+        {"delay", required_argument, NULL, 'd'},
+        {"jitter", required_argument, NULL, 'j'},
+        {"distribution", required_argument, NULL, 'D'},
+        {"loss", required_argument, NULL, 'l'},
+        {"duplicate", required_argument, NULL, 'u'},
+        {"reorder", required_argument, NULL, 'r'},
+        {"hold", required_argument, NULL, 'H'},
+        {"corrupt", required_argument, NULL, 'c'},
+        {"bitrate", required_argument, NULL, 'b'},
+        {"queue", required_argument, NULL, 'Q'},
+        {"limit", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 's'},
+        {"one-way", no_argument, NULL, '1'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+    args->distribution = UNIFORM;
+    args->hold = DEFAULT_HOLD_US;
+    args->queue = DEFAULT_QUEUE;
+    args->limit = DEFAULT_LIMIT;
+    args->seed = time(NULL);
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "d:j:D:l:u:r:H:c:b:Q:n:s:1qVh",
+                                    long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'd':
+            args->delay = parse_amount(optarg, "delay", 1e8);
+            break;
+        case 'j':
+            args->jitter = parse_amount(optarg, "jitter", 1e8);
+            break;
+        case 'D':
+            if (0 == strcmp(optarg, "uniform")) {
+                args->distribution = UNIFORM;
+            } else if (0 == strcmp(optarg, "normal")) {
+                args->distribution = NORMAL;
+            } else if (0 == strcmp(optarg, "pareto")) {
+                args->distribution = PARETO;
+            } else {
+                error(EXIT_FAILURE, 0, "invalid distribution: %s", optarg);
+            }
+            break;
+        case 'l':
+            args->loss = parse_amount(optarg, "loss", 100.0);
+            break;
+        case 'u':
+            args->duplicate = parse_amount(optarg, "duplicate", 100.0);
+            break;
+        case 'r':
+            args->reorder = parse_amount(optarg, "reorder", 100.0);
+            break;
+        case 'H':
+            args->hold = parse_amount(optarg, "hold", 1e8);
+            break;
+        case 'c':
+            args->corrupt = parse_amount(optarg, "corrupt", 100.0);
+            break;
+        case 'b':
+            args->bitrate = parse_count(optarg, "bitrate", 100000000);
+            break;
+        case 'Q':
+            args->queue = parse_count(optarg, "queue", INT32_MAX);
+            break;
+        case 'n':
+            args->limit = parse_count(optarg, "limit", INT32_MAX);
+            break;
+        case 's':
+            args->seed = strtoull(optarg, NULL, 0);
+            break;
+        case '1':
+            args->one_way = 1;
+            break;
+        case 'q':
+            args->quiet = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        error(0, 0, "two interface arguments expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->iface[0] = argv[optind];
+    args->iface[1] = argv[optind + 1];
+    if (0 == strcmp(args->iface[0], args->iface[1])) {
+        error(EXIT_FAILURE, 0, "the interfaces must differ");
+    }
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/* xorshift64*, uniform over [0, 1) */
+static double uniform(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * UINT64_C(2685821657736338717)) >> 11) * 0x1.0p-53;
+}
+
+static int chance(double percent)
+{
+    return percent > 0.0 && uniform() * 100.0 < percent;
+}
+
+/* Draw a delay in nanoseconds */
+static uint64_t draw_delay(const struct args *args)
+{
+    double us = args->delay;
+
+    if (args->jitter > 0.0) {
+        switch (args->distribution) {
+        case UNIFORM:
+            us += args->jitter * (2.0 * uniform() - 1.0);
+            break;
+        case NORMAL:
+            /* Box-Muller, the first of the pair */
+            us += args->jitter * sqrt(-2.0 * log(1.0 - uniform())) * cos(2.0 * M_PI * uniform());
+            break;
+        case PARETO:
+            /* Scaled so that the excess over the delay averages the jitter */
+            us += args->jitter * (PARETO_SHAPE - 1.0) *
+                  (pow(1.0 - uniform(), -1.0 / PARETO_SHAPE) - 1.0);
+            break;
+        }
+    }
+
+    return (us > 0.0) ? (uint64_t)(us * 1000.0) : 0;
+}
+
+static void corrupt(struct can_frame *frame)
+{
+    if (frame->len > 0 && !(frame->can_id & CAN_RTR_FLAG)) {
+        const unsigned int bit = uniform() * frame->len * 8;
+        frame->data[bit / 8] ^= 1 << (bit % 8);
+    } else {
+        const unsigned int bits = (frame->can_id & CAN_EFF_FLAG) ? 29 : 11;
+        frame->can_id ^= 1u << (unsigned int)(uniform() * bits);
+    }
+}
+
+/* Bits on the wire, without stuffing */
+static unsigned int frame_bits(const struct can_frame *frame)
+{
+    const unsigned int header = (frame->can_id & CAN_EFF_FLAG) ? 67 : 47;
+
+    if (frame->can_id & CAN_RTR_FLAG) {
+        return header;
+    }
+    return header + 8 * ((frame->len > CAN_MAX_DLEN) ? CAN_MAX_DLEN : frame->len);
+}
+
+/* Read up to CAN_BATCH frames waiting on a CAN socket, returning how many */
+static int read_frames(int can, struct can_frame *frames)
+{
+    static struct mmsghdr msgs[CAN_BATCH];
+    static struct iovec iovs[CAN_BATCH];
+    int n;
+    int i;
+
+    for (i = 0; i < CAN_BATCH; i++) {
+        iovs[i].iov_base = &frames[i];
+        iovs[i].iov_len = sizeof(frames[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    n = recvmmsg(can, msgs, CAN_BATCH, MSG_DONTWAIT, NULL);
+    if (-1 == n) {
+        if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+            error(EXIT_FAILURE, errno, "recvmmsg");
+        }
+        return 0;
+    }
+    return n;
+}
+
+/* Write the frames waiting on a path, waiting a little for room in the
+ * transmit queue before dropping them
+ */
+static void flush(struct path *p)
+{
+    static struct mmsghdr msgs[CAN_BATCH];
+    static struct iovec iovs[CAN_BATCH];
+    unsigned int done = 0;
+    unsigned int i;
+    int waited = 0;
+
+    for (i = 0; i < p->nout; i++) {
+        iovs[i].iov_base = &p->out[i];
+        iovs[i].iov_len = sizeof(p->out[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (done < p->nout) {
+        const int n = sendmmsg(p->to, msgs + done, p->nout - done, 0);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if ((ENOBUFS == errno || EAGAIN == errno) && !waited) {
+                struct pollfd pfd = {.fd = p->to, .events = POLLOUT};
+                poll(&pfd, 1, TX_WAIT_MS);
+                waited = 1;
+                continue;
+            }
+            p->stats.dropped += p->nout - done;
+            break;
+        }
+        done += n;
+        p->stats.sent += n;
+        waited = 0;
+    }
+    p->nout = 0;
+}
+
+static void forward(struct path *p, const struct can_frame *frame)
+{
+    p->out[p->nout++] = *frame;
+    if (CAN_BATCH == p->nout) {
+        flush(p);
+    }
+}
+
+/* Hold a frame in the wheel until when */
+static void hold(struct timerwheel *w, struct held *held, struct path *paths, int path,
+                 const struct can_frame *frame, uint64_t when)
+{
+    const int t = timerwheel_add(w, when);
+
+    if (-1 == t) {
+        paths[path].stats.full++;
+        return;
+    }
+    held[t].frame = *frame;
+    held[t].due = when;
+    held[t].path = path;
+    held[t].on_link = 0;
+}
+
+/* Inject faults into a frame received at now */
+static void inject(struct timerwheel *w, struct held *held, struct path *paths, int path,
+                   const struct can_frame *received, uint64_t now, const struct args *args)
+{
+    struct path *p = &paths[path];
+    int copies = 1;
+    int i;
+
+    p->stats.received++;
+    if (chance(args->loss)) {
+        p->stats.lost++;
+        return;
+    }
+    if (chance(args->duplicate)) {
+        p->stats.duplicated++;
+        copies = 2;
+    }
+
+    for (i = 0; i < copies; i++) {
+        struct can_frame frame = *received;
+        uint64_t delay = draw_delay(args);
+
+        if (chance(args->corrupt)) {
+            corrupt(&frame);
+            p->stats.corrupted++;
+        }
+        if (chance(args->reorder)) {
+            delay += args->hold * 1000;
+            p->stats.reordered++;
+        }
+
+        if (0 == delay && 0 == args->bitrate) {
+            forward(p, &frame);
+        } else {
+            hold(w, held, paths, path, &frame, now + delay);
+        }
+    }
+}
+
+/* Pass on the frames whose delay is over, onto the link if there is one */
+static void release(struct timerwheel *w, struct held *held, struct path *paths,
+                    uint64_t now, const struct args *args)
+{
+    int t;
+
+    while (-1 != (t = timerwheel_next(w))) {
+        struct held *h = &held[t];
+        struct path *p = &paths[h->path];
+        uint64_t late;
+
+        /* Delays beyond the reach of the wheel come back early */
+        if (now < h->due) {
+            timerwheel_schedule(w, t, h->due);
+            continue;
+        }
+
+        if (0 != args->bitrate && !h->on_link) {
+            if (p->queued >= args->queue) {
+                p->stats.overflowed++;
+                timerwheel_release(w, t);
+                continue;
+            }
+
+            /* Leave once the frames ahead and this one have been sent */
+            if (p->link_free < now) {
+                p->link_free = now;
+            }
+            p->link_free += frame_bits(&h->frame) * UINT64_C(1000000000) / args->bitrate;
+            p->queued++;
+            h->on_link = 1;
+            h->due = p->link_free;
+            timerwheel_schedule(w, t, h->due);
+            continue;
+        }
+
+        if (h->on_link) {
+            p->queued--;
+        }
+        late = (now > h->due) ? now - h->due : 0;
+        p->stats.late += late;
+        if (late > p->stats.late_max) {
+            p->stats.late_max = late;
+        }
+        forward(p, &h->frame);
+        timerwheel_release(w, t);
+    }
+}
+
+static void print_stats(const char *from, const char *to, const struct stats *s)
+{
+    const uint64_t timed = s->sent + s->dropped;
+
+    printf("%s -> %s: %llu received, %llu sent, %llu lost, %llu duplicated, "
+           "%llu reordered, %llu corrupted\n",
+           from, to, (unsigned long long)s->received, (unsigned long long)s->sent,
+           (unsigned long long)s->lost, (unsigned long long)s->duplicated,
+           (unsigned long long)s->reordered, (unsigned long long)s->corrupted);
+    printf("%*s  %llu over the queue, %llu over the limit, %llu dropped, "
+           "%.1f us late on average, %.1f us at most\n",
+           (int)(strlen(from) + strlen(to) + 4), "",
+           (unsigned long long)s->overflowed, (unsigned long long)s->full,
+           (unsigned long long)s->dropped,
+           timed ? s->late / 1000.0 / timed : 0.0, s->late_max / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+    static struct can_frame batch[CAN_BATCH];
+    struct path paths[2];
+    struct timerwheel w;
+    struct held *held;
+    struct args args;
+    int npaths;
+    int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    rng_state = args.seed | 1;
+    init_signals();
+
+    /* Wake up when frames are due, not up to the default 50 us later */
+    prctl(PR_SET_TIMERSLACK, 1);
+
+    memset(paths, 0, sizeof(paths));
+    paths[0].from = init_socket(args.iface[0]);
+    paths[0].to = init_socket(args.iface[1]);
+    paths[1].from = paths[0].to;
+    paths[1].to = paths[0].from;
+    npaths = args.one_way ? 1 : 2;
+
+    held = malloc(args.limit * sizeof(*held));
+    if (NULL == held || -1 == timerwheel_init(&w, args.limit, TICK_NS, monotonic_ns())) {
+        error(EXIT_FAILURE, errno, "malloc");
+    }
+
+    while (run) {
+        struct pollfd fds[2] = {
+            {.fd = paths[0].from, .events = POLLIN},
+            {.fd = paths[1].from, .events = POLLIN},
+        };
+        struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = IDLE_TIMEOUT_MS * 1000000L,
+        };
+        const uint64_t deadline = timerwheel_deadline(&w);
+        uint64_t now;
+
+        /* Wake up in time for the next frame held to be due */
+        if (UINT64_MAX != deadline) {
+            now = monotonic_ns();
+            const uint64_t wait = (deadline > now) ? deadline - now : 0;
+            if (wait < IDLE_TIMEOUT_MS * UINT64_C(1000000)) {
+                ts.tv_nsec = wait;
+            }
+        }
+
+        if (-1 == ppoll(fds, npaths, &ts, NULL)) {
+            if (EINTR == errno) {
+                continue;
+            }
+            error(EXIT_FAILURE, errno, "ppoll");
+        }
+
+        now = monotonic_ns();
+        for (i = 0; i < npaths; i++) {
+            if (fds[i].revents & POLLIN) {
+                const int n = read_frames(paths[i].from, batch);
+                int j;
+
+                for (j = 0; j < n; j++) {
+                    inject(&w, held, paths, i, &batch[j], now, &args);
+                }
+            }
+        }
+
+        timerwheel_advance(&w, now);
+        release(&w, held, paths, now, &args);
+
+        for (i = 0; i < npaths; i++) {
+            if (paths[i].nout > 0) {
+                flush(&paths[i]);
+            }
+        }
+    }
+
+    if (!args.quiet) {
+        print_stats(args.iface[0], args.iface[1], &paths[0].stats);
+        if (!args.one_way) {
+            print_stats(args.iface[1], args.iface[0], &paths[1].stats);
+        }
+        printf("%u frames still held, seed %llu\n", w.used, args.seed);
+    }
+
+    timerwheel_free(&w);
+    free(held);
+    cleanup(paths[0].to);
+    cleanup(paths[0].from);
+    return EXIT_SUCCESS;
+}
@@ -33,37 +33,127 @@ defined by the macro MSGID.
 */
 
 #include <errno.h>
+#include <math.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <unistd.h>
 #include <error.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 #include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "aggregate.h"
+#include "bitprof.h"
+#include "buserr.h"
+#include "dbc.h"
+#include "deadband.h"
+#include "flightrec.h"
+#include "ids.h"
+#include "pcapng.h"
+#include "timing.h"
 
 #define VERSION "2.0.0"
 
 #define MSGID (0x0CC)
 
+/* How often to wake up while the bus is idle to run periodic work */
+#define IDLE_TIMEOUT_US (100000)
+
+/* Most distinct CAN IDs tracked by the per-ID analyses */
+#define MAX_IDS (4096)
+
+/* Frames kept by the flight recorder unless told otherwise, about half a
+ * minute of a fully loaded 1 Mbit/s bus
+ */
+#define DEFAULT_RING (1 << 18)
+
+/* Seconds kept before and after a flight recorder trigger by default */
+#define DEFAULT_BEFORE (10.0)
+#define DEFAULT_AFTER (2.0)
+
+/* How often the alert reporter looks for new alerts */
+#define ALERT_POLL_US (100000)
+
+/* Most alerts printed per second, the rest are only counted */
+#define ALERT_BUDGET (10)
+
+/* Frames matching a pattern trigger the flight recorder */
+struct trigger
+{
+    canid_t id;
+    canid_t mask;
+    uint8_t data[CAN_MAX_DLEN]; /* Leading payload bytes which must match */
+    uint8_t len;
+};
+
 struct args
 {
     const char *iface;
+    const char *dbc;
+    double deadband;    /* Negative unless publishing changed signals */
+    unsigned long aggregate; /* Window length in milliseconds, 0 if disabled */
+    unsigned long bitprof;   /* Report interval in seconds, 0 if disabled */
+    unsigned long timing;    /* Report interval in seconds, 0 if disabled */
+    unsigned long ids;       /* Training window in seconds, 0 if disabled */
+    unsigned long errors;    /* Report interval in seconds, 0 if disabled */
+    const char *record;      /* Flight recorder dump prefix, NULL if none */
+    const char *ring_file;   /* Flight recorder ring file, NULL if in memory */
+    int recording;           /* Whether the flight recorder runs */
+    double before;           /* Seconds dumped before a trigger */
+    double after;            /* Seconds dumped after a trigger */
+    unsigned long ring;      /* Frames kept by the flight recorder */
+    struct trigger trigger;
+    int has_trigger;
+    const char *pcapng;      /* Capture file, NULL if disabled */
+    unsigned long rotate_size; /* Megabytes per capture file, 0 if unlimited */
+    unsigned long rotate_time; /* Seconds per capture file, 0 if unlimited */
+    int quiet;
+};
+
+/* State of the optional analyses run on every received frame */
+struct monitor
+{
+    struct dbc db;
+    struct deadband deadband;
+    struct aggregate aggregate;
+    struct bitprof bitprof;
+    struct timing timing;
+    struct ids ids;
+    struct buserr buserr;
+    struct flightrec flightrec;
+    struct pcapng pcapng;
+    pthread_t reporter;     /* Drains the intrusion alerts */
+    atomic_int reporting;   /* Cleared to stop the reporter */
+    uint64_t next_bitprof;  /* Time of the next bit activity report */
+    uint64_t next_timing;   /* Time of the next timing report */
+    uint64_t next_errors;   /* Time of the next bus health report */
+    int periodic;           /* Whether any analysis has periodic work */
 };
 
 static volatile sig_atomic_t run = 1;
+static volatile sig_atomic_t dump_requested = 0;
 
 static void on_signal(int)
 {
     run = 0;
 }
 
+static void on_dump_signal(int)
+{
+    dump_requested = 1;
+}
+
 static void init_signals(void)
 {
     struct sigaction sa;
@@ -72,6 +162,10 @@ static void init_signals(void)
     sigemptyset(&sa.sa_mask);
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
+
+    /* Trigger the flight recorder */
+    sa.sa_handler = on_dump_signal;
+    sigaction(SIGUSR1, &sa, NULL);
 }
 
 static int init_socket(const char *iface)
@@ -94,6 +188,12 @@ static int init_socket(const char *iface)
         error(EXIT_FAILURE, errno, "ioctl");
     }
 
+    /* Have the kernel timestamp every received frame */
+    rc = setsockopt(sfd, SOL_SOCKET, SO_TIMESTAMPNS, &(int){1}, sizeof(int));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "setsockopt");
+    }
+
     /* Set the local address to bind to */
     addr.can_family = AF_CAN;
     addr.can_ifindex = ifr.ifr_ifindex;
@@ -107,6 +207,76 @@ static int init_socket(const char *iface)
     return sfd;
 }
 
+static void set_idle_timeout(int sfd)
+{
+    const struct timeval tv = {
+        .tv_sec = 0,
+        .tv_usec = IDLE_TIMEOUT_US,
+    };
+    int rc;
+
+    /* Reads fail with EAGAIN when the bus has been idle for a while */
+    rc = setsockopt(sfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "setsockopt");
+    }
+}
+
+static void enable_error_frames(int sfd)
+{
+    const can_err_mask_t mask = BUSERR_MASK;
+    int rc;
+
+    /* Have the kernel deliver error frames along with the data frames */
+    rc = setsockopt(sfd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &mask, sizeof(mask));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "setsockopt");
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/* Read a frame along with its receive timestamp in nanoseconds */
+static ssize_t read_frame(int sfd, struct can_frame *frame, uint64_t *stamp)
+{
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    iov.iov_base = frame;
+    iov.iov_len = sizeof(*frame);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    n = recvmsg(sfd, &msg, 0);
+    if (-1 == n) {
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (SOL_SOCKET == cmsg->cmsg_level && SO_TIMESTAMPNS == cmsg->cmsg_type) {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            *stamp = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+            return n;
+        }
+    }
+
+    /* Fall back to the time of reading if the kernel did not stamp it */
+    *stamp = now_ns();
+    return n;
+}
+
 static void cleanup(int sfd)
 {
     sigset_t mask;
@@ -134,9 +304,46 @@ static void print_help(const char *progname)
         "  IFACE    CAN network interface (e.g. can0)\n"
         "\n"
         "Options:\n"
+        "  --dbc, -d FILE   Decode received frames using a DBC file\n"
+        "  --deadband, -b VALUE\n"
+        "                   Only print signals which moved by more than VALUE\n"
+        "                   since they were last printed (requires --dbc)\n"
+        "  --aggregate, -a MS\n"
+        "                   Print the min, max, mean and last value of every\n"
+        "                   signal over windows of MS milliseconds (requires --dbc)\n"
+        "  --bit-profile, -p SEC\n"
+        "                   Track which payload bits of every ID change and print\n"
+        "                   a heatmap every SEC seconds and on exit\n"
+        "  --timing, -t SEC Track inter-arrival statistics and cycle times of\n"
+        "                   every ID and print them every SEC seconds and on exit\n"
+        "  --ids, -i SEC    Learn the normal traffic for SEC seconds, then report\n"
+        "                   unknown IDs, rate spikes and unusual payloads on stderr\n"
+        "  --errors, -e SEC Capture error frames and print bus health counters\n"
+        "                   and rates every SEC seconds and on exit\n"
+        "  --record, -r PREFIX\n"
+        "                   Keep recent frames in memory and dump them to\n"
+        "                   PREFIX-TIME.canlog on SIGUSR1, a --trigger frame, an\n"
+        "                   error frame or an intrusion alert\n"
+        "  --window, -w BEFORE[:AFTER]\n"
+        "                   Seconds dumped before and after a trigger\n"
+        "                   (default: %g:%g)\n"
+        "  --ring, -R N     Frames kept in memory for dumps (default: %d)\n"
+        "  --ring-file, -F FILE\n"
+        "                   Keep the recorder ring in FILE so that it survives a\n"
+        "                   crash, recover it with canlog-recover\n"
+        "  --trigger, -T ID[:MASK][#DATA]\n"
+        "                   Dump when a frame matches ID under MASK and its payload\n"
+        "                   starts with the hex bytes DATA\n"
+        "  --pcapng, -P FILE\n"
+        "                   Capture received frames to FILE in pcapng format\n"
+        "  --rotate-size, -S MB\n"
+        "                   Start a new numbered capture file every MB megabytes\n"
+        "  --rotate-time, -M SEC\n"
+        "                   Start a new numbered capture file every SEC seconds\n"
+        "  --quiet, -q      Do not print received and transmitted frames\n"
         "  --help, -h       Display this help then exit\n"
         "  --version, -V    Display version info then exit\n",
-        progname
+        progname, DEFAULT_BEFORE, DEFAULT_AFTER, DEFAULT_RING
     );
 }
 
@@ -145,6 +352,56 @@ static void print_version(void)
     puts(VERSION);
 }
 
+/* Parse ID[:MASK][#DATA] with hex numbers, as in candump filters. Returns 0
+ * on success and -1 if the pattern is malformed.
+ */
+static int parse_trigger(const char *s, struct trigger *t)
+{
+    char *end;
+
+    memset(t, 0, sizeof(*t));
+
+    t->id = strtoul(s, &end, 16);
+    if (end == s) {
+        return -1;
+    }
+
+    t->mask = (t->id > CAN_SFF_MASK) ? CAN_EFF_MASK : CAN_SFF_MASK;
+    if (':' == *end) {
+        s = end + 1;
+        t->mask = strtoul(s, &end, 16);
+        if (end == s) {
+            return -1;
+        }
+    }
+
+    /* Extended IDs only match extended frames and vice versa */
+    if (t->id > CAN_SFF_MASK) {
+        t->id |= CAN_EFF_FLAG;
+    }
+    t->mask |= CAN_EFF_FLAG;
+
+    if ('#' == *end) {
+        for (s = end + 1; '\0' != s[0] && t->len < CAN_MAX_DLEN; s += 2) {
+            char byte[3] = {s[0], s[1], '\0'};
+            t->data[t->len++] = strtoul(byte, &end, 16);
+            if ('\0' != *end || '\0' == s[1]) {
+                return -1;
+            }
+        }
+        end = (char *)s;
+    }
+
+    return ('\0' == *end) ? 0 : -1;
+}
+
+static int trigger_matches(const struct trigger *t, const struct can_frame *frame)
+{
+    return 0 == ((frame->can_id ^ t->id) & t->mask) &&
+           frame->len >= t->len &&
+           0 == memcmp(frame->data, t->data, t->len);
+}
+
 static void print_can_frame(const struct can_frame *const frame)
 {
     const unsigned char *data = frame->data;
@@ -157,23 +414,242 @@ static void print_can_frame(const struct can_frame *const frame)
     }
 }
 
+static void print_signals(const struct dbc *db, const struct can_frame *const frame)
+{
+    const struct dbc_message *msg;
+    double values[DBC_MAX_SIGNALS];
+    uint16_t i;
+
+    msg = dbc_lookup(db, frame->can_id);
+    if (NULL == msg) {
+        return;
+    }
+
+    dbc_decode(db, msg, frame->data, frame->len, values);
+    for (i = 0; i < msg->count; i++) {
+        const struct dbc_signal *sig = &db->signals[msg->first + i];
+        if (isnan(values[i])) {
+            /* Not present in this frame */
+            continue;
+        }
+        printf("     %s.%s = %g %s\n",
+               dbc_string(db, msg->name),
+               dbc_string(db, sig->name),
+               values[i],
+               dbc_string(db, sig->unit));
+    }
+}
+
+static void publish_changes(
+    const struct dbc *db,
+    struct deadband *deadband,
+    const struct can_frame *const frame)
+{
+    const struct dbc_message *msg;
+    double values[DBC_MAX_SIGNALS];
+    uint16_t changed[DBC_MAX_SIGNALS];
+    uint16_t n;
+    uint16_t i;
+
+    msg = dbc_lookup(db, frame->can_id);
+    if (NULL == msg) {
+        return;
+    }
+
+    dbc_decode(db, msg, frame->data, frame->len, values);
+    n = deadband_update(deadband, msg, values, changed);
+    for (i = 0; i < n; i++) {
+        const struct dbc_signal *sig = &db->signals[msg->first + changed[i]];
+        printf("SIG: %s.%s = %g %s\n",
+               dbc_string(db, msg->name),
+               dbc_string(db, sig->name),
+               values[changed[i]],
+               dbc_string(db, sig->unit));
+    }
+}
+
+static void aggregate_frame(
+    const struct dbc *db,
+    struct aggregate *aggregate,
+    uint64_t stamp,
+    const struct can_frame *const frame)
+{
+    const struct dbc_message *msg;
+    double values[DBC_MAX_SIGNALS];
+
+    msg = dbc_lookup(db, frame->can_id);
+    if (NULL == msg) {
+        return;
+    }
+
+    dbc_decode(db, msg, frame->data, frame->len, values);
+    aggregate_add(aggregate, stamp, msg, values);
+}
+
+static void print_aggregates(const struct dbc *db, const struct aggregate *aggregate)
+{
+    const uint64_t start = aggregate->result_start;
+    uint32_t m;
+
+    for (m = 0; m < db->nmessages; m++) {
+        const struct dbc_message *msg = &db->messages[m];
+        uint32_t i;
+
+        for (i = msg->first; i < msg->first + msg->count; i++) {
+            if (0 == aggregate->result_count[i]) {
+                continue;
+            }
+
+            printf("AGG: %llu.%09llu %s.%s min=%g max=%g mean=%g last=%g n=%u\n",
+                   (unsigned long long)(start / 1000000000),
+                   (unsigned long long)(start % 1000000000),
+                   dbc_string(db, msg->name),
+                   dbc_string(db, db->signals[i].name),
+                   aggregate->result_min[i],
+                   aggregate->result_max[i],
+                   aggregate->result_mean[i],
+                   aggregate->result_last[i],
+                   aggregate->result_count[i]);
+        }
+    }
+}
+
 static void parse_args(int argc, char **argv, struct args *args)
 {
     const char *progname = program_invocation_short_name;
+    char *end;
 
     static const struct option long_options[] = {
+        {"dbc", required_argument, NULL, 'd'},
+        {"deadband", required_argument, NULL, 'b'},
+        {"aggregate", required_argument, NULL, 'a'},
+        {"bit-profile", required_argument, NULL, 'p'},
+        {"timing", required_argument, NULL, 't'},
+        {"ids", required_argument, NULL, 'i'},
+        {"errors", required_argument, NULL, 'e'},
+        {"record", required_argument, NULL, 'r'},
+        {"window", required_argument, NULL, 'w'},
+        {"ring", required_argument, NULL, 'R'},
+        {"ring-file", required_argument, NULL, 'F'},
+        {"trigger", required_argument, NULL, 'T'},
+        {"pcapng", required_argument, NULL, 'P'},
+        {"rotate-size", required_argument, NULL, 'S'},
+        {"rotate-time", required_argument, NULL, 'M'},
+        {"quiet", no_argument, NULL, 'q'},
         {"help", no_argument, NULL, 'h'},
         {"version", no_argument, NULL, 'V'},
         {0, 0, 0, 0}
     };
 
+    args->dbc = NULL;
+    args->deadband = -1;
+    args->aggregate = 0;
+    args->bitprof = 0;
+    args->timing = 0;
+    args->ids = 0;
+    args->errors = 0;
+    args->record = NULL;
+    args->ring_file = NULL;
+    args->before = DEFAULT_BEFORE;
+    args->after = DEFAULT_AFTER;
+    args->ring = DEFAULT_RING;
+    args->has_trigger = 0;
+    args->pcapng = NULL;
+    args->rotate_size = 0;
+    args->rotate_time = 0;
+    args->quiet = 0;
+
     for (;;) {
-        const int opt = getopt_long(argc, argv, "Vh", long_options, NULL);
+        const int opt = getopt_long(argc, argv, "d:b:a:p:t:i:e:r:w:R:F:T:P:S:M:qVh", long_options, NULL);
         if (opt == -1) {
             break;
         }
 
         switch (opt) {
+        case 'd':
+            args->dbc = optarg;
+            break;
+        case 'b':
+            args->deadband = strtod(optarg, &end);
+            if ('\0' != *end || !(args->deadband >= 0)) {
+                error(EXIT_FAILURE, 0, "invalid deadband: %s", optarg);
+            }
+            break;
+        case 'a':
+            args->aggregate = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->aggregate) {
+                error(EXIT_FAILURE, 0, "invalid aggregation window: %s", optarg);
+            }
+            break;
+        case 'p':
+            args->bitprof = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->bitprof) {
+                error(EXIT_FAILURE, 0, "invalid report interval: %s", optarg);
+            }
+            break;
+        case 't':
+            args->timing = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->timing) {
+                error(EXIT_FAILURE, 0, "invalid report interval: %s", optarg);
+            }
+            break;
+        case 'i':
+            args->ids = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->ids) {
+                error(EXIT_FAILURE, 0, "invalid training window: %s", optarg);
+            }
+            break;
+        case 'e':
+            args->errors = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->errors) {
+                error(EXIT_FAILURE, 0, "invalid report interval: %s", optarg);
+            }
+            break;
+        case 'r':
+            args->record = optarg;
+            break;
+        case 'F':
+            args->ring_file = optarg;
+            break;
+        case 'w':
+            args->before = strtod(optarg, &end);
+            if (':' == *end) {
+                args->after = strtod(end + 1, &end);
+            }
+            if ('\0' != *end || !(args->before >= 0) || !(args->after >= 0)) {
+                error(EXIT_FAILURE, 0, "invalid dump window: %s", optarg);
+            }
+            break;
+        case 'R':
+            args->ring = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->ring) {
+                error(EXIT_FAILURE, 0, "invalid ring size: %s", optarg);
+            }
+            break;
+        case 'T':
+            if (-1 == parse_trigger(optarg, &args->trigger)) {
+                error(EXIT_FAILURE, 0, "invalid trigger: %s", optarg);
+            }
+            args->has_trigger = 1;
+            break;
+        case 'P':
+            args->pcapng = optarg;
+            break;
+        case 'S':
+            args->rotate_size = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->rotate_size) {
+                error(EXIT_FAILURE, 0, "invalid rotation size: %s", optarg);
+            }
+            break;
+        case 'M':
+            args->rotate_time = strtoul(optarg, &end, 0);
+            if ('\0' != *end || 0 == args->rotate_time) {
+                error(EXIT_FAILURE, 0, "invalid rotation time: %s", optarg);
+            }
+            break;
+        case 'q':
+            args->quiet = 1;
+            break;
         case 'V':
             print_version();
             exit(EXIT_SUCCESS);
@@ -192,40 +668,366 @@ static void parse_args(int argc, char **argv, struct args *args)
         exit(EXIT_FAILURE);
     }
 
+    if ((args->deadband >= 0 || args->aggregate) && NULL == args->dbc) {
+        error(0, 0, "--deadband and --aggregate require --dbc");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->recording = NULL != args->record || NULL != args->ring_file;
+
+    if (args->has_trigger && NULL == args->record) {
+        error(0, 0, "--trigger requires --record");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((args->rotate_size || args->rotate_time) && NULL == args->pcapng) {
+        error(0, 0, "--rotate-size and --rotate-time require --pcapng");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
     args->iface = argv[optind];
 }
 
+/* Print queued intrusion alerts at a bounded rate, away from the receive loop */
+static void *report_alerts(void *arg)
+{
+    struct monitor *m = arg;
+    struct ids_alert alert;
+    unsigned long suppressed = 0;
+    unsigned int budget = ALERT_BUDGET;
+    unsigned int polls = 0;
+    int stopping = 0;
+    sigset_t mask;
+
+    /* Leave every signal to the receive loop */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while (!stopping) {
+        const struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = ALERT_POLL_US * 1000L,
+        };
+
+        /* Drain whatever is left once the receive loop has stopped */
+        stopping = !atomic_load(&m->reporting);
+
+        while (0 == ids_next_alert(&m->ids, &alert)) {
+            if (budget > 0) {
+                ids_print_alert(&alert, stderr);
+                budget--;
+            } else {
+                suppressed++;
+            }
+        }
+
+        /* Refill the budget every second */
+        if (++polls >= 1000000 / ALERT_POLL_US || stopping) {
+            if (suppressed > 0) {
+                fprintf(stderr, "ALERT: %lu more alerts suppressed\n", suppressed);
+                suppressed = 0;
+            }
+            budget = ALERT_BUDGET;
+            polls = 0;
+        }
+
+        if (!stopping) {
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static void init_monitor(struct monitor *m, const struct args *args)
+{
+    int rc;
+
+    memset(m, 0, sizeof(*m));
+
+    if (NULL != args->dbc && -1 == dbc_load(&m->db, args->dbc)) {
+        error(EXIT_FAILURE, errno, "%s", args->dbc);
+    }
+
+    if (args->deadband >= 0 && -1 == deadband_init(&m->deadband, &m->db, args->deadband)) {
+        error(EXIT_FAILURE, errno, "deadband");
+    }
+
+    if (args->aggregate &&
+        -1 == aggregate_init(&m->aggregate, &m->db, args->aggregate * UINT64_C(1000000))) {
+        error(EXIT_FAILURE, errno, "aggregate");
+    }
+
+    if (args->bitprof && -1 == bitprof_init(&m->bitprof, MAX_IDS)) {
+        error(EXIT_FAILURE, errno, "bit profile");
+    }
+
+    if (args->timing && -1 == timing_init(&m->timing, MAX_IDS)) {
+        error(EXIT_FAILURE, errno, "timing");
+    }
+
+    if (args->ids) {
+        if (-1 == ids_init(&m->ids, MAX_IDS, args->ids * UINT64_C(1000000000))) {
+            error(EXIT_FAILURE, errno, "ids");
+        }
+
+        atomic_init(&m->reporting, 1);
+        rc = pthread_create(&m->reporter, NULL, report_alerts, m);
+        if (0 != rc) {
+            error(EXIT_FAILURE, rc, "pthread_create");
+        }
+    }
+
+    m->next_bitprof = now_ns() + args->bitprof * UINT64_C(1000000000);
+    if (args->recording) {
+        if (-1 == flightrec_init(&m->flightrec, args->ring, args->before * 1e9,
+                                 args->after * 1e9, args->record, args->ring_file)) {
+            error(EXIT_FAILURE, errno, "%s",
+                  (NULL != args->ring_file) ? args->ring_file : "flight recorder");
+        }
+
+        rc = flightrec_start(&m->flightrec);
+        if (0 != rc) {
+            error(EXIT_FAILURE, rc, "pthread_create");
+        }
+    }
+
+    if (NULL != args->pcapng) {
+        if (-1 == pcapng_init(&m->pcapng, args->pcapng, args->rotate_size << 20,
+                              args->rotate_time * UINT64_C(1000000000)) ||
+            -1 == pcapng_add_interface(&m->pcapng, args->iface) ||
+            -1 == pcapng_start(&m->pcapng)) {
+            error(EXIT_FAILURE, errno, "%s", args->pcapng);
+        }
+    }
+
+    m->next_timing = now_ns() + args->timing * UINT64_C(1000000000);
+    m->next_errors = now_ns() + args->errors * UINT64_C(1000000000);
+    m->periodic = args->aggregate || args->bitprof || args->timing || args->errors;
+
+    buserr_init(&m->buserr, args->iface, now_ns());
+}
+
+/* Periodic work, run before every frame and whenever the bus is idle */
+static void run_timers(struct monitor *m, const struct args *args, uint64_t now)
+{
+    /* Close the time window if it has ended */
+    if (args->aggregate && aggregate_due(&m->aggregate, now)) {
+        aggregate_flush(&m->aggregate, now);
+        print_aggregates(&m->db, &m->aggregate);
+    }
+
+    /* Dump the bit activity heatmap */
+    if (args->bitprof && now >= m->next_bitprof) {
+        bitprof_report(&m->bitprof, stdout);
+        m->next_bitprof = now + args->bitprof * UINT64_C(1000000000);
+    }
+
+    /* Print the timing health view */
+    if (args->timing && now >= m->next_timing) {
+        timing_report(&m->timing, stdout);
+        m->next_timing = now + args->timing * UINT64_C(1000000000);
+    }
+
+    /* Print the bus health counters */
+    if (args->errors && now >= m->next_errors) {
+        buserr_report(&m->buserr, now, stdout);
+        m->next_errors = now + args->errors * UINT64_C(1000000000);
+    }
+}
+
+static void monitor_frame(
+    struct monitor *m,
+    const struct args *args,
+    const struct can_frame *const frame,
+    uint64_t stamp)
+{
+    /* Handed to the capture writer thread */
+    if (NULL != args->pcapng) {
+        pcapng_write(&m->pcapng, 0, stamp, frame, CAN_MTU);
+    }
+
+    /* Recording is a single copy into the ring, dumps happen elsewhere */
+    if (args->recording) {
+        flightrec_add(&m->flightrec, stamp, frame);
+        if (args->has_trigger && trigger_matches(&args->trigger, frame)) {
+            flightrec_trigger(&m->flightrec, stamp);
+        }
+    }
+
+    if (args->errors) {
+        buserr_add(&m->buserr, frame);
+    }
+
+    if (args->bitprof) {
+        bitprof_add(&m->bitprof, stamp, frame);
+    }
+
+    if (args->timing) {
+        timing_add(&m->timing, stamp, frame);
+    }
+
+    /* Alerts are queued for the reporter, never printed here */
+    if (args->ids && ids_check(&m->ids, stamp, frame) && args->recording) {
+        flightrec_trigger(&m->flightrec, stamp);
+    }
+
+    /* Fold the signals of the CAN frame into the current time window */
+    if (args->aggregate) {
+        aggregate_frame(&m->db, &m->aggregate, stamp, frame);
+    }
+
+    if (!args->quiet) {
+        /* Print the received CAN frame */
+        printf("RX:  ");
+        print_can_frame(frame);
+        printf("\n");
+
+        /* Print the decoded signals of the received CAN frame */
+        if (NULL != args->dbc && args->deadband < 0) {
+            print_signals(&m->db, frame);
+        }
+    }
+
+    /* Print only the signals which moved outside of their deadband */
+    if (args->deadband >= 0) {
+        publish_changes(&m->db, &m->deadband, frame);
+    }
+}
+
+static void monitor_error(
+    struct monitor *m,
+    const struct args *args,
+    const struct can_frame *const frame,
+    uint64_t stamp)
+{
+    if (NULL != args->pcapng) {
+        pcapng_write(&m->pcapng, 0, stamp, frame, CAN_MTU);
+    }
+
+    if (args->recording) {
+        flightrec_add(&m->flightrec, stamp, frame);
+        flightrec_trigger(&m->flightrec, stamp);
+    }
+
+    if (args->errors) {
+        buserr_add(&m->buserr, frame);
+    }
+
+    if (!args->quiet) {
+        buserr_print(frame, stdout);
+    }
+}
+
+static void free_monitor(struct monitor *m, const struct args *args)
+{
+    if (args->deadband >= 0 && m->deadband.decoded > 0) {
+        printf("Published %llu of %llu decoded signal values (%.1f%% reduction)\n",
+               (unsigned long long)m->deadband.published,
+               (unsigned long long)m->deadband.decoded,
+               100.0 * (m->deadband.decoded - m->deadband.published) / m->deadband.decoded);
+    }
+
+    if (args->bitprof) {
+        bitprof_report(&m->bitprof, stdout);
+    }
+
+    if (args->timing) {
+        timing_report(&m->timing, stdout);
+    }
+
+    if (args->errors) {
+        buserr_report(&m->buserr, now_ns(), stdout);
+    }
+
+    if (args->ids) {
+        atomic_store(&m->reporting, 0);
+        pthread_join(m->reporter, NULL);
+        printf("Checked %llu frames after training, raised %llu alerts (%llu lost)\n",
+               (unsigned long long)m->ids.frames,
+               (unsigned long long)m->ids.alerts,
+               (unsigned long long)m->ids.lost);
+    }
+
+    if (NULL != args->pcapng) {
+        pcapng_stop(&m->pcapng);
+        printf("Captured %llu frames to %u file(s), %llu dropped\n",
+               (unsigned long long)m->pcapng.packets, m->pcapng.files,
+               (unsigned long long)m->pcapng.dropped[0]);
+    }
+
+    pcapng_free(&m->pcapng);
+    flightrec_free(&m->flightrec);
+    ids_free(&m->ids);
+    timing_free(&m->timing);
+    bitprof_free(&m->bitprof);
+    aggregate_free(&m->aggregate);
+    deadband_free(&m->deadband);
+    dbc_free(&m->db);
+}
+
 int main(int argc, char **argv)
 {
+    struct monitor monitor;
     struct args args;
     int sfd;
 
     program_invocation_name = program_invocation_short_name;
 
     parse_args(argc, argv, &args);
+    init_monitor(&monitor, &args);
     init_signals();
     sfd = init_socket(args.iface);
+    if (monitor.periodic) {
+        set_idle_timeout(sfd);
+    }
+    if (args.errors) {
+        enable_error_frames(sfd);
+    }
 
     while (run) {
         struct can_frame frame;
         unsigned char i;
+        uint64_t stamp;
         ssize_t n;
 
+        if (dump_requested) {
+            dump_requested = 0;
+            if (args.recording) {
+                flightrec_trigger(&monitor.flightrec, now_ns());
+            }
+        }
+
         /* Read a frame from the CAN interface */
-        n = read(sfd, &frame, sizeof(frame));
+        n = read_frame(sfd, &frame, &stamp);
         if (-1 == n) {
             if (EINTR == errno) {
                 continue;
             }
 
+            /* Idle bus, still run any periodic work which is due */
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                run_timers(&monitor, &args, now_ns());
+                continue;
+            }
+
             error(0, errno, "read");
             break;
         }
 
-        /* Print the received CAN frame */
-        printf("RX:  ");
-        print_can_frame(&frame);
-        printf("\n");
+        run_timers(&monitor, &args, stamp);
+
+        /* Error frames describe the bus, they are counted but never echoed */
+        if (frame.can_id & CAN_ERR_FLAG) {
+            monitor_error(&monitor, &args, &frame, stamp);
+            continue;
+        }
+
+        /* Print, decode and analyse the received CAN frame */
+        monitor_frame(&monitor, &args, &frame, stamp);
 
         /* Modify the CAN frame to have our message ID */
         frame.can_id = MSGID;
@@ -245,14 +1047,18 @@ int main(int argc, char **argv)
             error(0, errno, "write");
             break;
         }
+        buserr_sent(&monitor.buserr);
 
         /* Print the transmitted CAN frame */
-        printf("TX:  ");
-        print_can_frame(&frame);
-        printf("\n");
+        if (!args.quiet) {
+            printf("TX:  ");
+            print_can_frame(&frame);
+            printf("\n");
+        }
     }
 
     cleanup(sfd);
+    free_monitor(&monitor, &args);
     puts("Goodbye!");
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,775 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Replay Demo
+
+This program demonstrates sending a recorded capture back out to a CAN bus
+using SocketCAN's raw interface, with the original timing between frames. The
+capture is a capture file (see canlog.h), such as a flight recorder dump, or a
+candump log. Frames can be rewritten on the way out by rules (see replay.h)
+which drop, keep, remap or overwrite the payload of chosen IDs, the timing can
+be sped up or slowed down, and the capture can be replayed over and over.
+
+Several interfaces can be driven at once, channel n of the capture going out
+on the n-th interface. By default one thread sends to all of them in capture
+order. With --threads, every interface gets a thread of its own, pinned to a
+core of its own. Either way all interfaces share one absolute start time, so
+they stay aligned with each other however long the replay runs, and the
+spread of their lateness is reported as the skew between them.
+
+Frames are sent at absolute times on the monotonic clock, so a late frame
+does not delay the ones after it. Every frame which is due is sent in one
+sendmmsg() call, and nothing is allocated once the replay has started.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "candump.h"
+#include "canlog.h"
+#include "replay.h"
+
+#define VERSION "2.0.0"
+
+/* Most frames handed to the kernel in one call */
+#define BATCH (64)
+
+/* How long to wait for room in the transmit queue before trying again */
+#define TX_WAIT_MS (10)
+
+#define MAX_IFACES (16)
+
+/* Lead time given to the threads before the first frame is due */
+#define START_DELAY_NS (UINT64_C(100000000))
+
+/* Longest sleep, so that an interrupted replay stops promptly */
+#define MAX_SLEEP_NS (UINT64_C(100000000))
+
+/* Lateness histogram buckets, bucket n holding up to 2^n microseconds */
+#define LATE_BUCKETS (32)
+
+struct args
+{
+    char *ifaces[MAX_IFACES];
+    unsigned int nifaces;
+    const char *input;
+    double speed;
+    unsigned long loops;    /* 0 to loop until interrupted */
+    int threads;            /* Whether every interface has a thread */
+    int quiet;
+};
+
+struct stats
+{
+    uint64_t sent;
+    uint64_t dropped;       /* By the rules */
+    uint64_t skipped;       /* Error frames, or channels without an interface */
+    uint64_t max_late;      /* Nanoseconds */
+    uint64_t total_late;
+    uint64_t histogram[LATE_BUCKETS];
+};
+
+static volatile sig_atomic_t run = 1;
+
+static void on_signal(int)
+{
+    run = 0;
+}
+
+static void init_signals(void)
+{
+    struct sigaction sa;
+    sa.sa_handler = on_signal;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+static int init_socket(const char *iface)
+{
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int sfd;
+    int rc;
+
+    /* Create a raw CAN socket */
+    sfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+
+    /* Determine the interface index */
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ);
+    rc = ioctl(sfd, SIOCGIFINDEX, &ifr);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "ioctl");
+    }
+
+    /* Only send, never receive */
+    rc = setsockopt(sfd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "setsockopt");
+    }
+
+    /* Set the local address to bind to */
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    /* Bind the address to the socket */
+    rc = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+
+    return sfd;
+}
+
+static void cleanup(int sfd)
+{
+    sigset_t mask;
+    int rc;
+
+    /* Block signals from interfering with graceful shutdown */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    /* Close the socket */
+    rc = close(sfd);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "close");
+    }
+}
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] IFACE[,IFACE...] INPUT\n"
+        "\n"
+        "Arguments:\n"
+        "  IFACE    CAN network interface (e.g. can0), the n-th one sending\n"
+        "           channel n of the capture, or every channel if it is the only one\n"
+        "  INPUT    Capture file or candump log to replay\n"
+        "\n"
+        "Options:\n"
+        "  --speed, -s X    Replay X times as fast as recorded, 0 for as fast as\n"
+        "                   the bus takes frames (default: 1)\n"
+        "  --loop, -l N     Replay N times, 0 for until interrupted (default: 1)\n"
+        "  --drop, -x ID    Do not send frames of a hex CAN ID, eight digits\n"
+        "                   being an extended ID\n"
+        "  --keep, -k ID    Only send frames of IDs given with --keep\n"
+        "  --map, -m ID=TO  Send frames of ID as ID TO\n"
+        "  --set, -S ID=DATA\n"
+        "                   Overwrite the payload of ID with hex bytes, \"..\"\n"
+        "                   keeping a byte (e.g. ..FF..01)\n"
+        "  --rules, -r FILE Read rules such as \"map 123=456\", one per line\n"
+        "  --threads, -T    Send to every interface from a thread of its own\n"
+        "  --quiet, -q      Do not print statistics at the end\n"
+        "  --help, -h       Display this help then exit\n"
+        "  --version, -V    Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void add_rule(struct replay_rules *rules, const char *verb, const char *arg)
+{
+    char rule[64];
+
+    snprintf(rule, sizeof(rule), "%s %s", verb, arg);
+    if (-1 == replay_rules_add(rules, rule)) {
+        if (ENOSPC == errno) {
+            error(EXIT_FAILURE, 0, "too many IDs with rules, at most %d", REPLAY_MAX_RULES);
+        }
+        error(EXIT_FAILURE, 0, "invalid rule: %s", rule);
+    }
+}
+
+static void parse_args(int argc, char **argv, struct args *args, struct replay_rules *rules)
+{
+    const char *progname = program_invocation_short_name;
+    char *iface;
+    char *save;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"speed", required_argument, NULL, 's'},
+        {"loop", required_argument, NULL, 'l'},
+        {"drop", required_argument, NULL, 'x'},
+        {"keep", required_argument, NULL, 'k'},
+        {"map", required_argument, NULL, 'm'},
+        {"set", required_argument, NULL, 'S'},
+        {"rules", required_argument, NULL, 'r'},
+        {"threads", no_argument, NULL, 'T'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+    args->speed = 1.0;
+    args->loops = 1;
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "s:l:x:k:m:S:r:TqVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 's':
+            args->speed = strtod(optarg, &end);
+            if ('\0' != *end || end == optarg || !(args->speed >= 0)) {
+                error(EXIT_FAILURE, 0, "invalid speed: %s", optarg);
+            }
+            break;
+        case 'l':
+            args->loops = strtoul(optarg, &end, 0);
+            if ('\0' != *end || end == optarg) {
+                error(EXIT_FAILURE, 0, "invalid loop count: %s", optarg);
+            }
+            break;
+        case 'x':
+            add_rule(rules, "drop", optarg);
+            break;
+        case 'k':
+            add_rule(rules, "keep", optarg);
+            break;
+        case 'm':
+            add_rule(rules, "map", optarg);
+            break;
+        case 'S':
+            add_rule(rules, "set", optarg);
+            break;
+        case 'r':
+            if (-1 == replay_rules_load(rules, optarg)) {
+                error(EXIT_FAILURE, (EINVAL == errno || ENOSPC == errno) ? 0 : errno,
+                      "%s", optarg);
+            }
+            break;
+        case 'T':
+            args->threads = 1;
+            break;
+        case 'q':
+            args->quiet = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        error(0, 0, "an interface and an input file argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    for (iface = strtok_r(argv[optind], ",", &save); NULL != iface;
+         iface = strtok_r(NULL, ",", &save)) {
+        if (args->nifaces >= MAX_IFACES) {
+            error(EXIT_FAILURE, 0, "too many interfaces, at most %d", MAX_IFACES);
+        }
+        args->ifaces[args->nifaces++] = iface;
+    }
+    if (0 == args->nifaces) {
+        error(EXIT_FAILURE, 0, "no interface given");
+    }
+    args->input = argv[optind + 1];
+}
+
+struct records
+{
+    struct canlog_record *r;
+    size_t n;
+    size_t capacity;
+};
+
+static int gather(void *ctx, const struct canlog_record *r)
+{
+    struct records *records = ctx;
+
+    if (records->n == records->capacity) {
+        const size_t capacity = records->capacity ? 2 * records->capacity : 65536;
+        struct canlog_record *p = realloc(records->r, capacity * sizeof(*p));
+        if (NULL == p) {
+            return -1;
+        }
+        records->r = p;
+        records->capacity = capacity;
+    }
+    records->r[records->n++] = *r;
+    return 0;
+}
+
+/* Records of a capture file are used in place, a candump log is parsed up
+ * front so that no text is handled while replaying. Parsed records are
+ * returned in parsed as well, for the caller to free.
+ */
+static const struct canlog_record *load(struct candump *input, const char *path, size_t *n,
+                                        struct canlog_record **parsed)
+{
+    struct canlog_header header;
+    struct records records = {NULL, 0, 0};
+
+    if (-1 == candump_open(input, path)) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+
+    if (input->size >= sizeof(header) &&
+        0 == memcmp(input->data, CANLOG_MAGIC, sizeof(header.magic))) {
+        memcpy(&header, input->data, sizeof(header));
+        if (!canlog_header_valid(&header)) {
+            error(EXIT_FAILURE, 0, "%s: unsupported capture file", path);
+        }
+        *n = (input->size - sizeof(header)) / sizeof(struct canlog_record);
+        *parsed = NULL;
+        return (const struct canlog_record *)(input->data + sizeof(header));
+    }
+
+    if (0 != candump_each(input, gather, &records)) {
+        error(EXIT_FAILURE, ENOMEM, "%s", path);
+    }
+    *n = records.n;
+    *parsed = records.r;
+    return records.r;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t due, uint64_t now)
+{
+    struct timespec ts;
+
+    if (due - now > MAX_SLEEP_NS) {
+        due = now + MAX_SLEEP_NS;
+    }
+    ts.tv_sec = due / 1000000000;
+    ts.tv_nsec = due % 1000000000;
+
+    /* A signal ends the sleep early, the caller checks whether to stop */
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/* Frames queued for one interface */
+struct batch
+{
+    struct mmsghdr msgs[BATCH];
+    struct iovec iovs[BATCH];
+    struct can_frame frames[BATCH];
+    uint64_t due[BATCH];
+    unsigned int n;
+};
+
+/* Everything sending to one interface needs, touched by one thread only */
+struct player
+{
+    int sfd;
+    struct batch batch;
+    struct stats stats;
+};
+
+/* What the threads share, read only while the replay runs */
+struct replay
+{
+    const struct canlog_record *records;
+    size_t count;
+    const struct args *args;
+    const struct replay_rules *rules;
+    struct replay_clock clock;
+    struct player *players;
+    unsigned int nplayers;
+};
+
+static void init_batch(struct batch *b)
+{
+    unsigned int i;
+
+    memset(b, 0, sizeof(*b));
+    for (i = 0; i < BATCH; i++) {
+        b->iovs[i].iov_base = &b->frames[i];
+        b->iovs[i].iov_len = sizeof(b->frames[i]);
+        b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+static unsigned int bucket_of(uint64_t late)
+{
+    const uint64_t us = late / 1000;
+    unsigned int b = 0;
+
+    while (b < LATE_BUCKETS - 1 && (UINT64_C(1) << b) <= us) {
+        b++;
+    }
+    return b;
+}
+
+/* Send every queued frame, waiting for room in the transmit queue when the
+ * bus cannot keep up
+ */
+static void flush(struct player *p)
+{
+    struct batch *b = &p->batch;
+    unsigned int done = 0;
+    uint64_t now;
+
+    while (done < b->n && run) {
+        const int n = sendmmsg(p->sfd, &b->msgs[done], b->n - done, 0);
+        if (-1 == n) {
+            if (ENOBUFS == errno || EAGAIN == errno) {
+                struct pollfd pfd = {.fd = p->sfd, .events = POLLOUT};
+                poll(&pfd, 1, TX_WAIT_MS);
+                continue;
+            }
+            if (EINTR == errno) {
+                continue;
+            }
+            error(EXIT_FAILURE, errno, "sendmmsg");
+        }
+        done += n;
+    }
+
+    now = monotonic_ns();
+    for (done = 0; done < b->n; done++) {
+        const uint64_t late = (now > b->due[done]) ? now - b->due[done] : 0;
+        p->stats.total_late += late;
+        if (late > p->stats.max_late) {
+            p->stats.max_late = late;
+        }
+        p->stats.histogram[bucket_of(late)]++;
+    }
+    p->stats.sent += b->n;
+    b->n = 0;
+}
+
+/* Send the channels of the capture which players[first, first + n) stand for,
+ * in capture order
+ */
+static void play(const struct replay *rp, unsigned int first, unsigned int n)
+{
+    const struct args *args = rp->args;
+    struct can_frame frame;
+    unsigned long lap;
+    uint64_t now = monotonic_ns();
+    unsigned int c;
+    size_t i;
+
+    for (lap = 0; run && (0 == args->loops || lap < args->loops); lap++) {
+        for (i = 0; i < rp->count && run; i++) {
+            const struct canlog_record *r = &rp->records[i];
+            struct player *p;
+            struct batch *b;
+            uint64_t due;
+
+            /* A lone interface sends every channel */
+            c = (1 == rp->nplayers) ? 0 : r->channel;
+            if (c < first || c >= first + n) {
+                if (c >= rp->nplayers && 0 == first) {
+                    rp->players[0].stats.skipped++;
+                }
+                continue;
+            }
+            p = &rp->players[c];
+
+            if (r->can_id & CAN_ERR_FLAG) {
+                p->stats.skipped++;
+                continue;
+            }
+
+            frame.can_id = r->can_id;
+            frame.len = r->len;
+            memcpy(frame.data, r->data, CAN_MAX_DLEN);
+            if (-1 == replay_rules_apply(rp->rules, &frame)) {
+                p->stats.dropped++;
+                continue;
+            }
+
+            /* Send what is queued before waiting for a frame due later */
+            due = replay_due(&rp->clock, r->stamp, lap);
+            if (due > now) {
+                for (c = first; c < first + n; c++) {
+                    if (rp->players[c].batch.n > 0) {
+                        flush(&rp->players[c]);
+                    }
+                }
+                now = monotonic_ns();
+                while (due > now && run) {
+                    sleep_until(due, now);
+                    now = monotonic_ns();
+                }
+            }
+
+            b = &p->batch;
+            b->frames[b->n] = frame;
+            b->due[b->n++] = due;
+            if (BATCH == b->n) {
+                flush(p);
+                now = monotonic_ns();
+            }
+        }
+    }
+
+    for (c = first; c < first + n; c++) {
+        flush(&rp->players[c]);
+    }
+}
+
+struct worker
+{
+    const struct replay *rp;
+    unsigned int index;
+    pthread_t thread;
+};
+
+static void *play_one(void *arg)
+{
+    const struct worker *w = arg;
+    sigset_t mask;
+
+    /* Leave every signal to the main thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    play(w->rp, w->index, 1);
+    return NULL;
+}
+
+/* Pin the thread to the n-th of the cores the process may run on */
+static void pin(pthread_t thread, unsigned int n)
+{
+    cpu_set_t allowed;
+    cpu_set_t one;
+    unsigned int count;
+    int cpu;
+
+    if (0 != sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return;
+    }
+    count = CPU_COUNT(&allowed);
+    if (0 == count) {
+        return;
+    }
+
+    n %= count;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && 0 == n--) {
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            pthread_setaffinity_np(thread, sizeof(one), &one);
+            return;
+        }
+    }
+}
+
+static void replay(struct replay *rp)
+{
+    static struct worker workers[MAX_IFACES];
+    unsigned int i;
+    int rc;
+
+    for (i = 0; i < rp->nplayers; i++) {
+        init_batch(&rp->players[i].batch);
+        memset(&rp->players[i].stats, 0, sizeof(rp->players[i].stats));
+    }
+
+    /* Every interface works off the same start time */
+    replay_clock_init(&rp->clock, rp->records, rp->count, rp->args->speed);
+    rp->clock.start += START_DELAY_NS;
+
+    if (!rp->args->threads || 1 == rp->nplayers) {
+        play(rp, 0, rp->nplayers);
+        return;
+    }
+
+    for (i = 0; i < rp->nplayers; i++) {
+        workers[i].rp = rp;
+        workers[i].index = i;
+        rc = pthread_create(&workers[i].thread, NULL, play_one, &workers[i]);
+        if (0 != rc) {
+            error(EXIT_FAILURE, rc, "pthread_create");
+        }
+        pin(workers[i].thread, i);
+    }
+
+    for (i = 0; i < rp->nplayers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+/* Upper bound of the lateness below which a fraction q of the frames were
+ * sent, in microseconds
+ */
+static double percentile(const struct stats *stats, double q)
+{
+    uint64_t seen = 0;
+    unsigned int b;
+
+    for (b = 0; b < LATE_BUCKETS; b++) {
+        seen += stats->histogram[b];
+        if (seen > 0 && seen >= q * stats->sent) {
+            return (0 == b) ? 1 : (double)(UINT64_C(1) << b);
+        }
+    }
+    return (double)(UINT64_C(1) << (LATE_BUCKETS - 1));
+}
+
+static void report(const struct replay *rp, double seconds)
+{
+    double mean_low = 0;
+    double mean_high = 0;
+    double p99_low = 0;
+    double p99_high = 0;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+    uint64_t skipped = 0;
+    unsigned int i;
+    int any = 0;
+
+    for (i = 0; i < rp->nplayers; i++) {
+        const struct stats *s = &rp->players[i].stats;
+        sent += s->sent;
+        dropped += s->dropped;
+        skipped += s->skipped;
+    }
+
+    printf("%llu frames sent in %.3f s (%.0f frames/s), %llu dropped by rules, "
+           "%llu skipped\n",
+           (unsigned long long)sent, seconds, sent / seconds,
+           (unsigned long long)dropped, (unsigned long long)skipped);
+    if (0 == rp->args->speed) {
+        return;
+    }
+
+    for (i = 0; i < rp->nplayers; i++) {
+        const struct stats *s = &rp->players[i].stats;
+        const double mean = s->sent ? s->total_late / 1e3 / s->sent : 0.0;
+        const double p99 = s->sent ? percentile(s, 0.99) : 0.0;
+
+        printf("%-8s %10llu frames, lateness mean %8.1f us, p99 < %6.0f us, max %8.1f us\n",
+               rp->args->ifaces[i], (unsigned long long)s->sent, mean, p99, s->max_late / 1e3);
+
+        if (0 == s->sent) {
+            continue;
+        }
+        if (!any || mean < mean_low) {
+            mean_low = mean;
+        }
+        if (!any || mean > mean_high) {
+            mean_high = mean;
+        }
+        if (!any || p99 < p99_low) {
+            p99_low = p99;
+        }
+        if (!any || p99 > p99_high) {
+            p99_high = p99;
+        }
+        any = 1;
+    }
+
+    if (rp->nplayers > 1) {
+        printf("Skew between interfaces: %.1f us in mean lateness, %.0f us in p99\n",
+               mean_high - mean_low, p99_high - p99_low);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static struct player players[MAX_IFACES];
+    struct canlog_record *parsed;
+    struct replay_rules rules;
+    struct candump input;
+    struct replay rp;
+    struct args args;
+    unsigned int i;
+    double t0;
+
+    program_invocation_name = program_invocation_short_name;
+
+    if (-1 == replay_rules_init(&rules)) {
+        error(EXIT_FAILURE, errno, "rules");
+    }
+    parse_args(argc, argv, &args, &rules);
+    init_signals();
+
+    rp.records = load(&input, args.input, &rp.count, &parsed);
+    rp.args = &args;
+    rp.rules = &rules;
+    rp.players = players;
+    rp.nplayers = args.nifaces;
+    for (i = 0; i < args.nifaces; i++) {
+        players[i].sfd = init_socket(args.ifaces[i]);
+    }
+
+    t0 = monotonic_ns() / 1e9;
+    replay(&rp);
+    if (!args.quiet) {
+        report(&rp, monotonic_ns() / 1e9 - t0);
+    }
+
+    for (i = 0; i < args.nifaces; i++) {
+        cleanup(players[i].sfd);
+    }
+    free(parsed);
+    candump_close(&input);
+    replay_rules_free(&rules);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,896 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Network Server Demo
+
+This program demonstrates sharing CAN interfaces with many clients over the
+network, speaking the protocol of socketcand so that its clients can connect.
+Clients connect over TCP or a Unix socket, open one of the interfaces the
+server was started with, and then either take every frame in raw mode or
+subscribe to the IDs they want in broadcast manager mode.
+
+Each interface is read through one raw socket however many clients there are.
+Subscriptions are kept in a table of subscriber bitmaps indexed by ID (see
+fanout.h), so a frame costs the same to look up for one client as for a
+hundred, is formatted once, and is only copied to the clients which want it.
+Throttled and content filtered subscriptions are handled there too. Cyclic
+transmissions are handed to a broadcast manager socket of the client's own,
+so the kernel sends them on time and stops them when the client goes away.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <netdb.h>
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+#include <linux/can/raw.h>
+
+#include "fanout.h"
+
+#define VERSION "2.0.0"
+
+/* The port socketcand listens on */
+#define DEFAULT_PORT "29536"
+
+#define MAX_IFACES (8)
+#define MAX_CONNS (FANOUT_MAX_CLIENTS)
+
+/* Frames read from an interface in one call */
+#define BATCH (64)
+
+/* Longest command accepted from a client */
+#define MAX_COMMAND (256)
+
+/* Most words of a command, "add SECS USECS ID DLC" and eight bytes */
+#define MAX_WORDS (16)
+
+/* How often to wake up while idle */
+#define IDLE_TIMEOUT_MS (1000)
+
+struct args
+{
+    const char *ifaces[MAX_IFACES];
+    int nifaces;
+    const char *port;       /* NULL if not listening on TCP */
+    const char *unix_path;  /* NULL if not listening on a Unix socket */
+    int quiet;
+};
+
+struct bus
+{
+    const char *name;
+    int ifindex;
+    int sfd;
+    struct fanout fanout;
+    uint64_t frames;
+    uint64_t clients;       /* Clients which opened the bus */
+    uint64_t dropped;       /* Lines lost to clients reading too slowly */
+};
+
+struct conn
+{
+    int fd;                 /* -1 for a free entry */
+    int bus;                /* -1 until an interface is opened */
+    int client;             /* Number in the bus's fan-out */
+    int bcm;                /* Broadcast manager socket, -1 until needed */
+    char in[MAX_COMMAND];
+    size_t fill;
+};
+
+static volatile sig_atomic_t run = 1;
+
+static void on_signal(int)
+{
+    run = 0;
+}
+
+static void init_signals(void)
+{
+    struct sigaction sa;
+    sa.sa_handler = on_signal;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+static int init_socket(const char *iface, int *ifindex)
+{
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int sfd;
+    int rc;
+
+    /* Create a raw CAN socket */
+    sfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+
+    /* Determine the interface index */
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ);
+    rc = ioctl(sfd, SIOCGIFINDEX, &ifr);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "%s", iface);
+    }
+    *ifindex = ifr.ifr_ifindex;
+
+    /* Have the kernel timestamp every received frame */
+    rc = setsockopt(sfd, SOL_SOCKET, SO_TIMESTAMPNS, &(int){1}, sizeof(int));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "setsockopt");
+    }
+
+    /* Frames sent for one client are seen by the others, as with a socket
+     * per client
+     */
+    rc = setsockopt(sfd, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS, &(int){1}, sizeof(int));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "setsockopt");
+    }
+
+    /* Set the local address to bind to */
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    /* Bind the address to the socket */
+    rc = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+
+    return sfd;
+}
+
+/* Listen on [HOST:]PORT over TCP */
+static int init_tcp(const char *spec)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+    char host[256];
+    const char *port = spec;
+    const char *colon = strrchr(spec, ':');
+    int sfd;
+    int rc;
+
+    host[0] = '\0';
+    if (NULL != colon) {
+        if ((size_t)(colon - spec) >= sizeof(host)) {
+            error(EXIT_FAILURE, 0, "invalid address: %s", spec);
+        }
+        memcpy(host, spec, colon - spec);
+        host[colon - spec] = '\0';
+        port = colon + 1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    rc = getaddrinfo('\0' == host[0] ? NULL : host, port, &hints, &res);
+    if (0 != rc) {
+        error(EXIT_FAILURE, 0, "%s: %s", spec, gai_strerror(rc));
+    }
+
+    sfd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+    setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+    if (-1 == bind(sfd, res->ai_addr, res->ai_addrlen) || -1 == listen(sfd, 16)) {
+        error(EXIT_FAILURE, errno, "%s", spec);
+    }
+
+    freeaddrinfo(res);
+    return sfd;
+}
+
+static int init_unix(const char *path)
+{
+    struct sockaddr_un addr;
+    int sfd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        error(EXIT_FAILURE, 0, "path too long: %s", path);
+    }
+    strcpy(addr.sun_path, path);
+
+    /* A socket left behind by an earlier run would make bind() fail */
+    unlink(path);
+
+    sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+    if (-1 == bind(sfd, (struct sockaddr *)&addr, sizeof(addr)) || -1 == listen(sfd, 16)) {
+        error(EXIT_FAILURE, errno, "%s", path);
+    }
+    return sfd;
+}
+
+static void cleanup(int sfd)
+{
+    sigset_t mask;
+    int rc;
+
+    /* Block signals from interfering with graceful shutdown */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    /* Close the socket */
+    rc = close(sfd);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "close");
+    }
+}
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] IFACE[,IFACE...]\n"
+        "\n"
+        "Arguments:\n"
+        "  IFACE    CAN network interfaces clients may open (e.g. can0)\n"
+        "\n"
+        "Options:\n"
+        "  --port, -p [HOST:]PORT  Listen for TCP connections on PORT\n"
+        "                          (default: %s)\n"
+        "  --unix, -u PATH         Listen for connections on a Unix socket at\n"
+        "                          PATH, and on TCP only if --port is given\n"
+        "  --quiet, -q             Do not print statistics at the end\n"
+        "  --help, -h              Display this help then exit\n"
+        "  --version, -V           Display version info then exit\n",
+        progname, DEFAULT_PORT
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *list;
+    char *iface;
+    char *save;
+
+    static const struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"unix", required_argument, NULL, 'u'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "p:u:qVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'p':
+            args->port = optarg;
+            break;
+        case 'u':
+            args->unix_path = optarg;
+            break;
+        case 'q':
+            args->quiet = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 1) {
+        error(0, 0, "an interface argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    if (NULL == args->port && NULL == args->unix_path) {
+        args->port = DEFAULT_PORT;
+    }
+
+    list = argv[optind];
+    for (iface = strtok_r(list, ",", &save); NULL != iface; iface = strtok_r(NULL, ",", &save)) {
+        if (MAX_IFACES == args->nifaces) {
+            error(EXIT_FAILURE, 0, "at most %d interfaces", MAX_IFACES);
+        }
+        args->ifaces[args->nifaces++] = iface;
+    }
+    if (0 == args->nifaces) {
+        error(EXIT_FAILURE, 0, "an interface argument expected");
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/* Queue a reply, or send it straight away before the client opened a bus */
+static void reply(struct bus *buses, struct conn *c, const char *text)
+{
+    if (-1 != c->bus) {
+        fanout_write(&buses[c->bus].fanout, c->client, text, strlen(text));
+    } else {
+        send(c->fd, text, strlen(text), MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+}
+
+/* Parse a hex CAN ID, eight digits being an extended ID */
+static int parse_id(const char *s, canid_t *can_id)
+{
+    char *end;
+    const unsigned long id = strtoul(s, &end, 16);
+
+    if ('\0' != *end || end == s || id > CAN_EFF_MASK) {
+        return -1;
+    }
+    *can_id = id;
+    if (id > CAN_SFF_MASK || 8 == end - s) {
+        *can_id |= CAN_EFF_FLAG;
+    }
+    return 0;
+}
+
+static int parse_uint(const char *s, unsigned long *value)
+{
+    char *end;
+
+    *value = strtoul(s, &end, 10);
+    return ('\0' != *end || end == s) ? -1 : 0;
+}
+
+/* Parse "ID DLC BYTE..." from words into frame */
+static int parse_frame(char **words, int nwords, struct can_frame *frame)
+{
+    unsigned long len;
+    int i;
+
+    memset(frame, 0, sizeof(*frame));
+    if (nwords < 2 || -1 == parse_id(words[0], &frame->can_id) ||
+        -1 == parse_uint(words[1], &len) || len > CAN_MAX_DLEN ||
+        (unsigned long)nwords != 2 + len) {
+        return -1;
+    }
+    frame->len = len;
+
+    for (i = 0; i < (int)len; i++) {
+        char *end;
+        const unsigned long byte = strtoul(words[2 + i], &end, 16);
+        if ('\0' != *end || end == words[2 + i] || byte > 0xFF) {
+            return -1;
+        }
+        frame->data[i] = byte;
+    }
+    return 0;
+}
+
+/* Parse "SECS USECS" into nanoseconds */
+static int parse_interval(char **words, uint64_t *ns, struct bcm_timeval *tv)
+{
+    unsigned long sec;
+    unsigned long usec;
+
+    if (-1 == parse_uint(words[0], &sec) || -1 == parse_uint(words[1], &usec)) {
+        return -1;
+    }
+    *ns = sec * UINT64_C(1000000000) + usec * UINT64_C(1000);
+    if (NULL != tv) {
+        tv->tv_sec = sec;
+        tv->tv_usec = usec;
+    }
+    return 0;
+}
+
+/* Hand a cyclic transmission job to the client's broadcast manager socket */
+static int bcm_write(struct bus *buses, struct conn *c, uint32_t opcode, uint32_t flags,
+                     const struct bcm_timeval *ival, const struct can_frame *frame)
+{
+    struct
+    {
+        struct bcm_msg_head head;
+        struct can_frame frames[1];
+    } msg;
+
+    if (-1 == c->bcm) {
+        struct sockaddr_can addr;
+
+        c->bcm = socket(PF_CAN, SOCK_DGRAM | SOCK_CLOEXEC, CAN_BCM);
+        if (-1 == c->bcm) {
+            return -1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = buses[c->bus].ifindex;
+        if (-1 == connect(c->bcm, (struct sockaddr *)&addr, sizeof(addr))) {
+            close(c->bcm);
+            c->bcm = -1;
+            return -1;
+        }
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.head.opcode = opcode;
+    msg.head.flags = flags;
+    msg.head.can_id = frame->can_id;
+    if (NULL != ival) {
+        msg.head.ival2 = *ival;
+    }
+    if (TX_DELETE != opcode) {
+        msg.head.nframes = 1;
+        msg.frames[0] = *frame;
+    }
+
+    return (-1 == write(c->bcm, &msg, sizeof(msg))) ? -1 : 0;
+}
+
+/* Carry out one command, the words between "<" and ">" */
+static void command(struct bus *buses, int nbuses, struct conn *c, char **w, int n)
+{
+    struct fanout *f = (-1 != c->bus) ? &buses[c->bus].fanout : NULL;
+    struct can_frame frame;
+    struct bcm_timeval tv;
+    uint64_t interval;
+    int i;
+
+    if (0 == n) {
+        return;
+    }
+
+    if (0 == strcmp(w[0], "open") && 2 == n) {
+        if (NULL != f) {
+            reply(buses, c, "< error interface already open >");
+            return;
+        }
+        for (i = 0; i < nbuses; i++) {
+            if (0 == strcmp(w[1], buses[i].name)) {
+                break;
+            }
+        }
+        if (i == nbuses) {
+            reply(buses, c, "< error could not open bus >");
+            return;
+        }
+        c->client = fanout_attach(&buses[i].fanout, c->fd);
+        if (-1 == c->client) {
+            reply(buses, c, "< error too many clients >");
+            return;
+        }
+        c->bus = i;
+        buses[i].clients++;
+        reply(buses, c, "< ok >");
+        return;
+    }
+
+    if (0 == strcmp(w[0], "echo") && 1 == n) {
+        reply(buses, c, "< echo >");
+        return;
+    }
+
+    if (NULL == f) {
+        reply(buses, c, "< error no bus open >");
+        return;
+    }
+
+    if (0 == strcmp(w[0], "rawmode") && 1 == n) {
+        fanout_set_raw(f, c->client, 1);
+        reply(buses, c, "< ok >");
+    } else if (0 == strcmp(w[0], "bcmmode") && 1 == n) {
+        fanout_set_raw(f, c->client, 0);
+        reply(buses, c, "< ok >");
+    } else if (0 == strcmp(w[0], "send") && 0 == parse_frame(w + 1, n - 1, &frame)) {
+        if (-1 == write(buses[c->bus].sfd, &frame, sizeof(frame))) {
+            reply(buses, c, "< error could not send >");
+        }
+    } else if (0 == strcmp(w[0], "add") && n >= 5 &&
+               0 == parse_interval(w + 1, &interval, &tv) &&
+               0 == parse_frame(w + 3, n - 3, &frame)) {
+        if (-1 == bcm_write(buses, c, TX_SETUP, SETTIMER | STARTTIMER, &tv, &frame)) {
+            reply(buses, c, "< error could not add job >");
+        }
+    } else if (0 == strcmp(w[0], "update") && 0 == parse_frame(w + 1, n - 1, &frame)) {
+        if (-1 == bcm_write(buses, c, TX_SETUP, 0, NULL, &frame)) {
+            reply(buses, c, "< error could not update job >");
+        }
+    } else if (0 == strcmp(w[0], "delete") && 2 == n && 0 == parse_id(w[1], &frame.can_id)) {
+        if (-1 == bcm_write(buses, c, TX_DELETE, 0, NULL, &frame)) {
+            reply(buses, c, "< error could not delete job >");
+        }
+    } else if (0 == strcmp(w[0], "subscribe") && 4 == n &&
+               0 == parse_interval(w + 1, &interval, NULL) &&
+               0 == parse_id(w[3], &frame.can_id)) {
+        if (-1 == fanout_subscribe(f, c->client, frame.can_id, interval, NULL)) {
+            reply(buses, c, "< error too many subscriptions >");
+        }
+    } else if (0 == strcmp(w[0], "filter") && n >= 5 &&
+               0 == parse_interval(w + 1, &interval, NULL) &&
+               0 == parse_frame(w + 3, n - 3, &frame)) {
+        /* The payload given is the mask of the bits whose changes count */
+        if (-1 == fanout_subscribe(f, c->client, frame.can_id, interval, frame.data)) {
+            reply(buses, c, "< error too many subscriptions >");
+        }
+    } else if (0 == strcmp(w[0], "unsubscribe") && 2 == n && 0 == parse_id(w[1], &frame.can_id)) {
+        fanout_unsubscribe(f, c->client, frame.can_id);
+    } else {
+        reply(buses, c, "< error unknown command >");
+    }
+}
+
+/* Carry out the complete commands received so far. Returns -1 if the client
+ * sent something which is not a command.
+ */
+static int commands(struct bus *buses, int nbuses, struct conn *c)
+{
+    size_t start = 0;
+    size_t i;
+
+    for (i = 0; i < c->fill; i++) {
+        char *words[MAX_WORDS];
+        char *save;
+        char *word;
+        int n = 0;
+
+        if ('>' != c->in[i]) {
+            continue;
+        }
+
+        /* Skip to the "<" opening the command */
+        while (start < i && '<' != c->in[start]) {
+            start++;
+        }
+        if (start == i) {
+            start = i + 1;
+            continue;
+        }
+
+        c->in[i] = '\0';
+        for (word = strtok_r(&c->in[start + 1], " \t\r\n", &save);
+             NULL != word && n < MAX_WORDS;
+             word = strtok_r(NULL, " \t\r\n", &save)) {
+            words[n++] = word;
+        }
+        command(buses, nbuses, c, words, n);
+        start = i + 1;
+    }
+
+    memmove(c->in, c->in + start, c->fill - start);
+    c->fill -= start;
+
+    /* A command longer than any valid one */
+    return (c->fill == sizeof(c->in)) ? -1 : 0;
+}
+
+static void close_conn(struct bus *buses, struct conn *c)
+{
+    if (-1 != c->bus) {
+        struct bus *bus = &buses[c->bus];
+
+        bus->dropped += bus->fanout.clients[c->client].dropped;
+        fanout_detach(&bus->fanout, c->client);
+    }
+    if (-1 != c->bcm) {
+        close(c->bcm);
+    }
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void accept_conn(int listener, struct conn *conns)
+{
+    const int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    int i;
+
+    if (-1 == fd) {
+        return;
+    }
+
+    for (i = 0; i < MAX_CONNS; i++) {
+        if (-1 == conns[i].fd) {
+            break;
+        }
+    }
+    if (MAX_CONNS == i) {
+        close(fd);
+        return;
+    }
+
+    conns[i].fd = fd;
+    conns[i].bus = -1;
+    conns[i].bcm = -1;
+    conns[i].fill = 0;
+    send(fd, "< hi >", 6, MSG_NOSIGNAL);
+}
+
+/* Read a batch of frames with their receive times and fan them out */
+static void read_bus(struct bus *bus)
+{
+    static struct can_frame frames[BATCH];
+    static char control[BATCH][CMSG_SPACE(sizeof(struct timespec))];
+    static struct mmsghdr msgs[BATCH];
+    static struct iovec iovs[BATCH];
+    uint64_t now = 0;
+    int n;
+    int i;
+
+    for (i = 0; i < BATCH; i++) {
+        iovs[i].iov_base = &frames[i];
+        iovs[i].iov_len = sizeof(frames[i]);
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    n = recvmmsg(bus->sfd, msgs, BATCH, MSG_DONTWAIT, NULL);
+    if (-1 == n) {
+        if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+            error(EXIT_FAILURE, errno, "recvmmsg");
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        struct cmsghdr *cmsg;
+        uint64_t stamp = 0;
+
+        for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); NULL != cmsg;
+             cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+            if (SOL_SOCKET == cmsg->cmsg_level && SO_TIMESTAMPNS == cmsg->cmsg_type) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                stamp = ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+            }
+        }
+
+        /* Fall back to the time of reading if the kernel did not stamp it */
+        if (0 == stamp) {
+            if (0 == now) {
+                now = now_ns();
+            }
+            stamp = now;
+        }
+
+        fanout_frame(&bus->fanout, stamp, &frames[i]);
+    }
+    bus->frames += n;
+}
+
+/* Send what is queued for a client. Returns -1 if the client went away. */
+static int write_conn(struct bus *buses, struct conn *c)
+{
+    struct fanout_client *fc;
+    ssize_t n;
+
+    if (-1 == c->bus) {
+        return 0;
+    }
+    fc = &buses[c->bus].fanout.clients[c->client];
+    if (0 == fc->fill) {
+        return 0;
+    }
+
+    n = send(c->fd, fc->out, fc->fill, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (-1 == n) {
+        return (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) ? 0 : -1;
+    }
+    memmove(fc->out, fc->out + n, fc->fill - n);
+    fc->fill -= n;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static struct conn conns[MAX_CONNS];
+    struct pollfd fds[2 + MAX_IFACES + MAX_CONNS];
+    int who[2 + MAX_IFACES + MAX_CONNS];
+    struct bus buses[MAX_IFACES];
+    struct args args;
+    int listeners[2];
+    int nlisteners = 0;
+    int i;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    init_signals();
+
+    for (i = 0; i < args.nifaces; i++) {
+        buses[i].name = args.ifaces[i];
+        buses[i].sfd = init_socket(args.ifaces[i], &buses[i].ifindex);
+        buses[i].frames = 0;
+        buses[i].clients = 0;
+        buses[i].dropped = 0;
+        if (-1 == fanout_init(&buses[i].fanout)) {
+            error(EXIT_FAILURE, errno, "fanout");
+        }
+    }
+    if (NULL != args.port) {
+        listeners[nlisteners++] = init_tcp(args.port);
+    }
+    if (NULL != args.unix_path) {
+        listeners[nlisteners++] = init_unix(args.unix_path);
+    }
+    for (i = 0; i < MAX_CONNS; i++) {
+        conns[i].fd = -1;
+    }
+
+    while (run) {
+        uint64_t due = UINT64_MAX;
+        int timeout = IDLE_TIMEOUT_MS;
+        uint64_t now;
+        int nfds = 0;
+        int rc;
+
+        for (i = 0; i < nlisteners; i++) {
+            fds[nfds] = (struct pollfd){.fd = listeners[i], .events = POLLIN};
+            who[nfds++] = -1;
+        }
+        for (i = 0; i < args.nifaces; i++) {
+            const uint64_t next = fanout_next_due(&buses[i].fanout);
+            if (next < due) {
+                due = next;
+            }
+            fds[nfds] = (struct pollfd){.fd = buses[i].sfd, .events = POLLIN};
+            who[nfds++] = -1;
+        }
+        for (i = 0; i < MAX_CONNS; i++) {
+            struct conn *c = &conns[i];
+            short events = POLLIN;
+
+            if (-1 == c->fd) {
+                continue;
+            }
+            if (-1 != c->bus && buses[c->bus].fanout.clients[c->client].fill > 0) {
+                events |= POLLOUT;
+            }
+            fds[nfds] = (struct pollfd){.fd = c->fd, .events = events};
+            who[nfds++] = i;
+        }
+
+        /* Wake up for the frames held back by throttles */
+        if (UINT64_MAX != due) {
+            now = now_ns();
+            timeout = (due > now) ? (int)((due - now) / 1000000 + 1) : 0;
+            if (timeout > IDLE_TIMEOUT_MS) {
+                timeout = IDLE_TIMEOUT_MS;
+            }
+        }
+
+        rc = poll(fds, nfds, timeout);
+        if (-1 == rc) {
+            if (EINTR == errno) {
+                continue;
+            }
+            error(EXIT_FAILURE, errno, "poll");
+        }
+
+        for (i = 0; i < nlisteners; i++) {
+            if (fds[i].revents & POLLIN) {
+                accept_conn(listeners[i], conns);
+            }
+        }
+        for (i = 0; i < args.nifaces; i++) {
+            if (fds[nlisteners + i].revents & POLLIN) {
+                read_bus(&buses[i]);
+            }
+        }
+
+        now = now_ns();
+        for (i = 0; i < args.nifaces; i++) {
+            fanout_due(&buses[i].fanout, now);
+        }
+
+        for (i = nlisteners + args.nifaces; i < nfds; i++) {
+            struct conn *c = &conns[who[i]];
+
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                const ssize_t n = recv(c->fd, c->in + c->fill, sizeof(c->in) - c->fill,
+                                       MSG_DONTWAIT);
+                if (0 == n || (-1 == n && EAGAIN != errno && EINTR != errno)) {
+                    close_conn(buses, c);
+                    continue;
+                }
+                if (n > 0) {
+                    c->fill += n;
+                    if (-1 == commands(buses, args.nifaces, c)) {
+                        close_conn(buses, c);
+                        continue;
+                    }
+                }
+            }
+        }
+
+        /* Send what the frames and commands queued for each client */
+        for (i = 0; i < MAX_CONNS; i++) {
+            if (-1 != conns[i].fd && -1 == write_conn(buses, &conns[i])) {
+                close_conn(buses, &conns[i]);
+            }
+        }
+    }
+
+    for (i = 0; i < MAX_CONNS; i++) {
+        if (-1 != conns[i].fd) {
+            close_conn(buses, &conns[i]);
+        }
+    }
+    for (i = 0; i < nlisteners; i++) {
+        cleanup(listeners[i]);
+    }
+    if (NULL != args.unix_path) {
+        unlink(args.unix_path);
+    }
+
+    for (i = 0; i < args.nifaces; i++) {
+        struct fanout *f = &buses[i].fanout;
+
+        if (!args.quiet) {
+            printf("%s: %llu frames, %llu clients, %llu lines dropped\n", buses[i].name,
+                   (unsigned long long)buses[i].frames, (unsigned long long)buses[i].clients,
+                   (unsigned long long)buses[i].dropped);
+        }
+        fanout_free(f);
+        cleanup(buses[i].sfd);
+    }
+    return EXIT_SUCCESS;
+}
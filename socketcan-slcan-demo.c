@@ -0,0 +1,582 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Serial Line Bridge Demo
+
+This program demonstrates joining a SocketCAN interface to a CAN adapter on a
+serial line which speaks the SLCAN (Lawicel) ASCII protocol, such as most USB
+serial dongles. Frames received on the interface are written to the adapter,
+and frames the adapter receives are sent out on the interface. With a virtual
+interface this makes a dongle usable by SocketCAN tools without slcand.
+
+The serial line is the narrow part. A full 1 Mbit/s bus takes about 250 kB/s
+of ASCII, so frames read from the interface are encoded into one buffer and
+handed to the tty with one write() per batch, and while the tty is not taking
+data no more frames are read, leaving them queued in the socket rather than
+overrunning the line. Input is read in large blocks and split into lines in
+place, keeping a partial line for the next read. Payloads are converted to and
+from hex with vector operations (see slcan.h).
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <error.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "slcan.h"
+
+#define VERSION "2.0.0"
+
+/* Frames read from, or written to, the CAN socket in one call */
+#define CAN_BATCH (64)
+
+/* Bytes read from the tty in one call */
+#define IN_SIZE (65536)
+
+/* Bytes waiting to be written to the tty */
+#define OUT_SIZE (65536)
+
+/* Room past the end of the input for the vector loads of a payload */
+#define SLACK (16)
+
+/* How long to wait for room in the CAN transmit queue before dropping */
+#define TX_WAIT_MS (10)
+
+/* How often to wake up while both sides are idle */
+#define IDLE_TIMEOUT_MS (100)
+
+struct args
+{
+    const char *iface;
+    const char *tty;
+    unsigned long bitrate;  /* Set on the adapter, 0 to leave it */
+    unsigned long baud;     /* Set on the tty, 0 to leave it */
+    int quiet;
+};
+
+struct stats
+{
+    uint64_t frames_out;    /* CAN to tty */
+    uint64_t bytes_out;
+    uint64_t writes;
+    uint64_t frames_in;     /* tty to CAN */
+    uint64_t bytes_in;
+    uint64_t replies;       /* Lines which are not frames */
+    uint64_t errors;        /* Error replies from the adapter */
+    uint64_t malformed;
+    uint64_t dropped;       /* Frames the CAN interface had no room for */
+};
+
+static volatile sig_atomic_t run = 1;
+
+static void on_signal(int)
+{
+    run = 0;
+}
+
+static void init_signals(void)
+{
+    struct sigaction sa;
+    sa.sa_handler = on_signal;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+static int init_socket(const char *iface)
+{
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+    int sfd;
+    int rc;
+
+    /* Create a raw CAN socket */
+    sfd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (-1 == sfd) {
+        error(EXIT_FAILURE, errno, "socket");
+    }
+
+    /* Determine the interface index */
+    strncpy(ifr.ifr_name, iface, IFNAMSIZ);
+    rc = ioctl(sfd, SIOCGIFINDEX, &ifr);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "ioctl");
+    }
+
+    /* Set the local address to bind to */
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+
+    /* Bind the address to the socket */
+    rc = bind(sfd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "bind");
+    }
+
+    return sfd;
+}
+
+static speed_t baud_constant(unsigned long baud)
+{
+    static const struct
+    {
+        unsigned long baud;
+        speed_t speed;
+    } speeds[] = {
+        {9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600},
+        {115200, B115200}, {230400, B230400}, {460800, B460800}, {500000, B500000},
+        {921600, B921600}, {1000000, B1000000}, {1500000, B1500000},
+        {2000000, B2000000}, {3000000, B3000000}, {4000000, B4000000},
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        if (speeds[i].baud == baud) {
+            return speeds[i].speed;
+        }
+    }
+    return B0;
+}
+
+/* Open the tty in raw mode, not blocking */
+static int init_tty(const struct args *args)
+{
+    struct termios tio;
+    int fd;
+
+    fd = open(args->tty, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (-1 == fd) {
+        error(EXIT_FAILURE, errno, "%s", args->tty);
+    }
+    if (-1 == tcgetattr(fd, &tio)) {
+        error(EXIT_FAILURE, errno, "%s", args->tty);
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (0 != args->baud && -1 == cfsetspeed(&tio, baud_constant(args->baud))) {
+        error(EXIT_FAILURE, errno, "%s", args->tty);
+    }
+    if (-1 == tcsetattr(fd, TCSANOW, &tio)) {
+        error(EXIT_FAILURE, errno, "%s", args->tty);
+    }
+    tcflush(fd, TCIOFLUSH);
+
+    return fd;
+}
+
+/* Write a command to the adapter, waiting for the tty to take it */
+static void command(int tty, const char *cmd)
+{
+    size_t done = 0;
+    const size_t len = strlen(cmd);
+
+    while (done < len) {
+        const ssize_t n = write(tty, cmd + done, len - done);
+        if (-1 == n) {
+            if (EAGAIN == errno || EINTR == errno) {
+                struct pollfd pfd = {.fd = tty, .events = POLLOUT};
+                poll(&pfd, 1, IDLE_TIMEOUT_MS);
+                continue;
+            }
+            error(EXIT_FAILURE, errno, "write");
+        }
+        done += n;
+    }
+}
+
+/* Set the adapter up and open its channel */
+static void init_adapter(int tty, const struct args *args)
+{
+    char cmd[8];
+
+    /* Empty lines flush any half sent command, then close the channel in
+     * case it was left open, as bitrates can only be set while closed
+     */
+    command(tty, "\r\r\rC\r");
+    if (0 != args->bitrate) {
+        snprintf(cmd, sizeof(cmd), "S%d\r", slcan_bitrate(args->bitrate));
+        command(tty, cmd);
+    }
+    command(tty, "O\r");
+}
+
+static void cleanup(int sfd)
+{
+    sigset_t mask;
+    int rc;
+
+    /* Block signals from interfering with graceful shutdown */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    /* Close the socket */
+    rc = close(sfd);
+    if (-1 == rc) {
+        error(EXIT_FAILURE, errno, "close");
+    }
+}
+
+static void print_help(const char *progname)
+{
+    printf(
+        "Usage: %s [OPTIONS] IFACE TTY\n"
+        "\n"
+        "Arguments:\n"
+        "  IFACE    CAN network interface (e.g. vcan0)\n"
+        "  TTY      Serial line of the SLCAN adapter (e.g. /dev/ttyACM0)\n"
+        "\n"
+        "Options:\n"
+        "  --bitrate, -b BPS  Set the adapter's CAN bitrate, from 10000 to\n"
+        "                     1000000 (default: leave it as it is)\n"
+        "  --baud, -B BAUD    Set the serial line's speed (default: leave it)\n"
+        "  --quiet, -q        Do not print statistics at the end\n"
+        "  --help, -h         Display this help then exit\n"
+        "  --version, -V      Display version info then exit\n",
+        progname
+    );
+}
+
+static void print_version(void)
+{
+    puts(VERSION);
+}
+
+static void parse_args(int argc, char **argv, struct args *args)
+{
+    const char *progname = program_invocation_short_name;
+    char *end;
+
+    static const struct option long_options[] = {
+        {"bitrate", required_argument, NULL, 'b'},
+        {"baud", required_argument, NULL, 'B'},
+        {"quiet", no_argument, NULL, 'q'},
+        {"help", no_argument, NULL, 'h'},
+        {"version", no_argument, NULL, 'V'},
+        {0, 0, 0, 0}
+    };
+
+    memset(args, 0, sizeof(*args));
+
+    for (;;) {
+        const int opt = getopt_long(argc, argv, "b:B:qVh", long_options, NULL);
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+        case 'b':
+            args->bitrate = strtoul(optarg, &end, 0);
+            if ('\0' != *end || -1 == slcan_bitrate(args->bitrate)) {
+                error(EXIT_FAILURE, 0, "invalid bitrate: %s", optarg);
+            }
+            break;
+        case 'B':
+            args->baud = strtoul(optarg, &end, 0);
+            if ('\0' != *end || B0 == baud_constant(args->baud)) {
+                error(EXIT_FAILURE, 0, "invalid baud rate: %s", optarg);
+            }
+            break;
+        case 'q':
+            args->quiet = 1;
+            break;
+        case 'V':
+            print_version();
+            exit(EXIT_SUCCESS);
+        case 'h':
+            print_help(progname);
+            exit(EXIT_SUCCESS);
+        default:
+            print_help(progname);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((argc - optind) != 2) {
+        error(0, 0, "an interface and a tty argument expected");
+        print_help(progname);
+        exit(EXIT_FAILURE);
+    }
+
+    args->iface = argv[optind];
+    args->tty = argv[optind + 1];
+}
+
+/* Read up to CAN_BATCH frames waiting on the CAN socket, returning how many */
+static int read_frames(int can, struct can_frame *frames)
+{
+    static struct mmsghdr msgs[CAN_BATCH];
+    static struct iovec iovs[CAN_BATCH];
+    int n;
+    int i;
+
+    for (i = 0; i < CAN_BATCH; i++) {
+        iovs[i].iov_base = &frames[i];
+        iovs[i].iov_len = sizeof(frames[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    n = recvmmsg(can, msgs, CAN_BATCH, MSG_DONTWAIT, NULL);
+    if (-1 == n) {
+        if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+            error(EXIT_FAILURE, errno, "recvmmsg");
+        }
+        return 0;
+    }
+    return n;
+}
+
+/* Write frames to the CAN socket a batch at a time, waiting a little for room
+ * in its transmit queue before dropping them
+ */
+static void write_frames(int can, struct can_frame *frames, unsigned int count,
+                         struct stats *stats)
+{
+    static struct mmsghdr msgs[CAN_BATCH];
+    static struct iovec iovs[CAN_BATCH];
+    unsigned int done = 0;
+    int waited = 0;
+
+    while (done < count) {
+        const unsigned int batch = (count - done < CAN_BATCH) ? count - done : CAN_BATCH;
+        unsigned int i;
+        int n;
+
+        for (i = 0; i < batch; i++) {
+            iovs[i].iov_base = &frames[done + i];
+            iovs[i].iov_len = sizeof(frames[0]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        n = sendmmsg(can, msgs, batch, 0);
+        if (-1 == n) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if ((ENOBUFS == errno || EAGAIN == errno) && !waited) {
+                struct pollfd pfd = {.fd = can, .events = POLLOUT};
+                poll(&pfd, 1, TX_WAIT_MS);
+                waited = 1;
+                continue;
+            }
+            stats->dropped += count - done;
+            return;
+        }
+        done += n;
+        waited = 0;
+    }
+}
+
+/* Split the input into lines and send the frames among them. Returns the
+ * number of bytes consumed, which stops short of a partial line.
+ */
+static size_t tty_to_can(int can, const char *in, size_t fill, struct stats *stats)
+{
+    static struct can_frame frames[IN_SIZE / 5];
+    const char *p = in;
+    const char *const end = in + fill;
+    unsigned int count = 0;
+
+    while (p < end) {
+        const char *cr;
+        int rc;
+
+        /* The adapter answers a command it could not carry out with a bell,
+         * and some follow their carriage returns with a line feed
+         */
+        if ('\a' == *p) {
+            stats->errors++;
+            p++;
+            continue;
+        }
+        if ('\n' == *p) {
+            p++;
+            continue;
+        }
+
+        cr = memchr(p, '\r', end - p);
+        if (NULL == cr) {
+            break;
+        }
+
+        rc = slcan_decode(p, cr - p, &frames[count]);
+        if (0 == rc) {
+            count++;
+        } else if (1 == rc) {
+            stats->replies++;
+        } else {
+            stats->malformed++;
+        }
+        p = cr + 1;
+    }
+
+    if (count > 0) {
+        write_frames(can, frames, count, stats);
+        stats->frames_in += count;
+    }
+    return p - in;
+}
+
+int main(int argc, char **argv)
+{
+    static struct can_frame batch[CAN_BATCH];
+    static char in[IN_SIZE + SLACK];
+    static char out[OUT_SIZE];
+    struct stats stats;
+    struct args args;
+    size_t infill = 0;
+    size_t outfill = 0;
+    int can;
+    int tty;
+
+    program_invocation_name = program_invocation_short_name;
+
+    parse_args(argc, argv, &args);
+    init_signals();
+    can = init_socket(args.iface);
+    tty = init_tty(&args);
+    init_adapter(tty, &args);
+    memset(&stats, 0, sizeof(stats));
+
+    while (run) {
+        /* Read frames only while a whole batch of them fits the output */
+        const int room = outfill + CAN_BATCH * SLCAN_MAX_LINE <= OUT_SIZE;
+        struct pollfd fds[2] = {
+            {.fd = can, .events = room ? POLLIN : 0},
+            {.fd = tty, .events = POLLIN | (outfill > 0 ? POLLOUT : 0)},
+        };
+        struct timespec ts = {
+            .tv_sec = 0,
+            .tv_nsec = IDLE_TIMEOUT_MS * 1000000L,
+        };
+
+        if (-1 == ppoll(fds, 2, &ts, NULL)) {
+            if (EINTR == errno) {
+                continue;
+            }
+            error(EXIT_FAILURE, errno, "ppoll");
+        }
+
+        if (fds[0].revents & POLLIN) {
+            const int n = read_frames(can, batch);
+            int i;
+
+            for (i = 0; i < n; i++) {
+                outfill += slcan_encode(out + outfill, &batch[i]);
+            }
+            stats.frames_out += n;
+        }
+
+        /* Everything encoded goes to the tty in one write */
+        if (outfill > 0) {
+            const ssize_t n = write(tty, out, outfill);
+            if (-1 == n) {
+                if (EAGAIN != errno && EINTR != errno) {
+                    error(EXIT_FAILURE, errno, "write");
+                }
+            } else {
+                memmove(out, out + n, outfill - n);
+                outfill -= n;
+                stats.bytes_out += n;
+                stats.writes++;
+            }
+        }
+
+        if (fds[1].revents & (POLLHUP | POLLERR) && !(fds[1].revents & POLLIN)) {
+            error(0, 0, "%s: hung up", args.tty);
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            const ssize_t n = read(tty, in + infill, IN_SIZE - infill);
+            size_t used;
+
+            if (-1 == n) {
+                if (EAGAIN != errno && EINTR != errno) {
+                    error(EXIT_FAILURE, errno, "read");
+                }
+                continue;
+            }
+            infill += n;
+            stats.bytes_in += n;
+
+            used = tty_to_can(can, in, infill, &stats);
+
+            /* A buffer without a single line end holds no frames */
+            if (0 == used && IN_SIZE == infill) {
+                stats.malformed++;
+                used = infill;
+            }
+            memmove(in, in + used, infill - used);
+            infill -= used;
+        }
+    }
+
+    /* Close the adapter's channel so it stops sending */
+    if (run == 0 && -1 == write(tty, "C\r", 2)) {
+        error(0, errno, "%s: closing the channel", args.tty);
+    }
+
+    if (!args.quiet) {
+        printf("CAN to tty: %llu frames, %.1f bytes/frame, %llu writes (%.1f frames/write)\n",
+               (unsigned long long)stats.frames_out,
+               stats.frames_out ? (double)stats.bytes_out / stats.frames_out : 0.0,
+               (unsigned long long)stats.writes,
+               stats.writes ? (double)stats.frames_out / stats.writes : 0.0);
+        printf("tty to CAN: %llu frames, %llu replies, %llu errors, %llu malformed, "
+               "%llu frames dropped\n",
+               (unsigned long long)stats.frames_in, (unsigned long long)stats.replies,
+               (unsigned long long)stats.errors, (unsigned long long)stats.malformed,
+               (unsigned long long)stats.dropped);
+    }
+
+    cleanup(tty);
+    cleanup(can);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Single Producer Single Consumer Queue
+
+A bounded, lock-free queue of fixed size elements for handing work from the
+receive loop to a helper thread. The producer never blocks: when the queue is
+full the element is refused and the caller decides what to drop. Head and
+tail live on separate cache lines, and each side keeps a cached copy of the
+other side's index so that it only touches the shared line when it appears to
+have run out of room or elements.
+*/
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPSC_CACHE_LINE (64)
+
+struct spsc
+{
+    /* Producer side */
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t head;
+    size_t tail_cache;
+
+    /* Consumer side */
+    _Alignas(SPSC_CACHE_LINE) atomic_size_t tail;
+    size_t head_cache;
+
+    /* Read-only after initialisation */
+    _Alignas(SPSC_CACHE_LINE) unsigned char *buf;
+    size_t mask;
+    size_t elem_size;
+};
+
+/* Set up a queue for at least capacity elements of elem_size bytes. Returns 0
+ * on success and -1 on allocation failure.
+ */
+static inline int spsc_init(struct spsc *q, size_t capacity, size_t elem_size)
+{
+    size_t n = 2;
+
+    while (n < capacity) {
+        n *= 2;
+    }
+
+    q->buf = malloc(n * elem_size);
+    if (NULL == q->buf) {
+        return -1;
+    }
+
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    q->tail_cache = 0;
+    q->head_cache = 0;
+    q->mask = n - 1;
+    q->elem_size = elem_size;
+    return 0;
+}
+
+static inline void spsc_free(struct spsc *q)
+{
+    free(q->buf);
+    q->buf = NULL;
+}
+
+/* Append an element. Returns 0 on success and -1 if the queue is full. */
+static inline int spsc_push(struct spsc *q, const void *elem)
+{
+    const size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (head - q->tail_cache > q->mask) {
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head - q->tail_cache > q->mask) {
+            return -1;
+        }
+    }
+
+    memcpy(q->buf + (head & q->mask) * q->elem_size, elem, q->elem_size);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return 0;
+}
+
+/* Remove the oldest element. Returns 0 on success and -1 if the queue is
+ * empty.
+ */
+static inline int spsc_pop(struct spsc *q, void *elem)
+{
+    const size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail == q->head_cache) {
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail == q->head_cache) {
+            return -1;
+        }
+    }
+
+    memcpy(elem, q->buf + (tail & q->mask) * q->elem_size, q->elem_size);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+#endif /* SPSC_H */
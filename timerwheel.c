@@ -0,0 +1,228 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Timer Wheel
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "timerwheel.h"
+
+#define MASK (TIMERWHEEL_SLOTS - 1)
+
+/* Ticks reached by the top level */
+#define SPAN ((uint64_t)1 << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS))
+
+int timerwheel_init(struct timerwheel *w, uint32_t capacity, uint64_t tick, uint64_t now)
+{
+    uint32_t i;
+    int l;
+    int s;
+
+    if (0 == capacity || capacity > INT32_MAX || 0 == tick) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    w->timers = malloc((size_t)capacity * sizeof(*w->timers));
+    if (NULL == w->timers) {
+        return -1;
+    }
+
+    for (i = 0; i < capacity; i++) {
+        w->timers[i].next = (i + 1 < capacity) ? i + 1 : TIMERWHEEL_NONE;
+    }
+    for (l = 0; l < TIMERWHEEL_LEVELS; l++) {
+        for (s = 0; s < TIMERWHEEL_SLOTS; s++) {
+            w->slots[l][s].head = TIMERWHEEL_NONE;
+        }
+        w->occupied[l] = 0;
+    }
+
+    w->start = now;
+    w->tick = tick;
+    w->now = 0;
+    w->capacity = capacity;
+    w->free = 0;
+    w->used = 0;
+    w->pending = 0;
+    w->expired.head = TIMERWHEEL_NONE;
+    return 0;
+}
+
+void timerwheel_free(struct timerwheel *w)
+{
+    free(w->timers);
+}
+
+static void append(struct timerwheel *w, struct timerwheel_list *list, uint32_t t)
+{
+    w->timers[t].next = TIMERWHEEL_NONE;
+    if (TIMERWHEEL_NONE == list->head) {
+        list->head = t;
+    } else {
+        w->timers[list->tail].next = t;
+    }
+    list->tail = t;
+}
+
+/* File a timer by its expiry */
+static void place(struct timerwheel *w, uint32_t t)
+{
+    const uint64_t tick = w->timers[t].expires;
+    int l = 0;
+    int s;
+
+    if (tick <= w->now) {
+        append(w, &w->expired, t);
+        return;
+    }
+
+    /* The lowest level that reaches the tick before coming round again. As
+     * no timer goes in a level for ticks it will pass through on this turn,
+     * moving timers down never puts them behind ones set later.
+     */
+    while (l < TIMERWHEEL_LEVELS - 1 &&
+           tick >> (TIMERWHEEL_BITS * (l + 1)) != w->now >> (TIMERWHEEL_BITS * (l + 1))) {
+        l++;
+    }
+    s = (tick >> (TIMERWHEEL_BITS * l)) & MASK;
+    append(w, &w->slots[l][s], t);
+    w->occupied[l] |= UINT64_C(1) << s;
+    w->pending++;
+}
+
+void timerwheel_schedule(struct timerwheel *w, uint32_t t, uint64_t when)
+{
+    uint64_t tick = 0;
+
+    /* Round up, so the timer never expires early */
+    if (when > w->start) {
+        tick = (when - w->start + w->tick - 1) / w->tick;
+    }
+    if (tick >= w->now + SPAN) {
+        tick = w->now + SPAN - 1;
+    }
+    w->timers[t].expires = tick;
+    place(w, t);
+}
+
+int timerwheel_add(struct timerwheel *w, uint64_t when)
+{
+    const uint32_t t = w->free;
+
+    if (TIMERWHEEL_NONE == t) {
+        return -1;
+    }
+    w->free = w->timers[t].next;
+    w->used++;
+    timerwheel_schedule(w, t, when);
+    return t;
+}
+
+/* Take the timers out of a slot, returning the first */
+static uint32_t empty(struct timerwheel *w, int l, int s)
+{
+    const uint32_t t = w->slots[l][s].head;
+
+    w->slots[l][s].head = TIMERWHEEL_NONE;
+    w->occupied[l] &= ~(UINT64_C(1) << s);
+    return t;
+}
+
+/* Expire the current tick, first moving down the timers of the higher levels
+ * that have come due, from the top
+ */
+static void expire(struct timerwheel *w)
+{
+    uint32_t t;
+    int top = 0;
+    int l;
+
+    while (top < TIMERWHEEL_LEVELS - 1 &&
+           0 == (w->now & (((uint64_t)1 << (TIMERWHEEL_BITS * (top + 1))) - 1))) {
+        top++;
+    }
+
+    for (l = top; l > 0; l--) {
+        t = empty(w, l, (w->now >> (TIMERWHEEL_BITS * l)) & MASK);
+        while (TIMERWHEEL_NONE != t) {
+            const uint32_t next = w->timers[t].next;
+            w->pending--;
+            place(w, t);
+            t = next;
+        }
+    }
+
+    t = empty(w, 0, w->now & MASK);
+    while (TIMERWHEEL_NONE != t) {
+        const uint32_t next = w->timers[t].next;
+        w->pending--;
+        append(w, &w->expired, t);
+        t = next;
+    }
+}
+
+/* The next slot in use of the first level, after the current tick, or the
+ * first level coming round if there is none
+ */
+static uint64_t next_tick(const struct timerwheel *w)
+{
+    const uint64_t later = w->occupied[0] & ~((UINT64_C(2) << (w->now & MASK)) - 1);
+
+    if (0 == later) {
+        return (w->now | MASK) + 1;
+    }
+    return (w->now & ~(uint64_t)MASK) + __builtin_ctzll(later);
+}
+
+void timerwheel_advance(struct timerwheel *w, uint64_t now)
+{
+    const uint64_t target = (now > w->start) ? (now - w->start) / w->tick : 0;
+
+    while (w->now < target) {
+        const uint64_t next = next_tick(w);
+
+        if (0 == w->pending || next > target) {
+            w->now = target;
+            break;
+        }
+        w->now = next;
+        expire(w);
+    }
+}
+
+uint64_t timerwheel_deadline(const struct timerwheel *w)
+{
+    if (TIMERWHEEL_NONE != w->expired.head) {
+        return w->start + w->now * w->tick;
+    }
+    if (0 == w->pending) {
+        return UINT64_MAX;
+    }
+
+    return w->start + next_tick(w) * w->tick;
+}
@@ -0,0 +1,136 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Timer Wheel
+
+Holds timers, such as frames waiting out a delay, and hands them back once
+they expire, at a constant cost per timer however many are waiting.
+
+Time is counted in ticks of a fixed length. Each of TIMERWHEEL_LEVELS levels
+is a ring of TIMERWHEEL_SLOTS slots, every slot a list of timers. A slot of
+the first level holds the timers of one tick, a slot of the next level those
+of TIMERWHEEL_SLOTS ticks, and so on. A timer goes in the lowest level that
+reaches its expiry before coming round again. As time passes the first level
+is walked a tick at a time, and each time it comes round, the slot of the
+level above that has come due is emptied into the levels below. A timer
+therefore moves at most TIMERWHEEL_LEVELS - 1 times. Timers expiring beyond
+the reach of the top level, TIMERWHEEL_SLOTS ^ TIMERWHEEL_LEVELS ticks, are
+kept at its edge and so come back early, for the caller to set again.
+
+Expiry is rounded up to the next tick, so no timer within reach expires
+early, and timers expiring in the same tick come back in the order they were
+set. Each level keeps a bitmap of its slots in use, so time skips from one
+slot in use to the next without walking the empty ones.
+
+Timers are numbered from 0 to the capacity, so the caller keeps what they are
+for in an array of its own.
+*/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+
+#define TIMERWHEEL_BITS (6)
+#define TIMERWHEEL_SLOTS (1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_LEVELS (4)
+
+/* No timer, ending a list */
+#define TIMERWHEEL_NONE (UINT32_MAX)
+
+struct timerwheel_list
+{
+    uint32_t head;
+    uint32_t tail;
+};
+
+struct timerwheel_timer
+{
+    uint64_t expires;           /* Tick it expires at */
+    uint32_t next;              /* Next timer in the same list */
+};
+
+struct timerwheel
+{
+    uint64_t start;             /* Time of tick 0 in nanoseconds */
+    uint64_t tick;              /* Length of a tick in nanoseconds */
+    uint64_t now;               /* Last tick expired */
+    struct timerwheel_timer *timers;
+    uint32_t capacity;
+    uint32_t free;              /* First unused timer */
+    uint32_t used;              /* Timers set, expired or not */
+    uint32_t pending;           /* Timers not expired yet */
+    uint64_t occupied[TIMERWHEEL_LEVELS];
+    struct timerwheel_list slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+    struct timerwheel_list expired;
+};
+
+/* Set up a wheel for up to capacity timers, counting ticks of tick
+ * nanoseconds from now. Returns 0 on success, or -1 with errno set.
+ */
+int timerwheel_init(struct timerwheel *w, uint32_t capacity, uint64_t tick, uint64_t now);
+
+void timerwheel_free(struct timerwheel *w);
+
+/* Set a new timer expiring at when, in nanoseconds. Returns its number, or
+ * -1 if the wheel is full.
+ */
+int timerwheel_add(struct timerwheel *w, uint64_t when);
+
+/* Set an expired timer, taken with timerwheel_next(), again */
+void timerwheel_schedule(struct timerwheel *w, uint32_t t, uint64_t when);
+
+/* Expire the timers due by now, in nanoseconds */
+void timerwheel_advance(struct timerwheel *w, uint64_t now);
+
+/* Take the next expired timer, returning its number, or -1 if none has
+ * expired. It stays in use until released or scheduled again.
+ */
+static inline int timerwheel_next(struct timerwheel *w)
+{
+    const uint32_t t = w->expired.head;
+
+    if (TIMERWHEEL_NONE == t) {
+        return -1;
+    }
+    w->expired.head = w->timers[t].next;
+    return t;
+}
+
+/* Release a timer taken with timerwheel_next() */
+static inline void timerwheel_release(struct timerwheel *w, uint32_t t)
+{
+    w->timers[t].next = w->free;
+    w->free = t;
+    w->used--;
+}
+
+/* When timerwheel_advance() should next be called, in nanoseconds, or
+ * UINT64_MAX if no timer is pending. This is the next expiry, or earlier when
+ * timers must move down a level first.
+ */
+uint64_t timerwheel_deadline(const struct timerwheel *w);
+
+#endif /* TIMERWHEEL_H */
@@ -0,0 +1,262 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Inter-Arrival Timing Statistics
+
+The nominal cycle is seeded, once a few intervals have been seen, from an
+interval falling in the fullest histogram bucket. From then on every interval
+within a tolerance of the cycle nudges it (an exponential moving average), so
+the estimate follows slow clock drift of the sending ECU. Intervals outside
+the tolerance are outliers: late frames, lost frames or bursts. A long run of
+outliers means the ID changed its rate, and the cycle is learned again.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+
+/* Intervals seen before a cycle is inferred */
+#define LEARN_INTERVALS (8)
+
+/* Consecutive outliers after which the cycle is learned again */
+#define RELEARN_STREAK (16)
+
+/* Largest deviation from the cycle, as a fraction of it, which still counts
+ * as on time
+ */
+#define TOLERANCE (0.25)
+
+/* Weight of a new interval in the moving averages, as a power of two */
+#define SMOOTHING (4)
+
+/* Share of intervals which must match the cycle for an ID to be cyclic */
+#define CYCLIC_SHARE (0.8)
+
+int timing_init(struct timing *t, uint32_t capacity)
+{
+    memset(t, 0, sizeof(*t));
+
+    t->entries = idtable_init_entries(&t->index, capacity, sizeof(*t->entries));
+    if (NULL == t->entries) {
+        return -1;
+    }
+
+    t->capacity = capacity;
+    return 0;
+}
+
+void timing_free(struct timing *t)
+{
+    idtable_free(&t->index);
+    free(t->entries);
+    memset(t, 0, sizeof(*t));
+}
+
+static unsigned int bucket(uint64_t interval)
+{
+    const uint64_t us = interval / 1000;
+    const unsigned int b = us ? 64 - __builtin_clzll(us) : 0;
+    return (b < TIMING_BUCKETS) ? b : TIMING_BUCKETS - 1;
+}
+
+static unsigned int fullest_bucket(const struct timing_entry *e)
+{
+    unsigned int best = 0;
+    unsigned int i;
+
+    for (i = 1; i < TIMING_BUCKETS; i++) {
+        if (e->hist[i] > e->hist[best]) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void track_cycle(struct timing_entry *e, uint64_t interval)
+{
+    double deviation;
+
+    if (0 == e->cycle) {
+        if (e->count >= LEARN_INTERVALS && bucket(interval) == fullest_bucket(e)) {
+            e->cycle = interval;
+            e->jitter = 0;
+            e->streak = 0;
+        }
+        return;
+    }
+
+    deviation = fabs(interval - e->cycle);
+    if (deviation <= e->cycle * TOLERANCE) {
+        e->cycle += (interval - e->cycle) / (1 << SMOOTHING);
+        e->jitter += (deviation - e->jitter) / (1 << SMOOTHING);
+        e->in_cycle++;
+        e->streak = 0;
+        return;
+    }
+
+    e->outliers++;
+    e->recent_outliers++;
+    if (++e->streak >= RELEARN_STREAK) {
+        e->cycle = 0;
+    }
+}
+
+void timing_add(struct timing *t, uint64_t stamp, const struct can_frame *frame)
+{
+    const uint32_t key = idtable_key(frame->can_id);
+    struct timing_entry *e;
+    uint64_t interval;
+    double delta;
+    uint32_t i;
+
+    i = idtable_find(&t->index, key);
+    if (IDTABLE_EMPTY == i) {
+        i = t->index.count;
+        if (1 != idtable_insert(&t->index, key, i)) {
+            t->dropped++;
+            return;
+        }
+
+        /* The first frame only starts the clock */
+        e = &t->entries[i];
+        e->can_id = key;
+        e->previous = stamp;
+        e->min = UINT64_MAX;
+        return;
+    }
+
+    e = &t->entries[i];
+    interval = (stamp > e->previous) ? stamp - e->previous : 0;
+    e->previous = stamp;
+
+    /* Welford's streaming mean and variance */
+    e->count++;
+    delta = interval - e->mean;
+    e->mean += delta / e->count;
+    e->m2 += delta * (interval - e->mean);
+
+    e->min = (interval < e->min) ? interval : e->min;
+    e->max = (interval > e->max) ? interval : e->max;
+    e->hist[bucket(interval)]++;
+
+    track_cycle(e, interval);
+}
+
+static int compare_ids(const void *a, const void *b)
+{
+    const struct timing_entry *x = *(const struct timing_entry *const *)a;
+    const struct timing_entry *y = *(const struct timing_entry *const *)b;
+    return (x->can_id > y->can_id) - (x->can_id < y->can_id);
+}
+
+/* Render the histogram with one character per bucket, shaded relative to the
+ * fullest bucket
+ */
+static void print_histogram(FILE *fp, const struct timing_entry *e)
+{
+    static const char shades[] = " .:-=+*#";
+    const uint32_t top = e->hist[fullest_bucket(e)];
+    unsigned int i;
+
+    for (i = 0; i < TIMING_BUCKETS; i++) {
+        const uint32_t n = e->hist[i];
+        size_t level = 0;
+        if (n > 0) {
+            level = 1 + (size_t)((sizeof(shades) - 3) * (double)n / top);
+        }
+        fputc(shades[level], fp);
+    }
+}
+
+static double ms(double ns)
+{
+    return ns / 1e6;
+}
+
+void timing_report(struct timing *t, FILE *fp)
+{
+    struct timing_entry **sorted;
+    uint32_t i;
+
+    sorted = malloc((t->index.count ? t->index.count : 1) * sizeof(*sorted));
+    if (NULL == sorted) {
+        return;
+    }
+
+    for (i = 0; i < t->index.count; i++) {
+        sorted[i] = &t->entries[i];
+    }
+    qsort(sorted, t->index.count, sizeof(*sorted), compare_ids);
+
+    fprintf(fp,
+        "Inter-arrival times per ID in milliseconds, histogram buckets are powers\n"
+        "of two from 1 us, '!' marks IDs with outliers since the last report\n"
+        "%-8s %10s %9s %9s %9s %9s %9s %9s %5s %9s  %s\n",
+        "ID", "Frames", "Mean", "Stddev", "Min", "Max",
+        "Cycle", "Jitter", "Kind", "Outliers", "Histogram");
+
+    for (i = 0; i < t->index.count; i++) {
+        struct timing_entry *e = sorted[i];
+        const uint64_t judged = e->in_cycle + e->outliers;
+        const double stddev = (e->count > 1) ? sqrt(e->m2 / (e->count - 1)) : 0;
+        const char *kind = "-";
+
+        if (e->can_id & CAN_EFF_FLAG) {
+            fprintf(fp, "%08X", e->can_id & CAN_EFF_MASK);
+        } else {
+            fprintf(fp, "%03X     ", e->can_id);
+        }
+
+        fprintf(fp, "%c%10llu", e->recent_outliers ? '!' : ' ',
+                (unsigned long long)e->count + 1);
+
+        if (0 == e->count) {
+            fputc('\n', fp);
+            continue;
+        }
+
+        if (judged > 0) {
+            kind = (e->in_cycle >= CYCLIC_SHARE * judged) ? "cycl" : "event";
+        }
+
+        fprintf(fp, " %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %5s %9llu  ",
+                ms(e->mean), ms(stddev), ms(e->min), ms(e->max),
+                ms(e->cycle), ms(e->jitter), kind,
+                (unsigned long long)e->outliers);
+        print_histogram(fp, e);
+        fputc('\n', fp);
+
+        e->recent_outliers = 0;
+    }
+
+    if (t->dropped) {
+        fprintf(fp, "%llu frames of IDs beyond the first %u were not timed\n",
+                (unsigned long long)t->dropped, t->capacity);
+    }
+
+    free(sorted);
+}
@@ -0,0 +1,90 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2015 Jacob McGladdery
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+-------------------------------------------------------------------------------
+
+Inter-Arrival Timing Statistics
+
+Keeps streaming statistics of the time between consecutive frames of every
+CAN ID: count, mean and variance (Welford's algorithm), minimum, maximum and a
+histogram with one bucket per power of two microseconds. From these it infers
+the nominal cycle time of each ID and counts intervals which stray too far
+from it.
+
+Entries live in one flat array indexed through the fixed size ID table, so
+updating the statistics of a frame touches a single entry and nothing else.
+*/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <linux/can.h>
+
+#include "idtable.h"
+
+/* Histogram buckets, the last one collects every interval above 2^22 us */
+#define TIMING_BUCKETS (24)
+
+struct timing_entry
+{
+    uint64_t previous;  /* Arrival of the previous frame in nanoseconds */
+    uint64_t count;     /* Number of intervals measured */
+    double mean;        /* Mean interval in nanoseconds */
+    double m2;          /* Sum of squared deviations from the mean */
+    uint64_t min;
+    uint64_t max;
+    double cycle;       /* Inferred nominal cycle in nanoseconds, 0 if unknown */
+    double jitter;      /* Smoothed absolute deviation from the cycle */
+    uint64_t in_cycle;  /* Intervals which matched the cycle */
+    uint64_t outliers;  /* Intervals which did not */
+    uint64_t recent_outliers; /* Outliers since the last report */
+    uint32_t streak;    /* Consecutive outliers */
+    uint32_t hist[TIMING_BUCKETS];
+    canid_t can_id;
+};
+
+struct timing
+{
+    struct idtable index;   /* Maps CAN IDs to entries */
+    struct timing_entry *entries;
+    uint32_t capacity;
+    uint64_t dropped;       /* Frames of IDs which did not fit the table */
+};
+
+/* Allocate statistics for up to capacity distinct IDs. Returns 0 on success
+ * and -1 with errno set on failure.
+ */
+int timing_init(struct timing *t, uint32_t capacity);
+
+void timing_free(struct timing *t);
+
+/* Account for a frame received at stamp nanoseconds */
+void timing_add(struct timing *t, uint64_t stamp, const struct can_frame *frame);
+
+/* Print one row per ID, sorted by ID, and start a new outlier period */
+void timing_report(struct timing *t, FILE *fp);
+
+#endif /* TIMING_H */